@@ -83,6 +83,30 @@ extern __typeof(bugle_public) bugle_alias __attribute__((alias("bugle_public"),
 # error "Cygwin accepts but ignores hidden visibility"
 #endif''')
 
+def _has_thread_local(ctx, subst):
+    ctx.Message('Checking for ' + subst + '... ')
+    ret = ctx.TryLink('''
+static %s int my_thread_local;
+
+int main() { return my_thread_local; }
+''' % subst, '.c')
+    ctx.Result(ret)
+    return ret
+
+def check_thread_local(ctx):
+    '''
+    Checks for a storage class specifier for thread-local variables, and
+    defines BUGLE_THREAD_LOCAL to it in config.h. The default TLS model is
+    kept, since libbugle may be loaded with dlopen (e.g. by a program that
+    loads libGL itself), which the initial-exec model does not support.
+    '''
+    for subst in ['__thread', '__declspec(thread)']:
+        if _has_thread_local(ctx, subst):
+            ctx.sconf.Define('BUGLE_HAVE_THREAD_LOCAL', 1, 'Define to 1 if thread-local variables are supported')
+            ctx.sconf.Define('BUGLE_THREAD_LOCAL', subst)
+            return True
+    return False
+
 def _has_inline(ctx, subst):
     ctx.Message('Checking for ' + subst + '... ')
     ret = ctx.TryCompile('''
@@ -122,6 +146,7 @@ tests = {
         'CheckAttributeConstructor': check_attribute_constructor,
         'CheckAttributeHiddenAlias': check_attribute_hidden_alias,
         'CheckInline': check_inline,
+        'CheckThreadLocal': check_thread_local,
         'CheckPkgConfig': check_pkg_config,
         'CheckPkg': check_pkg
         }
@@ -22,28 +22,10 @@
 #include <bugle/bool.h>
 #include <string.h>
 #include <assert.h>
-#include <bugle/hashtable.h>
 #include <bugle/apireflect.h>
 #include <budgie/reflect.h>
 #include "apitables.h"
-#include "platform/threads.h"
-
-static hash_table ext_map;
-static bugle_thread_once_t ext_map_once = BUGLE_THREAD_ONCE_INIT;
-
-static void bugle_api_extension_clear(void)
-{
-    bugle_hash_clear(&ext_map);
-}
-
-static void bugle_api_extension_init(void)
-{
-    bugle_api_extension i;
-    bugle_hash_init(&ext_map, BUGLE_FALSE);
-    for (i = 0; i < BUGLE_API_EXTENSION_COUNT; i++)
-        bugle_hash_set(&ext_map, _bugle_api_extension_table[i].name, (void *) (size_t) (i + 1));
-    atexit(bugle_api_extension_clear);
-}
+#include "common/perfecthash.h"
 
 int bugle_api_extension_count(void)
 {
@@ -70,8 +52,15 @@ api_block bugle_api_extension_block(bugle_api_extension ext)
 
 bugle_api_extension bugle_api_extension_id(const char *name)
 {
-    bugle_thread_once(&ext_map_once, bugle_api_extension_init);
-    return (bugle_api_extension) (size_t) bugle_hash_get(&ext_map, name) - 1;
+    int id;
+
+    id = bugle_perfect_hash_lookup(name, _bugle_api_extension_hash_displace,
+                                   _bugle_api_extension_hash_index,
+                                   _bugle_api_extension_hash_count);
+    if (id >= 0 && strcmp(_bugle_api_extension_table[id].name, name) == 0)
+        return id;
+    else
+        return NULL_EXTENSION;
 }
 
 const bugle_api_extension *bugle_api_extension_group_members(bugle_api_extension ext)
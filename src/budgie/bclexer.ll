@@ -98,6 +98,7 @@ PARAMETER	{ return PARAMETER; }
 NEWTYPE		{ return NEWTYPE; }
 BITFIELD	{ return BITFIELD; }
 EXTRATYPE	{ return EXTRATYPE; }
+HALFTYPE	{ return HALFTYPE; }
 DUMP		{ return DUMP; }
 ALIAS		{ return ALIAS; }
 CALLAPI         { return CALLAPI; }
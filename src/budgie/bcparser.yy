@@ -56,6 +56,7 @@ int yyerror(const char *msg)
 %token NEWTYPE
 %token BITFIELD
 %token EXTRATYPE
+%token HALFTYPE
 %token LENGTH
 %token <str> C_STATEMENTS
 %token TYPE
@@ -90,6 +91,7 @@ bcitem: headeritem
 	| aliasitem
 	| newtypeitem
 	| extratypeitem
+	| halftypeitem
         | overrideitem
         | callapiitem
 ;
@@ -104,6 +106,9 @@ newtypeitem: NEWTYPE BITFIELD ID type idlist
 extratypeitem: EXTRATYPE type
 	{ parser_extra_type(*$2); delete $2; }
 ;
+halftypeitem: HALFTYPE type
+	{ parser_half_type(*$2); delete $2; }
+;
 overrideitem: LENGTH TYPE type ccode
         { parser_type(OVERRIDE_LENGTH, *$3, *$4); delete $3; delete $4; }
         | LENGTH PARAMETER funcregex number ccode
@@ -171,6 +171,7 @@ static list<string> headers, libraries;
 static list<Override> overrides;
 static list<pair<string, string> > aliases;
 static list<string> extra_types;
+static list<string> half_types;
 static list<Bitfield> bitfields;
 
 /* Yacc stuff */
@@ -895,8 +896,119 @@ static void write_typedefs(FILE *f)
     fprintf(f, "\n");
 }
 
+/* Must match bugle_perfect_hash in common/perfecthash.h */
+static unsigned long perfect_hash(const string &key, unsigned long seed)
+{
+    unsigned long h = (2166136261UL ^ seed) & 0xffffffffUL;
+
+    for (string::size_type i = 0; i < key.length(); i++)
+    {
+        h ^= (unsigned char) key[i];
+        h = (h * 16777619UL) & 0xffffffffUL;
+    }
+    h ^= h >> 16;
+    h = (h * 0x85ebca6bUL) & 0xffffffffUL;
+    h ^= h >> 13;
+    h = (h * 0xc2b2ae35UL) & 0xffffffffUL;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Orders bucket indices from largest to smallest bucket */
+struct BucketLarger
+{
+    const vector<vector<int> > &buckets;
+
+    explicit BucketLarger(const vector<vector<int> > &buckets) : buckets(buckets) {}
+    bool operator()(size_t a, size_t b) const
+    {
+        return buckets[a].size() > buckets[b].size();
+    }
+};
+
+/* Writes a minimal perfect hash table mapping names to IDs, in the format
+ * described in common/perfecthash.h. The arrays are named
+ * <prefix>_hash_displace and <prefix>_hash_index, and the number of distinct
+ * names is <prefix>_hash_count. If a name is repeated, the last ID wins.
+ */
+static void write_perfect_hash(FILE *f, const string &prefix, const vector<string> &names)
+{
+    map<string, int> last;
+    vector<string> keys;
+    vector<int> ids;
+
+    for (size_t i = 0; i < names.size(); i++)
+        last[names[i]] = i;
+    for (map<string, int>::iterator i = last.begin(); i != last.end(); i++)
+    {
+        keys.push_back(i->first);
+        ids.push_back(i->second);
+    }
+
+    size_t n = keys.size();
+    vector<vector<int> > buckets(n);
+    vector<size_t> order;
+    vector<long> displace(n, 0);
+    vector<int> slots(n, -1);
+
+    for (size_t i = 0; i < n; i++)
+        buckets[perfect_hash(keys[i], 0) % n].push_back(i);
+    for (size_t b = 0; b < n; b++)
+        if (!buckets[b].empty())
+            order.push_back(b);
+    stable_sort(order.begin(), order.end(), BucketLarger(buckets));
+
+    /* Place the collisions first, searching for a seed that sends every
+     * key of the bucket to a distinct free slot.
+     */
+    size_t pos;
+    for (pos = 0; pos < order.size() && buckets[order[pos]].size() > 1; pos++)
+    {
+        const vector<int> &bucket = buckets[order[pos]];
+        for (unsigned long d = 1; ; d++)
+        {
+            set<size_t> used;
+            size_t j;
+            for (j = 0; j < bucket.size(); j++)
+            {
+                size_t slot = perfect_hash(keys[bucket[j]], d) % n;
+                if (slots[slot] != -1 || used.count(slot)) break;
+                used.insert(slot);
+            }
+            if (j == bucket.size())
+            {
+                for (j = 0; j < bucket.size(); j++)
+                    slots[perfect_hash(keys[bucket[j]], d) % n] = bucket[j];
+                displace[order[pos]] = d;
+                break;
+            }
+        }
+    }
+
+    /* Singletons go directly into the remaining free slots */
+    size_t free_slot = 0;
+    for (; pos < order.size(); pos++)
+    {
+        while (slots[free_slot] != -1) free_slot++;
+        slots[free_slot] = buckets[order[pos]][0];
+        displace[order[pos]] = -(long) free_slot - 1;
+    }
+
+    fprintf(f, "const int %s_hash_displace[%d] =\n{", prefix.c_str(), (int) max(n, (size_t) 1));
+    for (size_t i = 0; i < n; i++)
+        fprintf(f, "%s%s%ld", i ? "," : "", i % 16 ? " " : "\n    ", displace[i]);
+    fprintf(f, "%s\n};\n\n", n ? "" : "\n    0");
+    fprintf(f, "const int %s_hash_index[%d] =\n{", prefix.c_str(), (int) max(n, (size_t) 1));
+    for (size_t i = 0; i < n; i++)
+        fprintf(f, "%s%s%d", i ? "," : "", i % 16 ? " " : "\n    ", ids[slots[i]]);
+    fprintf(f, "%s\n};\n\n", n ? "" : "\n    0");
+    fprintf(f, "const int %s_hash_count = %d;\n\n", prefix.c_str(), (int) n);
+}
+
 static void write_function_table(FILE *f)
 {
+    vector<string> names;
+
     fprintf(f,
             "const function_data _budgie_function_table[FUNCTION_COUNT] =\n"
             "{\n");
@@ -915,8 +1027,11 @@ static void write_function_table(FILE *f)
         fprintf(f,
                 "    { \"%s\", %s, %s }",
                 name.c_str(), group.c_str(), next_name.c_str());
+        names.push_back(name);
     }
     fprintf(f, "\n};\n\n");
+
+    write_perfect_hash(f, "_budgie_function", names);
 }
 
 static void write_group_table(FILE *f)
@@ -1018,6 +1133,7 @@ static void write_group_dump_table(FILE *f)
 static void write_type_table(FILE *f)
 {
     map<tree_node_p, tree_node_p> inverse_pointer;
+    vector<string> names, names_nomangle;
 
     // build inverse of the pointer mapping
     for (list<Type>::iterator i = types.begin(); i != types.end(); i++)
@@ -1118,8 +1234,13 @@ static void write_type_table(FILE *f)
                 type.c_str(), name.c_str(), code, base_type.c_str(), ptr.c_str(), fields.c_str(),
                 type.c_str(), (int) length, define.c_str(),
                 get_type.c_str(), get_length.c_str());
+        names_nomangle.push_back(type);
+        names.push_back(name);
     }
     fprintf(f, "\n};\n\n");
+
+    write_perfect_hash(f, "_budgie_type", names);
+    write_perfect_hash(f, "_budgie_type_nomangle", names_nomangle);
 }
 
 static void write_library_table(FILE *f)
@@ -1220,32 +1341,33 @@ static void write_type_dumpers(FILE *f)
                 tmp = TREE_CHAIN(tmp);
             }
             fprintf(f,
-                    "    default: bugle_io_printf(writer, \"%%ld\", (long) *value);\n"
+                    "    default: _budgie_dump_int((bugle_int64_t) *value, writer);\n"
                     "    }\n");
             break;
         case INTEGER_TYPE:
             fprintf(f,
                     "%s"
-                    "    bugle_io_printf(writer, \"%%\" BUGLE_PRI%c%ld, (bugle_%sint%ld_t) *value);\n",
+                    "    _budgie_dump_%s((bugle_%sint64_t) *value, writer);\n",
                     custom_code.c_str(),
-                    (i->node->flag_unsigned ? 'u' : 'd'),
-                    i->node->size->low,
-                    (i->node->flag_unsigned ? "u" : ""),
-                    i->node->size->low);
+                    (i->node->flag_unsigned ? "uint" : "int"),
+                    (i->node->flag_unsigned ? "u" : ""));
             break;
         case REAL_TYPE:
-            // FIXME: long double
 #if HAVE_LONG_DOUBLE
+            // Anything wider than a double would lose precision
+            if (i->node->size->low > 64)
+            {
+                fprintf(f,
+                        "%s"
+                        "    bugle_io_printf(writer, \"%%Lg\", (long double) *value);\n",
+                        custom_code.c_str());
+                break;
+            }
+#endif
             fprintf(f,
                     "%s"
-                    "    bugle_io_printf(writer, \"%%Lg\", (long double) *value);\n",
-                    custom_code.c_str());
-#else
-            fprintf(f,
-                    "%s"
-                    "    bugle_io_printf(writer, \"%%g\", (double) *value);\n",
+                    "    _budgie_dump_real((double) *value, writer);\n",
                     custom_code.c_str());
-#endif
             break;
         case ARRAY_TYPE:
             fprintf(f,
@@ -1261,21 +1383,22 @@ static void write_type_dumpers(FILE *f)
             else
                 fprintf(f, "    asize = count;\n");
             child = TREE_TYPE(i->node); // array element type
-            fprintf(f,
-                    "    bugle_io_puts(\"{ \", writer);\n"
-                    "    for (i = 0; i < asize; i++)\n"
-                    "    {\n");
             if (type_map.count(child))
             {
                 define = get_type_map(child)->define();
                 fprintf(f,
-                        "        budgie_dump_any_type(%s, &(*value)[i], -1, writer);\n",
+                        "    if (asize >= 0)\n"
+                        "    {\n"
+                        "        budgie_dump_array(%s, *value, asize, -1, writer);\n"
+                        "        return;\n"
+                        "    }\n",
                         define.c_str());
             }
-            else
-                fprintf(f,
-                        "        bugle_io_puts(\"<unknown>\", writer);\n");
             fprintf(f,
+                    "    bugle_io_puts(\"{ \", writer);\n"
+                    "    for (i = 0; i < asize; i++)\n"
+                    "    {\n"
+                    "        bugle_io_puts(\"<unknown>\", writer);\n"
                     "        if (i < asize - 1)\n"
                     "            bugle_io_puts(\", \", writer);\n"
                     "    }\n"
@@ -1285,12 +1408,10 @@ static void write_type_dumpers(FILE *f)
             break;
         case POINTER_TYPE:
             child = TREE_TYPE(i->node); // pointed to type
-            if (type_map.count(child))
-                fprintf(f, "    int i;\n");
             fprintf(f,
                     "%s"
                     "    if (*value == NULL) bugle_io_puts(\"NULL\", writer);\n"
-                    "    else bugle_io_printf(writer, \"%%p\", (void *) *value);\n",
+                    "    else _budgie_dump_pointer((const void *) *value, writer);\n",
                     custom_code.c_str());
             if (type_map.count(child))
             {
@@ -1303,16 +1424,8 @@ static void write_type_dumpers(FILE *f)
                         "        if (count < 0)\n"
                         "            budgie_dump_any_type(%s, *value, -1, writer);\n"
                         "        else\n"
-                        "        {\n"
                         // pointer to array
-                        "            bugle_io_puts(\"{ \", writer);\n"
-                        "            for (i = 0; i < count; i++)\n"
-                        "            {\n"
-                        "                budgie_dump_any_type(%s, &(*value)[i], -1, writer);\n"
-                        "                if (i + 1 < count) bugle_io_puts(\", \", writer);\n"
-                        "            }\n"
-                        "            bugle_io_puts(\" }\", writer);\n"
-                        "        }\n"
+                        "            budgie_dump_array(%s, *value, count, -1, writer);\n"
                         "    }\n",
                         define.c_str(), define.c_str());
             }
@@ -1448,19 +1561,68 @@ static void write_parameter_overrides(FILE *f)
 static void write_converter(FILE *f)
 {
     tree_node_p tmp;
+    set<tree_node_p> halves;
+
+    /* Older headers lack some of the half-float typedefs, so missing ones
+     * are skipped rather than treated as errors.
+     */
+    for (list<string>::iterator i = half_types.begin(); i != half_types.end(); i++)
+    {
+        tmp = get_type_node_test(*i);
+        if (tmp != NULL_TREE)
+            halves.insert(tmp);
+    }
+
+    /* Machine representations for the specialised loops. The sizes are
+     * only known to the C compiler, so the macros work them out.
+     */
+    fprintf(f,
+            "const unsigned char _budgie_type_convert_kind[TYPE_COUNT] =\n"
+            "{\n");
+    for (list<Type>::iterator i = types.begin(); i != types.end(); i++)
+    {
+        string type = i->type_name();
+        tree_node_p base = CP_TYPE_CONST_P(i->node) ? TYPE_MAIN_VARIANT(i->node) : i->node;
+        switch (TREE_CODE(i->node))
+        {
+        case ENUMERAL_TYPE:
+        case INTEGER_TYPE:
+            if (halves.count(base))
+                fprintf(f, "    _BUDGIE_CONVERT_KIND_HALF(%s),\n", type.c_str());
+            else
+                fprintf(f, "    _BUDGIE_CONVERT_KIND_INTEGER(%s),\n", type.c_str());
+            break;
+        case REAL_TYPE:
+            fprintf(f, "    _BUDGIE_CONVERT_KIND_FLOAT(%s),\n", type.c_str());
+            break;
+        default:
+            fprintf(f, "    CONVERT_NONE,\n");
+        }
+    }
+    fprintf(f, "};\n\n");
 
+    /* Types with the same code and size are copied, except that half-float
+     * types are converted by value. Next come the specialised loops, and
+     * anything they don't handle (such as long double) goes through a
+     * generic loop.
+     */
     fprintf(f,
             "void budgie_type_convert(void *out, budgie_type out_type, const void *in, budgie_type in_type, size_t count)\n"
             "{\n"
             "    long double value;\n"
             "    size_t i;\n"
+            "    convert_kind in_kind = (convert_kind) _budgie_type_convert_kind[in_type];\n"
+            "    convert_kind out_kind = (convert_kind) _budgie_type_convert_kind[out_type];\n"
             "    if (in_type == out_type\n"
             "        || (_budgie_type_table[in_type].code == _budgie_type_table[out_type].code\n"
-            "            && _budgie_type_table[in_type].size == _budgie_type_table[out_type].size))\n"
+            "            && _budgie_type_table[in_type].size == _budgie_type_table[out_type].size\n"
+            "            && (in_kind == CONVERT_HALF) == (out_kind == CONVERT_HALF)))\n"
             "    {\n"
             "        memcpy(out, in, _budgie_type_table[in_type].size * count);\n"
             "        return;\n"
             "    }\n"
+            "    if (_budgie_convert(out, out_kind, in, in_kind, count))\n"
+            "        return;\n"
             "    for (i = 0; i < count; i++)\n"
             "    {\n"
             "        switch (in_type)\n"
@@ -1841,6 +2003,11 @@ void parser_extra_type(const string &type)
     extra_types.push_back(type);
 }
 
+void parser_half_type(const string &type)
+{
+    half_types.push_back(type);
+}
+
 void parser_bitfield(const string &new_type, const string &old_type,
                      const list<string> &bits)
 {
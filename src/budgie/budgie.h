@@ -53,6 +53,7 @@ void parser_type(override_type mode,
                  const std::string &type, const std::string &code);
 
 void parser_extra_type(const std::string &type);
+void parser_half_type(const std::string &type);
 void parser_bitfield(const std::string &newtype,
                      const std::string &base,
                      const std::list<std::string> &bits);
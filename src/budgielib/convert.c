@@ -0,0 +1,384 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Specialised loops for budgie_type_convert. There is one loop for each
+ * pair of machine representations, which the compiler is free to
+ * vectorise, and hand-written SSE2 versions of the pairs that show up most
+ * often (index arrays being widened to GLuint, and float/double state).
+ *
+ * The plain loops cast directly from the input to the output type. This
+ * gives the same results as the generic converter, which goes via long
+ * double, except where the generic converter's behaviour is undefined
+ * (e.g. negative values converted to an unsigned type).
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#include <bugle/bool.h>
+#include "platform/types.h"
+#include "budgielib/internal.h"
+
+typedef void (*convert_func)(void *out, const void *in, size_t count);
+
+typedef union
+{
+    bugle_uint32_t u;
+    float f;
+} convert_float_bits;
+
+/* Handles denormals, infinities and NaNs. The multiplication by 2^112
+ * rebiases the exponent, and turns a half denormal into a float normal.
+ */
+static float half_to_float(bugle_uint16_t h)
+{
+    convert_float_bits magic, o;
+
+    magic.u = (254 - 15) << 23;
+    o.u = (bugle_uint32_t) (h & 0x7fff) << 13;
+    o.f *= magic.f;
+    if ((h & 0x7fff) > 0x7bff)
+        o.u |= 255 << 23;
+    o.u |= (bugle_uint32_t) (h & 0x8000) << 16;
+    return o.f;
+}
+
+/* Rounds to nearest even. Values too large for a half become infinity, and
+ * NaNs become a quiet NaN.
+ */
+static bugle_uint16_t float_to_half(float value)
+{
+    convert_float_bits f, infinity, half_max, denorm_magic;
+    bugle_uint32_t sign;
+    bugle_uint16_t o;
+
+    infinity.u = 255 << 23;
+    half_max.u = (127 + 16) << 23;
+    denorm_magic.u = ((127 - 15) + (23 - 10) + 1) << 23;
+
+    f.f = value;
+    sign = f.u & 0x80000000u;
+    f.u ^= sign;
+    if (f.u >= half_max.u)
+        o = f.u > infinity.u ? 0x7e00 : 0x7c00;
+    else if (f.u < (113 << 23))
+    {
+        /* Result is a denormal or zero: let the FPU do the rounding */
+        f.f += denorm_magic.f;
+        o = (bugle_uint16_t) (f.u - denorm_magic.u);
+    }
+    else
+    {
+        bugle_uint32_t odd = (f.u >> 13) & 1;
+        f.u += ((bugle_uint32_t) (15 - 127) << 23) + 0xfff + odd;
+        o = (bugle_uint16_t) (f.u >> 13);
+    }
+    return (bugle_uint16_t) (o | (sign >> 16));
+}
+
+/* The representations other than half, as (name, C type). The list is
+ * duplicated because a macro cannot expand itself.
+ */
+#define CONVERT_IN_KINDS(X) \
+    X(int8, bugle_int8_t) \
+    X(uint8, bugle_uint8_t) \
+    X(int16, bugle_int16_t) \
+    X(uint16, bugle_uint16_t) \
+    X(int32, bugle_int32_t) \
+    X(uint32, bugle_uint32_t) \
+    X(int64, bugle_int64_t) \
+    X(uint64, bugle_uint64_t) \
+    X(float, float) \
+    X(double, double)
+
+#define CONVERT_OUT_KINDS(X, in_name, in_type) \
+    X(in_name, in_type, int8, bugle_int8_t) \
+    X(in_name, in_type, uint8, bugle_uint8_t) \
+    X(in_name, in_type, int16, bugle_int16_t) \
+    X(in_name, in_type, uint16, bugle_uint16_t) \
+    X(in_name, in_type, int32, bugle_int32_t) \
+    X(in_name, in_type, uint32, bugle_uint32_t) \
+    X(in_name, in_type, int64, bugle_int64_t) \
+    X(in_name, in_type, uint64, bugle_uint64_t) \
+    X(in_name, in_type, float, float) \
+    X(in_name, in_type, double, double)
+
+#define CONVERT_DEFINE(in_name, in_type, out_name, out_type) \
+    static void convert_##in_name##_##out_name(void *out, const void *in, size_t count) \
+    { \
+        out_type *o = (out_type *) out; \
+        const in_type *i = (const in_type *) in; \
+        size_t j; \
+        for (j = 0; j < count; j++) \
+            o[j] = (out_type) i[j]; \
+    }
+
+#define CONVERT_DEFINE_HALF(name, type) \
+    static void convert_half_##name(void *out, const void *in, size_t count) \
+    { \
+        type *o = (type *) out; \
+        const bugle_uint16_t *i = (const bugle_uint16_t *) in; \
+        size_t j; \
+        for (j = 0; j < count; j++) \
+            o[j] = (type) half_to_float(i[j]); \
+    } \
+    static void convert_##name##_half(void *out, const void *in, size_t count) \
+    { \
+        bugle_uint16_t *o = (bugle_uint16_t *) out; \
+        const type *i = (const type *) in; \
+        size_t j; \
+        for (j = 0; j < count; j++) \
+            o[j] = float_to_half((float) i[j]); \
+    }
+
+#define CONVERT_DEFINE_ROW(in_name, in_type) \
+    CONVERT_OUT_KINDS(CONVERT_DEFINE, in_name, in_type)
+
+CONVERT_IN_KINDS(CONVERT_DEFINE_ROW)
+CONVERT_IN_KINDS(CONVERT_DEFINE_HALF)
+
+#ifdef __SSE2__
+
+/* Zero-extends as many elements as possible, and returns the number done.
+ * This is shared by the conversions to uint32 and int32, which only differ
+ * in how the remaining elements are handled.
+ */
+static size_t widen_uint8_sse2(bugle_uint32_t *o, const bugle_uint8_t *i, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t j;
+
+    for (j = 0; j + 16 <= count; j += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (i + j));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128((__m128i *) (o + j), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *) (o + j + 4), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i *) (o + j + 8), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i *) (o + j + 12), _mm_unpackhi_epi16(hi, zero));
+    }
+    return j;
+}
+
+static size_t widen_uint16_sse2(bugle_uint32_t *o, const bugle_uint16_t *i, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t j;
+
+    for (j = 0; j + 8 <= count; j += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (i + j));
+        _mm_storeu_si128((__m128i *) (o + j), _mm_unpacklo_epi16(v, zero));
+        _mm_storeu_si128((__m128i *) (o + j + 4), _mm_unpackhi_epi16(v, zero));
+    }
+    return j;
+}
+
+#define CONVERT_DEFINE_WIDEN(in_name, in_type, out_name, out_type) \
+    static void convert_##in_name##_##out_name##_sse2(void *out, const void *in, size_t count) \
+    { \
+        size_t j = widen_##in_name##_sse2((bugle_uint32_t *) out, (const in_type *) in, count); \
+        convert_##in_name##_##out_name((out_type *) out + j, (const in_type *) in + j, count - j); \
+    }
+
+CONVERT_DEFINE_WIDEN(uint8, bugle_uint8_t, uint32, bugle_uint32_t)
+CONVERT_DEFINE_WIDEN(uint8, bugle_uint8_t, int32, bugle_int32_t)
+CONVERT_DEFINE_WIDEN(uint16, bugle_uint16_t, uint32, bugle_uint32_t)
+CONVERT_DEFINE_WIDEN(uint16, bugle_uint16_t, int32, bugle_int32_t)
+
+static void convert_int32_float_sse2(void *out, const void *in, size_t count)
+{
+    float *o = (float *) out;
+    const bugle_int32_t *i = (const bugle_int32_t *) in;
+    size_t j;
+
+    for (j = 0; j + 4 <= count; j += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (i + j));
+        _mm_storeu_ps(o + j, _mm_cvtepi32_ps(v));
+    }
+    convert_int32_float(o + j, i + j, count - j);
+}
+
+static void convert_float_double_sse2(void *out, const void *in, size_t count)
+{
+    double *o = (double *) out;
+    const float *i = (const float *) in;
+    size_t j;
+
+    for (j = 0; j + 4 <= count; j += 4)
+    {
+        __m128 v = _mm_loadu_ps(i + j);
+        _mm_storeu_pd(o + j, _mm_cvtps_pd(v));
+        _mm_storeu_pd(o + j + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    convert_float_double(o + j, i + j, count - j);
+}
+
+static void convert_double_float_sse2(void *out, const void *in, size_t count)
+{
+    float *o = (float *) out;
+    const double *i = (const double *) in;
+    size_t j;
+
+    for (j = 0; j + 4 <= count; j += 4)
+    {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(i + j));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(i + j + 2));
+        _mm_storeu_ps(o + j, _mm_movelh_ps(lo, hi));
+    }
+    convert_double_float(o + j, i + j, count - j);
+}
+
+/* Same algorithm as half_to_float, four lanes at a time */
+static __m128i convert_half_float_lanes(__m128i h)
+{
+    const __m128i exp_mant = _mm_set1_epi32(0x7fff);
+    const __m128i max_finite = _mm_set1_epi32(0x7bff);
+    const __m128i exp_infnan = _mm_set1_epi32(255 << 23);
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+    __m128i abs, sign, infnan, o;
+
+    abs = _mm_and_si128(h, exp_mant);
+    sign = _mm_slli_epi32(_mm_andnot_si128(exp_mant, h), 16);
+    infnan = _mm_and_si128(_mm_cmpgt_epi32(abs, max_finite), exp_infnan);
+    o = _mm_castps_si128(_mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(abs, 13)), magic));
+    return _mm_or_si128(_mm_or_si128(o, infnan), sign);
+}
+
+static void convert_half_float_sse2(void *out, const void *in, size_t count)
+{
+    float *o = (float *) out;
+    const bugle_uint16_t *i = (const bugle_uint16_t *) in;
+    const __m128i zero = _mm_setzero_si128();
+    size_t j;
+
+    for (j = 0; j + 8 <= count; j += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (i + j));
+        _mm_storeu_si128((__m128i *) (o + j),
+                         convert_half_float_lanes(_mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128((__m128i *) (o + j + 4),
+                         convert_half_float_lanes(_mm_unpackhi_epi16(v, zero)));
+    }
+    convert_half_float(o + j, i + j, count - j);
+}
+
+# define convert_uint8_uint32_fast convert_uint8_uint32_sse2
+# define convert_uint8_int32_fast convert_uint8_int32_sse2
+# define convert_uint16_uint32_fast convert_uint16_uint32_sse2
+# define convert_uint16_int32_fast convert_uint16_int32_sse2
+# define convert_int32_float_fast convert_int32_float_sse2
+# define convert_float_double_fast convert_float_double_sse2
+# define convert_double_float_fast convert_double_float_sse2
+# define convert_half_float_fast convert_half_float_sse2
+
+#else /* !__SSE2__ */
+
+# define convert_uint8_uint32_fast convert_uint8_uint32
+# define convert_uint8_int32_fast convert_uint8_int32
+# define convert_uint16_uint32_fast convert_uint16_uint32
+# define convert_uint16_int32_fast convert_uint16_int32
+# define convert_int32_float_fast convert_int32_float
+# define convert_float_double_fast convert_float_double
+# define convert_double_float_fast convert_double_float
+# define convert_half_float_fast convert_half_float
+
+#endif /* !__SSE2__ */
+
+/* Indexed by [in][out], in the order of convert_kind. Pairs with the same
+ * kind are only reached when the types differ in some other way (e.g. an
+ * enum and an integer typedef), and are plain copies.
+ */
+static const convert_func convert_table[CONVERT_COUNT][CONVERT_COUNT] =
+{
+    { NULL },
+    {
+        NULL, convert_int8_int8, convert_int8_uint8, convert_int8_int16, convert_int8_uint16,
+        convert_int8_int32, convert_int8_uint32, convert_int8_int64, convert_int8_uint64,
+        convert_int8_float, convert_int8_double, convert_int8_half
+    },
+    {
+        NULL, convert_uint8_int8, convert_uint8_uint8, convert_uint8_int16, convert_uint8_uint16,
+        convert_uint8_int32_fast, convert_uint8_uint32_fast, convert_uint8_int64,
+        convert_uint8_uint64, convert_uint8_float, convert_uint8_double, convert_uint8_half
+    },
+    {
+        NULL, convert_int16_int8, convert_int16_uint8, convert_int16_int16, convert_int16_uint16,
+        convert_int16_int32, convert_int16_uint32, convert_int16_int64, convert_int16_uint64,
+        convert_int16_float, convert_int16_double, convert_int16_half
+    },
+    {
+        NULL, convert_uint16_int8, convert_uint16_uint8, convert_uint16_int16,
+        convert_uint16_uint16, convert_uint16_int32_fast, convert_uint16_uint32_fast,
+        convert_uint16_int64, convert_uint16_uint64, convert_uint16_float, convert_uint16_double,
+        convert_uint16_half
+    },
+    {
+        NULL, convert_int32_int8, convert_int32_uint8, convert_int32_int16, convert_int32_uint16,
+        convert_int32_int32, convert_int32_uint32, convert_int32_int64, convert_int32_uint64,
+        convert_int32_float_fast, convert_int32_double, convert_int32_half
+    },
+    {
+        NULL, convert_uint32_int8, convert_uint32_uint8, convert_uint32_int16,
+        convert_uint32_uint16, convert_uint32_int32, convert_uint32_uint32, convert_uint32_int64,
+        convert_uint32_uint64, convert_uint32_float, convert_uint32_double, convert_uint32_half
+    },
+    {
+        NULL, convert_int64_int8, convert_int64_uint8, convert_int64_int16, convert_int64_uint16,
+        convert_int64_int32, convert_int64_uint32, convert_int64_int64, convert_int64_uint64,
+        convert_int64_float, convert_int64_double, convert_int64_half
+    },
+    {
+        NULL, convert_uint64_int8, convert_uint64_uint8, convert_uint64_int16,
+        convert_uint64_uint16, convert_uint64_int32, convert_uint64_uint32, convert_uint64_int64,
+        convert_uint64_uint64, convert_uint64_float, convert_uint64_double, convert_uint64_half
+    },
+    {
+        NULL, convert_float_int8, convert_float_uint8, convert_float_int16, convert_float_uint16,
+        convert_float_int32, convert_float_uint32, convert_float_int64, convert_float_uint64,
+        convert_float_float, convert_float_double_fast, convert_float_half
+    },
+    {
+        NULL, convert_double_int8, convert_double_uint8, convert_double_int16,
+        convert_double_uint16, convert_double_int32, convert_double_uint32, convert_double_int64,
+        convert_double_uint64, convert_double_float_fast, convert_double_double,
+        convert_double_half
+    },
+    {
+        NULL, convert_half_int8, convert_half_uint8, convert_half_int16, convert_half_uint16,
+        convert_half_int32, convert_half_uint32, convert_half_int64, convert_half_uint64,
+        convert_half_float_fast, convert_half_double, NULL
+    }
+};
+
+bugle_bool _budgie_convert(void *out, convert_kind out_kind,
+                           const void *in, convert_kind in_kind, size_t count)
+{
+    convert_func func;
+
+    func = convert_table[in_kind][out_kind];
+    if (func == NULL)
+        return BUGLE_FALSE;
+    func(out, in, count);
+    return BUGLE_TRUE;
+}
@@ -20,9 +20,11 @@
 #endif
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdarg.h>
 #include <stddef.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 #include <bugle/io.h>
 #include <budgie/reflect.h>
 #include "budgielib/defines.h"
@@ -58,61 +60,172 @@ void _budgie_dump_bitfield(unsigned int value, bugle_io_writer *writer,
     }
 }
 
-bugle_bool budgie_dump_string(const char *value, bugle_io_writer *writer)
+/* Formats value in decimal, ending just before end. Returns the start. */
+static char *format_uint(bugle_uint64_t value, char *end)
 {
-    /* FIXME: handle illegal dereferences */
-    if (value == NULL) bugle_io_puts("NULL", writer);
+    do
+    {
+        *--end = '0' + (int) (value % 10);
+        value /= 10;
+    } while (value != 0);
+    return end;
+}
+
+void _budgie_dump_int(bugle_int64_t value, bugle_io_writer *writer)
+{
+    char buffer[24];
+    char *start;
+
+    if (value < 0)
+    {
+        start = format_uint(-(bugle_uint64_t) value, buffer + sizeof(buffer));
+        *--start = '-';
+    }
+    else
+        start = format_uint(value, buffer + sizeof(buffer));
+    bugle_io_write(start, 1, buffer + sizeof(buffer) - start, writer);
+}
+
+void _budgie_dump_uint(bugle_uint64_t value, bugle_io_writer *writer)
+{
+    char buffer[24];
+    char *start;
+
+    start = format_uint(value, buffer + sizeof(buffer));
+    bugle_io_write(start, 1, buffer + sizeof(buffer) - start, writer);
+}
+
+void _budgie_dump_pointer(const void *value, bugle_io_writer *writer)
+{
+    static const char digits[] = "0123456789abcdef";
+    char buffer[2 + 2 * sizeof(bugle_uintptr_t)];
+    char *start = buffer + sizeof(buffer);
+    bugle_uintptr_t v = (bugle_uintptr_t) value;
+
+    do
+    {
+        *--start = digits[v & 15];
+        v >>= 4;
+    } while (v != 0);
+    *--start = 'x';
+    *--start = '0';
+    bugle_io_write(start, 1, buffer + sizeof(buffer) - start, writer);
+}
+
+void _budgie_dump_real(double value, bugle_io_writer *writer)
+{
+    static const double zero = 0.0;
+
+    /* %g writes integers of up to six digits exactly, without a decimal
+     * point or exponent. These are by far the most common values (0.0 and
+     * 1.0 in particular). Negative zero is left to printf.
+     */
+    if (value > -1e6 && value < 1e6 && value == (double) (long) value
+        && (value != 0.0 || memcmp(&value, &zero, sizeof(value)) == 0))
+        _budgie_dump_int((long) value, writer);
     else
+        bugle_io_printf(writer, "%g", value);
+}
+
+/* Returns the number of characters at the start of value that can be
+ * written as-is inside a string literal, i.e. everything except quotes,
+ * backslashes and control characters.
+ */
+static size_t string_clean_prefix(const unsigned char *value, size_t length)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i max_control = _mm_set1_epi8(0x1f);
+
+    /* Finds the first 16-byte chunk with anything in it that needs escaping,
+     * and leaves the scalar loop to find the exact position.
+     */
+    while (length - i >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (value + i));
+        __m128i special;
+
+        special = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(v, del));
+        /* v <= 0x1f as unsigned bytes */
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(v, max_control), v));
+        if (_mm_movemask_epi8(special) != 0)
+            break;
+        i += 16;
+    }
+#endif
+    while (i < length
+           && value[i] >= 0x20 && value[i] != 0x7f
+           && value[i] != '"' && value[i] != '\\')
+        i++;
+    return i;
+}
+
+/* Common code for budgie_dump_string and budgie_dump_string_length. Runs of
+ * characters that need no escaping are written in one go.
+ */
+static void dump_string_escaped(const char *value, size_t length, bugle_bool escape_tab,
+                                bugle_io_writer *writer)
+{
+    size_t i = 0;
+
+    bugle_io_putc('"', writer);
+    while (i < length)
     {
-        bugle_io_putc('"', writer);
-        while (value[0])
+        size_t clean;
+        char octal[4];
+
+        clean = string_clean_prefix((const unsigned char *) value + i, length - i);
+        if (clean > 0)
+        {
+            bugle_io_write(value + i, 1, clean, writer);
+            i += clean;
+            if (i == length)
+                break;
+        }
+        switch (value[i])
         {
-            switch (value[0])
+        case '"': bugle_io_puts("\\\"", writer); break;
+        case '\\': bugle_io_puts("\\\\", writer); break;
+        case '\n': bugle_io_puts("\\n", writer); break;
+        case '\r': bugle_io_puts("\\r", writer); break;
+        case '\t':
+            if (escape_tab)
             {
-            case '"': bugle_io_puts("\\\"", writer); break;
-            case '\\': bugle_io_puts("\\\\", writer); break;
-            case '\n': bugle_io_puts("\\n", writer); break;
-            case '\r': bugle_io_puts("\\r", writer); break;
-            default:
-                if (iscntrl(value[0]))
-                    bugle_io_printf(writer, "\\%03o", (int) value[0]);
-                else
-                    bugle_io_putc(value[0], writer);
+                bugle_io_puts("\\t", writer);
+                break;
             }
-            value++;
+            /* Fall through */
+        default:
+            /* Only control characters get here, so three digits suffice */
+            octal[0] = '\\';
+            octal[1] = '0' + ((value[i] >> 6) & 7);
+            octal[2] = '0' + ((value[i] >> 3) & 7);
+            octal[3] = '0' + (value[i] & 7);
+            bugle_io_write(octal, 1, sizeof(octal), writer);
         }
-        bugle_io_putc('"', writer);
+        i++;
     }
+    bugle_io_putc('"', writer);
+}
+
+bugle_bool budgie_dump_string(const char *value, bugle_io_writer *writer)
+{
+    /* FIXME: handle illegal dereferences */
+    if (value == NULL) bugle_io_puts("NULL", writer);
+    else dump_string_escaped(value, strlen(value), BUGLE_FALSE, writer);
     return BUGLE_TRUE;
 }
 
 bugle_bool budgie_dump_string_length(const char *value, size_t length, bugle_io_writer *writer)
 {
-    size_t i;
     /* FIXME: handle illegal dereferences */
     if (value == NULL) bugle_io_puts("NULL", writer);
-    else
-    {
-        bugle_io_putc('"', writer);
-        for (i = 0; i < length; i++)
-        {
-            switch (value[0])
-            {
-            case '"': bugle_io_puts("\\\"", writer); break;
-            case '\\': bugle_io_puts("\\\\", writer); break;
-            case '\n': bugle_io_puts("\\n", writer); break;
-            case '\r': bugle_io_puts("\\r", writer); break;
-            case '\t': bugle_io_puts("\\t", writer); break;
-            default:
-                if (iscntrl(value[0]))
-                    bugle_io_printf(writer, "\\%03o", (int) value[0]);
-                else
-                    bugle_io_putc(value[0], writer);
-            }
-            value++;
-        }
-        bugle_io_putc('"', writer);
-    }
+    else dump_string_escaped(value, length, BUGLE_TRUE, writer);
     return BUGLE_TRUE;
 }
 
@@ -25,6 +25,7 @@
 #include <budgie/types.h>
 #include <bugle/export.h>
 #include <bugle/io.h>
+#include "platform/types.h"
 
 typedef struct
 {
@@ -103,12 +104,75 @@ extern const function_data _budgie_function_table[];
 extern const function_name_data _budgie_function_name_table[]; /* Holds wrappers in alphabetical order */
 extern bugle_bool _budgie_bypass[];
 
+/* Minimal perfect hash tables for name lookup (see common/perfecthash.h) */
+extern const int _budgie_function_hash_displace[];
+extern const int _budgie_function_hash_index[];
+extern const int _budgie_function_hash_count;
+extern const int _budgie_type_hash_displace[];
+extern const int _budgie_type_hash_index[];
+extern const int _budgie_type_hash_count;
+extern const int _budgie_type_nomangle_hash_displace[];
+extern const int _budgie_type_nomangle_hash_index[];
+extern const int _budgie_type_nomangle_hash_count;
+
 extern int _budgie_group_count;
 extern const group_data _budgie_group_table[];
 
+/* Machine-level representations understood by the specialised conversion
+ * loops in convert.c. The generated tables record one for each type, using
+ * the macros below so that the compiler works out sizes and signedness.
+ * Signed and unsigned variants must stay adjacent, signed first.
+ */
+typedef enum
+{
+    CONVERT_NONE,
+    CONVERT_INT8,
+    CONVERT_UINT8,
+    CONVERT_INT16,
+    CONVERT_UINT16,
+    CONVERT_INT32,
+    CONVERT_UINT32,
+    CONVERT_INT64,
+    CONVERT_UINT64,
+    CONVERT_FLOAT,
+    CONVERT_DOUBLE,
+    CONVERT_HALF,      /* IEEE 754 binary16, stored in a 16-bit integer type */
+    CONVERT_COUNT
+} convert_kind;
+
+#define _BUDGIE_CONVERT_KIND_SIZE(size) \
+    ((size) == 1 ? CONVERT_INT8 : (size) == 2 ? CONVERT_INT16 \
+     : (size) == 4 ? CONVERT_INT32 : (size) == 8 ? CONVERT_INT64 : CONVERT_NONE)
+#define _BUDGIE_CONVERT_KIND_INTEGER(type) \
+    (_BUDGIE_CONVERT_KIND_SIZE(sizeof(type)) == CONVERT_NONE ? CONVERT_NONE \
+     : _BUDGIE_CONVERT_KIND_SIZE(sizeof(type)) + ((type) -1 < (type) 0 ? 0 : 1))
+#define _BUDGIE_CONVERT_KIND_FLOAT(type) \
+    (sizeof(type) == sizeof(float) ? CONVERT_FLOAT \
+     : sizeof(type) == sizeof(double) ? CONVERT_DOUBLE : CONVERT_NONE)
+#define _BUDGIE_CONVERT_KIND_HALF(type) \
+    (sizeof(type) == 2 ? CONVERT_HALF : CONVERT_NONE)
+
+extern const unsigned char _budgie_type_convert_kind[];
+
+/* Converts count elements with a specialised loop. Returns BUGLE_FALSE
+ * (without touching out) if there is no loop for this pair of kinds, in
+ * which case the caller must fall back to the generic conversion.
+ */
+bugle_bool _budgie_convert(void *out, convert_kind out_kind,
+                           const void *in, convert_kind in_kind, size_t count);
+
 void _budgie_dump_bitfield(unsigned int value, bugle_io_writer *writer,
                            const bitfield_pair *tags, int count);
 
+/* Used by the generated dumpers in place of bugle_io_printf. The output
+ * matches the corresponding printf conversion (%d, %u, %p and %g), except
+ * that pointers are always written as 0x followed by lowercase hex digits.
+ */
+void _budgie_dump_int(bugle_int64_t value, bugle_io_writer *writer);
+void _budgie_dump_uint(bugle_uint64_t value, bugle_io_writer *writer);
+void _budgie_dump_pointer(const void *value, bugle_io_writer *writer);
+void _budgie_dump_real(double value, bugle_io_writer *writer);
+
 /* User functions for .bc files */
 
 bugle_bool BUGLE_EXPORT_PRE budgie_dump_string(const char *value, bugle_io_writer *writer) BUGLE_EXPORT_POST;
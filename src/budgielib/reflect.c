@@ -23,47 +23,14 @@
 #include <string.h>
 #include <assert.h>
 #include <stdarg.h>
-#include <bugle/hashtable.h>
 #include <bugle/string.h>
 #include <bugle/io.h>
 #include <budgie/types.h>
 #include <budgie/reflect.h>
 #include "internal.h"
 #include "platform/threads.h"
-
-static hash_table function_id_map;
-static hash_table type_id_map;
-static hash_table type_id_nomangle_map;
-static bugle_thread_once_t reflect_once = BUGLE_THREAD_ONCE_INIT;
-
-static void reflect_shutdown(void)
-{
-    bugle_hash_clear(&function_id_map);
-    bugle_hash_clear(&type_id_map);
-    bugle_hash_clear(&type_id_nomangle_map);
-}
-
-static void reflect_initialise(void)
-{
-    int i;
-
-    bugle_hash_init(&function_id_map, NULL);
-    for (i = 0; i < _budgie_function_count; i++)
-        bugle_hash_set(&function_id_map, _budgie_function_table[i].name,
-                       (void *) (size_t) (i + 1));
-
-    bugle_hash_init(&type_id_map, NULL);
-    bugle_hash_init(&type_id_nomangle_map, NULL);
-    for (i = 0; i < _budgie_type_count; i++)
-    {
-        bugle_hash_set(&type_id_map, _budgie_type_table[i].name,
-                       (void *) (size_t) (i + 1));
-        bugle_hash_set(&type_id_nomangle_map, _budgie_type_table[i].name_nomangle,
-                       (void *) (size_t) (i + 1));
-    }
-
-    atexit(reflect_shutdown);
-}
+#include "common/perfecthash.h"
+#include "common/fnv.h"
 
 int budgie_function_count()
 {
@@ -78,8 +45,15 @@ const char *budgie_function_name(budgie_function id)
 
 budgie_function budgie_function_id(const char *name)
 {
-    bugle_thread_once(&reflect_once, reflect_initialise);
-    return (budgie_function) (size_t) bugle_hash_get(&function_id_map, name) - 1;
+    int id;
+
+    id = bugle_perfect_hash_lookup(name, _budgie_function_hash_displace,
+                                   _budgie_function_hash_index,
+                                   _budgie_function_hash_count);
+    if (id >= 0 && strcmp(_budgie_function_table[id].name, name) == 0)
+        return id;
+    else
+        return NULL_FUNCTION;
 }
 
 budgie_group budgie_function_group(budgie_function id)
@@ -165,14 +139,28 @@ const char *budgie_type_name_nomangle(budgie_type type)
 
 budgie_type budgie_type_id(const char *name)
 {
-    bugle_thread_once(&reflect_once, reflect_initialise);
-    return (budgie_type) (size_t) bugle_hash_get(&type_id_map, name) - 1;
+    int id;
+
+    id = bugle_perfect_hash_lookup(name, _budgie_type_hash_displace,
+                                   _budgie_type_hash_index,
+                                   _budgie_type_hash_count);
+    if (id >= 0 && strcmp(_budgie_type_table[id].name, name) == 0)
+        return id;
+    else
+        return NULL_TYPE;
 }
 
 budgie_type budgie_type_id_nomangle(const char *name)
 {
-    bugle_thread_once(&reflect_once, reflect_initialise);
-    return (budgie_type) (size_t) bugle_hash_get(&type_id_nomangle_map, name) - 1;
+    int id;
+
+    id = bugle_perfect_hash_lookup(name, _budgie_type_nomangle_hash_displace,
+                                   _budgie_type_nomangle_hash_index,
+                                   _budgie_type_nomangle_hash_count);
+    if (id >= 0 && strcmp(_budgie_type_table[id].name_nomangle, name) == 0)
+        return id;
+    else
+        return NULL_TYPE;
 }
 
 /* Remaps a type based on the instance. This is not expected to be used; it
@@ -227,23 +215,66 @@ void budgie_dump_any_type_extended(budgie_type type,
                                    const void *pointer,
                                    bugle_io_writer *writer)
 {
-    int i;
-    const char *v;
-
     if (pointer)
         bugle_io_printf(writer, "%p -> ", pointer);
     if (outer_length == -1)
         budgie_dump_any_type(type, value, length, writer);
     else
+        budgie_dump_array(type, value, outer_length, length, writer);
+}
+
+static bugle_thread_key_t dump_policy_key;
+static bugle_thread_once_t dump_policy_once = BUGLE_THREAD_ONCE_INIT;
+
+static void dump_policy_initialise(void)
+{
+    bugle_thread_key_create(&dump_policy_key, NULL);
+}
+
+void budgie_dump_set_array_policy(const budgie_dump_array_policy *policy)
+{
+    bugle_thread_once(&dump_policy_once, dump_policy_initialise);
+    bugle_thread_setspecific(dump_policy_key, (void *) policy);
+}
+
+void budgie_dump_array(budgie_type type, const void *value, int count, int length, bugle_io_writer *writer)
+{
+    const budgie_dump_array_policy *policy;
+    const char *v;
+    size_t size;
+    int shown, i;
+
+    bugle_thread_once(&dump_policy_once, dump_policy_initialise);
+    policy = (const budgie_dump_array_policy *) bugle_thread_getspecific(dump_policy_key);
+    size = _budgie_type_table[type].size;
+    shown = count;
+    if (policy != NULL && policy->mode != BUDGIE_DUMP_ARRAY_FULL && count > policy->limit)
     {
-        v = (const char *) value;
-        bugle_io_puts("{ ", writer);
-        for (i = 0; i < outer_length; i++)
+        /* Hashing pointers would say nothing about the data, so arrays of
+         * them are truncated instead.
+         */
+        if (policy->mode == BUDGIE_DUMP_ARRAY_HASH && budgie_type_pointer_base(type) == NULL_TYPE)
         {
-            if (i) bugle_io_puts(", ", writer);
-            budgie_dump_any_type(type, (const void *) v, length, writer);
-            v += _budgie_type_table[type].size;
+            bugle_uint64_t hash;
+
+            hash = bugle_fnv1a64(value, size * count);
+            bugle_io_printf(writer, "{ <%d elements, hash %08lx%08lx> }", count,
+                            (unsigned long) (hash >> 32),
+                            (unsigned long) (hash & 0xffffffffUL));
+            return;
         }
-        bugle_io_puts(" }", writer);
+        shown = policy->limit;
+    }
+
+    v = (const char *) value;
+    bugle_io_puts("{ ", writer);
+    for (i = 0; i < shown; i++)
+    {
+        if (i) bugle_io_puts(", ", writer);
+        budgie_dump_any_type(type, (const void *) v, length, writer);
+        v += size;
     }
+    if (shown < count)
+        bugle_io_printf(writer, "%s... <%d elements>", shown ? ", " : "", count);
+    bugle_io_puts(" }", writer);
 }
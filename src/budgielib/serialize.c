@@ -0,0 +1,414 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Binary serialisation of values, for capturing calls without formatting
+ * them. A serialised value is
+ *
+ *   int32 type      (after budgie_type_type)
+ *   int32 length    (after the type's length override, as for dumping)
+ *   raw bytes of the value
+ *   extras
+ *
+ * where the extras hold the memory reachable through pointers. Types that
+ * contain no followable pointers ("flat" types) have no extras. Otherwise
+ * the extras are, by type code:
+ *
+ *   pointer: a tag byte. SERIAL_NONE means nothing was captured (NULL or
+ *            unknown target). SERIAL_STRING is followed by a uint32 byte
+ *            count and the characters without terminator. SERIAL_ARRAY is
+ *            followed by the raw bytes of the elements (1 if length is
+ *            negative, otherwise length), then for non-flat element types
+ *            the element headers and extras.
+ *   array:   for each element, int32 type, int32 length and extras.
+ *   record:  for each field, int32 type, int32 length and extras.
+ *
+ * The encoding uses native byte order and sizes, and type IDs are only
+ * meaningful to the same build of the type tables.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <bugle/bool.h>
+#include <bugle/io.h>
+#include <bugle/memory.h>
+#include <budgie/types.h>
+#include <budgie/reflect.h>
+#include "platform/types.h"
+#include "budgielib/internal.h"
+
+enum
+{
+    SERIAL_NONE = 0,
+    SERIAL_STRING = 1,
+    SERIAL_ARRAY = 2
+};
+
+/* Whether a value of this type could lead budgie_dump_any_type to
+ * dereference a pointer.
+ */
+static bugle_bool serial_flat(budgie_type type)
+{
+    const type_data *info;
+    const type_record_data *field;
+
+    if (type < 0 || type >= _budgie_type_count)
+        return BUGLE_TRUE;
+    info = &_budgie_type_table[type];
+    switch (info->code)
+    {
+    case CODE_POINTER:
+        return info->type == NULL_TYPE
+            || _budgie_type_table[info->type].code == CODE_OTHER
+            || _budgie_type_table[info->type].size == 0;
+    case CODE_ARRAY:
+        return serial_flat(info->type);
+    case CODE_RECORD:
+        if (info->fields)
+            for (field = info->fields; field->type != NULL_TYPE; field++)
+                if (!serial_flat(field->type))
+                    return BUGLE_FALSE;
+        return BUGLE_TRUE;
+    default:
+        return BUGLE_TRUE;
+    }
+}
+
+/* Pointers to character types are dumped as strings (see the DUMP TYPE
+ * overrides in the .bc files), and so are followed up to the terminator.
+ */
+static bugle_bool serial_string(budgie_type type)
+{
+    const type_data *base;
+    const char *name;
+
+    base = &_budgie_type_table[_budgie_type_table[type].type];
+    if (base->code != CODE_INTEGRAL || base->size != 1)
+        return BUGLE_FALSE;
+    name = base->name_nomangle;
+    if (strncmp(name, "const ", 6) == 0)
+        name += 6;
+    return strcmp(name, "char") == 0
+        || strcmp(name, "GLchar") == 0
+        || strcmp(name, "GLcharARB") == 0
+        || strcmp(name, "CHAR") == 0;
+}
+
+static void serial_put_int32(bugle_int32_t value, bugle_io_writer *writer)
+{
+    bugle_io_write(&value, sizeof(value), 1, writer);
+}
+
+/* Number of elements followed for an array type or pointer to array */
+static int serial_array_count(const type_data *info, int length)
+{
+    if (info->code == CODE_ARRAY && info->length >= 0)
+        return info->length;
+    return length;
+}
+
+static void serial_put_extras(budgie_type type, const void *value, int length,
+                              bugle_io_writer *writer);
+
+/* Writes the header and extras of an embedded value, whose raw bytes have
+ * already been written as part of the containing value.
+ */
+static void serial_put_embedded(budgie_type type, const void *value,
+                                bugle_io_writer *writer)
+{
+    int length;
+
+    type = budgie_type_type(type, value);
+    length = budgie_type_length(type, value);
+    serial_put_int32(type, writer);
+    serial_put_int32(length, writer);
+    serial_put_extras(type, value, length, writer);
+}
+
+static void serial_put_extras(budgie_type type, const void *value, int length,
+                              bugle_io_writer *writer)
+{
+    const type_data *info;
+    const type_record_data *field;
+    const char *ptr;
+    bugle_uint8_t tag;
+    bugle_uint32_t n;
+    size_t size;
+    int count, i;
+
+    if (serial_flat(type))
+        return;
+    info = &_budgie_type_table[type];
+    switch (info->code)
+    {
+    case CODE_POINTER:
+        ptr = *(const char * const *) value;
+        if (ptr == NULL)
+        {
+            tag = SERIAL_NONE;
+            bugle_io_write(&tag, 1, 1, writer);
+        }
+        else if (serial_string(type))
+        {
+            tag = SERIAL_STRING;
+            n = strlen(ptr);
+            bugle_io_write(&tag, 1, 1, writer);
+            bugle_io_write(&n, sizeof(n), 1, writer);
+            bugle_io_write(ptr, 1, n, writer);
+        }
+        else
+        {
+            tag = SERIAL_ARRAY;
+            count = length < 0 ? 1 : length;
+            size = _budgie_type_table[info->type].size;
+            bugle_io_write(&tag, 1, 1, writer);
+            bugle_io_write(ptr, size, count, writer);
+            if (!serial_flat(info->type))
+                for (i = 0; i < count; i++)
+                    serial_put_embedded(info->type, ptr + i * size, writer);
+        }
+        break;
+    case CODE_ARRAY:
+        count = serial_array_count(info, length);
+        size = _budgie_type_table[info->type].size;
+        for (i = 0; i < count; i++)
+            serial_put_embedded(info->type, (const char *) value + i * size, writer);
+        break;
+    case CODE_RECORD:
+        for (field = info->fields; field->type != NULL_TYPE; field++)
+            serial_put_embedded(field->type, (const char *) value + field->offset, writer);
+        break;
+    default:
+        assert(0);
+    }
+}
+
+void budgie_serialize_any_type(budgie_type type, const void *value, int length,
+                               bugle_io_writer *writer)
+{
+    const type_data *info;
+
+    type = budgie_type_type(type, value);
+    assert(type >= 0 && type < _budgie_type_count);
+    info = &_budgie_type_table[type];
+    if (info->get_length && length == -1)
+        length = (*info->get_length)(value);
+
+    serial_put_int32(type, writer);
+    serial_put_int32(length, writer);
+    bugle_io_write(value, info->size, 1, writer);
+    serial_put_extras(type, value, length, writer);
+}
+
+/* Cursor over serialised data. Bounds are checked on every read, since the
+ * data may come from a truncated file. The data need not be aligned, so
+ * raw values are copied to allocated memory before being dumped.
+ */
+typedef struct
+{
+    const char *cur;
+    const char *end;
+} serial_reader;
+
+static const void *serial_get(serial_reader *r, size_t size)
+{
+    const char *ptr = r->cur;
+
+    if ((size_t) (r->end - r->cur) < size)
+        return NULL;
+    r->cur += size;
+    return ptr;
+}
+
+static bugle_bool serial_get_header(serial_reader *r, budgie_type *type, int *length)
+{
+    const void *ptr;
+    bugle_int32_t v[2];
+
+    if ((ptr = serial_get(r, sizeof(v))) == NULL)
+        return BUGLE_FALSE;
+    memcpy(v, ptr, sizeof(v));
+    if (v[0] < 0 || v[0] >= _budgie_type_count)
+        return BUGLE_FALSE;
+    *type = v[0];
+    *length = v[1];
+    return BUGLE_TRUE;
+}
+
+static bugle_bool serial_dump_extras(budgie_type type, const char *raw, int length,
+                                     serial_reader *r, bugle_io_writer *writer);
+
+static bugle_bool serial_dump_embedded(budgie_type expected, const char *raw,
+                                       serial_reader *r, bugle_io_writer *writer)
+{
+    budgie_type type;
+    int length;
+
+    if (!serial_get_header(r, &type, &length)
+        || _budgie_type_table[type].size != _budgie_type_table[expected].size)
+        return BUGLE_FALSE;
+    return serial_dump_extras(type, raw, length, r, writer);
+}
+
+/* Mirrors the generated dumpers for types that contain pointers, but takes
+ * the pointed-to memory from the serialised data while still printing the
+ * original addresses.
+ */
+static bugle_bool serial_dump_extras(budgie_type type, const char *raw, int length,
+                                     serial_reader *r, bugle_io_writer *writer)
+{
+    const type_data *info;
+    const type_record_data *field;
+    const bugle_uint8_t *tag;
+    const void *ptr;
+    const char *data;
+    size_t size;
+    int count, i;
+
+    if (serial_flat(type))
+    {
+        budgie_dump_any_type(type, raw, length, writer);
+        return BUGLE_TRUE;
+    }
+
+    info = &_budgie_type_table[type];
+    switch (info->code)
+    {
+    case CODE_POINTER:
+        memcpy(&ptr, raw, sizeof(ptr));
+        if ((tag = (const bugle_uint8_t *) serial_get(r, 1)) == NULL)
+            return BUGLE_FALSE;
+        switch (*tag)
+        {
+        case SERIAL_NONE:
+            if (ptr == NULL) bugle_io_puts("NULL", writer);
+            else bugle_io_printf(writer, "%p", ptr);
+            return BUGLE_TRUE;
+        case SERIAL_STRING:
+            {
+                bugle_uint32_t n;
+                char *str;
+
+                if ((data = (const char *) serial_get(r, sizeof(n))) == NULL)
+                    return BUGLE_FALSE;
+                memcpy(&n, data, sizeof(n));
+                if ((data = (const char *) serial_get(r, n)) == NULL)
+                    return BUGLE_FALSE;
+                str = BUGLE_NMALLOC(n + 1, char);
+                memcpy(str, data, n);
+                str[n] = '\0';
+                budgie_dump_any_type(type, &str, length, writer);
+                bugle_free(str);
+                return BUGLE_TRUE;
+            }
+        case SERIAL_ARRAY:
+            {
+                char *elements;
+                bugle_bool ok = BUGLE_TRUE;
+
+                count = length < 0 ? 1 : length;
+                size = _budgie_type_table[info->type].size;
+                if ((data = (const char *) serial_get(r, size * count)) == NULL)
+                    return BUGLE_FALSE;
+                elements = (char *) bugle_malloc(size * count + 1);
+                memcpy(elements, data, size * count);
+
+                bugle_io_printf(writer, "%p -> ", ptr);
+                if (length >= 0 && serial_flat(info->type))
+                {
+                    budgie_dump_array(info->type, elements, count, -1, writer);
+                    bugle_free(elements);
+                    return BUGLE_TRUE;
+                }
+                if (length >= 0)
+                    bugle_io_puts("{ ", writer);
+                for (i = 0; i < count && ok; i++)
+                {
+                    if (serial_flat(info->type))
+                        budgie_dump_any_type(info->type, elements + i * size, -1, writer);
+                    else
+                        ok = serial_dump_embedded(info->type, elements + i * size, r, writer);
+                    if (length >= 0 && i + 1 < count)
+                        bugle_io_puts(", ", writer);
+                }
+                if (length >= 0)
+                    bugle_io_puts(" }", writer);
+                bugle_free(elements);
+                return ok;
+            }
+        default:
+            return BUGLE_FALSE;
+        }
+    case CODE_ARRAY:
+        count = serial_array_count(info, length);
+        size = _budgie_type_table[info->type].size;
+        bugle_io_puts("{ ", writer);
+        for (i = 0; i < count; i++)
+        {
+            if (!serial_dump_embedded(info->type, raw + i * size, r, writer))
+                return BUGLE_FALSE;
+            if (i < count - 1)
+                bugle_io_puts(", ", writer);
+        }
+        if (count < 0)
+            bugle_io_puts("<unknown size array>", writer);
+        bugle_io_puts(" }", writer);
+        return BUGLE_TRUE;
+    case CODE_RECORD:
+        bugle_io_puts("{ ", writer);
+        for (field = info->fields; field->type != NULL_TYPE; field++)
+        {
+            if (field != info->fields)
+                bugle_io_puts(", ", writer);
+            if (!serial_dump_embedded(field->type, raw + field->offset, r, writer))
+                return BUGLE_FALSE;
+        }
+        bugle_io_puts(" }", writer);
+        return BUGLE_TRUE;
+    default:
+        return BUGLE_FALSE;
+    }
+}
+
+bugle_bool budgie_dump_serialized(const char **data, const char *end, bugle_io_writer *writer)
+{
+    serial_reader r;
+    budgie_type type;
+    int length;
+    size_t size;
+    const char *raw;
+    char *value;
+    bugle_bool ok;
+
+    r.cur = *data;
+    r.end = end;
+    if (!serial_get_header(&r, &type, &length))
+        return BUGLE_FALSE;
+    size = _budgie_type_table[type].size;
+    if ((raw = (const char *) serial_get(&r, size)) == NULL)
+        return BUGLE_FALSE;
+    value = (char *) bugle_malloc(size + 1);
+    memcpy(value, raw, size);
+    ok = serial_dump_extras(type, value, length, &r, writer);
+    bugle_free(value);
+    if (ok)
+        *data = r.cur;
+    return ok;
+}
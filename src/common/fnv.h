@@ -0,0 +1,47 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2013  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/* Hashing of binary data, shared by the array dumping in budgielib and the
+ * blob deduplication in the exe filter.
+ */
+
+#ifndef BUGLE_COMMON_FNV_H
+#define BUGLE_COMMON_FNV_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include "platform/types.h"
+
+/* 64-bit FNV-1a */
+static inline bugle_uint64_t bugle_fnv1a64(const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    bugle_uint64_t hash = 0xcbf29ce4;
+    size_t i;
+
+    /* Written in two halves since C89 lacks 64-bit literals */
+    hash = (hash << 32) | 0x84222325;
+    for (i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= (((bugle_uint64_t) 0x100) << 32) | 0x1b3;
+    }
+    return hash;
+}
+
+#endif /* !BUGLE_COMMON_FNV_H */
@@ -26,46 +26,71 @@
 #include <bugle/memory.h>
 #include <bugle/string.h>
 #include <bugle/hashtable.h>
-#include "platform/threads.h"
 
-/* Primes are used for hash table sizes */
-static size_t primes[sizeof(size_t) * 8];
+/* Both tables use open addressing with linear probing in a power-of-two
+ * sized array, so the slot for a hash is found by masking. Deletion uses
+ * backward shifting: each later entry in the same cluster that could live
+ * in the vacated slot is moved back into it, so no tombstones are needed
+ * and probe sequences never get longer due to deletions.
+ *
+ * The string table caches the full hash of each key, so that rehashing does
+ * not rehash the strings and most mismatches are rejected without a strcmp.
+ * The hashes are kept in the same allocation as the entries, directly after
+ * them, so that hash_table_entry keeps its public layout.
+ */
 
-static bugle_bool is_prime(int x)
-{
-    int i;
+#define HASH_MIN_SIZE 8
 
-    for (i = 2; i * i <= x; i++)
-        if (x % i == 0) return BUGLE_FALSE;
-    return BUGLE_TRUE;
-}
+/* The table is grown once it is more than 3/4 full */
+#define HASH_FULL(count, size) ((count) >= (size) - (size) / 4)
 
-static bugle_thread_once_t hash_once = BUGLE_THREAD_ONCE_INIT;
+/* Final mixing step, so that all the bits of the key affect the low bits
+ * that are used to index the table. This is the finaliser from
+ * MurmurHash3, after folding the upper half of a 64-bit size_t into the
+ * lower half.
+ */
+static inline size_t hash_mix(size_t h)
+{
+    h ^= h >> (sizeof(size_t) * 4);
+    h ^= h >> 16;
+    h *= 0x85ebca6bUL;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35UL;
+    h ^= h >> 16;
+    return h;
+}
 
-static void hash_initialise(void)
+/* 32-bit FNV-1a, followed by hash_mix */
+static inline size_t hash(const char *str)
 {
-    int i;
+    size_t h = 2166136261UL;
+    const unsigned char *ch;
 
-    primes[0] = 0;
-    primes[1] = 5;
-    i = 1;
-    while (primes[i] < ((size_t) -1) / 2)
+    for (ch = (const unsigned char *) str; *ch; ch++)
     {
-        primes[i + 1] = primes[i] * 2 + 1;
-        i++;
-        while (!is_prime(primes[i])) primes[i] += 2;
+        h ^= *ch;
+        h *= 16777619UL;
     }
-    primes[i + 1] = (size_t) -1;
+    return hash_mix(h);
 }
 
-static inline size_t hash(const char *str)
+/* Allocates a zeroed array of size entries followed by size hashes */
+static hash_table_entry *hash_alloc(size_t size)
 {
-    size_t h = 0;
-    const char *ch;
+    return (hash_table_entry *) bugle_calloc(size, sizeof(hash_table_entry) + sizeof(size_t));
+}
 
-    for (ch = str; *ch; ch++)
-        h = (h + *ch) * 29;
-    return h;
+static inline size_t *hash_hashes(const hash_table *table)
+{
+    return (size_t *) (table->entries + table->size);
+}
+
+/* Returns true if the entry at slot i, whose home slot is home, may be
+ * moved back into the hole at slot j (i.e., j lies cyclically in [home, i)).
+ */
+static inline bugle_bool hash_can_shift(size_t home, size_t i, size_t j, size_t mask)
+{
+    return ((i - home) & mask) >= ((i - j) & mask);
 }
 
 void bugle_hash_init(hash_table *table, void (*destructor)(void *))
@@ -76,81 +101,115 @@ void bugle_hash_init(hash_table *table, void (*destructor)(void *))
     table->destructor = destructor;
 }
 
-/* Does not
- * - resize the table
- * - update the count
- * - copy the memory for the key
- * - check for duplicate keys
- * It should only be used for rehashing
- */
-static void hash_set_fast(hash_table *table, char *key, void *value)
+/* Returns the slot holding key, or the empty slot where it belongs */
+static size_t hash_find(const hash_table *table, const char *key, size_t h)
 {
-    size_t h;
+    size_t mask, i;
+    const hash_table_entry *e;
+    const size_t *hashes;
 
-    h = hash(key) % table->size;
-    while (table->entries[h].key)
-        if (++h == table->size) h = 0;
-    table->entries[h].key = key;
-    table->entries[h].value = value;
+    mask = table->size - 1;
+    hashes = hash_hashes(table);
+    for (i = h & mask; ; i = (i + 1) & mask)
+    {
+        e = &table->entries[i];
+        if (!e->key
+            || (hashes[i] == h && strcmp(key, e->key) == 0))
+            return i;
+    }
+}
+
+static void hash_grow(hash_table *table)
+{
+    hash_table_entry *old;
+    const size_t *old_hashes;
+    size_t *hashes;
+    size_t old_size, i, j, mask;
+
+    old = table->entries;
+    old_size = table->size;
+    old_hashes = old ? hash_hashes(table) : NULL;
+    table->size = old_size ? old_size * 2 : HASH_MIN_SIZE;
+    table->entries = hash_alloc(table->size);
+    hashes = hash_hashes(table);
+    mask = table->size - 1;
+    for (i = 0; i < old_size; i++)
+        if (old[i].key)
+        {
+            for (j = old_hashes[i] & mask; table->entries[j].key; j = (j + 1) & mask)
+            {
+                /* Keys are unique, so just find an empty slot */
+            }
+            table->entries[j] = old[i];
+            hashes[j] = old_hashes[i];
+        }
+    bugle_free(old);
 }
 
 void bugle_hash_set(hash_table *table, const char *key, void *value)
 {
-    hash_table big;
-    size_t i;
-    size_t h;
+    size_t h, i;
+    hash_table_entry *e;
 
-    if (table->count >= table->size / 2
-        && table->size < (size_t) -1)
-    {
-        bugle_thread_once(&hash_once, hash_initialise);
-        big.size_index = table->size_index + 1;
-        big.size = primes[big.size_index];
-        big.entries = BUGLE_CALLOC(big.size, hash_table_entry);
-        big.count = 0;
-        big.destructor = table->destructor;
-        for (i = 0; i < table->size; i++)
-            if (table->entries[i].key)
-                hash_set_fast(&big, table->entries[i].key,
-                                    table->entries[i].value);
-        if (table->entries) bugle_free(table->entries);
-        *table = big;
-    }
+    if (HASH_FULL(table->count, table->size))
+        hash_grow(table);
 
-    h = hash(key) % table->size;
-    while (table->entries[h].key && strcmp(key, table->entries[h].key) != 0)
-        if (++h == table->size) h = 0;
-    if (!table->entries[h].key)
+    h = hash(key);
+    i = hash_find(table, key, h);
+    e = &table->entries[i];
+    if (!e->key)
     {
-        table->entries[h].key = bugle_strdup(key);
+        e->key = bugle_strdup(key);
+        hash_hashes(table)[i] = h;
         table->count++;
     }
     else if (table->destructor)
-        table->destructor(table->entries[h].value);
-    table->entries[h].value = value;
+        table->destructor(e->value);
+    e->value = value;
 }
 
 bugle_bool bugle_hash_count(const hash_table *table, const char *key)
 {
-    size_t h;
-
-    if (!table->entries) return BUGLE_FALSE;
-    h = hash(key) % table->size;
-    while (table->entries[h].key && strcmp(key, table->entries[h].key) != 0)
-        if (++h == table->size) h = 0;
-    return table->entries[h].key != NULL;
+    if (!table->count) return BUGLE_FALSE;
+    return table->entries[hash_find(table, key, hash(key))].key != NULL;
 }
 
 void *bugle_hash_get(const hash_table *table, const char *key)
 {
-    size_t h;
+    if (!table->count) return NULL;
+    return table->entries[hash_find(table, key, hash(key))].value;
+}
 
-    if (!table->entries) return NULL;
-    h = hash(key) % table->size;
-    while (table->entries[h].key && strcmp(key, table->entries[h].key) != 0)
-        if (++h == table->size) h = 0;
-    if (table->entries[h].key) return table->entries[h].value;
-    else return NULL;
+void bugle_hash_erase(hash_table *table, const char *key)
+{
+    size_t mask, i, j, home;
+    hash_table_entry *e;
+    size_t *hashes;
+
+    if (!table->count) return;
+    mask = table->size - 1;
+    hashes = hash_hashes(table);
+    j = hash_find(table, key, hash(key));
+    e = &table->entries[j];
+    if (!e->key) return;
+
+    bugle_free(e->key);
+    if (table->destructor)
+        table->destructor(e->value);
+    table->count--;
+
+    for (i = (j + 1) & mask; table->entries[i].key; i = (i + 1) & mask)
+    {
+        home = hashes[i] & mask;
+        if (hash_can_shift(home, i, j, mask))
+        {
+            table->entries[j] = table->entries[i];
+            hashes[j] = hashes[i];
+            j = i;
+        }
+    }
+    table->entries[j].key = NULL;
+    table->entries[j].value = NULL;
 }
 
 void bugle_hash_clear(hash_table *table)
@@ -170,7 +229,6 @@ void bugle_hash_clear(hash_table *table)
     }
     table->entries = NULL;
     table->size = table->count = 0;
-    table->size_index = 0;
 }
 
 const hash_table_entry *bugle_hash_next(hash_table *table, const hash_table_entry *e)
@@ -191,15 +249,23 @@ const hash_table_entry *bugle_hash_begin(hash_table *table)
     else return bugle_hash_next(table, table->entries);
 }
 
-/* void * based hashing */
-/* FIXME: a lot of this code should be unified with the regular hash code;
- * either using actually shared code, or hacks with #includes or inlines
- * to maintain efficiency but still cut down maintainence
+/* void * based hashing. The hash is cheap to compute, so it is not cached.
  */
 
-static inline size_t hashptr(const void *str)
+/* Multiplier for Fibonacci hashing, 2^N divided by the golden ratio */
+#define HASH_GOLDEN (sizeof(size_t) > 4                                     \
+                     ? ((size_t) 0x9e3779b9UL << 16 << 16) | 0x7f4a7c15UL   \
+                     : (size_t) 0x9e3779b9UL)
+
+static inline size_t hashptr(const void *key)
 {
-    return (const char *) str - (const char *) NULL;
+    size_t h;
+
+    /* The multiplication moves entropy upwards, so fold the upper half
+     * back down into the bits used to index the table.
+     */
+    h = ((const char *) key - (const char *) NULL) * HASH_GOLDEN;
+    return h ^ (h >> (sizeof(size_t) * 4));
 }
 
 void bugle_hashptr_init(hashptr_table *table, void (*destructor)(void *))
@@ -210,81 +276,98 @@ void bugle_hashptr_init(hashptr_table *table, void (*destructor)(void *))
     table->destructor = destructor;
 }
 
-/* Does not
- * - resize the table
- * - update the count
- * - copy the memory for the key
- * - check for duplicate keys
- * It should only be used for rehashing
- */
-static void hashptr_set_fast(hashptr_table *table, const void *key, void *value)
+static size_t hashptr_find(const hashptr_table *table, const void *key)
 {
-    size_t h;
+    size_t mask, i;
+    const hashptr_table_entry *e;
 
-    h = hashptr(key) % table->size;
-    while (table->entries[h].key)
-        if (++h == table->size) h = 0;
-    table->entries[h].key = key;
-    table->entries[h].value = value;
+    mask = table->size - 1;
+    for (i = hashptr(key) & mask; ; i = (i + 1) & mask)
+    {
+        e = &table->entries[i];
+        if (!e->key || e->key == key)
+            return i;
+    }
+}
+
+static void hashptr_grow(hashptr_table *table)
+{
+    hashptr_table_entry *old;
+    size_t old_size, i, j, mask;
+
+    old = table->entries;
+    old_size = table->size;
+    table->size = old_size ? old_size * 2 : HASH_MIN_SIZE;
+    table->entries = BUGLE_CALLOC(table->size, hashptr_table_entry);
+    mask = table->size - 1;
+    for (i = 0; i < old_size; i++)
+        if (old[i].key)
+        {
+            for (j = hashptr(old[i].key) & mask; table->entries[j].key; j = (j + 1) & mask)
+            {
+                /* Keys are unique, so just find an empty slot */
+            }
+            table->entries[j] = old[i];
+        }
+    bugle_free(old);
 }
 
 void bugle_hashptr_set(hashptr_table *table, const void *key, void *value)
 {
-    hashptr_table big;
-    size_t i;
-    size_t h;
+    hashptr_table_entry *e;
 
-    if (table->count >= table->size / 2
-        && table->size < (size_t) -1)
-    {
-        bugle_thread_once(&hash_once, hash_initialise);
-        big.size_index = table->size_index + 1;
-        big.size = primes[big.size_index];
-        big.entries = BUGLE_CALLOC(big.size, hashptr_table_entry);
-        big.count = 0;
-        big.destructor = table->destructor;
-        for (i = 0; i < table->size; i++)
-            if (table->entries[i].key)
-                hashptr_set_fast(&big, table->entries[i].key,
-                                 table->entries[i].value);
-        if (table->entries) bugle_free(table->entries);
-        *table = big;
-    }
+    if (HASH_FULL(table->count, table->size))
+        hashptr_grow(table);
 
-    h = hashptr(key) % table->size;
-    while (table->entries[h].key && key != table->entries[h].key)
-        if (++h == table->size) h = 0;
-    if (!table->entries[h].key)
+    e = &table->entries[hashptr_find(table, key)];
+    if (!e->key)
     {
-        table->entries[h].key = key;
+        e->key = key;
         table->count++;
     }
     else if (table->destructor)
-        table->destructor(table->entries[h].value);
-    table->entries[h].value = value;
+        table->destructor(e->value);
+    e->value = value;
 }
 
 bugle_bool bugle_hashptr_count(const hashptr_table *table, const void *key)
 {
-    size_t h;
-
-    if (!table->entries) return BUGLE_FALSE;
-    h = hashptr(key) % table->size;
-    while (table->entries[h].key && table->entries[h].key != key)
-        if (++h == table->size) h = 0;
-    return table->entries[h].key != NULL;
+    if (!table->count) return BUGLE_FALSE;
+    return table->entries[hashptr_find(table, key)].key != NULL;
 }
 
 void *bugle_hashptr_get(const hashptr_table *table, const void *key)
 {
-    size_t h;
+    if (!table->count) return NULL;
+    return table->entries[hashptr_find(table, key)].value;
+}
 
-    if (!table->entries) return NULL;
-    h = hashptr(key) % table->size;
-    while (table->entries[h].key && table->entries[h].key != key)
-        if (++h == table->size) h = 0;
-    if (table->entries[h].key) return table->entries[h].value;
-    else return NULL;
+void bugle_hashptr_erase(hashptr_table *table, const void *key)
+{
+    size_t mask, i, j, home;
+    hashptr_table_entry *e;
+
+    if (!table->count) return;
+    mask = table->size - 1;
+    j = hashptr_find(table, key);
+    e = &table->entries[j];
+    if (!e->key) return;
+
+    if (table->destructor)
+        table->destructor(e->value);
+    table->count--;
+
+    for (i = (j + 1) & mask; table->entries[i].key; i = (i + 1) & mask)
+    {
+        home = hashptr(table->entries[i].key) & mask;
+        if (hash_can_shift(home, i, j, mask))
+        {
+            table->entries[j] = table->entries[i];
+            j = i;
+        }
+    }
+    table->entries[j].key = NULL;
+    table->entries[j].value = NULL;
 }
 
 void bugle_hashptr_clear(hashptr_table *table)
@@ -303,7 +386,6 @@ void bugle_hashptr_clear(hashptr_table *table)
     }
     table->entries = NULL;
     table->size = table->count = 0;
-    table->size_index = 0;
 }
 
 const hashptr_table_entry *bugle_hashptr_next(hashptr_table *table, const hashptr_table_entry *e)
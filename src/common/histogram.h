@@ -0,0 +1,67 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2013  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/* Logarithmic histogram buckets for 64-bit values, such as call times in
+ * ticks. Values below BUGLE_HISTOGRAM_SUB have a bucket each. Above that,
+ * each power of two is split into BUGLE_HISTOGRAM_SUB buckets, so a bucket
+ * is never wider than 1/BUGLE_HISTOGRAM_SUB of its lower bound. The largest
+ * value falls in bucket BUGLE_HISTOGRAM_BUCKETS - 1.
+ */
+
+#ifndef BUGLE_COMMON_HISTOGRAM_H
+#define BUGLE_COMMON_HISTOGRAM_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <math.h>
+#include "platform/types.h"
+
+#define BUGLE_HISTOGRAM_SUB_BITS 3
+#define BUGLE_HISTOGRAM_SUB (1 << BUGLE_HISTOGRAM_SUB_BITS)
+#define BUGLE_HISTOGRAM_BUCKETS (BUGLE_HISTOGRAM_SUB * (64 - BUGLE_HISTOGRAM_SUB_BITS + 1))
+
+static inline int bugle_histogram_bucket(bugle_uint64_t value)
+{
+    bugle_uint64_t v = value;
+    int e = 0;
+
+    if (value < BUGLE_HISTOGRAM_SUB)
+        return (int) value;
+    if (v >> 32) { e += 32; v >>= 32; }
+    if (v >> 16) { e += 16; v >>= 16; }
+    if (v >> 8) { e += 8; v >>= 8; }
+    if (v >> 4) { e += 4; v >>= 4; }
+    if (v >> 2) { e += 2; v >>= 2; }
+    if (v >> 1) { e += 1; }
+    /* e is now floor(log2(value)), and is at least BUGLE_HISTOGRAM_SUB_BITS */
+    e -= BUGLE_HISTOGRAM_SUB_BITS;
+    return BUGLE_HISTOGRAM_SUB * (e + 1) + (int) ((value >> e) & (BUGLE_HISTOGRAM_SUB - 1));
+}
+
+/* Returns the largest value that falls in the bucket */
+static inline double bugle_histogram_bucket_max(int bucket)
+{
+    int e, sub;
+
+    if (bucket < BUGLE_HISTOGRAM_SUB)
+        return bucket;
+    e = bucket / BUGLE_HISTOGRAM_SUB - 1;
+    sub = bucket % BUGLE_HISTOGRAM_SUB;
+    return ldexp(BUGLE_HISTOGRAM_SUB + sub + 1, e) - 1.0;
+}
+
+#endif /* !BUGLE_COMMON_HISTOGRAM_H */
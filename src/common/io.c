@@ -28,7 +28,11 @@
 #include <bugle/memory.h>
 #include <bugle/attributes.h>
 #include "io-impl.h"
+#include "common/fnv.h"
+#include "common/lz.h"
 #include "platform/macros.h"
+#include "platform/threads.h"
+#include "platform/types.h"
 
 size_t bugle_io_read(void *ptr, size_t size, size_t nmemb, bugle_io_reader *reader)
 {
@@ -242,6 +246,36 @@ void bugle_io_writer_mem_release(bugle_io_writer *writer)
     mem->total = 0;
 }
 
+static bugle_thread_key_t scratch_key;
+static bugle_thread_once_t scratch_once = BUGLE_THREAD_ONCE_INIT;
+
+static void scratch_destroy(void *writer)
+{
+    bugle_io_writer_mem_release((bugle_io_writer *) writer);
+    bugle_io_writer_close((bugle_io_writer *) writer);
+}
+
+static void scratch_initialise(void)
+{
+    bugle_thread_key_create(&scratch_key, scratch_destroy);
+}
+
+bugle_io_writer *bugle_io_writer_mem_scratch(void)
+{
+    bugle_io_writer *writer;
+
+    bugle_thread_once(&scratch_once, scratch_initialise);
+    writer = (bugle_io_writer *) bugle_thread_getspecific(scratch_key);
+    if (writer == NULL)
+    {
+        writer = bugle_io_writer_mem_new(256);
+        bugle_thread_setspecific(scratch_key, writer);
+    }
+    else
+        bugle_io_writer_mem_clear(writer);
+    return writer;
+}
+
 bugle_io_writer *bugle_io_writer_file_new(FILE *f)
 {
     bugle_io_writer *writer;
@@ -255,3 +289,337 @@ bugle_io_writer *bugle_io_writer_file_new(FILE *f)
     writer->arg = f;
     return writer;
 }
+
+bugle_io_reader *bugle_io_reader_file_new(FILE *f)
+{
+    bugle_io_reader *reader;
+
+    reader = BUGLE_MALLOC(bugle_io_reader);
+    reader->fn_read = (size_t (*)(void *, size_t, size_t, void *)) fread;
+    reader->fn_close = (int (*)(void *)) fclose;
+    reader->arg = f;
+    return reader;
+}
+
+/* Block compression.
+ *
+ * The stream starts with IO_BLOCK_MAGIC and two little-endian uint32s: the
+ * format version and the block size. Each block then has three little-endian
+ * uint32s (uncompressed length, stored length, low 32 bits of the 64-bit
+ * FNV-1a hash of the uncompressed data) followed by the stored bytes. If the
+ * stored length equals the uncompressed length the block is stored as-is,
+ * otherwise it is in the format of common/lz.h. Blocks are independent, so a stream that is
+ * cut off can be decoded up to the last complete block.
+ *
+ * Writers fill the slots in turn. A full slot is handed to the compressor
+ * thread through filled_sem, and the compressor hands it back through
+ * free_sem once it has been written out. The writer always owns the slot it
+ * is filling, so at most IO_BLOCK_SLOTS - 1 blocks are queued.
+ */
+#define IO_BLOCK_MAGIC "BGLBLOCK"
+#define IO_BLOCK_VERSION 2
+#define IO_BLOCK_DEFAULT_SIZE (256 * 1024)
+#define IO_BLOCK_MAX_SIZE (64 * 1024 * 1024)
+#define IO_BLOCK_SLOTS 4
+#define IO_BLOCK_HEADER 12
+
+typedef struct
+{
+    char *data;
+    size_t length;              /* 0 in a submitted slot means stop */
+} io_block_slot;
+
+typedef struct
+{
+    bugle_io_writer *inner;
+    size_t block_size;
+    bugle_thread_lock_t lock;   /* serialises callers of the writer */
+    io_block_slot slots[IO_BLOCK_SLOTS];
+    unsigned int current;       /* slot being filled, protected by lock */
+    unsigned int next;          /* next slot to compress, compressor only */
+    bugle_thread_sem_t filled_sem;
+    bugle_thread_sem_t free_sem;
+    bugle_thread_handle thread;
+
+    /* Compressor thread only */
+    char *packed;
+    bugle_lz_state lz;
+} io_block_writer;
+
+typedef struct
+{
+    bugle_io_reader *inner;
+    size_t block_size;
+    char *data;
+    char *packed;
+    size_t length;
+    size_t pos;
+    bugle_bool eof;
+} io_block_reader;
+
+/* The low half of the 64-bit FNV-1a hash is stored in the block header */
+static bugle_uint32_t io_block_hash(const char *data, size_t length)
+{
+    return (bugle_uint32_t) (bugle_fnv1a64(data, length) & 0xffffffffUL);
+}
+
+static void io_put_le32(unsigned char *out, bugle_uint32_t value)
+{
+    out[0] = value & 0xff;
+    out[1] = (value >> 8) & 0xff;
+    out[2] = (value >> 16) & 0xff;
+    out[3] = (value >> 24) & 0xff;
+}
+
+static bugle_uint32_t io_get_le32(const unsigned char *in)
+{
+    return (bugle_uint32_t) in[0]
+        | ((bugle_uint32_t) in[1] << 8)
+        | ((bugle_uint32_t) in[2] << 16)
+        | ((bugle_uint32_t) in[3] << 24);
+}
+
+static void io_block_compress(io_block_writer *w, const io_block_slot *slot)
+{
+    unsigned char header[IO_BLOCK_HEADER];
+    const char *stored;
+    size_t stored_length;
+
+    stored_length = bugle_lz_compress(&w->lz, slot->data, slot->length,
+                                      w->packed, slot->length - 1);
+    if (stored_length == 0)
+    {
+        stored = slot->data;
+        stored_length = slot->length;
+    }
+    else
+        stored = w->packed;
+
+    io_put_le32(header, slot->length);
+    io_put_le32(header + 4, stored_length);
+    io_put_le32(header + 8, io_block_hash(slot->data, slot->length));
+    bugle_io_write(header, 1, sizeof(header), w->inner);
+    bugle_io_write(stored, 1, stored_length, w->inner);
+}
+
+static unsigned int io_block_thread(void *arg)
+{
+    io_block_writer *w = (io_block_writer *) arg;
+
+    for (;;)
+    {
+        io_block_slot *slot;
+
+        bugle_thread_sem_wait(&w->filled_sem);
+        slot = &w->slots[w->next];
+        if (slot->length == 0)
+            break;
+        io_block_compress(w, slot);
+        slot->length = 0;
+        w->next = (w->next + 1) % IO_BLOCK_SLOTS;
+        bugle_thread_sem_post(&w->free_sem);
+    }
+    return 0;
+}
+
+/* Hands the current slot to the compressor. Must be called with the lock held */
+static void io_block_submit(io_block_writer *w)
+{
+    bugle_thread_sem_post(&w->filled_sem);
+    bugle_thread_sem_wait(&w->free_sem);
+    w->current = (w->current + 1) % IO_BLOCK_SLOTS;
+}
+
+static size_t io_block_write(const void *ptr, size_t size, size_t nmemb, void *arg)
+{
+    io_block_writer *w = (io_block_writer *) arg;
+    const char *src = (const char *) ptr;
+    size_t remain = size * nmemb;
+
+    bugle_thread_lock_lock(&w->lock);
+    while (remain > 0)
+    {
+        io_block_slot *slot = &w->slots[w->current];
+        size_t n = w->block_size - slot->length;
+
+        if (n > remain) n = remain;
+        memcpy(slot->data + slot->length, src, n);
+        slot->length += n;
+        src += n;
+        remain -= n;
+        if (slot->length == w->block_size)
+            io_block_submit(w);
+    }
+    bugle_thread_lock_unlock(&w->lock);
+    return nmemb;
+}
+
+static int io_block_close(void *arg)
+{
+    io_block_writer *w = (io_block_writer *) arg;
+    int ret, i;
+
+    bugle_thread_lock_lock(&w->lock);
+    if (w->slots[w->current].length > 0)
+        io_block_submit(w);
+    /* The current slot is now empty, which tells the compressor to stop */
+    bugle_thread_sem_post(&w->filled_sem);
+    bugle_thread_lock_unlock(&w->lock);
+    bugle_thread_join(w->thread, NULL);
+
+    ret = bugle_io_writer_close(w->inner);
+    for (i = 0; i < IO_BLOCK_SLOTS; i++)
+        bugle_free(w->slots[i].data);
+    bugle_free(w->packed);
+    bugle_thread_sem_destroy(&w->filled_sem);
+    bugle_thread_sem_destroy(&w->free_sem);
+    bugle_thread_lock_destroy(&w->lock);
+    bugle_free(w);
+    return ret;
+}
+
+bugle_io_writer *bugle_io_writer_block_new(bugle_io_writer *inner, size_t block_size)
+{
+    bugle_io_writer *writer;
+    io_block_writer *w;
+    unsigned char header[16];
+    int i;
+
+    if (block_size == 0)
+        block_size = IO_BLOCK_DEFAULT_SIZE;
+    if (block_size > IO_BLOCK_MAX_SIZE)
+        block_size = IO_BLOCK_MAX_SIZE;
+
+    w = BUGLE_ZALLOC(io_block_writer);
+    w->inner = inner;
+    w->block_size = block_size;
+    for (i = 0; i < IO_BLOCK_SLOTS; i++)
+        w->slots[i].data = BUGLE_NMALLOC(block_size, char);
+    w->packed = BUGLE_NMALLOC(block_size, char);
+    bugle_thread_lock_init(&w->lock);
+    bugle_thread_sem_init(&w->filled_sem, 0);
+    /* Every slot except the one being filled starts out free */
+    bugle_thread_sem_init(&w->free_sem, IO_BLOCK_SLOTS - 1);
+
+    if (bugle_thread_create(&w->thread, io_block_thread, w) != 0)
+    {
+        for (i = 0; i < IO_BLOCK_SLOTS; i++)
+            bugle_free(w->slots[i].data);
+        bugle_free(w->packed);
+        bugle_thread_sem_destroy(&w->filled_sem);
+        bugle_thread_sem_destroy(&w->free_sem);
+        bugle_thread_lock_destroy(&w->lock);
+        bugle_free(w);
+        return NULL;
+    }
+
+    memcpy(header, IO_BLOCK_MAGIC, 8);
+    io_put_le32(header + 8, IO_BLOCK_VERSION);
+    io_put_le32(header + 12, block_size);
+    bugle_io_write(header, 1, sizeof(header), inner);
+
+    writer = BUGLE_MALLOC(bugle_io_writer);
+    writer->fn_vprintf = NULL;
+    writer->fn_putc = NULL;
+    writer->fn_write = io_block_write;
+    writer->fn_close = io_block_close;
+    writer->arg = w;
+    return writer;
+}
+
+/* Loads the next block. Returns false at the end of the stream, including
+ * a final block that is incomplete or fails its hash.
+ */
+static bugle_bool io_block_next(io_block_reader *r)
+{
+    unsigned char header[IO_BLOCK_HEADER];
+    bugle_uint32_t length, stored_length, hash;
+    char *stored;
+
+    if (bugle_io_read(header, 1, sizeof(header), r->inner) != sizeof(header))
+        return BUGLE_FALSE;
+    length = io_get_le32(header);
+    stored_length = io_get_le32(header + 4);
+    hash = io_get_le32(header + 8);
+    if (length == 0 || length > r->block_size || stored_length > length)
+        return BUGLE_FALSE;
+
+    stored = stored_length == length ? r->data : r->packed;
+    if (bugle_io_read(stored, 1, stored_length, r->inner) != stored_length)
+        return BUGLE_FALSE;
+    if (stored != r->data
+        && bugle_lz_decompress(r->packed, stored_length, r->data, length) != length)
+        return BUGLE_FALSE;
+    if (io_block_hash(r->data, length) != hash)
+        return BUGLE_FALSE;
+    r->length = length;
+    r->pos = 0;
+    return BUGLE_TRUE;
+}
+
+static size_t io_block_read(void *ptr, size_t size, size_t nmemb, void *arg)
+{
+    io_block_reader *r = (io_block_reader *) arg;
+    char *dst = (char *) ptr;
+    size_t total = size * nmemb, done = 0;
+
+    while (done < total)
+    {
+        size_t n;
+
+        if (r->pos == r->length)
+        {
+            if (r->eof || !io_block_next(r))
+            {
+                r->eof = BUGLE_TRUE;
+                break;
+            }
+        }
+        n = r->length - r->pos;
+        if (n > total - done) n = total - done;
+        memcpy(dst + done, r->data + r->pos, n);
+        r->pos += n;
+        done += n;
+    }
+    return size ? done / size : 0;
+}
+
+static int io_block_reader_close(void *arg)
+{
+    io_block_reader *r = (io_block_reader *) arg;
+    int ret;
+
+    ret = bugle_io_reader_close(r->inner);
+    bugle_free(r->data);
+    bugle_free(r->packed);
+    bugle_free(r);
+    return ret;
+}
+
+bugle_io_reader *bugle_io_reader_block_new(bugle_io_reader *inner)
+{
+    bugle_io_reader *reader;
+    io_block_reader *r;
+    unsigned char header[16];
+    bugle_uint32_t block_size;
+
+    if (bugle_io_read(header, 1, sizeof(header), inner) != sizeof(header)
+        || memcmp(header, IO_BLOCK_MAGIC, 8) != 0
+        || io_get_le32(header + 8) != IO_BLOCK_VERSION)
+        return NULL;
+    block_size = io_get_le32(header + 12);
+    if (block_size == 0 || block_size > IO_BLOCK_MAX_SIZE)
+        return NULL;
+
+    r = BUGLE_ZALLOC(io_block_reader);
+    r->inner = inner;
+    r->block_size = block_size;
+    r->data = BUGLE_NMALLOC(block_size, char);
+    r->packed = BUGLE_NMALLOC(block_size, char);
+
+    reader = BUGLE_MALLOC(bugle_io_reader);
+    reader->fn_read = io_block_read;
+    reader->fn_close = io_block_reader_close;
+    reader->arg = r;
+    return reader;
+}
@@ -0,0 +1,210 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include <string.h>
+#include "platform/types.h"
+#include "common/lz.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+/* Matches stop this many bytes before the end, and none start in the last
+ * LZ_MATCH_LIMIT bytes, so that 4-byte reads never run off the end.
+ */
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12
+/* After this many misses in a row, start skipping ahead faster */
+#define LZ_SKIP_TRIGGER 6
+
+static inline bugle_uint32_t lz_read32(const unsigned char *p)
+{
+    bugle_uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline unsigned int lz_hash(bugle_uint32_t v)
+{
+    return (bugle_uint32_t) (v * 2654435761U) >> (32 - BUGLE_LZ_HASH_BITS);
+}
+
+/* Writes the extra bytes of a length whose nibble was 15 */
+static inline unsigned char *lz_put_length(unsigned char *op, size_t length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char) length;
+    return op;
+}
+
+/* Emits one pair. A match_length of 0 marks the final, literal-only pair.
+ * Returns NULL if it does not fit.
+ */
+static unsigned char *lz_put_sequence(unsigned char *op, unsigned char *oend,
+                                      const unsigned char *literals, size_t literal_length,
+                                      size_t offset, size_t match_length)
+{
+    unsigned char *token;
+    size_t extra;
+
+    if ((size_t) (oend - op) < 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1)
+        return NULL;
+    token = op++;
+    if (literal_length >= 15)
+    {
+        *token = 15 << 4;
+        op = lz_put_length(op, literal_length - 15);
+    }
+    else
+        *token = (unsigned char) (literal_length << 4);
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+
+    if (match_length == 0)
+        return op;
+    *op++ = (unsigned char) (offset & 0xff);
+    *op++ = (unsigned char) (offset >> 8);
+    extra = match_length - LZ_MIN_MATCH;
+    if (extra >= 15)
+    {
+        *token |= 15;
+        op = lz_put_length(op, extra - 15);
+    }
+    else
+        *token |= (unsigned char) extra;
+    return op;
+}
+
+size_t bugle_lz_compress(bugle_lz_state *state, const void *src, size_t n,
+                         void *dst, size_t capacity)
+{
+    const unsigned char *in = (const unsigned char *) src;
+    const unsigned char *ip = in, *anchor = in, *end = in + n;
+    const unsigned char *match_limit = n > LZ_MATCH_LIMIT ? end - LZ_MATCH_LIMIT : in;
+    const unsigned char *extend_limit = end - LZ_LAST_LITERALS;
+    unsigned char *op = (unsigned char *) dst, *oend = op + capacity;
+    unsigned int misses = 0;
+
+    memset(state->table, 0, sizeof(state->table));
+    while (ip < match_limit)
+    {
+        const unsigned char *ref;
+        bugle_uint32_t v;
+        unsigned int h;
+        size_t length;
+
+        v = lz_read32(ip);
+        h = lz_hash(v);
+        ref = in + state->table[h];
+        state->table[h] = (bugle_uint32_t) (ip - in);
+        if (ref >= ip || ip - ref > LZ_MAX_OFFSET || lz_read32(ref) != v)
+        {
+            ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+            continue;
+        }
+        misses = 0;
+
+        length = LZ_MIN_MATCH;
+        while (ip + length < extend_limit && ip[length] == ref[length])
+            length++;
+        while (ip > anchor && ref > in && ip[-1] == ref[-1])
+        {
+            ip--;
+            ref--;
+            length++;
+        }
+
+        op = lz_put_sequence(op, oend, anchor, ip - anchor, ip - ref, length);
+        if (op == NULL)
+            return 0;
+        ip += length;
+        anchor = ip;
+    }
+
+    op = lz_put_sequence(op, oend, anchor, end - anchor, 0, 0);
+    if (op == NULL)
+        return 0;
+    return op - (unsigned char *) dst;
+}
+
+/* Reads the extra bytes of a length whose nibble was 15. Returns false if
+ * the input runs out.
+ */
+static inline int lz_get_length(const unsigned char **ip, const unsigned char *iend, size_t *length)
+{
+    unsigned char b;
+
+    do
+    {
+        if (*ip >= iend)
+            return 0;
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return 1;
+}
+
+size_t bugle_lz_decompress(const void *src, size_t n, void *dst, size_t capacity)
+{
+    const unsigned char *ip = (const unsigned char *) src, *iend = ip + n;
+    unsigned char *out = (unsigned char *) dst, *op = out, *oend = out + capacity;
+
+    while (ip < iend)
+    {
+        unsigned char token;
+        size_t length, offset;
+        const unsigned char *ref;
+
+        token = *ip++;
+        length = token >> 4;
+        if (length == 15 && !lz_get_length(&ip, iend, &length))
+            return (size_t) -1;
+        if (length > (size_t) (iend - ip) || length > (size_t) (oend - op))
+            return (size_t) -1;
+        memcpy(op, ip, length);
+        ip += length;
+        op += length;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return (size_t) -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        length = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15 && !lz_get_length(&ip, iend, &length))
+            return (size_t) -1;
+        if (offset == 0 || offset > (size_t) (op - out) || length > (size_t) (oend - op))
+            return (size_t) -1;
+        ref = op - offset;
+        if (offset >= length)
+        {
+            memcpy(op, ref, length);
+            op += length;
+        }
+        else
+            while (length--)
+                *op++ = *ref++;
+    }
+    return op - out;
+}
@@ -0,0 +1,62 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* A small, fast LZ77 codec for independent blocks, used by the block
+ * compression writer in common/io.c. It favours speed over ratio, which
+ * suits the highly repetitive text of call traces.
+ *
+ * The compressed form is a sequence of (literals, match) pairs. Each starts
+ * with a token byte whose high nibble is the literal count and low nibble is
+ * the match length minus LZ_MIN_MATCH; a nibble of 15 is followed by bytes
+ * that are added on, ending with one that is less than 255. Then come the
+ * literals, a 16-bit little-endian match offset and any extra match length
+ * bytes. The final pair has only literals.
+ */
+
+#ifndef BUGLE_COMMON_LZ_H
+#define BUGLE_COMMON_LZ_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stddef.h>
+#include "platform/types.h"
+
+#define BUGLE_LZ_HASH_BITS 13
+
+/* Space needed for the compressed form of n bytes, in the worst case */
+#define BUGLE_LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+/* Scratch space for compression, to avoid putting it on the stack */
+typedef struct
+{
+    bugle_uint32_t table[1 << BUGLE_LZ_HASH_BITS];
+} bugle_lz_state;
+
+/* Compresses n bytes from src into dst, which holds capacity bytes. Returns
+ * the compressed size, or 0 if it would not fit.
+ */
+size_t bugle_lz_compress(bugle_lz_state *state, const void *src, size_t n,
+                         void *dst, size_t capacity);
+
+/* Decompresses n bytes from src into dst, which holds capacity bytes.
+ * Returns the decompressed size, or (size_t) -1 if the input is corrupt or
+ * would overflow dst.
+ */
+size_t bugle_lz_decompress(const void *src, size_t n, void *dst, size_t capacity);
+
+#endif /* !BUGLE_COMMON_LZ_H */
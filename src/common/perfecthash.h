@@ -0,0 +1,77 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2013  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Lookup in minimal perfect hash tables of names, which are generated by
+ * budgie and gengl for the fixed sets of functions, types and extensions.
+ *
+ * A table for n keys consists of two arrays of n ints. The key is hashed
+ * with seed 0 to select a displacement d = displace[h % n]. If d is
+ * negative, the key belongs in slot -d - 1, otherwise it belongs in slot
+ * bugle_perfect_hash(key, d) % n. The ID of the key in that slot is
+ * index[slot]. Names that are not in the set map to an arbitrary ID, so the
+ * caller must compare the name of the ID with the key.
+ *
+ * The hash function must match perfect_hash in budgie/budgie.cpp and in
+ * gengl/genglxml.py exactly.
+ */
+
+#ifndef BUGLE_COMMON_PERFECTHASH_H
+#define BUGLE_COMMON_PERFECTHASH_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+/* 32-bit FNV-1a with the seed mixed into the offset basis, followed by the
+ * MurmurHash3 finaliser.
+ */
+static inline unsigned long bugle_perfect_hash(const char *key, unsigned long seed)
+{
+    unsigned long h;
+    const unsigned char *ch;
+
+    h = (2166136261UL ^ seed) & 0xffffffffUL;
+    for (ch = (const unsigned char *) key; *ch; ch++)
+    {
+        h ^= *ch;
+        h = (h * 16777619UL) & 0xffffffffUL;
+    }
+    h ^= h >> 16;
+    h = (h * 0x85ebca6bUL) & 0xffffffffUL;
+    h ^= h >> 13;
+    h = (h * 0xc2b2ae35UL) & 0xffffffffUL;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Returns the candidate ID for key, or -1 if the table is empty */
+static inline int bugle_perfect_hash_lookup(const char *key,
+                                            const int *displace,
+                                            const int *index,
+                                            int n)
+{
+    int d;
+
+    if (n <= 0) return -1;
+    d = displace[bugle_perfect_hash(key, 0) % (unsigned long) n];
+    if (d < 0)
+        return index[-d - 1];
+    else
+        return index[bugle_perfect_hash(key, d) % (unsigned long) n];
+}
+
+#endif /* !BUGLE_COMMON_PERFECTHASH_H */
@@ -0,0 +1,69 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* File format written by the tracebin filter-set and read by
+ * bugle-tracedump. Everything is in the native byte order of the capturing
+ * machine, and the file can only be decoded by a build with the same type
+ * tables.
+ *
+ * The file starts with a bugle_tracebin_header. It is followed by records,
+ * each of which is a uint32 giving the number of bytes that follow, a uint8
+ * record type, and the body. For BUGLE_TRACEBIN_RECORD_CALL the body is
+ *
+ *   uint32 function ID
+ *   uint64 thread ID
+ *   uint64 timestamp in nanoseconds (arbitrary origin)
+ *   uint8  non-zero if there is a return value
+ *   the arguments, then the return value if any, each written by
+ *   budgie_serialize_any_type
+ *
+ * BUGLE_TRACEBIN_RECORD_PENDING marks a call that had not returned when the
+ * file was written (by the flightrec filter-set). Its body is just the
+ * function ID, thread ID and timestamp, as above.
+ *
+ * Readers should skip records of unknown type.
+ */
+
+#ifndef BUGLE_COMMON_TRACEBIN_H
+#define BUGLE_COMMON_TRACEBIN_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "platform/types.h"
+
+#define BUGLE_TRACEBIN_MAGIC "BGLTRACE"
+#define BUGLE_TRACEBIN_VERSION 1
+#define BUGLE_TRACEBIN_BYTE_ORDER 0x01020304
+
+enum
+{
+    BUGLE_TRACEBIN_RECORD_CALL = 1,
+    BUGLE_TRACEBIN_RECORD_PENDING = 2
+};
+
+typedef struct
+{
+    char magic[8];
+    bugle_uint32_t version;
+    bugle_uint32_t byte_order;
+    bugle_uint32_t pointer_size;
+    bugle_uint32_t function_count;
+    bugle_uint32_t type_count;
+} bugle_tracebin_header;
+
+#endif /* !BUGLE_COMMON_TRACEBIN_H */
@@ -0,0 +1,73 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Frame index written by the trace filter-set alongside the log, and read by
+ * bugle-traceseek. Everything is in the native byte order of the capturing
+ * machine.
+ *
+ * The index file is a bugle_traceindex_header followed by one
+ * bugle_traceindex_frame per completed frame, in increasing frame order.
+ * Since the entries have a fixed size, a reader can binary search them
+ * directly, and a partially written final entry is simply ignored.
+ *
+ * The per-function call counts are kept in a second file, whose name is that
+ * of the index with BUGLE_TRACEINDEX_COUNTS_SUFFIX appended. For each frame
+ * it holds bugle_traceindex_count pairs for the functions that were called,
+ * at the offset and with the length given in the frame entry. Function IDs
+ * are only meaningful to the same build, which is why the header records
+ * the number of functions.
+ */
+
+#ifndef BUGLE_COMMON_TRACEINDEX_H
+#define BUGLE_COMMON_TRACEINDEX_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "platform/types.h"
+
+#define BUGLE_TRACEINDEX_MAGIC "BGLINDEX"
+#define BUGLE_TRACEINDEX_VERSION 1
+#define BUGLE_TRACEINDEX_BYTE_ORDER 0x01020304
+#define BUGLE_TRACEINDEX_COUNTS_SUFFIX ".counts"
+
+typedef struct
+{
+    char magic[8];
+    bugle_uint32_t version;
+    bugle_uint32_t byte_order;
+    bugle_uint32_t function_count;
+    bugle_uint32_t reserved;
+} bugle_traceindex_header;
+
+typedef struct
+{
+    bugle_uint64_t frame;
+    bugle_uint64_t start;           /* Log offset of the first line of the frame */
+    bugle_uint64_t end;             /* Log offset just after the swap that ends it */
+    bugle_uint64_t counts_offset;   /* Byte offset into the counts file */
+    bugle_uint32_t counts_length;   /* Number of bugle_traceindex_count entries */
+    bugle_uint32_t calls;           /* Total calls traced in the frame */
+} bugle_traceindex_frame;
+
+typedef struct
+{
+    bugle_uint32_t function;
+    bugle_uint32_t count;
+} bugle_traceindex_count;
+
+#endif /* !BUGLE_COMMON_TRACEINDEX_H */
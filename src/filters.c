@@ -38,6 +38,7 @@
 #include <budgie/addresses.h>
 #include "budgielib/defines.h"
 #include "platform/threads.h"
+#include "platform/types.h"
 #include "platform/dl.h"
 
 struct filter_set_s
@@ -81,26 +82,79 @@ static linked_list added_filter_sets; /* Those specified in the config, plus dep
  * locking is required because this all happens in the initialisation
  * code.
  *
- * The active_callbacks list contains the list of callback in
- * active filters. Each active_callback list entry points to a
- * filter_catcher in the original filter structure. It is updated by calling
- * compute_active_callbacks, which takes a write lock on
- * active_callbacks_rwlock. The same lock also protects the ->active flag
- * on filter-sets, and the activations_deferred list (see below).
+ * The callbacks in active filters are published as a filter_snapshot,
+ * which holds a compiled filter_chain for each function: a flat array of
+ * {callback, filter-set} pairs, packed so that short chains do not
+ * straddle a cache line. Chains consisting only of the invoke filter are
+ * flagged so that filters_run can call the real function directly. A snapshot is
+ * immutable once published. Readers (filters_run) take no locks and do no
+ * read-modify-write operations: they announce the epoch in which they
+ * started in a per-thread filter_reader record, then load the current
+ * snapshot pointer. Writers (activation changes) hold
+ * active_callbacks_lock, build a complete new snapshot with
+ * compute_active_callbacks, publish it and retire the old one. A retired
+ * snapshot is freed only once no reader announced an epoch early enough
+ * to still be walking it. The same lock protects the ->active flag on
+ * filter-sets.
  *
  * If a filter wishes to activate or deactivate a filter-set (its own
  * or another), it should call bugle_filter_set_activate_deferred
  * or bugle_filter_set_deactivate_deferred. This causes the change to
  * happen only after the current call has completed processing (which
  * removes the need to recompute the active filters while processing
- * them), and also prevents a self-deadlock.
+ * them). The activations_deferred list has its own lock, so that it can
+ * be appended to from inside a callback.
  */
 static linked_list loaded_filters;
 
-/* FIXME: remove the dependence on defines.h */
-static linked_list active_callbacks[FUNCTION_COUNT];
+/* Size of a cache line, for laying out filter chains */
+#define FILTER_CACHE_LINE 64
+
+typedef struct
+{
+    filter_callback callback;
+    filter_set *filter_set_handle;
+} filter_chain_entry;
+
+typedef struct
+{
+    const filter_chain_entry *entries;
+    unsigned int count;
+    bugle_bool invoke_only;   /* The only entry is the invoke filter */
+} filter_chain;
+
+typedef struct filter_snapshot
+{
+    struct filter_snapshot *next_retired;
+    unsigned long retired_epoch;  /* Value of snapshot_epoch when replaced */
+    void *storage;                /* Unaligned allocation holding all the entries */
+    /* FIXME: remove the dependence on defines.h */
+    filter_chain chains[FUNCTION_COUNT];
+} filter_snapshot;
+
+typedef struct
+{
+    /* Epoch in which the outermost filters_run in this thread started, or
+     * 0 if the thread is not in filters_run. Written only by the owning
+     * thread and read by writers.
+     */
+    volatile unsigned long epoch;
+    int depth;
+    linked_list_node *node;   /* Node in filter_readers */
+} filter_reader;
+
+static filter_snapshot * volatile active_snapshot = NULL;
+static volatile unsigned long snapshot_epoch = 1;
+static filter_snapshot *retired_snapshots = NULL;
+static bugle_thread_lock_t active_callbacks_lock;
+
+static linked_list filter_readers;
+static bugle_thread_lock_t filter_readers_lock;
+static bugle_thread_key_t filter_reader_key;
+
 static linked_list activations_deferred;
-static bugle_thread_rwlock_t active_callbacks_rwlock;
+static volatile unsigned long activations_pending = 0;
+static bugle_thread_lock_t activations_lock;
 
 /* hash tables of linked lists of strings; A is the key, B is the linked list element */
 static hash_table filter_orders;           /* A is called after B */
@@ -263,15 +317,135 @@ static void filter_set_free(filter_set *handle)
     }
 }
 
+static void filter_snapshot_free(filter_snapshot *snapshot)
+{
+    bugle_free(snapshot->storage);
+    bugle_free(snapshot);
+}
+
+/* Frees retired snapshots that no reader can still be walking. The caller
+ * must hold active_callbacks_lock.
+ */
+static void reclaim_snapshots(void)
+{
+    linked_list_node *i;
+    filter_reader *reader;
+    filter_snapshot **prev, *cur;
+    unsigned long oldest = 0, epoch;
+
+    /* Find the oldest epoch in which a reader is still running */
+    bugle_thread_lock_lock(&filter_readers_lock);
+    for (i = bugle_list_head(&filter_readers); i; i = bugle_list_next(i))
+    {
+        reader = (filter_reader *) bugle_list_data(i);
+        epoch = bugle_atomic_load(&reader->epoch);
+        if (epoch != 0 && (oldest == 0 || epoch < oldest))
+            oldest = epoch;
+    }
+    bugle_thread_lock_unlock(&filter_readers_lock);
+
+    prev = &retired_snapshots;
+    while (*prev)
+    {
+        cur = *prev;
+        /* A reader that started in the epoch in which cur was replaced may
+         * have loaded either snapshot; later readers see the new one.
+         */
+        if (oldest == 0 || cur->retired_epoch < oldest)
+        {
+            *prev = cur->next_retired;
+            filter_snapshot_free(cur);
+        }
+        else
+            prev = &cur->next_retired;
+    }
+}
+
+/* Makes snapshot the current snapshot and retires the old one. The caller
+ * must hold active_callbacks_lock.
+ */
+static void publish_snapshot(filter_snapshot *snapshot)
+{
+    filter_snapshot *old;
+
+    old = active_snapshot;
+    bugle_atomic_store(&active_snapshot, snapshot);
+    if (old)
+    {
+        old->retired_epoch = snapshot_epoch;
+        old->next_retired = retired_snapshots;
+        retired_snapshots = old;
+    }
+    bugle_atomic_store(&snapshot_epoch, snapshot_epoch + 1);
+    /* Pairs with the fence in filter_reader_enter: either we see the
+     * reader's epoch, or the reader sees the new snapshot.
+     */
+    bugle_thread_fence();
+    reclaim_snapshots();
+}
+
+static void filter_reader_free(void *data)
+{
+    filter_reader *reader;
+
+    reader = (filter_reader *) data;
+    bugle_thread_lock_lock(&filter_readers_lock);
+    bugle_list_erase(&filter_readers, reader->node);
+    bugle_thread_lock_unlock(&filter_readers_lock);
+    bugle_free(reader);
+}
+
+/* Marks the current thread as reading the current snapshot. Returns the
+ * reader record, which must be passed to filter_reader_leave.
+ */
+static filter_reader *filter_reader_enter(void)
+{
+    filter_reader *reader;
+
+    reader = (filter_reader *) bugle_thread_getspecific(filter_reader_key);
+    if (!reader)
+    {
+        reader = BUGLE_MALLOC(filter_reader);
+        reader->epoch = 0;
+        reader->depth = 0;
+        bugle_thread_lock_lock(&filter_readers_lock);
+        reader->node = bugle_list_append(&filter_readers, reader);
+        bugle_thread_lock_unlock(&filter_readers_lock);
+        bugle_thread_setspecific(filter_reader_key, reader);
+    }
+    if (reader->depth++ == 0)
+    {
+        bugle_atomic_store(&reader->epoch, bugle_atomic_load(&snapshot_epoch));
+        bugle_thread_fence();
+    }
+    return reader;
+}
+
+static void filter_reader_leave(filter_reader *reader)
+{
+    if (--reader->depth == 0)
+        bugle_atomic_store(&reader->epoch, 0UL);
+}
+
 static void filters_shutdown(void)
 {
     linked_list_node *i;
     filter_set *s;
-    budgie_function k;
+    filter_snapshot *snapshot;
 
     bugle_list_clear(&loaded_filters);
-    for (k = 0; k < budgie_function_count(); k++)
-        bugle_list_clear(&active_callbacks[k]);
+    if (active_snapshot)
+    {
+        filter_snapshot_free(active_snapshot);
+        active_snapshot = NULL;
+    }
+    while (retired_snapshots)
+    {
+        snapshot = retired_snapshots;
+        retired_snapshots = snapshot->next_retired;
+        filter_snapshot_free(snapshot);
+    }
+    bugle_list_clear(&activations_deferred);
 
     /* NB: this list runs backwards to obtain the correct shutdown order.
      * Don't try to turn it into a list destructor or the shutdown order
@@ -325,19 +499,21 @@ static void list_free(void *l)
 void filters_initialise(void)
 {
     const char *libdir;
-    budgie_function f;
 
-    bugle_thread_rwlock_init(&active_callbacks_rwlock);
+    bugle_thread_lock_init(&active_callbacks_lock);
+    bugle_thread_lock_init(&filter_readers_lock);
+    bugle_thread_lock_init(&activations_lock);
+    bugle_thread_key_create(&filter_reader_key, filter_reader_free);
     bugle_list_init(&filter_sets, bugle_free);
     bugle_list_init(&added_filter_sets, NULL);
     bugle_list_init(&loaded_filters, NULL);
-    for (f = 0; f < budgie_function_count(); f++)
-        bugle_list_init(&active_callbacks[f], NULL);
+    bugle_list_init(&filter_readers, NULL);
     bugle_list_init(&activations_deferred, bugle_free);
     bugle_hash_init(&filter_orders, list_free);
     bugle_hash_init(&filter_set_dependencies, list_free);
     bugle_hash_init(&filter_set_orders, list_free);
     bugle_call_class = bugle_object_class_new(NULL);
+    bugle_object_class_set_pooled(bugle_call_class);
 
     libdir = getenv("BUGLE_FILTER_DIR");
     if (!libdir) libdir = PKGLIBDIR;
@@ -492,7 +668,7 @@ bugle_bool filter_set_variable(filter_set *handle, const char *name, const char
     return BUGLE_FALSE;
 }
 
-/* Every function that calls this one must hold active_callbacks_rwlock
+/* Every function that calls this one must hold active_callbacks_lock
  * (or be single-threaded startup code), and must arrange for
  * compute_active_callbacks to be run afterwards.
  */
@@ -587,45 +763,44 @@ static void load_filter_sets(void)
 
 void filter_set_activate(filter_set *handle)
 {
-    bugle_thread_rwlock_wrlock(&active_callbacks_rwlock);
+    bugle_thread_lock_lock(&active_callbacks_lock);
     filter_set_activate_nolock(handle);
     compute_active_callbacks();
-    bugle_thread_rwlock_unlock(&active_callbacks_rwlock);
+    bugle_thread_lock_unlock(&active_callbacks_lock);
 }
 
 void filter_set_deactivate(filter_set *handle)
 {
-    bugle_thread_rwlock_wrlock(&active_callbacks_rwlock);
+    bugle_thread_lock_lock(&active_callbacks_lock);
     filter_set_deactivate_nolock(handle);
     compute_active_callbacks();
-    bugle_thread_rwlock_unlock(&active_callbacks_rwlock);
+    bugle_thread_lock_unlock(&active_callbacks_lock);
 }
 
-/* Note: these should be called only from within a callback, in which
- * case the lock is already held.
- */
-void bugle_filter_set_activate_deferred(filter_set *handle)
+static void filter_set_defer(filter_set *handle, bugle_bool active)
 {
     filter_set_activation *activation = BUGLE_MALLOC(filter_set_activation);
 
     activation->set = handle;
-    activation->active = BUGLE_TRUE;
+    activation->active = active;
 
-    bugle_thread_rwlock_wrlock(&active_callbacks_rwlock);
+    bugle_thread_lock_lock(&activations_lock);
     bugle_list_append(&activations_deferred, activation);
-    bugle_thread_rwlock_unlock(&active_callbacks_rwlock);
+    bugle_atomic_store(&activations_pending, 1UL);
+    bugle_thread_lock_unlock(&activations_lock);
 }
 
-void bugle_filter_set_deactivate_deferred(filter_set *handle)
+/* Note: these are intended to be called from within a callback. The
+ * change takes effect once the current call has been processed.
+ */
+void bugle_filter_set_activate_deferred(filter_set *handle)
 {
-    filter_set_activation *activation = BUGLE_MALLOC(filter_set_activation);
-
-    activation->set = handle;
-    activation->active = BUGLE_FALSE;
+    filter_set_defer(handle, BUGLE_TRUE);
+}
 
-    bugle_thread_rwlock_wrlock(&active_callbacks_rwlock);
-    bugle_list_append(&activations_deferred, activation);
-    bugle_thread_rwlock_unlock(&active_callbacks_rwlock);
+void bugle_filter_set_deactivate_deferred(filter_set *handle)
+{
+    filter_set_defer(handle, BUGLE_FALSE);
 }
 
 static const char *filter_get_name(void *f)
@@ -674,28 +849,125 @@ static void set_bypass(void)
     bugle_free(bypass);
 }
 
-/* Note: caller must take mutexes */
+/* Builds and publishes a new snapshot from the current ->active flags.
+ * This is done in two passes over the filters: the first counts the
+ * entries in each chain so that the chains can be laid out in a single
+ * block, and the second fills them in.
+ * Note: caller must hold active_callbacks_lock
+ */
 static void compute_active_callbacks(void)
 {
+    const size_t per_line = FILTER_CACHE_LINE / sizeof(filter_chain_entry);
     linked_list_node *i, *j;
     filter *cur;
     budgie_function func;
     filter_catcher *catcher;
+    filter_snapshot *snapshot;
+    filter_chain_entry *base, *entry;
+    size_t *offsets;
+    size_t total = 0, count, line_left;
+
+    snapshot = BUGLE_MALLOC(filter_snapshot);
+    snapshot->next_retired = NULL;
+    snapshot->retired_epoch = 0;
+    for (func = 0; func < budgie_function_count(); func++)
+    {
+        snapshot->chains[func].entries = NULL;
+        snapshot->chains[func].count = 0;
+        snapshot->chains[func].invoke_only = BUGLE_FALSE;
+    }
 
-    /* Clear the old active_callback lists */
+    for (i = bugle_list_head(&loaded_filters); i; i = bugle_list_next(i))
+    {
+        cur = (filter *) bugle_list_data(i);
+        for (j = bugle_list_head(&cur->callbacks); j; j = bugle_list_next(j))
+        {
+            catcher = (filter_catcher *) bugle_list_data(j);
+            if (cur->parent->active || catcher->inactive)
+                snapshot->chains[catcher->function].count++;
+        }
+    }
+
+    /* Assign offsets (in entries) from the start of the aligned block. A
+     * chain that fits in a cache line is not allowed to straddle one, and
+     * longer chains start on a line boundary.
+     */
+    offsets = BUGLE_NMALLOC(budgie_function_count(), size_t);
     for (func = 0; func < budgie_function_count(); func++)
-        bugle_list_clear(&active_callbacks[func]);
+    {
+        count = snapshot->chains[func].count;
+        line_left = per_line - total % per_line;
+        if (count > line_left && line_left != per_line)
+            total += line_left;
+        offsets[func] = total;
+        total += count;
+    }
+
+    snapshot->storage = bugle_malloc(total * sizeof(filter_chain_entry) + FILTER_CACHE_LINE);
+    base = (filter_chain_entry *)
+        (((bugle_uintptr_t) snapshot->storage + FILTER_CACHE_LINE - 1)
+         & ~(bugle_uintptr_t) (FILTER_CACHE_LINE - 1));
+    for (func = 0; func < budgie_function_count(); func++)
+    {
+        snapshot->chains[func].entries = base + offsets[func];
+        snapshot->chains[func].count = 0;
+    }
+    bugle_free(offsets);
 
     for (i = bugle_list_head(&loaded_filters); i; i = bugle_list_next(i))
     {
         cur = (filter *) bugle_list_data(i);
         for (j = bugle_list_tail(&cur->callbacks); j; j = bugle_list_prev(j))
         {
+            filter_chain *chain;
+
             catcher = (filter_catcher *) bugle_list_data(j);
             if (cur->parent->active || catcher->inactive)
-                bugle_list_append(&active_callbacks[catcher->function], catcher);
+            {
+                chain = &snapshot->chains[catcher->function];
+                entry = (filter_chain_entry *) chain->entries + chain->count;
+                entry->callback = catcher->callback;
+                entry->filter_set_handle = cur->parent;
+                chain->count++;
+                chain->invoke_only = chain->count == 1 && strcmp(cur->name, "invoke") == 0;
+            }
+        }
+    }
+    publish_snapshot(snapshot);
+}
+
+/* Applies activations requested with bugle_filter_set_activate_deferred
+ * or bugle_filter_set_deactivate_deferred.
+ */
+static void process_deferred_activations(void)
+{
+    linked_list pending;
+    linked_list_node *i;
+    filter_set_activation *activation;
+
+    bugle_thread_lock_lock(&active_callbacks_lock);
+
+    bugle_thread_lock_lock(&activations_lock);
+    pending = activations_deferred;
+    bugle_list_init(&activations_deferred, bugle_free);
+    bugle_atomic_store(&activations_pending, 0UL);
+    bugle_thread_lock_unlock(&activations_lock);
+
+    if (bugle_list_head(&pending))
+    {
+        for (i = bugle_list_head(&pending); i; i = bugle_list_next(i))
+        {
+            activation = (filter_set_activation *) bugle_list_data(i);
+            if (activation->active)
+                filter_set_activate_nolock(activation->set);
+            else
+                filter_set_deactivate_nolock(activation->set);
         }
+        compute_active_callbacks();
     }
+    bugle_list_clear(&pending);
+
+    bugle_thread_lock_unlock(&active_callbacks_lock);
 }
 
 void filters_finalise(void)
@@ -703,43 +975,45 @@ void filters_finalise(void)
     load_filter_sets();
     filter_compute_order();
     set_bypass();
+    bugle_thread_lock_lock(&active_callbacks_lock);
     compute_active_callbacks();
+    bugle_thread_lock_unlock(&active_callbacks_lock);
 }
 
 void filters_run(function_call *call)
 {
-    linked_list_node *i;
-    filter_catcher *cur;
+    const filter_chain *chain;
+    const filter_chain_entry *cur, *end;
     callback_data data;
+    filter_reader *reader;
+    const filter_snapshot *snapshot;
 
-    bugle_thread_rwlock_rdlock(&active_callbacks_rwlock);
+    reader = filter_reader_enter();
+    snapshot = bugle_atomic_load(&active_snapshot);
+    chain = &snapshot->chains[call->generic.id];
 
-    data.call_object = bugle_object_new(bugle_call_class, NULL, BUGLE_TRUE);
-    for (i = bugle_list_head(&active_callbacks[call->generic.id]); i; i = bugle_list_next(i))
+    if (chain->invoke_only)
     {
-        cur = (filter_catcher *) bugle_list_data(i);
-        data.filter_set_handle = cur->parent->parent;
-        if (!(*cur->callback)(call, &data)) break;
+        /* Nothing else is interested, so skip the call object */
+        budgie_invoke(call);
     }
-    bugle_object_free(data.call_object);
-
-    /* Process any pending activations */
-    if (bugle_list_head(&activations_deferred))
+    else
     {
-        /* Upgrade to a write lock. Somebody else make get in between the
-         * unlock and the wrlock, but at worst they will do our work for us.
-         */
-        bugle_thread_rwlock_unlock(&active_callbacks_rwlock);
-        bugle_thread_rwlock_wrlock(&active_callbacks_rwlock);
-        while (bugle_list_head(&activations_deferred))
+        data.call_object = bugle_object_new(bugle_call_class, NULL, BUGLE_TRUE);
+        end = chain->entries + chain->count;
+        for (cur = chain->entries; cur != end; cur++)
         {
-            i = bugle_list_head(&activations_deferred);
-            filter_set_activate_nolock((filter_set *) bugle_list_data(i));
-            bugle_list_erase(&activations_deferred, i);
+            data.filter_set_handle = cur->filter_set_handle;
+            if (!(*cur->callback)(call, &data)) break;
         }
-        compute_active_callbacks();
+        bugle_object_free(data.call_object);
     }
-    bugle_thread_rwlock_unlock(&active_callbacks_rwlock);
+
+    filter_reader_leave(reader);
+
+    /* Process any pending activations */
+    if (bugle_atomic_load(&activations_pending))
+        process_deferred_activations();
 }
 
 filter_set *bugle_filter_set_new(const filter_set_info *info)
@@ -34,38 +34,60 @@
 #include <bugle/gl/glsl.h>
 #include <bugle/gl/glbeginend.h>
 #include <bugle/gl/glextensions.h>
+#include <bugle/gl/gldisplaylist.h>
+#include <bugle/gl/glbuffershadow.h>
 #include <bugle/filters.h>
 #include <bugle/log.h>
 #include <bugle/apireflect.h>
 #include <bugle/memory.h>
+#include <bugle/objects.h>
+#include <bugle/hashtable.h>
 #include "platform/threads.h"
+#include "platform/process.h"
 #include <budgie/addresses.h>
 #include <budgie/types.h>
 #include <budgie/reflect.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 #ifdef GL_VERSION_1_1
-static void checks_texture_complete_fail(int unit, GLenum target, const char *reason)
+/* The outcome of checking a texture for completeness */
+typedef struct
+{
+    GLenum face;            /* target or cube map face where a problem was found */
+    const char *reason;     /* NULL if the texture is complete */
+} checks_texture_state;
+
+static void checks_texture_complete_fail(checks_texture_state *state, GLenum face, const char *reason)
+{
+    state->face = face;
+    state->reason = reason;
+}
+
+static void checks_texture_report(int unit, const checks_texture_state *state)
 {
     const char *target_name;
 
-    target_name = bugle_api_enum_name(target, BUGLE_API_EXTENSION_BLOCK_GL);
+    target_name = bugle_api_enum_name(state->face, BUGLE_API_EXTENSION_BLOCK_GL);
     if (!target_name) target_name = "<unknown target>";
     bugle_log_printf("checks", "texture", BUGLE_LOG_NOTICE,
                      "GL_TEXTURE%d / %s: incomplete texture (%s)",
-                     unit, target_name, reason);
+                     unit, target_name, state->reason);
 }
 
 /* Tests whether the given texture face (bound to the active texture unit)
- * is complete (unit is passed only for error reporting). The face is either
- * a target, or a single face of a cube map. Returns BUGLE_TRUE if complete,
- * BUGLE_FALSE (and a log message) if not.  It assumes that the minification filter
- * requires mipmapping and that base <= max.
+ * is complete. The face is either a target, or a single face of a cube map.
+ * Returns BUGLE_TRUE if complete, BUGLE_FALSE (and the reason in state) if
+ * not. It assumes that the minification filter requires mipmapping and that
+ * base <= max.
  *
  * TODO: handle sampler objects
  * TODO: handle other reasons for incompleteness e.g. linear filtering of integer data
  */
-static bugle_bool checks_texture_face_complete(GLuint unit, GLenum face, int dims, int mip_dims,
-                                               int base, int max, bugle_bool needs_mip)
+static bugle_bool checks_texture_face_complete(GLenum face, int dims, int mip_dims,
+                                               int base, int max, bugle_bool needs_mip,
+                                               checks_texture_state *state)
 {
     GLint sizes[3], border, format;
     int d, lvl;
@@ -81,7 +103,7 @@ static bugle_bool checks_texture_face_complete(GLuint unit, GLenum face, int dim
         CALL(glGetTexLevelParameteriv)(face, base, dim_enum[d], &sizes[d]);
         if (sizes[d] <= 0)
         {
-            checks_texture_complete_fail(unit, face,
+            checks_texture_complete_fail(state, face,
                                          "base level does not have positive dimensions");
             return BUGLE_FALSE;
         }
@@ -109,13 +131,13 @@ static bugle_bool checks_texture_face_complete(GLuint unit, GLenum face, int dim
             CALL(glGetTexLevelParameteriv)(face, lvl, dim_enum[d], &size);
             if (size <= 0)
             {
-                checks_texture_complete_fail(unit, face,
+                checks_texture_complete_fail(state, face,
                                              "missing image in mipmap sequence");
                 return BUGLE_FALSE;
             }
             if (size != sizes[d])
             {
-                checks_texture_complete_fail(unit, face,
+                checks_texture_complete_fail(state, face,
                                              "incorrect size in mipmap sequence");
                 return BUGLE_FALSE;
             }
@@ -124,13 +146,13 @@ static bugle_bool checks_texture_face_complete(GLuint unit, GLenum face, int dim
         CALL(glGetTexLevelParameteriv)(face, lvl, GL_TEXTURE_BORDER, &lborder);
         if (format != lformat)
         {
-            checks_texture_complete_fail(unit, face,
+            checks_texture_complete_fail(state, face,
                                          "inconsistent internal formats");
             return BUGLE_FALSE;
         }
         if (border != lborder)
         {
-            checks_texture_complete_fail(unit, face,
+            checks_texture_complete_fail(state, face,
                                          "inconsistent borders");
             return BUGLE_FALSE;
         }
@@ -139,11 +161,11 @@ static bugle_bool checks_texture_face_complete(GLuint unit, GLenum face, int dim
 }
 
 /* Tests whether the texture bound to the given target is complete, and
- * prints a warning if not. It is assumed that we are already inside
+ * stores the outcome in state. It is assumed that we are already inside
  * bugle_gl_begin_internal_render. The texture unit is a number from 0, not
  * an enumerant.
  */
-static void checks_texture_complete(int unit, GLenum target)
+static void checks_texture_complete(int unit, GLenum target, checks_texture_state *state)
 {
     GLint min_filter, base, max, size, width, height;
     GLint format, lformat, border, lborder;
@@ -153,6 +175,8 @@ static void checks_texture_complete(int unit, GLenum target)
     bugle_bool success = BUGLE_TRUE;
     int i;
 
+    state->face = target;
+    state->reason = NULL;
     if (BUGLE_GL_HAS_EXTENSION_GROUP(GL_ARB_multitexture))
     {
         CALL(glGetIntegerv)(GL_ACTIVE_TEXTURE, &old_unit);
@@ -170,7 +194,7 @@ static void checks_texture_complete(int unit, GLenum target)
     }
 
     if (base > max && needs_mip)
-        checks_texture_complete_fail(unit, target, "base > max");
+        checks_texture_complete_fail(state, target, "base > max");
     else
         switch (target)
         {
@@ -187,25 +211,25 @@ static void checks_texture_complete(int unit, GLenum target)
                 CALL(glGetTexLevelParameteriv)(face, base, GL_TEXTURE_BORDER, &lborder);
                 if (width != height)
                 {
-                    checks_texture_complete_fail(unit, face, "cube map face is not square");
+                    checks_texture_complete_fail(state, face, "cube map face is not square");
                     success = BUGLE_FALSE;
                     break;
                 }
                 if (width != size)
                 {
-                    checks_texture_complete_fail(unit, face, "cube map faces have different sizes");
+                    checks_texture_complete_fail(state, face, "cube map faces have different sizes");
                     success = BUGLE_FALSE;
                     break;
                 }
                 if (format != lformat)
                 {
-                    checks_texture_complete_fail(unit, face, "cube map faces have different internal formats");
+                    checks_texture_complete_fail(state, face, "cube map faces have different internal formats");
                     success = BUGLE_FALSE;
                     break;
                 }
                 if (border != lborder)
                 {
-                    checks_texture_complete_fail(unit, face, "cube map faces have different border widths");
+                    checks_texture_complete_fail(state, face, "cube map faces have different border widths");
                     success = BUGLE_FALSE;
                     break;
                 }
@@ -215,25 +239,25 @@ static void checks_texture_complete(int unit, GLenum target)
             for (i = 0; i < 6; i++)
             {
                 face = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
-                if (!checks_texture_face_complete(unit, face, 2, 2, base, max, needs_mip))
+                if (!checks_texture_face_complete(face, 2, 2, base, max, needs_mip, state))
                     break;
             }
             break;
         case GL_TEXTURE_3D:
-            success = checks_texture_face_complete(unit, target, 3, 3, base, max, needs_mip);
+            success = checks_texture_face_complete(target, 3, 3, base, max, needs_mip, state);
             break;
         case GL_TEXTURE_2D:
         case GL_TEXTURE_RECTANGLE:
-            checks_texture_face_complete(unit, target, 2, 2, base, max, needs_mip);
+            checks_texture_face_complete(target, 2, 2, base, max, needs_mip, state);
             break;
         case GL_TEXTURE_1D:
-            checks_texture_face_complete(unit, target, 1, 1, base, max, needs_mip);
+            checks_texture_face_complete(target, 1, 1, base, max, needs_mip, state);
             break;
         case GL_TEXTURE_2D_ARRAY:
-            checks_texture_face_complete(unit, target, 3, 2, base, max, needs_mip);
+            checks_texture_face_complete(target, 3, 2, base, max, needs_mip, state);
             break;
         case GL_TEXTURE_1D_ARRAY:
-            checks_texture_face_complete(unit, target, 2, 1, base, max, needs_mip);
+            checks_texture_face_complete(target, 2, 1, base, max, needs_mip, state);
             break;
         }
 
@@ -242,101 +266,662 @@ static void checks_texture_complete(int unit, GLenum target)
 }
 #endif /* GL_VERSION_1_1 */
 
-static void checks_completeness(void)
+#ifdef GL_VERSION_2_0
+/* Finding out whether a texture is complete takes dozens of queries, so the
+ * outcome is cached for each texture object and discarded by the calls that
+ * could change it. So that a draw does not need any queries at all, the
+ * current program, the samplers it uses and the textures bound to each unit
+ * are also tracked. Anything that is not known (initially, or after a call
+ * whose effect cannot be followed) is queried the next time it is needed.
+ */
+
+#define CHECKS_TEXTURE_TARGETS 7
+
+typedef struct
 {
-    if (bugle_gl_begin_internal_render())
+    GLenum target;
+    GLenum binding;
+} checks_texture_target;
+
+static const checks_texture_target checks_texture_targets[CHECKS_TEXTURE_TARGETS] =
+{
+    { GL_TEXTURE_1D, GL_TEXTURE_BINDING_1D },
+    { GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D },
+    { GL_TEXTURE_3D, GL_TEXTURE_BINDING_3D },
+    { GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BINDING_CUBE_MAP },
+    { GL_TEXTURE_RECTANGLE, GL_TEXTURE_BINDING_RECTANGLE },
+    { GL_TEXTURE_1D_ARRAY, GL_TEXTURE_BINDING_1D_ARRAY },
+    { GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BINDING_2D_ARRAY }
+};
+
+/* A sampler uniform in a program. Only the first element of an array
+ * is checked.
+ */
+typedef struct
+{
+    int target;                 /* index into checks_texture_targets */
+    GLint location;
+    GLint unit;
+} checks_sampler;
+
+typedef struct
+{
+    GLint count;
+    checks_sampler *samplers;
+} checks_program_samplers;
+
+/* Shared by contexts that share objects */
+typedef struct
+{
+    bugle_thread_lock_t mutex;
+    hashptr_table textures;     /* checks_texture_state, indexed by texture id */
+    hashptr_table programs;     /* checks_program_samplers, indexed by program id */
+} checks_texture_cache;
+
+/* Per context, so no lock is needed */
+typedef struct
+{
+    bugle_bool program_known;
+    GLuint program;
+    bugle_bool active_known;
+    GLint active_unit;          /* from 0, not an enumerant */
+    hashptr_table bindings;     /* texture + 1, indexed by checks_texture_slot */
+    /* The default textures belong to the context rather than the namespace */
+    bugle_bool defaults_known[CHECKS_TEXTURE_TARGETS];
+    checks_texture_state defaults[CHECKS_TEXTURE_TARGETS];
+} checks_texture_context;
+
+static object_view checks_texture_cache_view;
+static object_view checks_texture_context_view;
+
+static void checks_program_samplers_free(void *data)
+{
+    checks_program_samplers *program;
+
+    program = (checks_program_samplers *) data;
+    bugle_free(program->samplers);
+    bugle_free(program);
+}
+
+static void checks_texture_cache_init(const void *key, void *data)
+{
+    checks_texture_cache *cache;
+
+    cache = (checks_texture_cache *) data;
+    bugle_thread_lock_init(&cache->mutex);
+    bugle_hashptr_init(&cache->textures, bugle_free);
+    bugle_hashptr_init(&cache->programs, checks_program_samplers_free);
+}
+
+static void checks_texture_cache_clear(void *data)
+{
+    checks_texture_cache *cache;
+
+    cache = (checks_texture_cache *) data;
+    bugle_thread_lock_destroy(&cache->mutex);
+    bugle_hashptr_clear(&cache->textures);
+    bugle_hashptr_clear(&cache->programs);
+}
+
+static void checks_texture_context_init(const void *key, void *data)
+{
+    checks_texture_context *ctx;
+
+    ctx = (checks_texture_context *) data;
+    memset(ctx, 0, sizeof(*ctx));
+    bugle_hashptr_init(&ctx->bindings, NULL);
+}
+
+static void checks_texture_context_clear(void *data)
+{
+    checks_texture_context *ctx;
+
+    ctx = (checks_texture_context *) data;
+    bugle_hashptr_clear(&ctx->bindings);
+}
+
+static int checks_texture_target_index(GLenum target)
+{
+    int i;
+
+    if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+        target = GL_TEXTURE_CUBE_MAP;
+    for (i = 0; i < CHECKS_TEXTURE_TARGETS; i++)
+        if (checks_texture_targets[i].target == target)
+            return i;
+    return -1;
+}
+
+/* Returns the target index for a sampler type, or -1 if it is not a sampler
+ * type that is checked.
+ */
+static int checks_sampler_target_index(GLenum type)
+{
+    switch (type)
     {
-        /* FIXME: should unify this code with glstate.c */
-        GLint num_textures = 1;
-        if (BUGLE_FALSE)
-            (void) 0; /* makes sure the "else if" works regardless of ifdefs */
-#if GL_ES_VERSION_2_0 || GL_VERSION_2_0
-        else if (BUGLE_GL_HAS_EXTENSION_GROUP(EXTGROUP_texunits))
-            CALL(glGetIntegerv)(GL_MAX_TEXTURE_IMAGE_UNITS, &num_textures);
-#endif
-#if GL_VERSION_ES_CM_1_0 || GL_VERSION_1_3
-        else if (BUGLE_GL_HAS_EXTENSION_GROUP(GL_ARB_multitexture))
-            CALL(glGetIntegerv)(GL_MAX_TEXTURE_UNITS, &num_textures);
-#endif
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_1D_SHADOW:
+        return checks_texture_target_index(GL_TEXTURE_1D);
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_2D_SHADOW:
+        return checks_texture_target_index(GL_TEXTURE_2D);
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_CUBE_SHADOW:
+        return checks_texture_target_index(GL_TEXTURE_CUBE_MAP);
+    case GL_SAMPLER_2D_RECT:
+    case GL_SAMPLER_2D_RECT_SHADOW:
+        return checks_texture_target_index(GL_TEXTURE_RECTANGLE);
+    case GL_SAMPLER_3D:
+        return checks_texture_target_index(GL_TEXTURE_3D);
+    case GL_SAMPLER_1D_ARRAY:
+    case GL_SAMPLER_1D_ARRAY_SHADOW:
+        return checks_texture_target_index(GL_TEXTURE_1D_ARRAY);
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+        return checks_texture_target_index(GL_TEXTURE_2D_ARRAY);
+    default:
+        return -1;
+    }
+}
 
-#if GL_ES_VERSION_2_0 || GL_VERSION_2_0
-        if (BUGLE_GL_HAS_EXTENSION_GROUP(GL_ARB_shader_objects))
+/* Key into checks_texture_context::bindings. Zero is not a valid key. */
+static size_t checks_texture_slot(GLint unit, int target)
+{
+    return (size_t) unit * CHECKS_TEXTURE_TARGETS + target + 1;
+}
+
+/* Starts an internal render the first time a draw needs to query
+ * something. Returns BUGLE_FALSE if queries are not possible.
+ */
+static bugle_bool checks_texture_queries(bugle_bool *internal)
+{
+    if (!*internal)
+        *internal = bugle_gl_begin_internal_render();
+    return *internal;
+}
+
+/* Returns the texture bound to a target on a unit, or -1 if it cannot be
+ * determined.
+ */
+static GLint checks_texture_bound(checks_texture_context *ctx, GLint unit, int target,
+                                  bugle_bool *internal)
+{
+    size_t slot;
+    void *value;
+    GLint old_unit, texture = 0;
+
+    if (unit < 0)
+        return -1;
+    slot = checks_texture_slot(unit, target);
+    value = bugle_hashptr_get_int(&ctx->bindings, slot);
+    if (value)
+        return (GLint) ((size_t) value - 1);
+
+    if (!checks_texture_queries(internal))
+        return -1;
+    CALL(glGetIntegerv)(GL_ACTIVE_TEXTURE, &old_unit);
+    CALL(glActiveTexture)(GL_TEXTURE0 + unit);
+    CALL(glGetIntegerv)(checks_texture_targets[target].binding, &texture);
+    CALL(glActiveTexture)(old_unit);
+    bugle_hashptr_set_int(&ctx->bindings, slot, (void *) (size_t) (texture + 1));
+    return texture;
+}
+
+/* Queries the samplers used by a program. Must be called with the cache
+ * lock held and inside an internal render.
+ */
+static checks_program_samplers *checks_program_samplers_query(checks_texture_cache *cache, GLuint program)
+{
+    checks_program_samplers *ans;
+    GLint num_uniforms, u;
+    GLenum type;
+    GLint size, length;
+    char *name;
+    int target;
+
+    ans = BUGLE_MALLOC(checks_program_samplers);
+    ans->count = 0;
+    ans->samplers = NULL;
+    num_uniforms = 0;
+    length = 0;
+    bugle_glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    bugle_glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+    if (num_uniforms > 0)
+    {
+        name = BUGLE_NMALLOC(length + 1, char);
+        ans->samplers = BUGLE_NMALLOC(num_uniforms, checks_sampler);
+        for (u = 0; u < num_uniforms; u++)
         {
-            GLuint program;
-            GLint num_uniforms, u;
-            GLenum type;
-            GLint size, length, loc, unit;
-            char *name;
-            GLint target;
-            program = bugle_gl_get_current_program();
-            if (program)
+            bugle_glGetActiveUniform(program, u, length + 1, NULL, &size, &type, name);
+            target = checks_sampler_target_index(type);
+            if (target >= 0)
             {
-                bugle_glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &num_uniforms);
-                bugle_glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
-                name = BUGLE_NMALLOC(length + 1, char);
-                for (u = 0; u < num_uniforms; u++)
-                {
-                    bugle_glGetActiveUniform(program, u, length + 1, NULL, &size, &type, name);
-                    target = 0;
-                    switch (type)
-                    {
-#if BUGLE_GLTYPE_GL
-                    case GL_SAMPLER_1D:
-                    case GL_SAMPLER_1D_SHADOW:
-                        target = GL_TEXTURE_1D;
-                        break;
-#endif
-                    case GL_SAMPLER_2D:
-#if BUGLE_GLTYPE_GL
-                    case GL_SAMPLER_2D_SHADOW:
-#endif
-                        target = GL_TEXTURE_2D;
-                        break;
-                    case GL_SAMPLER_CUBE:
-#if BUGLE_GLTYPE_GL
-                    case GL_SAMPLER_CUBE_SHADOW:
-#endif
-                        target = GL_TEXTURE_CUBE_MAP;
-                        break;
-#if BUGLE_GLTYPE_GL
-                    case GL_SAMPLER_2D_RECT:
-                    case GL_SAMPLER_2D_RECT_SHADOW:
-                        target = GL_TEXTURE_RECTANGLE;
-                        break;
-#endif
-#if BUGLE_GLTYPE_GL
-                    case GL_SAMPLER_3D:
-                        target = GL_TEXTURE_3D;
-                        break;
-#endif
-#if BUGLE_GLTYPE_GL
-                    case GL_SAMPLER_1D_ARRAY:
-                    case GL_SAMPLER_1D_ARRAY_SHADOW:
-                        target = GL_TEXTURE_1D_ARRAY;
-                        break;
-                    case GL_SAMPLER_2D_ARRAY:
-                    case GL_SAMPLER_2D_ARRAY_SHADOW:
-                        target = GL_TEXTURE_2D_ARRAY;
-                        break;
-#endif
-                    }
-                    if (target)
-                    {
-                        loc = bugle_glGetUniformLocation(program, name);
-                        bugle_glGetUniformiv(program, loc, &unit);
-#ifdef GL_VERSION_2_0 /* not because it doesn't apply to ES, but it can't currently be checked */
-                        checks_texture_complete(unit, target);
-#endif
-                    }
-                }
-                bugle_free(name);
+                checks_sampler *s;
+
+                s = &ans->samplers[ans->count++];
+                s->target = target;
+                s->location = bugle_glGetUniformLocation(program, name);
+                s->unit = -1;
+                bugle_glGetUniformiv(program, s->location, &s->unit);
             }
         }
-#endif /* GLES2 || GL2 */
+        bugle_free(name);
+    }
+    bugle_hashptr_set_int(&cache->programs, program, ans);
+    return ans;
+}
+
+/* Checks the texture used by one sampler, querying its completeness only if
+ * it is not already known, or always if fresh is set. Returns BUGLE_TRUE if
+ * the texture is incomplete, and reports it if fresh is set. Must be called
+ * with the cache lock held.
+ */
+static bugle_bool checks_sampler_complete(checks_texture_context *ctx, checks_texture_cache *cache,
+                                          const checks_sampler *s, bugle_bool fresh,
+                                          bugle_bool *internal)
+{
+    GLint texture;
+    checks_texture_state *state;
+
+    texture = checks_texture_bound(ctx, s->unit, s->target, internal);
+    if (texture < 0)
+        return BUGLE_FALSE;
+    if (fresh && texture != 0)
+        bugle_hashptr_erase_int(&cache->textures, texture);
+    if (texture == 0)
+        state = ctx->defaults_known[s->target] ? &ctx->defaults[s->target] : NULL;
+    else
+        state = (checks_texture_state *) bugle_hashptr_get_int(&cache->textures, texture);
+
+    if (!state)
+    {
+        if (!checks_texture_queries(internal))
+            return BUGLE_FALSE;
+        if (texture == 0)
+        {
+            state = &ctx->defaults[s->target];
+            ctx->defaults_known[s->target] = BUGLE_TRUE;
+        }
+        else
+        {
+            state = BUGLE_MALLOC(checks_texture_state);
+            bugle_hashptr_set_int(&cache->textures, texture, state);
+        }
+        checks_texture_complete(s->unit, checks_texture_targets[s->target].target, state);
+    }
+    if (state->reason && fresh)
+        checks_texture_report(s->unit, state);
+    return state->reason != NULL;
+}
+
+/* Checks the textures used by the current program. Returns BUGLE_TRUE if
+ * any is incomplete. If fresh is set, nothing cached about the context or
+ * the program is trusted, and incomplete textures are reported.
+ */
+static bugle_bool checks_program_complete(checks_texture_context *ctx, checks_texture_cache *cache,
+                                          bugle_bool fresh, bugle_bool *internal)
+{
+    checks_program_samplers *samplers;
+    bugle_bool incomplete = BUGLE_FALSE;
+    GLint i;
+
+    if (!ctx->program_known)
+    {
+        if (!checks_texture_queries(internal))
+            return BUGLE_FALSE;
+        ctx->program = bugle_gl_get_current_program();
+        ctx->program_known = BUGLE_TRUE;
+    }
+    if (ctx->program)
+    {
+        bugle_thread_lock_lock(&cache->mutex);
+        if (fresh)
+            bugle_hashptr_erase_int(&cache->programs, ctx->program);
+        samplers = (checks_program_samplers *) bugle_hashptr_get_int(&cache->programs, ctx->program);
+        if (!samplers && checks_texture_queries(internal))
+            samplers = checks_program_samplers_query(cache, ctx->program);
+        if (samplers)
+            for (i = 0; i < samplers->count; i++)
+                if (checks_sampler_complete(ctx, cache, &samplers->samplers[i], fresh, internal))
+                    incomplete = BUGLE_TRUE;
+        bugle_thread_lock_unlock(&cache->mutex);
+    }
+    return incomplete;
+}
+
+static void checks_texture_context_forget(checks_texture_context *ctx);
+#endif /* GL_VERSION_2_0 */
+
+static void checks_completeness(void)
+{
+#ifdef GL_VERSION_2_0 /* not because it doesn't apply to ES, but it can't currently be checked */
+    checks_texture_context *ctx;
+    checks_texture_cache *cache;
+    bugle_bool internal = BUGLE_FALSE;
+
+    /* The check only produces log messages, so skip it if they would be
+     * discarded.
+     */
+    if (!bugle_log_enabled("checks", "texture", BUGLE_LOG_NOTICE))
+        return;
+    if (!BUGLE_GL_HAS_EXTENSION_GROUP(GL_ARB_shader_objects))
+        return;
+    ctx = (checks_texture_context *) bugle_object_get_current_data(bugle_get_context_class(), checks_texture_context_view);
+    cache = (checks_texture_cache *) bugle_object_get_current_data(bugle_get_namespace_class(), checks_texture_cache_view);
+    if (!ctx || !cache)
+        return;
+
+    /* The cached bindings, program and samplers assume that the tracked
+     * calls succeeded, which is only known if the error filter-set is
+     * loaded. So when the cache says that a texture is incomplete, it is
+     * discarded and the check repeated from the real state before
+     * reporting anything.
+     */
+    if (checks_program_complete(ctx, cache, BUGLE_FALSE, &internal))
+    {
+        checks_texture_context_forget(ctx);
+        checks_program_complete(ctx, cache, BUGLE_TRUE, &internal);
+    }
+    if (internal)
         bugle_gl_end_internal_render("checks_completeness", BUGLE_TRUE);
+#endif
+}
+
+#ifdef GL_VERSION_2_0
+static checks_texture_context *checks_texture_get_context(void)
+{
+    return (checks_texture_context *) bugle_object_get_current_data(bugle_get_context_class(), checks_texture_context_view);
+}
+
+/* Forgets everything known about the state of the current context */
+static void checks_texture_context_forget(checks_texture_context *ctx)
+{
+    int i;
+
+    ctx->program_known = BUGLE_FALSE;
+    ctx->active_known = BUGLE_FALSE;
+    bugle_hashptr_clear(&ctx->bindings);
+    for (i = 0; i < CHECKS_TEXTURE_TARGETS; i++)
+        ctx->defaults_known[i] = BUGLE_FALSE;
+}
+
+/* Discards the cached completeness of a texture. A texture of 0 means that
+ * it is unknown which textures changed.
+ */
+static void checks_texture_modified(GLuint texture)
+{
+    checks_texture_cache *cache;
+
+    cache = (checks_texture_cache *) bugle_object_get_current_data(bugle_get_namespace_class(), checks_texture_cache_view);
+    if (!cache)
+        return;
+    bugle_thread_lock_lock(&cache->mutex);
+    if (texture)
+        bugle_hashptr_erase_int(&cache->textures, texture);
+    else
+        bugle_hashptr_clear(&cache->textures);
+    bugle_thread_lock_unlock(&cache->mutex);
+}
+
+/* Discards the samplers of a program. A program of 0 means all programs. */
+static void checks_program_modified(GLuint program)
+{
+    checks_texture_cache *cache;
+
+    cache = (checks_texture_cache *) bugle_object_get_current_data(bugle_get_namespace_class(), checks_texture_cache_view);
+    if (!cache)
+        return;
+    bugle_thread_lock_lock(&cache->mutex);
+    if (program)
+        bugle_hashptr_erase_int(&cache->programs, program);
+    else
+        bugle_hashptr_clear(&cache->programs);
+    bugle_thread_lock_unlock(&cache->mutex);
+}
+
+/* Returns BUGLE_FALSE for calls that only went into a display list, or
+ * that failed, and so did not change the state.
+ */
+static bugle_bool checks_texture_call_executed(const callback_data *data)
+{
+    return bugle_displaylist_mode() != GL_COMPILE
+        && bugle_gl_call_get_error(data->call_object) == GL_NO_ERROR;
+}
+
+static bugle_bool checks_glActiveTexture(function_call *call, const callback_data *data)
+{
+    checks_texture_context *ctx;
+
+    ctx = checks_texture_get_context();
+    if (ctx)
+    {
+        ctx->active_known = checks_texture_call_executed(data);
+        ctx->active_unit = *call->glActiveTexture.arg0 - GL_TEXTURE0;
+    }
+    return BUGLE_TRUE;
+}
+
+static bugle_bool checks_glBindTexture(function_call *call, const callback_data *data)
+{
+    checks_texture_context *ctx;
+    GLenum target;
+    int index;
+
+    ctx = checks_texture_get_context();
+    target = *call->glBindTexture.arg0;
+    index = checks_texture_target_index(target);
+    if (!ctx || index < 0 || bugle_displaylist_mode() == GL_COMPILE)
+        return BUGLE_TRUE;
+    if (!ctx->active_known)
+    {
+        GLint active;
+
+        if (bugle_gl_in_begin_end())
+            return BUGLE_TRUE;
+        CALL(glGetIntegerv)(GL_ACTIVE_TEXTURE, &active);
+        ctx->active_unit = active - GL_TEXTURE0;
+        ctx->active_known = BUGLE_TRUE;
+    }
+    if (checks_texture_call_executed(data))
+        bugle_hashptr_set_int(&ctx->bindings, checks_texture_slot(ctx->active_unit, index),
+                              (void *) (size_t) (*call->glBindTexture.arg1 + 1));
+    else
+        bugle_hashptr_erase_int(&ctx->bindings, checks_texture_slot(ctx->active_unit, index));
+    return BUGLE_TRUE;
+}
+
+/* Called for functions whose first argument is a target whose bound
+ * texture may have become complete or incomplete.
+ */
+static bugle_bool checks_texture_write_target(function_call *call, const callback_data *data)
+{
+    checks_texture_context *ctx;
+    GLenum target;
+    GLint texture;
+    int index;
+    void *value;
+
+    ctx = checks_texture_get_context();
+    target = *(const GLenum *) call->generic.args[0];
+    index = checks_texture_target_index(target);
+    if (!ctx || index < 0 || bugle_gl_in_begin_end())
+        return BUGLE_TRUE;   /* Proxy targets land here, and do not change anything */
+
+    value = NULL;
+    if (ctx->active_known)
+        value = bugle_hashptr_get_int(&ctx->bindings, checks_texture_slot(ctx->active_unit, index));
+    if (value)
+        texture = (GLint) ((size_t) value - 1);
+    else
+    {
+        texture = 0;
+        CALL(glGetIntegerv)(checks_texture_targets[index].binding, &texture);
     }
+    if (texture)
+        checks_texture_modified(texture);
+    else
+        ctx->defaults_known[index] = BUGLE_FALSE;
+    return BUGLE_TRUE;
 }
 
+/* Called for functions whose first argument is a texture that may have
+ * become complete or incomplete.
+ */
+static bugle_bool checks_texture_write_id(function_call *call, const callback_data *data)
+{
+    GLuint texture;
+
+    texture = *(const GLuint *) call->generic.args[0];
+    if (texture)
+        checks_texture_modified(texture);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool checks_glDeleteTextures(function_call *call, const callback_data *data)
+{
+    checks_texture_context *ctx;
+    GLsizei n, i;
+    const GLuint *textures;
+
+    n = *call->glDeleteTextures.arg0;
+    textures = *call->glDeleteTextures.arg1;
+    if (bugle_gl_call_get_error(data->call_object) != GL_NO_ERROR)
+        return BUGLE_TRUE;
+    for (i = 0; i < n; i++)
+        if (textures[i])
+            checks_texture_modified(textures[i]);
+    /* Bindings to the deleted textures revert to 0 */
+    ctx = checks_texture_get_context();
+    if (ctx)
+        bugle_hashptr_clear(&ctx->bindings);
+    return BUGLE_TRUE;
+}
+
+/* Called for functions that change texture bindings in ways that are not
+ * tracked.
+ */
+static bugle_bool checks_texture_bindings_unknown(function_call *call, const callback_data *data)
+{
+    checks_texture_context *ctx;
+
+    ctx = checks_texture_get_context();
+    if (ctx)
+        bugle_hashptr_clear(&ctx->bindings);
+    return BUGLE_TRUE;
+}
+
+/* Called for functions that could change anything, such as glCallList and
+ * glPopAttrib (which also restores texture parameters).
+ */
+static bugle_bool checks_texture_state_unknown(function_call *call, const callback_data *data)
+{
+    checks_texture_context *ctx;
+
+    ctx = checks_texture_get_context();
+    if (ctx)
+        checks_texture_context_forget(ctx);
+    checks_texture_modified(0);
+    checks_program_modified(0);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool checks_glUseProgram(function_call *call, const callback_data *data)
+{
+    checks_texture_context *ctx;
+
+    ctx = checks_texture_get_context();
+    if (ctx && bugle_displaylist_mode() != GL_COMPILE)
+    {
+        ctx->program_known = checks_texture_call_executed(data);
+        ctx->program = *call->glUseProgram.arg0;
+    }
+    return BUGLE_TRUE;
+}
+
+/* Called for functions whose first argument is a program whose samplers
+ * may have changed.
+ */
+static bugle_bool checks_program_write_id(function_call *call, const callback_data *data)
+{
+    GLuint program;
+
+    program = *(const GLuint *) call->generic.args[0];
+    if (program)
+        checks_program_modified(program);
+    return BUGLE_TRUE;
+}
+
+/* Discards the samplers of program if any of them are in the range of
+ * locations that was set.
+ */
+static void checks_uniform_modified(GLuint program, GLint location, GLsizei count)
+{
+    checks_texture_cache *cache;
+    checks_program_samplers *samplers;
+    GLint i;
+
+    cache = (checks_texture_cache *) bugle_object_get_current_data(bugle_get_namespace_class(), checks_texture_cache_view);
+    if (!cache || !program || location < 0)
+        return;
+    bugle_thread_lock_lock(&cache->mutex);
+    samplers = (checks_program_samplers *) bugle_hashptr_get_int(&cache->programs, program);
+    if (samplers)
+        for (i = 0; i < samplers->count; i++)
+            if (samplers->samplers[i].location >= location
+                && samplers->samplers[i].location - location < count)
+            {
+                bugle_hashptr_erase_int(&cache->programs, program);
+                break;
+            }
+    bugle_thread_lock_unlock(&cache->mutex);
+}
+
+/* Returns the current program, or 0 if it cannot be determined */
+static GLuint checks_uniform_program(void)
+{
+    checks_texture_context *ctx;
+
+    ctx = checks_texture_get_context();
+    if (!ctx)
+        return 0;
+    if (!ctx->program_known)
+    {
+        if (bugle_gl_in_begin_end())
+            return 0;
+        ctx->program = bugle_gl_get_current_program();
+        ctx->program_known = BUGLE_TRUE;
+    }
+    return ctx->program;
+}
+
+static bugle_bool checks_glUniform1i(function_call *call, const callback_data *data)
+{
+    checks_uniform_modified(checks_uniform_program(), *call->glUniform1i.arg0, 1);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool checks_glUniform1iv(function_call *call, const callback_data *data)
+{
+    checks_uniform_modified(checks_uniform_program(), *call->glUniform1iv.arg0, *call->glUniform1iv.arg1);
+    return BUGLE_TRUE;
+}
+
+#ifdef GL_VERSION_4_1
+static bugle_bool checks_glProgramUniform1i(function_call *call, const callback_data *data)
+{
+    checks_uniform_modified(*call->glProgramUniform1i.arg0, *call->glProgramUniform1i.arg1, 1);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool checks_glProgramUniform1iv(function_call *call, const callback_data *data)
+{
+    checks_uniform_modified(*call->glProgramUniform1iv.arg0, *call->glProgramUniform1iv.arg1,
+                            *call->glProgramUniform1iv.arg2);
+    return BUGLE_TRUE;
+}
+#endif
+#endif /* GL_VERSION_2_0 */
+
 #if HAVE_SIGLONGJMP
 static sigjmp_buf checks_buf;
 static bugle_thread_lock_t checks_mutex;
@@ -356,6 +941,8 @@ static void checks_sigsegv_handler(int sig)
 static void checks_pointer_message(
     const char *description, int attribute, bugle_bool vbo, budgie_function function)
 {
+    if (!bugle_log_enabled("checks", "error", BUGLE_LOG_NOTICE))
+        return;
     if (attribute != -1)
         bugle_log_printf("checks", "error", BUGLE_LOG_NOTICE,
                          "illegal generic attribute array %d caught in %s (%s); call will be ignored.",
@@ -370,14 +957,15 @@ static void checks_pointer_message(
                          vbo ? "VBO overrun" : "unreadable memory");
 }
 
-/* Determines whether the range [data, data + size) is safe to read.
- * Writes a message to the log if not.
+#if HAVE_SIGLONGJMP
+/* Determines whether the range [data, data + size) is safe to read by
+ * reading every byte and catching SIGSEGV. This is only used when the
+ * platform cannot tell us directly, since it is slow and serialises all
+ * threads.
  */
-static bugle_bool valid_read_range(const void *data, size_t size,
-                                   const char *description, int attribute, budgie_function function)
+static bugle_bool checks_touch_range(const void *data, size_t size)
 {
     bugle_bool result = BUGLE_TRUE;
-#if HAVE_SIGLONGJMP
     struct sigaction act, old_act;
     /* sigsetjmp affects the whole process, so we have to serialise these
      * checks.
@@ -418,12 +1006,33 @@ static bugle_bool valid_read_range(const void *data, size_t size,
             exit(1);
         }
     bugle_thread_lock_unlock(&checks_mutex);
+    return result;
+}
+#endif
+
+/* Determines whether the range [data, data + size) is safe to read.
+ * Writes a message to the log if not.
+ */
+static bugle_bool valid_read_range(const void *data, size_t size,
+                                   const char *description, int attribute, budgie_function function)
+{
+    bugle_bool result = BUGLE_TRUE;
+    int readable;
+
+    readable = bugle_process_check_readable(data, size);
+    if (readable >= 0)
+        result = readable != 0;
+    else
+    {
+#if HAVE_SIGLONGJMP
+        result = checks_touch_range(data, size);
 #elif BUGLE_PLATFORM_WIN32
-    /* TODO: Do something clever with VirtualQueryEx */
+        /* TODO: Do something clever with VirtualQueryEx */
 #else
-    if (data == NULL && size > 0)
-        result = BUGLE_FALSE;
+        if (data == NULL && size > 0)
+            result = BUGLE_FALSE;
 #endif
+    }
 
     if (!result)
     {
@@ -698,18 +1307,579 @@ static bugle_bool checks_attributes(size_t first, size_t count,
     return result;
 }
 
+/* Scans count indices for the smallest and largest, skipping any that equal
+ * restart_index if restart is set. If every index is skipped, *min_out
+ * ends up greater than *max_out. The SSE2 versions treat the input as
+ * unsigned by flipping the top bit, and handle primitive restart by
+ * replacing the restart index with a value that cannot affect the result.
+ */
+#define CHECKS_INDEX_RANGE_TAIL(indices, i, count, restart, restart_index, min, max) \
+    do { \
+        for (; (i) < (count); (i)++) \
+        { \
+            GLuint v = (indices)[i]; \
+            if ((restart) && v == (restart_index)) continue; \
+            if (v < (min)) (min) = v; \
+            if (v > (max)) (max) = v; \
+        } \
+    } while (0)
+
+static void checks_index_range_ubyte(const GLubyte *indices, size_t count,
+                                     bugle_bool restart, GLuint restart_index,
+                                     GLuint *min_out, GLuint *max_out)
+{
+    GLuint min = 0xff, max = 0;
+    size_t i = 0;
+
+    if (restart_index > 0xff)
+        restart = BUGLE_FALSE;
+#ifdef __SSE2__
+    if (count >= 16)
+    {
+        __m128i vmin = _mm_set1_epi8((char) 0xff);
+        __m128i vmax = _mm_setzero_si128();
+        __m128i r = _mm_set1_epi8((char) restart_index);
+        __m128i enable = restart ? _mm_set1_epi8((char) 0xff) : _mm_setzero_si128();
+        GLubyte lanes[16];
+        int j;
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *) (indices + i));
+            __m128i skip = _mm_and_si128(_mm_cmpeq_epi8(v, r), enable);
+            vmin = _mm_min_epu8(vmin, _mm_or_si128(v, skip));
+            vmax = _mm_max_epu8(vmax, _mm_andnot_si128(skip, v));
+        }
+        _mm_storeu_si128((__m128i *) lanes, vmin);
+        for (j = 0; j < 16; j++)
+            if (lanes[j] < min) min = lanes[j];
+        _mm_storeu_si128((__m128i *) lanes, vmax);
+        for (j = 0; j < 16; j++)
+            if (lanes[j] > max) max = lanes[j];
+    }
+#endif
+    CHECKS_INDEX_RANGE_TAIL(indices, i, count, restart, restart_index, min, max);
+    *min_out = min;
+    *max_out = max;
+}
+
+static void checks_index_range_ushort(const GLushort *indices, size_t count,
+                                      bugle_bool restart, GLuint restart_index,
+                                      GLuint *min_out, GLuint *max_out)
+{
+    GLuint min = 0xffff, max = 0;
+    size_t i = 0;
+
+    if (restart_index > 0xffff)
+        restart = BUGLE_FALSE;
+#ifdef __SSE2__
+    if (count >= 8)
+    {
+        const __m128i bias = _mm_set1_epi16((short) 0x8000);
+        __m128i vmin = _mm_set1_epi16(0x7fff);
+        __m128i vmax = bias;
+        __m128i r = _mm_set1_epi16((short) restart_index);
+        __m128i enable = restart ? _mm_set1_epi16((short) 0xffff) : _mm_setzero_si128();
+        GLushort lanes[8];
+        int j;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *) (indices + i));
+            __m128i skip = _mm_and_si128(_mm_cmpeq_epi16(v, r), enable);
+            vmin = _mm_min_epi16(vmin, _mm_xor_si128(_mm_or_si128(v, skip), bias));
+            vmax = _mm_max_epi16(vmax, _mm_xor_si128(_mm_andnot_si128(skip, v), bias));
+        }
+        _mm_storeu_si128((__m128i *) lanes, _mm_xor_si128(vmin, bias));
+        for (j = 0; j < 8; j++)
+            if (lanes[j] < min) min = lanes[j];
+        _mm_storeu_si128((__m128i *) lanes, _mm_xor_si128(vmax, bias));
+        for (j = 0; j < 8; j++)
+            if (lanes[j] > max) max = lanes[j];
+    }
+#endif
+    CHECKS_INDEX_RANGE_TAIL(indices, i, count, restart, restart_index, min, max);
+    *min_out = min;
+    *max_out = max;
+}
+
+static void checks_index_range_uint(const GLuint *indices, size_t count,
+                                    bugle_bool restart, GLuint restart_index,
+                                    GLuint *min_out, GLuint *max_out)
+{
+    GLuint min = 0xffffffffu, max = 0;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    if (count >= 4)
+    {
+        const __m128i bias = _mm_set1_epi32((int) 0x80000000u);
+        __m128i vmin = _mm_set1_epi32(0x7fffffff);
+        __m128i vmax = bias;
+        __m128i r = _mm_set1_epi32((int) restart_index);
+        __m128i enable = restart ? _mm_set1_epi32(-1) : _mm_setzero_si128();
+        GLuint lanes[4];
+        int j;
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *) (indices + i));
+            __m128i skip = _mm_and_si128(_mm_cmpeq_epi32(v, r), enable);
+            __m128i lo = _mm_xor_si128(_mm_or_si128(v, skip), bias);
+            __m128i hi = _mm_xor_si128(_mm_andnot_si128(skip, v), bias);
+            __m128i lt = _mm_cmplt_epi32(lo, vmin);
+            __m128i gt = _mm_cmpgt_epi32(hi, vmax);
+            vmin = _mm_or_si128(_mm_and_si128(lt, lo), _mm_andnot_si128(lt, vmin));
+            vmax = _mm_or_si128(_mm_and_si128(gt, hi), _mm_andnot_si128(gt, vmax));
+        }
+        _mm_storeu_si128((__m128i *) lanes, _mm_xor_si128(vmin, bias));
+        for (j = 0; j < 4; j++)
+            if (lanes[j] < min) min = lanes[j];
+        _mm_storeu_si128((__m128i *) lanes, _mm_xor_si128(vmax, bias));
+        for (j = 0; j < 4; j++)
+            if (lanes[j] > max) max = lanes[j];
+    }
+#endif
+    CHECKS_INDEX_RANGE_TAIL(indices, i, count, restart, restart_index, min, max);
+    *min_out = min;
+    *max_out = max;
+}
+
+static void checks_index_range(const GLvoid *indices, GLenum gltype, size_t count,
+                               bugle_bool restart, GLuint restart_index,
+                               GLuint *min_out, GLuint *max_out)
+{
+    switch (gltype)
+    {
+    case GL_UNSIGNED_BYTE:
+        checks_index_range_ubyte((const GLubyte *) indices, count,
+                                 restart, restart_index, min_out, max_out);
+        break;
+    case GL_UNSIGNED_SHORT:
+        checks_index_range_ushort((const GLushort *) indices, count,
+                                  restart, restart_index, min_out, max_out);
+        break;
+    default:
+        checks_index_range_uint((const GLuint *) indices, count,
+                                restart, restart_index, min_out, max_out);
+        break;
+    }
+}
+
+#if defined(GL_VERSION_3_1) || defined(GL_PRIMITIVE_RESTART_FIXED_INDEX)
+/* The primitive restart state is queried on the first indexed draw and kept
+ * until a call that may change it. Being per context, it needs no lock.
+ */
+typedef struct
+{
+    bugle_bool known;
+    bugle_bool fixed;           /* GL_PRIMITIVE_RESTART_FIXED_INDEX */
+    bugle_bool enabled;         /* GL_PRIMITIVE_RESTART */
+    GLuint index;
+} checks_restart_context;
+
+static object_view checks_restart_view;
+
+static void checks_restart_init(const void *key, void *data)
+{
+    ((checks_restart_context *) data)->known = BUGLE_FALSE;
+}
+
+static void checks_restart_forget(void)
+{
+    checks_restart_context *ctx;
+
+    ctx = (checks_restart_context *) bugle_object_get_current_data(bugle_get_context_class(), checks_restart_view);
+    if (ctx)
+        ctx->known = BUGLE_FALSE;
+}
+
+static bugle_bool checks_restart_enable(function_call *call, const callback_data *data)
+{
+    switch (*(const GLenum *) call->generic.args[0])
+    {
+#ifdef GL_PRIMITIVE_RESTART_FIXED_INDEX
+    case GL_PRIMITIVE_RESTART_FIXED_INDEX:
+#endif
+#ifdef GL_VERSION_3_1
+    case GL_PRIMITIVE_RESTART:
+#endif
+        checks_restart_forget();
+        break;
+    }
+    return BUGLE_TRUE;
+}
+
+/* Called for glPrimitiveRestartIndex, and for calls that could change
+ * anything, such as glCallList and glPopAttrib.
+ */
+static bugle_bool checks_restart_unknown(function_call *call, const callback_data *data)
+{
+    checks_restart_forget();
+    return BUGLE_TRUE;
+}
+#endif
+
+/* Determines whether primitive restart is enabled, and if so, the index */
+static bugle_bool checks_primitive_restart(GLenum gltype, GLuint *restart_index)
+{
+#if defined(GL_VERSION_3_1) || defined(GL_PRIMITIVE_RESTART_FIXED_INDEX)
+    checks_restart_context dummy, *ctx;
+
+    ctx = (checks_restart_context *) bugle_object_get_current_data(bugle_get_context_class(), checks_restart_view);
+    if (!ctx)
+    {
+        ctx = &dummy;
+        ctx->known = BUGLE_FALSE;
+    }
+    if (!ctx->known)
+    {
+        ctx->fixed = BUGLE_FALSE;
+        ctx->enabled = BUGLE_FALSE;
+        ctx->index = 0;
+#ifdef GL_PRIMITIVE_RESTART_FIXED_INDEX
+        if (BUGLE_GL_HAS_EXTENSION_GROUP(GL_ARB_ES3_compatibility))
+            ctx->fixed = CALL(glIsEnabled)(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+#endif
+#ifdef GL_VERSION_3_1
+        if (BUGLE_GL_HAS_EXTENSION_GROUP(GL_VERSION_3_1))
+        {
+            GLint index;
+
+            ctx->enabled = CALL(glIsEnabled)(GL_PRIMITIVE_RESTART);
+            CALL(glGetIntegerv)(GL_PRIMITIVE_RESTART_INDEX, &index);
+            ctx->index = (GLuint) index;
+        }
+#endif
+        ctx->known = BUGLE_TRUE;
+    }
+
+    if (ctx->fixed)
+    {
+        switch (gltype)
+        {
+        case GL_UNSIGNED_BYTE: *restart_index = 0xff; break;
+        case GL_UNSIGNED_SHORT: *restart_index = 0xffff; break;
+        default: *restart_index = 0xffffffffu; break;
+        }
+        return BUGLE_TRUE;
+    }
+    if (ctx->enabled)
+    {
+        *restart_index = ctx->index;
+        return BUGLE_TRUE;
+    }
+#endif
+    return BUGLE_FALSE;
+}
+
+#ifdef GL_VERSION_1_5
+/* Index ranges found in buffer objects are cached, so that static index
+ * buffers only need to be read back once. Each buffer is assigned a
+ * generation number, which is replaced by a fresh one whenever the buffer
+ * might have been modified, and cache entries record the generation they
+ * were computed from. The cache is direct-mapped, and is shared by all
+ * contexts in a share group.
+ */
+#define CHECKS_INDEX_CACHE_SIZE 1024
+
+typedef struct
+{
+    GLuint buffer;              /* 0 if the entry is unused */
+    unsigned long generation;
+    size_t offset;
+    GLsizei count;
+    GLenum type;
+    bugle_bool restart;
+    GLuint restart_index;
+    GLuint min, max;
+} checks_index_cache_entry;
+
+typedef struct
+{
+    unsigned long generation;
+    bugle_bool persistent;      /* may be written while mapped, so not cached */
+} checks_buffer_state;
+
+typedef struct
+{
+    bugle_thread_lock_t mutex;
+    unsigned long generation;   /* last generation handed out */
+    /* Set if an unknown buffer was made persistent, after which nothing is
+     * cached.
+     */
+    bugle_bool persistent;
+    hashptr_table buffers;      /* checks_buffer_state, indexed by buffer id */
+    checks_index_cache_entry entries[CHECKS_INDEX_CACHE_SIZE];
+} checks_index_cache;
+
+static object_view checks_index_cache_view;
+
+static void checks_index_cache_init(const void *key, void *data)
+{
+    checks_index_cache *cache;
+
+    cache = (checks_index_cache *) data;
+    bugle_thread_lock_init(&cache->mutex);
+    cache->generation = 0;
+    cache->persistent = BUGLE_FALSE;
+    bugle_hashptr_init(&cache->buffers, bugle_free);
+    memset(cache->entries, 0, sizeof(cache->entries));
+}
+
+static void checks_index_cache_clear(void *data)
+{
+    checks_index_cache *cache;
+
+    cache = (checks_index_cache *) data;
+    bugle_thread_lock_destroy(&cache->mutex);
+    bugle_hashptr_clear(&cache->buffers);
+}
+
+/* Must be called with the lock held */
+static checks_buffer_state *checks_buffer_get_state(checks_index_cache *cache, GLuint buffer)
+{
+    checks_buffer_state *state;
+
+    state = (checks_buffer_state *) bugle_hashptr_get_int(&cache->buffers, buffer);
+    if (!state)
+    {
+        state = BUGLE_MALLOC(checks_buffer_state);
+        state->generation = ++cache->generation;
+        state->persistent = BUGLE_FALSE;
+        bugle_hashptr_set_int(&cache->buffers, buffer, state);
+    }
+    return state;
+}
+
+static size_t checks_index_cache_slot(GLuint buffer, size_t offset, GLsizei count, GLenum type)
+{
+    size_t h;
+
+    h = buffer * 0x9e3779b1u;
+    h ^= offset + 0x7f4a7c15u + (h << 6) + (h >> 2);
+    h ^= (size_t) count + 0x7f4a7c15u + (h << 6) + (h >> 2);
+    h ^= (size_t) type;
+    return h & (CHECKS_INDEX_CACHE_SIZE - 1);
+}
+
+/* Records that the contents of buffer may have changed. A buffer of 0
+ * means that it is unknown which buffer changed, so every buffer is
+ * assumed to have changed (and to be persistent, if persistent is set).
+ */
+static void checks_buffer_modified(GLuint buffer, bugle_bool persistent)
+{
+    checks_index_cache *cache;
+
+    cache = (checks_index_cache *) bugle_object_get_current_data(bugle_get_namespace_class(), checks_index_cache_view);
+    if (!cache)
+        return;
+    bugle_thread_lock_lock(&cache->mutex);
+    if (buffer)
+    {
+        checks_buffer_state *state;
+
+        state = checks_buffer_get_state(cache, buffer);
+        state->generation = ++cache->generation;
+        state->persistent = state->persistent || persistent;
+    }
+    else
+    {
+        memset(cache->entries, 0, sizeof(cache->entries));
+        cache->persistent = cache->persistent || persistent;
+    }
+    bugle_thread_lock_unlock(&cache->mutex);
+}
+
+static void checks_buffer_deleted(GLuint buffer)
+{
+    checks_index_cache *cache;
+
+    cache = (checks_index_cache *) bugle_object_get_current_data(bugle_get_namespace_class(), checks_index_cache_view);
+    if (!cache)
+        return;
+    bugle_thread_lock_lock(&cache->mutex);
+    /* A new buffer with the same name will be given a fresh generation */
+    bugle_hashptr_erase_int(&cache->buffers, buffer);
+    bugle_thread_lock_unlock(&cache->mutex);
+}
+
+/* Records a write through a buffer target. If the target is not one we
+ * know, the buffer cannot be identified, so every buffer is treated as
+ * modified.
+ */
+static void checks_buffer_target_modified(GLenum target, bugle_bool persistent)
+{
+    GLenum binding;
+    GLint id = 0;
+
+    binding = bugle_gl_buffer_binding(target);
+    if (binding != GL_NONE)
+    {
+        CALL(glGetIntegerv)(binding, &id);
+        if (!id)
+            return;   /* Not a buffer write at all, or an error */
+    }
+    checks_buffer_modified(id, persistent);
+}
+
+/* Called for functions whose first argument is the target of a write */
+static bugle_bool checks_buffer_write_target(function_call *call, const callback_data *data)
+{
+    if (!bugle_gl_in_begin_end())
+        checks_buffer_target_modified(*(const GLenum *) call->generic.args[0], BUGLE_FALSE);
+    return BUGLE_TRUE;
+}
+
+/* Called for functions whose first argument is a buffer that is written */
+static bugle_bool checks_buffer_write_id(function_call *call, const callback_data *data)
+{
+    checks_buffer_modified(*(const GLuint *) call->generic.args[0], BUGLE_FALSE);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool checks_glDeleteBuffers(function_call *call, const callback_data *data)
+{
+    GLsizei n, i;
+    const GLuint *buffers;
+
+    n = *call->glDeleteBuffers.arg0;
+    buffers = *call->glDeleteBuffers.arg1;
+    if (n > 0 && valid_read_range(buffers, n * sizeof(GLuint), "buffers array", -1, call->generic.id))
+    {
+        for (i = 0; i < n; i++)
+            if (buffers[i])
+                checks_buffer_deleted(buffers[i]);
+    }
+    return BUGLE_TRUE;
+}
+
+#ifdef GL_VERSION_2_1
+/* Reading pixels into a buffer object writes it */
+static bugle_bool checks_pixel_pack(function_call *call, const callback_data *data)
+{
+    if (!bugle_gl_in_begin_end()
+        && BUGLE_GL_HAS_EXTENSION_GROUP(GL_VERSION_2_1))
+        checks_buffer_target_modified(GL_PIXEL_PACK_BUFFER, BUGLE_FALSE);
+    return BUGLE_TRUE;
+}
+#endif
+
+/* Writes by the GPU to an unknown set of buffers */
+static bugle_bool checks_buffer_write_unknown(function_call *call, const callback_data *data)
+{
+    checks_buffer_modified(0, BUGLE_FALSE);
+    return BUGLE_TRUE;
+}
+
+#ifdef GL_VERSION_3_1
+static bugle_bool checks_glCopyBufferSubData(function_call *call, const callback_data *data)
+{
+    if (!bugle_gl_in_begin_end())
+        checks_buffer_target_modified(*call->glCopyBufferSubData.arg1, BUGLE_FALSE);
+    return BUGLE_TRUE;
+}
+#endif
+
+#ifdef GL_VERSION_4_4
+static bugle_bool checks_glBufferStorage(function_call *call, const callback_data *data)
+{
+    if (!bugle_gl_in_begin_end())
+        checks_buffer_target_modified(*call->glBufferStorage.arg0,
+                                      (*call->glBufferStorage.arg3 & GL_MAP_PERSISTENT_BIT) != 0);
+    return BUGLE_TRUE;
+}
+#endif
+
+#ifdef GL_VERSION_4_5
+static bugle_bool checks_glCopyNamedBufferSubData(function_call *call, const callback_data *data)
+{
+    checks_buffer_modified(*call->glCopyNamedBufferSubData.arg1, BUGLE_FALSE);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool checks_glNamedBufferStorage(function_call *call, const callback_data *data)
+{
+    checks_buffer_modified(*call->glNamedBufferStorage.arg0,
+                           (*call->glNamedBufferStorage.arg3 & GL_MAP_PERSISTENT_BIT) != 0);
+    return BUGLE_TRUE;
+}
+#endif
+
+/* Looks up the cache, returning BUGLE_FALSE on a miss. On a miss, *generation
+ * is set to the generation to pass to checks_index_cache_store, or to 0 if
+ * the result should not be stored.
+ */
+static bugle_bool checks_index_cache_lookup(GLuint buffer, size_t offset, GLsizei count, GLenum type,
+                                            bugle_bool restart, GLuint restart_index,
+                                            unsigned long *generation,
+                                            GLuint *min_out, GLuint *max_out)
+{
+    checks_index_cache *cache;
+    checks_buffer_state *state;
+    const checks_index_cache_entry *e;
+    bugle_bool hit = BUGLE_FALSE;
+
+    *generation = 0;
+    cache = (checks_index_cache *) bugle_object_get_current_data(bugle_get_namespace_class(), checks_index_cache_view);
+    if (!cache)
+        return BUGLE_FALSE;
+    bugle_thread_lock_lock(&cache->mutex);
+    state = checks_buffer_get_state(cache, buffer);
+    if (!state->persistent && !cache->persistent)
+    {
+        e = &cache->entries[checks_index_cache_slot(buffer, offset, count, type)];
+        if (e->buffer == buffer && e->generation == state->generation
+            && e->offset == offset && e->count == count && e->type == type
+            && e->restart == restart && (!restart || e->restart_index == restart_index))
+        {
+            *min_out = e->min;
+            *max_out = e->max;
+            hit = BUGLE_TRUE;
+        }
+        else
+            *generation = state->generation;
+    }
+    bugle_thread_lock_unlock(&cache->mutex);
+    return hit;
+}
+
+static void checks_index_cache_store(GLuint buffer, size_t offset, GLsizei count, GLenum type,
+                                     bugle_bool restart, GLuint restart_index,
+                                     unsigned long generation, GLuint min, GLuint max)
+{
+    checks_index_cache *cache;
+    checks_index_cache_entry *e;
+
+    cache = (checks_index_cache *) bugle_object_get_current_data(bugle_get_namespace_class(), checks_index_cache_view);
+    if (!cache || !generation)
+        return;
+    bugle_thread_lock_lock(&cache->mutex);
+    e = &cache->entries[checks_index_cache_slot(buffer, offset, count, type)];
+    e->buffer = buffer;
+    e->generation = generation;
+    e->offset = offset;
+    e->count = count;
+    e->type = type;
+    e->restart = restart;
+    e->restart_index = restart_index;
+    e->min = min;
+    e->max = max;
+    bugle_thread_lock_unlock(&cache->mutex);
+}
+#endif /* GL_VERSION_1_5 */
+
 /* Determines the range of indices encoded in <indices>, and returns it
- * through min_out and max_out. Returns false if the parameters are invalid.
- * TODO: handle primitive restart.
+ * through min_out and max_out. Returns false if the parameters are invalid,
+ * or if every index is the primitive restart index.
  */
 static bugle_bool checks_min_max(GLsizei count, GLenum gltype, const GLvoid *indices,
                                  GLuint *min_out, GLuint *max_out)
 {
-    GLuint *out;
-    GLsizei i;
     GLuint min, max;
-    budgie_type type;
-    GLvoid *vbo_indices = NULL;
+    bugle_bool restart;
+    GLuint restart_index = 0;
+    GLint id = 0;
 
     if (count <= 0)
         return BUGLE_FALSE;
@@ -717,53 +1887,75 @@ static bugle_bool checks_min_max(GLsizei count, GLenum gltype, const GLvoid *ind
         && gltype != GL_UNSIGNED_SHORT
         && gltype != GL_UNSIGNED_BYTE)
         return BUGLE_FALSE; /* It will just generate a GL error and be ignored */
-    type = bugle_gl_type_to_type(gltype);
+    restart = checks_primitive_restart(gltype, &restart_index);
 
     /* Check for element array buffer */
     if (BUGLE_GL_HAS_EXTENSION_GROUP(GL_ARB_vertex_buffer_object))
     {
-        GLint id;
         CALL(glGetIntegerv)(GL_ELEMENT_ARRAY_BUFFER_BINDING, &id);
         if (id)
         {
 #if GL_VERSION_ES_CM_1_1 || GL_ES_VERSION_2_0
-            /* FIXME-GLES: save data on load */
-            return BUGLE_FALSE;
-#else
-            GLint mapped;
-            size_t size;
-            /* We are not allowed to call glGetBufferSubDataARB on a
-             * mapped buffer. Fortunately, if the buffer is mapped, the
-             * call is illegal and should generate INVALID_OPERATION anyway.
+            /* There is no glGetBufferSubData, so only shadowed buffers can
+             * be checked.
              */
-            CALL(glGetBufferParameteriv)(GL_ELEMENT_ARRAY_BUFFER,
-                                         GL_BUFFER_MAPPED,
-                                         &mapped);
-            if (mapped)
-                return BUGLE_FALSE;
+            size_t size, offset;
+            GLvoid *vbo_indices;
 
-            size = count * budgie_type_size(type);
+            offset = (const char *) indices - (const char *) NULL;
+            size = count * bugle_gl_type_to_size(gltype);
             vbo_indices = bugle_malloc(size);
-            CALL(glGetBufferSubData)(GL_ELEMENT_ARRAY_BUFFER,
-                                    (const char *) indices - (const char *) NULL,
-                                    size, vbo_indices);
-            indices = vbo_indices;
+            if (!bugle_gl_buffer_shadow_read(id, offset, size, vbo_indices))
+            {
+                bugle_free(vbo_indices);
+                return BUGLE_FALSE;
+            }
+            checks_index_range(vbo_indices, gltype, count, restart, restart_index, &min, &max);
+            bugle_free(vbo_indices);
+#else
+            GLint mapped;
+            size_t size, offset;
+            unsigned long generation;
+            GLvoid *vbo_indices;
+
+            offset = (const char *) indices - (const char *) NULL;
+            if (!checks_index_cache_lookup(id, offset, count, gltype, restart, restart_index,
+                                           &generation, &min, &max))
+            {
+                size = count * bugle_gl_type_to_size(gltype);
+                vbo_indices = bugle_malloc(size);
+                if (!bugle_gl_buffer_shadow_read(id, offset, size, vbo_indices))
+                {
+                    /* We are not allowed to call glGetBufferSubDataARB on a
+                     * mapped buffer. Fortunately, if the buffer is mapped, the
+                     * call is illegal and should generate INVALID_OPERATION anyway.
+                     */
+                    CALL(glGetBufferParameteriv)(GL_ELEMENT_ARRAY_BUFFER,
+                                                 GL_BUFFER_MAPPED,
+                                                 &mapped);
+                    if (mapped)
+                    {
+                        bugle_free(vbo_indices);
+                        return BUGLE_FALSE;
+                    }
+                    CALL(glGetBufferSubData)(GL_ELEMENT_ARRAY_BUFFER, offset, size, vbo_indices);
+                }
+                checks_index_range(vbo_indices, gltype, count, restart, restart_index, &min, &max);
+                bugle_free(vbo_indices);
+                checks_index_cache_store(id, offset, count, gltype, restart, restart_index,
+                                         generation, min, max);
+            }
 #endif /* !GLES */
         }
     }
 
-    out = BUGLE_NMALLOC(count, GLuint);
-    budgie_type_convert(out, bugle_gl_type_to_type(GL_UNSIGNED_INT), indices, type, count);
-    min = max = out[0];
-    for (i = 0; i < count; i++)
-    {
-        if (out[i] < min) min = out[i];
-        if (out[i] > max) max = out[i];
-    }
+    /* Client-side indices are scanned in place */
+    if (!id)
+        checks_index_range(indices, gltype, count, restart, restart_index, &min, &max);
+    if (min > max)
+        return BUGLE_FALSE;
     if (min_out) *min_out = min;
     if (max_out) *max_out = max;
-    bugle_free(out);
-    if (vbo_indices) bugle_free(vbo_indices);
     return BUGLE_TRUE;
 }
 
@@ -897,7 +2089,7 @@ static bugle_bool checks_glMultiDrawElements(function_call *call, const callback
                          GL_ELEMENT_ARRAY_BUFFER_BINDING,
                          "index array", -1, call->generic.id))
             return BUGLE_FALSE;
-        if (checks_min_max(count, type, indices_ptr[i], &min, &max))
+        if (checks_min_max(count_ptr[i], type, indices_ptr[i], &min, &max))
             if (!checks_attributes(min, max - min + 1, 0, 1, call->generic.id))
                 return BUGLE_FALSE;
     }
@@ -1115,6 +2307,158 @@ static bugle_bool checks_initialise(filter_set *handle)
     bugle_filter_catches(f, "glMultiTexCoord4dv", BUGLE_FALSE, checks_glMultiTexCoord);
 #endif /* GL 1.1 */
 
+#ifdef GL_VERSION_1_5
+    /* Track writes to buffers, to keep the index range cache up to date.
+     * These are caught even while inactive, since the cache outlives that.
+     */
+    bugle_filter_catches(f, "glBufferData", BUGLE_TRUE, checks_buffer_write_target);
+    bugle_filter_catches(f, "glBufferSubData", BUGLE_TRUE, checks_buffer_write_target);
+    bugle_filter_catches(f, "glMapBuffer", BUGLE_TRUE, checks_buffer_write_target);
+    bugle_filter_catches(f, "glUnmapBuffer", BUGLE_TRUE, checks_buffer_write_target);
+    bugle_filter_catches(f, "glDeleteBuffers", BUGLE_TRUE, checks_glDeleteBuffers);
+#ifdef GL_VERSION_2_1
+    bugle_filter_catches(f, "glReadPixels", BUGLE_TRUE, checks_pixel_pack);
+    bugle_filter_catches(f, "glGetTexImage", BUGLE_TRUE, checks_pixel_pack);
+    bugle_filter_catches(f, "glGetCompressedTexImage", BUGLE_TRUE, checks_pixel_pack);
+#endif
+#ifdef GL_VERSION_3_0
+    bugle_filter_catches(f, "glMapBufferRange", BUGLE_TRUE, checks_buffer_write_target);
+    bugle_filter_catches(f, "glFlushMappedBufferRange", BUGLE_TRUE, checks_buffer_write_target);
+    bugle_filter_catches(f, "glEndTransformFeedback", BUGLE_TRUE, checks_buffer_write_unknown);
+#endif
+#ifdef GL_VERSION_3_1
+    bugle_filter_catches(f, "glCopyBufferSubData", BUGLE_TRUE, checks_glCopyBufferSubData);
+#endif
+#ifdef GL_VERSION_4_2
+    bugle_filter_catches(f, "glMemoryBarrier", BUGLE_TRUE, checks_buffer_write_unknown);
+#endif
+#ifdef GL_VERSION_4_3
+    bugle_filter_catches(f, "glClearBufferData", BUGLE_TRUE, checks_buffer_write_target);
+    bugle_filter_catches(f, "glClearBufferSubData", BUGLE_TRUE, checks_buffer_write_target);
+    bugle_filter_catches(f, "glInvalidateBufferData", BUGLE_TRUE, checks_buffer_write_id);
+    bugle_filter_catches(f, "glInvalidateBufferSubData", BUGLE_TRUE, checks_buffer_write_id);
+#endif
+#ifdef GL_VERSION_4_4
+    bugle_filter_catches(f, "glBufferStorage", BUGLE_TRUE, checks_glBufferStorage);
+#endif
+#ifdef GL_VERSION_4_5
+    bugle_filter_catches(f, "glNamedBufferData", BUGLE_TRUE, checks_buffer_write_id);
+    bugle_filter_catches(f, "glNamedBufferSubData", BUGLE_TRUE, checks_buffer_write_id);
+    bugle_filter_catches(f, "glMapNamedBuffer", BUGLE_TRUE, checks_buffer_write_id);
+    bugle_filter_catches(f, "glMapNamedBufferRange", BUGLE_TRUE, checks_buffer_write_id);
+    bugle_filter_catches(f, "glUnmapNamedBuffer", BUGLE_TRUE, checks_buffer_write_id);
+    bugle_filter_catches(f, "glFlushMappedNamedBufferRange", BUGLE_TRUE, checks_buffer_write_id);
+    bugle_filter_catches(f, "glClearNamedBufferData", BUGLE_TRUE, checks_buffer_write_id);
+    bugle_filter_catches(f, "glClearNamedBufferSubData", BUGLE_TRUE, checks_buffer_write_id);
+    bugle_filter_catches(f, "glCopyNamedBufferSubData", BUGLE_TRUE, checks_glCopyNamedBufferSubData);
+    bugle_filter_catches(f, "glNamedBufferStorage", BUGLE_TRUE, checks_glNamedBufferStorage);
+    bugle_filter_catches(f, "glMemoryBarrierByRegion", BUGLE_TRUE, checks_buffer_write_unknown);
+    bugle_filter_catches(f, "glReadnPixels", BUGLE_TRUE, checks_pixel_pack);
+    bugle_filter_catches(f, "glGetnTexImage", BUGLE_TRUE, checks_pixel_pack);
+    bugle_filter_catches(f, "glGetnCompressedTexImage", BUGLE_TRUE, checks_pixel_pack);
+    bugle_filter_catches(f, "glGetTextureImage", BUGLE_TRUE, checks_pixel_pack);
+    bugle_filter_catches(f, "glGetTextureSubImage", BUGLE_TRUE, checks_pixel_pack);
+    bugle_filter_catches(f, "glGetCompressedTextureImage", BUGLE_TRUE, checks_pixel_pack);
+    bugle_filter_catches(f, "glGetCompressedTextureSubImage", BUGLE_TRUE, checks_pixel_pack);
+#endif
+    checks_index_cache_view = bugle_object_view_new(bugle_get_namespace_class(),
+                                                    checks_index_cache_init,
+                                                    checks_index_cache_clear,
+                                                    sizeof(checks_index_cache));
+#endif /* GL_VERSION_1_5 */
+
+#if defined(GL_VERSION_3_1) || defined(GL_PRIMITIVE_RESTART_FIXED_INDEX)
+    /* Track the primitive restart state, even while inactive */
+    bugle_filter_catches(f, "glEnable", BUGLE_TRUE, checks_restart_enable);
+    bugle_filter_catches(f, "glDisable", BUGLE_TRUE, checks_restart_enable);
+    bugle_filter_catches(f, "glPopAttrib", BUGLE_TRUE, checks_restart_unknown);
+    bugle_filter_catches(f, "glCallList", BUGLE_TRUE, checks_restart_unknown);
+    bugle_filter_catches(f, "glCallLists", BUGLE_TRUE, checks_restart_unknown);
+#ifdef GL_VERSION_3_1
+    bugle_filter_catches(f, "glPrimitiveRestartIndex", BUGLE_TRUE, checks_restart_unknown);
+#endif
+    checks_restart_view = bugle_object_view_new(bugle_get_context_class(),
+                                                checks_restart_init,
+                                                NULL,
+                                                sizeof(checks_restart_context));
+#endif
+
+#ifdef GL_VERSION_2_0
+    /* Track the state that texture completeness depends on. This needs the
+     * outcome of the calls, so it is done after they are invoked. Like the
+     * index range cache, this is done even while inactive.
+     */
+    f = bugle_filter_new(handle, "checks_textures");
+    bugle_filter_catches(f, "glActiveTexture", BUGLE_TRUE, checks_glActiveTexture);
+    bugle_filter_catches(f, "glBindTexture", BUGLE_TRUE, checks_glBindTexture);
+    bugle_filter_catches(f, "glDeleteTextures", BUGLE_TRUE, checks_glDeleteTextures);
+    bugle_filter_catches(f, "glTexImage1D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glTexImage2D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glTexImage3D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glCopyTexImage1D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glCopyTexImage2D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glCompressedTexImage1D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glCompressedTexImage2D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glCompressedTexImage3D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glTexParameteri", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glTexParameterf", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glTexParameteriv", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glTexParameterfv", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glPopAttrib", BUGLE_TRUE, checks_texture_state_unknown);
+    bugle_filter_catches(f, "glCallList", BUGLE_TRUE, checks_texture_state_unknown);
+    bugle_filter_catches(f, "glCallLists", BUGLE_TRUE, checks_texture_state_unknown);
+    bugle_filter_catches(f, "glUseProgram", BUGLE_TRUE, checks_glUseProgram);
+    bugle_filter_catches(f, "glLinkProgram", BUGLE_TRUE, checks_program_write_id);
+    bugle_filter_catches(f, "glDeleteProgram", BUGLE_TRUE, checks_program_write_id);
+    bugle_filter_catches(f, "glUniform1i", BUGLE_TRUE, checks_glUniform1i);
+    bugle_filter_catches(f, "glUniform1iv", BUGLE_TRUE, checks_glUniform1iv);
+#ifdef GL_VERSION_3_0
+    bugle_filter_catches(f, "glTexParameterIiv", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glTexParameterIuiv", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glGenerateMipmap", BUGLE_TRUE, checks_texture_write_target);
+#endif
+#ifdef GL_VERSION_4_1
+    bugle_filter_catches(f, "glProgramUniform1i", BUGLE_TRUE, checks_glProgramUniform1i);
+    bugle_filter_catches(f, "glProgramUniform1iv", BUGLE_TRUE, checks_glProgramUniform1iv);
+#endif
+#ifdef GL_VERSION_4_2
+    bugle_filter_catches(f, "glTexStorage1D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glTexStorage2D", BUGLE_TRUE, checks_texture_write_target);
+    bugle_filter_catches(f, "glTexStorage3D", BUGLE_TRUE, checks_texture_write_target);
+#endif
+#ifdef GL_VERSION_4_3
+    bugle_filter_catches(f, "glTextureView", BUGLE_TRUE, checks_texture_write_id);
+#endif
+#ifdef GL_VERSION_4_4
+    bugle_filter_catches(f, "glBindTextures", BUGLE_TRUE, checks_texture_bindings_unknown);
+#endif
+#ifdef GL_VERSION_4_5
+    bugle_filter_catches(f, "glBindTextureUnit", BUGLE_TRUE, checks_texture_bindings_unknown);
+    bugle_filter_catches(f, "glTextureParameteri", BUGLE_TRUE, checks_texture_write_id);
+    bugle_filter_catches(f, "glTextureParameterf", BUGLE_TRUE, checks_texture_write_id);
+    bugle_filter_catches(f, "glTextureParameteriv", BUGLE_TRUE, checks_texture_write_id);
+    bugle_filter_catches(f, "glTextureParameterfv", BUGLE_TRUE, checks_texture_write_id);
+    bugle_filter_catches(f, "glTextureParameterIiv", BUGLE_TRUE, checks_texture_write_id);
+    bugle_filter_catches(f, "glTextureParameterIuiv", BUGLE_TRUE, checks_texture_write_id);
+    bugle_filter_catches(f, "glTextureStorage1D", BUGLE_TRUE, checks_texture_write_id);
+    bugle_filter_catches(f, "glTextureStorage2D", BUGLE_TRUE, checks_texture_write_id);
+    bugle_filter_catches(f, "glTextureStorage3D", BUGLE_TRUE, checks_texture_write_id);
+    bugle_filter_catches(f, "glGenerateTextureMipmap", BUGLE_TRUE, checks_texture_write_id);
+#endif
+    bugle_filter_order("invoke", "checks_textures");
+    bugle_gl_filter_post_renders("checks_textures");
+    bugle_gl_filter_set_queries_error("checks");
+
+    checks_texture_cache_view = bugle_object_view_new(bugle_get_namespace_class(),
+                                                      checks_texture_cache_init,
+                                                      checks_texture_cache_clear,
+                                                      sizeof(checks_texture_cache));
+    checks_texture_context_view = bugle_object_view_new(bugle_get_context_class(),
+                                                        checks_texture_context_init,
+                                                        checks_texture_context_clear,
+                                                        sizeof(checks_texture_context));
+#endif /* GL_VERSION_2_0 */
+
     /* FIXME: still perhaps to do:
      * - check for passing a glMapBuffer region to a command
      */
@@ -1152,4 +2496,5 @@ void bugle_initialise_filter_library(void)
 
     bugle_gl_filter_set_renders("checks");
     bugle_filter_set_depends("checks", "glextensions");
+    bugle_filter_set_depends("checks", "gldisplaylist");
 }
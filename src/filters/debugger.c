@@ -31,6 +31,7 @@
 #include <bugle/gl/glutils.h>
 #include <bugle/gl/glbeginend.h>
 #include <bugle/gl/globjects.h>
+#include <bugle/gl/glbuffershadow.h>
 #include <bugle/gl/glextensions.h>
 #include <bugle/gl/glfbo.h>
 #include <bugle/filters.h>
@@ -220,16 +221,14 @@ static void send_state_raw(const glstate *state, bugle_uint32_t id)
     gldb_protocol_send_code(out_pipe, id);
 }
 
-static char *dump_any_call_string(const function_call *call)
+/* The result is only valid until the next call on the same thread */
+static const char *dump_any_call_string(const function_call *call)
 {
     bugle_io_writer *writer;
-    char *ans;
 
-    writer = bugle_io_writer_mem_new(256);
+    writer = bugle_io_writer_mem_scratch();
     budgie_dump_any_call(&call->generic, 0, writer);
-    ans = bugle_io_writer_mem_get(writer);
-    bugle_io_writer_close(writer);
-    return ans;
+    return bugle_io_writer_mem_get(writer);
 }
 
 #if BUGLE_GLTYPE_GL  /* Currently only used in this build */
@@ -747,6 +746,7 @@ static bugle_bool send_data_buffer(bugle_uint32_t id, GLuint object_id)
 {
     GLint old_binding;
     GLint size;
+    size_t shadow_size;
     void *data;
 
     glwin_display dpy = NULL;
@@ -779,6 +779,23 @@ static bugle_bool send_data_buffer(bugle_uint32_t id, GLuint object_id)
         return BUGLE_FALSE;
     }
 
+    /* Use the shadow copy if there is one, to avoid a readback */
+    if (bugle_gl_buffer_shadow_size(object_id, &shadow_size))
+    {
+        data = bugle_malloc(shadow_size);
+        if (bugle_gl_buffer_shadow_read(object_id, 0, shadow_size, data))
+        {
+            gldb_protocol_send_code(out_pipe, RESP_DATA);
+            gldb_protocol_send_code(out_pipe, id);
+            gldb_protocol_send_code(out_pipe, REQ_DATA_BUFFER);
+            gldb_protocol_send_binary_string(out_pipe, shadow_size, data);
+            bugle_free(data);
+            bugle_gl_end_internal_render("send_data_buffer", BUGLE_TRUE);
+            return BUGLE_TRUE;
+        }
+        bugle_free(data);
+    }
+
     aux = bugle_get_aux_context(BUGLE_TRUE);
     if (aux)
     {
@@ -1061,13 +1078,11 @@ static void process_single_command(function_call *call, gldb_request_header *req
                 break_on_next = BUGLE_TRUE;
             else
             {
-                resp_str = dump_any_call_string(call);
                 stopped = BUGLE_TRUE;
                 break_on_next = BUGLE_FALSE;
                 gldb_protocol_send_code(out_pipe, RESP_BREAK);
                 gldb_protocol_send_code(out_pipe, start_id);
-                gldb_protocol_send_string(out_pipe, resp_str);
-                bugle_free(resp_str);
+                gldb_protocol_send_string(out_pipe, dump_any_call_string(call));
             }
         }
         break;
@@ -1125,8 +1140,6 @@ static bugle_thread_once_t debugger_init_thread_once = BUGLE_THREAD_ONCE_INIT;
 
 static bugle_bool debugger_callback(function_call *call, const callback_data *data)
 {
-    char *resp_str;
-
     /* Only one thread can read and write from the pipes.
      * FIXME: still stop others threads, with events to start and stop everything
      * in sync.
@@ -1139,13 +1152,11 @@ static bugle_bool debugger_callback(function_call *call, const callback_data *da
     {
         if (break_on[call->generic.id] || break_on_next)
         {
-            resp_str = dump_any_call_string(call);
             stopped = BUGLE_TRUE;
             break_on_next = BUGLE_FALSE;
             gldb_protocol_send_code(out_pipe, RESP_BREAK);
             gldb_protocol_send_code(out_pipe, start_id);
-            gldb_protocol_send_string(out_pipe, resp_str);
-            bugle_free(resp_str);
+            gldb_protocol_send_string(out_pipe, dump_any_call_string(call));
         }
     }
     debugger_loop(call);
@@ -1155,7 +1166,6 @@ static bugle_bool debugger_callback(function_call *call, const callback_data *da
 static bugle_bool debugger_error_callback(function_call *call, const callback_data *data)
 {
     GLenum error;
-    char *resp_str;
     const char *error_str = NULL; /* NULL indicates no break, if non-NULL then break */
 
     bugle_thread_once(&debugger_init_thread_once, debugger_init_thread);
@@ -1188,12 +1198,10 @@ static bugle_bool debugger_error_callback(function_call *call, const callback_da
 
     if (error_str != NULL)
     {
-        resp_str = dump_any_call_string(call);
         gldb_protocol_send_code(out_pipe, RESP_BREAK_EVENT);
         gldb_protocol_send_code(out_pipe, start_id);
-        gldb_protocol_send_string(out_pipe, resp_str);
+        gldb_protocol_send_string(out_pipe, dump_any_call_string(call));
         gldb_protocol_send_string(out_pipe, error_str);
-        bugle_free(resp_str);
         stopped = BUGLE_TRUE;
         debugger_loop(call);
     }
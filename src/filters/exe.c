@@ -22,24 +22,95 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#ifdef _WIN32
+# include <direct.h>
+# define getcwd _getcwd
+#else
+# include <unistd.h>
+#endif
 #include <bugle/bool.h>
 #include <bugle/memory.h>
 #include <bugle/string.h>
 #include <bugle/io.h>
+#include <bugle/hashtable.h>
 #include <budgie/reflect.h>
 #include <budgie/addresses.h>
 #include <bugle/glwin/glwin.h>
 #include <bugle/apireflect.h>
 #include <bugle/filters.h>
 #include <bugle/log.h>
+#include "platform/types.h"
+#include "common/fnv.h"
 
 static bugle_io_writer *out;
 static int frame = 0;
 static bugle_bool outside = BUGLE_TRUE;
 static char *exe_filename = NULL;
+static bugle_bool exe_compress = BUGLE_FALSE;
+
+/* Arrays of more than exe_array_limit elements are written to a side file
+ * rather than into the source, with each distinct const array stored once.
+ * The generated code maps the file and refers to arrays by their offset in
+ * it. exe_blobs maps a key made from the hash and size of an array to an
+ * exe_blob_entry.
+ */
+static char *exe_blob_filename = NULL;
+static FILE *exe_blob_file = NULL;
+static long exe_array_limit = 16;
+static unsigned long exe_blob_size = 0;
+static hash_table exe_blobs;
+
+typedef struct
+{
+    unsigned long offset;
+} exe_blob_entry;
+
+/* Arrays in the blob are aligned to this, to suit any element type */
+#define EXE_BLOB_ALIGN 16
 
 #define MAX_ARGS 32 /* Up this if necessary, but I hope not... */
 
+/* Returns the offset of a copy of the data in the blob, writing it if it is
+ * not already there. The blob is mapped writable, so arrays that the call
+ * may write to are not shared, and each gets a region of its own.
+ */
+static unsigned long exe_blob_offset(const void *data, size_t size, bugle_bool shared)
+{
+    char key[64];
+    bugle_uint64_t hash;
+    unsigned long offset;
+    exe_blob_entry *entry;
+    static const char padding[EXE_BLOB_ALIGN] = { 0 };
+
+    if (shared)
+    {
+        hash = bugle_fnv1a64(data, size);
+        sprintf(key, "%08lx%08lx:%lu",
+                (unsigned long) (hash >> 32), (unsigned long) (hash & 0xffffffffUL),
+                (unsigned long) size);
+        entry = (exe_blob_entry *) bugle_hash_get(&exe_blobs, key);
+        if (entry != NULL)
+            return entry->offset;
+    }
+
+    offset = exe_blob_size;
+    fwrite(data, 1, size, exe_blob_file);
+    exe_blob_size += size;
+    if (exe_blob_size % EXE_BLOB_ALIGN)
+    {
+        size_t pad = EXE_BLOB_ALIGN - exe_blob_size % EXE_BLOB_ALIGN;
+        fwrite(padding, 1, pad, exe_blob_file);
+        exe_blob_size += pad;
+    }
+    if (shared)
+    {
+        entry = BUGLE_MALLOC(exe_blob_entry);
+        entry->offset = offset;
+        bugle_hash_set(&exe_blobs, key, entry);
+    }
+    return offset;
+}
+
 /* Outputs a definition for the data in the pointer, and returns its number.
  * Also updated defn_pool to avoid name collisions. The type is the base
  * type, not the type of the pointer
@@ -52,6 +123,20 @@ static int follow_pointer(budgie_type type, int length, const void *ptr,
     int *arg_ids;
 
     size = budgie_type_size(type);
+    /* Large arrays of plain data go to the blob, which saves both dumping
+     * them here and compiling them later. Only const arrays (a leading K in
+     * the mangled name) are deduplicated.
+     */
+    if (exe_blob_file && length > exe_array_limit
+        && budgie_type_pointer_base(type) == NULL_TYPE)
+    {
+        bugle_io_printf(out, "        __typeof(%s) *defn%d = exe_blob(%lu);\n",
+                        budgie_type_name_nomangle(type), *defn_pool,
+                        exe_blob_offset(ptr, size * length,
+                                        budgie_type_name(type)[0] == 'K'));
+        return (*defn_pool)++;
+    }
+
     arg_ids = BUGLE_NMALLOC(length, int);
     /* First follow any sub-pointers */
     for (i = 0; i < length; i++)
@@ -62,18 +147,19 @@ static int follow_pointer(budgie_type type, int length, const void *ptr,
         cur = (const void *) (i * size + (const char *) ptr);
         cur_type = budgie_type_type(type, cur);
         base = budgie_type_pointer_base(cur_type);
-        if (base != NULL_TYPE)
+        if (base != NULL_TYPE && *(const void * const *) cur != NULL)
         {
             int cur_length;
             const void * const * cur_ptr;
 
             cur_ptr = (const void * const *) cur;
-            cur_length = abs(budgie_type_length(base, cur_ptr));
-            arg_ids[i] = follow_pointer(base, cur_length, cur_ptr, defn_pool);
+            cur_length = abs(budgie_type_length(cur_type, cur_ptr));
+            arg_ids[i] = follow_pointer(base, cur_length, *cur_ptr, defn_pool);
         }
         else
             arg_ids[i] = -1;
     }
+
     /* Now output ourself
      * Note: the __typeof is because not all definitions can be formed
      * simply as "<type> <identifier>" e.g. function pointers.
@@ -95,7 +181,7 @@ static int follow_pointer(budgie_type type, int length, const void *ptr,
     }
     bugle_free(arg_ids);
     bugle_io_puts(" };\n", out);
-    return *defn_pool++;
+    return (*defn_pool)++;
 }
 
 static bugle_bool exe_glwin_swap_buffers(function_call *call, const callback_data *data)
@@ -159,6 +245,119 @@ static bugle_bool exe_callback(function_call *call, const callback_data *data)
     return BUGLE_TRUE;
 }
 
+/* Returns the name of the blob as the generated program should open it.
+ * A relative name is resolved against the current directory, which is
+ * where the blob is written, so that the program can be run from anywhere.
+ * The caller must free the result.
+ */
+static char *exe_blob_path(void)
+{
+    const char *name = exe_blob_filename;
+    char *cwd = NULL, *path;
+    size_t size = 256;
+
+#ifdef _WIN32
+    if (name[0] == '/' || name[0] == '\\' || (name[0] && name[1] == ':'))
+        return bugle_strdup(name);
+#else
+    if (name[0] == '/')
+        return bugle_strdup(name);
+#endif
+    for (;;)
+    {
+        cwd = BUGLE_NREALLOC(cwd, size, char);
+        if (getcwd(cwd, size) != NULL)
+            break;
+        if (errno != ERANGE)
+        {
+            bugle_log_printf("exe", "initialise", BUGLE_LOG_WARNING,
+                             "cannot find the current directory (%s); the program "
+                             "must be run where %s can be found",
+                             strerror(errno), name);
+            bugle_free(cwd);
+            return bugle_strdup(name);
+        }
+        size *= 2;
+    }
+    path = bugle_asprintf("%s/%s", cwd, name);
+    bugle_free(cwd);
+    return path;
+}
+
+/* Emits exe_blob(offset), which returns a pointer into the blob file. The
+ * file is mapped copy-on-write where possible, so that only the pages that
+ * are used are read, and output arrays placed in the blob can be written.
+ */
+static void exe_write_blob_loader(void)
+{
+    char *path;
+    const char *c;
+
+    bugle_io_puts("#ifndef _WIN32\n"
+                  "# include <sys/types.h>\n"
+                  "# include <sys/stat.h>\n"
+                  "# include <sys/mman.h>\n"
+                  "# include <fcntl.h>\n"
+                  "# include <unistd.h>\n"
+                  "#endif\n"
+                  "\n"
+                  "static const char exe_blob_filename[] = \"", out);
+    path = exe_blob_path();
+    for (c = path; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            bugle_io_putc('\\', out);
+        bugle_io_putc(*c, out);
+    }
+    bugle_free(path);
+    bugle_io_puts("\";\n"
+                  "static char *exe_blob_data = NULL;\n"
+                  "\n"
+                  "static void *exe_blob(size_t offset)\n"
+                  "{\n"
+                  "    if (exe_blob_data == NULL)\n"
+                  "    {\n"
+                  "#ifndef _WIN32\n"
+                  "        struct stat st;\n"
+                  "        int fd = open(exe_blob_filename, O_RDONLY);\n"
+                  "\n"
+                  "        if (fd < 0 || fstat(fd, &st) != 0)\n"
+                  "        {\n"
+                  "            perror(exe_blob_filename);\n"
+                  "            exit(1);\n"
+                  "        }\n"
+                  "        exe_blob_data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);\n"
+                  "        if (exe_blob_data == MAP_FAILED)\n"
+                  "        {\n"
+                  "            perror(exe_blob_filename);\n"
+                  "            exit(1);\n"
+                  "        }\n"
+                  "        close(fd);\n"
+                  "#else\n"
+                  "        FILE *f = fopen(exe_blob_filename, \"rb\");\n"
+                  "        long size;\n"
+                  "\n"
+                  "        if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0)\n"
+                  "        {\n"
+                  "            perror(exe_blob_filename);\n"
+                  "            exit(1);\n"
+                  "        }\n"
+                  "        rewind(f);\n"
+                  "        exe_blob_data = malloc(size + 1);\n"
+                  "        if (exe_blob_data == NULL || fread(exe_blob_data, 1, size, f) != (size_t) size)\n"
+                  "        {\n"
+                  "            fprintf(stderr, \"%s: cannot read\\n\", exe_blob_filename);\n"
+                  "            exit(1);\n"
+                  "        }\n"
+                  "        fclose(f);\n"
+                  "#endif\n"
+                  "    }\n"
+                  "    return exe_blob_data + offset;\n"
+                  "}\n"
+                  "\n",
+                  out);
+}
+
 static bugle_bool exe_initialise(filter_set *handle)
 {
     filter *f;
@@ -169,7 +368,7 @@ static bugle_bool exe_initialise(filter_set *handle)
     bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, exe_glwin_swap_buffers);
     bugle_filter_order("invoke", "exe");
 
-    out_file = fopen(exe_filename, "w");
+    out_file = fopen(exe_filename, exe_compress ? "wb" : "w");
     if (!out_file)
     {
         bugle_log_printf("exe", "initialise", BUGLE_LOG_ERROR,
@@ -177,7 +376,19 @@ static bugle_bool exe_initialise(filter_set *handle)
         return BUGLE_FALSE;
     }
     out = bugle_io_writer_file_new(out_file);
-    bugle_io_puts("#include <stdlib.h>\n"
+    if (exe_compress)
+    {
+        bugle_io_writer *block;
+
+        block = bugle_io_writer_block_new(out, 0);
+        if (block)
+            out = block;
+        else
+            bugle_log("exe", "initialise", BUGLE_LOG_WARNING,
+                      "cannot start the compression thread; writing uncompressed");
+    }
+    bugle_io_puts("#include <stdio.h>\n"
+                  "#include <stdlib.h>\n"
                   "#include <string.h>\n"
 #if BUGLE_GLTYPE_GL
                   "#include <GL/glew.h>\n"
@@ -193,6 +404,19 @@ static bugle_bool exe_initialise(filter_set *handle)
 #endif
                   "\n",
                   out);
+    if (exe_blob_filename && exe_blob_filename[0])
+    {
+        exe_blob_file = fopen(exe_blob_filename, "wb");
+        if (!exe_blob_file)
+        {
+            bugle_log_printf("exe", "initialise", BUGLE_LOG_ERROR,
+                             "cannot open %s for writing: %s", exe_blob_filename, strerror(errno));
+            bugle_io_writer_close(out);
+            return BUGLE_FALSE;
+        }
+        bugle_hash_init(&exe_blobs, bugle_free);
+        exe_write_blob_loader();
+    }
     return BUGLE_TRUE;
 }
 
@@ -208,7 +432,13 @@ static void exe_shutdown(filter_set *handle)
         bugle_io_printf(out, "    frame%d,\n", i);
     bugle_io_printf(out, "};\n");
     bugle_io_writer_close(out);
+    if (exe_blob_file)
+    {
+        fclose(exe_blob_file);
+        bugle_hash_clear(&exe_blobs);
+    }
     bugle_free(exe_filename);
+    bugle_free(exe_blob_filename);
 }
 
 void bugle_initialise_filter_library(void)
@@ -216,6 +446,9 @@ void bugle_initialise_filter_library(void)
     static const filter_set_variable_info exe_variables[] =
     {
         { "filename", "filename of the C file to write [exetrace.c]", FILTER_SET_VARIABLE_STRING, &exe_filename, NULL },
+        { "compress", "compress the output (decompress with bugle-unblock) [no]", FILTER_SET_VARIABLE_BOOL, &exe_compress, NULL },
+        { "blob", "filename for the contents of large arrays, instead of writing them into the C file [none]", FILTER_SET_VARIABLE_STRING, &exe_blob_filename, NULL },
+        { "array_limit", "arrays with more elements than this go in the blob [16]", FILTER_SET_VARIABLE_UINT, &exe_array_limit, NULL },
         { NULL, NULL, 0, NULL, NULL }
     };
 
@@ -65,31 +65,34 @@ static void BUDGIEAPI logdebug_message(
         level = BUGLE_LOG_INFO; /* should never be reached */
     }
 
-    switch (source)
+    if (bugle_log_enabled("logdebug", "message", level))
     {
-    case GL_DEBUG_SOURCE_API_ARB:             source_label = "API"; break;
-    case GL_DEBUG_SOURCE_WINDOW_SYSTEM_ARB:   source_label = "window system"; break;
-    case GL_DEBUG_SOURCE_SHADER_COMPILER_ARB: source_label = "shader compiler"; break;
-    case GL_DEBUG_SOURCE_THIRD_PARTY_ARB:     source_label = "third party"; break;
-    case GL_DEBUG_SOURCE_APPLICATION_ARB:     source_label = "application"; break;
-    case GL_DEBUG_SOURCE_OTHER_ARB:           source_label = "other"; break;
-    default:                                  source_label = "???"; break;
-    }
+        switch (source)
+        {
+        case GL_DEBUG_SOURCE_API_ARB:             source_label = "API"; break;
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM_ARB:   source_label = "window system"; break;
+        case GL_DEBUG_SOURCE_SHADER_COMPILER_ARB: source_label = "shader compiler"; break;
+        case GL_DEBUG_SOURCE_THIRD_PARTY_ARB:     source_label = "third party"; break;
+        case GL_DEBUG_SOURCE_APPLICATION_ARB:     source_label = "application"; break;
+        case GL_DEBUG_SOURCE_OTHER_ARB:           source_label = "other"; break;
+        default:                                  source_label = "???"; break;
+        }
 
-    switch (type)
-    {
-    case GL_DEBUG_TYPE_ERROR_ARB:               type_label = "error"; break;
-    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR_ARB: type_label = "deprecated behavior"; break;
-    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR_ARB:  type_label = "undefined behavior"; break;
-    case GL_DEBUG_TYPE_PORTABILITY_ARB:         type_label = "portability"; break;
-    case GL_DEBUG_TYPE_PERFORMANCE_ARB:         type_label = "performance"; break;
-    case GL_DEBUG_TYPE_OTHER_ARB:               type_label = "other"; break;
-    default:                                    type_label = "???"; break;
-    }
+        switch (type)
+        {
+        case GL_DEBUG_TYPE_ERROR_ARB:               type_label = "error"; break;
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR_ARB: type_label = "deprecated behavior"; break;
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR_ARB:  type_label = "undefined behavior"; break;
+        case GL_DEBUG_TYPE_PORTABILITY_ARB:         type_label = "portability"; break;
+        case GL_DEBUG_TYPE_PERFORMANCE_ARB:         type_label = "performance"; break;
+        case GL_DEBUG_TYPE_OTHER_ARB:               type_label = "other"; break;
+        default:                                    type_label = "???"; break;
+        }
 
-    bugle_log_printf("logdebug", "message", level,
-                     "%.*s [source: %s type: %s id: %u]",
-                     length, message, source_label, type_label, (unsigned int) id);
+        bugle_log_printf("logdebug", "message", level,
+                         "%.*s [source: %s type: %s id: %u]",
+                         length, message, source_label, type_label, (unsigned int) id);
+    }
 
     if (ctx->orig_callback != NULL)
     {
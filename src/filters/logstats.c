@@ -60,6 +60,8 @@ static bugle_bool logstats_swap_buffers(function_call *call, const callback_data
         {
             double v;
             st = (stats_statistic *) bugle_list_data(i);
+            if (!bugle_log_enabled("logstats", st->name, BUGLE_LOG_INFO))
+                continue;
             v = bugle_stats_expression_evaluate(st->value, &logstats_prev, &logstats_cur);
             if (bugle_isfinite(v))
             {
@@ -15,53 +15,392 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+/* Call timing is done in a way that keeps the per-call work small, since it
+ * distorts the very times being measured. Each thread times calls with
+ * bugle_ticks() and adds the result to its own per-function counters,
+ * which only it writes. At the end of each frame the counters are read,
+ * converted to seconds and added to the signals, with a single clock read
+ * for all of them. Optionally only a sample of the calls are timed, and
+ * the totals are scaled up to compensate.
+ *
+ * If any of the latency signals are in use, each timed call is also
+ * counted in a per-thread, per-function histogram with logarithmic
+ * buckets (see common/histogram.h). These are merged every few frames to
+ * produce percentiles.
+ */
+
 #if HAVE_CONFIG_H
 # include <config.h>
 #endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <bugle/bool.h>
 #include <bugle/memory.h>
+#include <bugle/math.h>
 #include <bugle/string.h>
 #include <bugle/time.h>
 #include <bugle/stats.h>
 #include <bugle/filters.h>
-#include <bugle/objects.h>
+#include <bugle/linkedlist.h>
+#include <bugle/glwin/glwin.h>
 #include <budgie/reflect.h>
+#include "platform/threads.h"
+#include "platform/ticks.h"
+#include "platform/types.h"
+#include "common/histogram.h"
+
+enum
+{
+    STATS_CALLTIMES_P50,
+    STATS_CALLTIMES_P95,
+    STATS_CALLTIMES_P99,
+    STATS_CALLTIMES_MAX,
+    STATS_CALLTIMES_LATENCIES
+};
+
+typedef struct
+{
+    long countdown;               /* calls until the next one to time */
+    bugle_uint32_t random;        /* xorshift state, for random sampling */
+    bugle_uint64_t start;
+    bugle_bool timing;            /* BUGLE_TRUE if the current call is timed */
+    /* Ticks spent in timed calls to each function. Only the owning thread
+     * writes these, and they are never reset; the flush works with the
+     * difference from the last values it saw, which is valid even if they
+     * wrap.
+     */
+    volatile bugle_uint64_t *ticks;
+    bugle_uint64_t *flushed;      /* only accessed by the flush, under the lock */
+
+    /* Histogram of timed calls to each function, allocated on first use.
+     * As for ticks, only the owning thread writes the counts, and the
+     * pointers are published with bugle_atomic_store.
+     */
+    volatile unsigned long **histograms;
+    unsigned long **histograms_flushed;
+    linked_list_node *node;       /* in stats_calltimes_threads */
+} stats_calltimes_thread;
+
+static long stats_calltimes_sample = 1;
+static bugle_bool stats_calltimes_random = BUGLE_FALSE;
+static bugle_bool stats_calltimes_cycles = BUGLE_TRUE;
+static long stats_calltimes_window = 60;
 
 static stats_signal **stats_calltimes_signals;
 static stats_signal *stats_calltimes_total;
-static object_view time_view;
+static double *stats_calltimes_seconds;   /* scratch for the flush */
+static double stats_calltimes_tick_seconds;
+
+static const char * const stats_calltimes_latency_names[STATS_CALLTIMES_LATENCIES] =
+{
+    "calltimes_p50",
+    "calltimes_p95",
+    "calltimes_p99",
+    "calltimes_max"
+};
+static const double stats_calltimes_latency_quantiles[STATS_CALLTIMES_LATENCIES] =
+{
+    0.50, 0.95, 0.99, 1.0
+};
+static stats_signal **stats_calltimes_latencies[STATS_CALLTIMES_LATENCIES];
+static bugle_bool stats_calltimes_histograms = BUGLE_FALSE;
+static unsigned long **stats_calltimes_window_histograms;
+static long stats_calltimes_window_frames = 0;
+
+static bugle_thread_key_t stats_calltimes_key;
+/* Protects the list, and the totals that threads are merged into */
+static bugle_thread_lock_t stats_calltimes_lock;
+static linked_list stats_calltimes_threads;
+
+static bugle_uint64_t stats_calltimes_now(void)
+{
+    return stats_calltimes_cycles ? bugle_ticks() : bugle_ticks_clock();
+}
+
+/* Measures the tick rate against bugle_gettime over a few milliseconds */
+static double stats_calltimes_calibrate(void)
+{
+    bugle_timespec start, end;
+    bugle_uint64_t ticks_start, ticks_end;
+    double elapsed;
+
+    bugle_gettime(&start);
+    ticks_start = stats_calltimes_now();
+    do
+    {
+        bugle_gettime(&end);
+        ticks_end = stats_calltimes_now();
+        elapsed = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+    } while (elapsed < 0.01);
+    if (ticks_end == ticks_start)
+        return 0.0;
+    return elapsed / (double) (ticks_end - ticks_start);
+}
+
+/* Returns the number of calls until the next sample: always
+ * stats_calltimes_sample, or uniform on [1, 2 * stats_calltimes_sample - 1]
+ * for random sampling, which has the same mean but does not lock onto
+ * repeating patterns of calls.
+ */
+static long stats_calltimes_interval(stats_calltimes_thread *t)
+{
+    if (!stats_calltimes_random || stats_calltimes_sample == 1)
+        return stats_calltimes_sample;
+    t->random ^= t->random << 13;
+    t->random ^= t->random >> 17;
+    t->random ^= t->random << 5;
+    return 1 + (long) (t->random % (bugle_uint32_t) (2 * stats_calltimes_sample - 1));
+}
+
+static void stats_calltimes_thread_free(void *data)
+{
+    stats_calltimes_thread *t = (stats_calltimes_thread *) data;
+    int i;
+
+    for (i = 0; i < budgie_function_count(); i++)
+    {
+        bugle_free((void *) t->histograms[i]);
+        bugle_free(t->histograms_flushed[i]);
+    }
+    bugle_free((void *) t->histograms);
+    bugle_free(t->histograms_flushed);
+    bugle_free((void *) t->ticks);
+    bugle_free(t->flushed);
+    bugle_free(t);
+}
+
+static stats_calltimes_thread *stats_calltimes_get_thread(void)
+{
+    stats_calltimes_thread *t;
+
+    t = (stats_calltimes_thread *) bugle_thread_getspecific(stats_calltimes_key);
+    if (!t)
+    {
+        t = BUGLE_MALLOC(stats_calltimes_thread);
+        t->random = (bugle_uint32_t) (bugle_uintptr_t) t ^ (bugle_uint32_t) bugle_ticks_clock();
+        if (t->random == 0)
+            t->random = 1;
+        t->countdown = stats_calltimes_interval(t);
+        t->timing = BUGLE_FALSE;
+        t->ticks = BUGLE_CALLOC(budgie_function_count(), bugle_uint64_t);
+        t->flushed = BUGLE_CALLOC(budgie_function_count(), bugle_uint64_t);
+        t->histograms = (volatile unsigned long **) BUGLE_CALLOC(budgie_function_count(), unsigned long *);
+        t->histograms_flushed = BUGLE_CALLOC(budgie_function_count(), unsigned long *);
+        bugle_thread_setspecific(stats_calltimes_key, t);
+
+        bugle_thread_lock_lock(&stats_calltimes_lock);
+        t->node = bugle_list_append(&stats_calltimes_threads, t);
+        bugle_thread_lock_unlock(&stats_calltimes_lock);
+    }
+    return t;
+}
 
 static bugle_bool stats_calltimes_pre(function_call *call, const callback_data *data)
 {
-    bugle_timespec *start;
+    stats_calltimes_thread *t;
 
-    start = bugle_object_get_current_data(bugle_get_call_class(), time_view);
-    bugle_gettime(start);
+    t = stats_calltimes_get_thread();
+    if (--t->countdown == 0)
+    {
+        t->countdown = stats_calltimes_interval(t);
+        t->timing = BUGLE_TRUE;
+        t->start = stats_calltimes_now();
+    }
     return BUGLE_TRUE;
 }
 
 static bugle_bool stats_calltimes_post(function_call *call, const callback_data *data)
 {
-    bugle_timespec *start;
-    bugle_timespec end;
-    double elapsed;
+    stats_calltimes_thread *t;
+    bugle_uint64_t end;
+    volatile bugle_uint64_t *ticks;
 
-    bugle_gettime(&end);
-    start = bugle_object_get_current_data(bugle_get_call_class(), time_view);
-    elapsed = (end.tv_sec  - start->tv_sec) + 1e-9 * (end.tv_nsec - start->tv_nsec);
+    t = (stats_calltimes_thread *) bugle_thread_getspecific(stats_calltimes_key);
+    if (t && t->timing)
+    {
+        end = stats_calltimes_now();
+        t->timing = BUGLE_FALSE;
+        ticks = &t->ticks[call->generic.id];
+        bugle_atomic_store(ticks, *ticks + (end - t->start));
+        if (stats_calltimes_histograms)
+        {
+            volatile unsigned long *h;
+            int b;
 
-    bugle_stats_signal_add(stats_calltimes_signals[call->generic.id], elapsed);
-    bugle_stats_signal_add(stats_calltimes_total, elapsed);
+            h = t->histograms[call->generic.id];
+            if (!h)
+            {
+                h = BUGLE_CALLOC(BUGLE_HISTOGRAM_BUCKETS, unsigned long);
+                bugle_atomic_store(&t->histograms[call->generic.id], h);
+            }
+            b = bugle_histogram_bucket(end - t->start);
+            bugle_atomic_store(&h[b], h[b] + 1);
+        }
+    }
+    return BUGLE_TRUE;
+}
+
+/* Adds the counts made by a thread since the last merge to the window
+ * histograms. Must be called with the lock held.
+ */
+static void stats_calltimes_merge(stats_calltimes_thread *t)
+{
+    int n, f, b;
+
+    n = budgie_function_count();
+    for (f = 0; f < n; f++)
+    {
+        volatile unsigned long *h;
+        unsigned long *flushed, *window;
+
+        h = bugle_atomic_load(&t->histograms[f]);
+        if (!h)
+            continue;
+        flushed = t->histograms_flushed[f];
+        if (!flushed)
+            flushed = t->histograms_flushed[f] = BUGLE_CALLOC(BUGLE_HISTOGRAM_BUCKETS, unsigned long);
+        window = stats_calltimes_window_histograms[f];
+        if (!window)
+            window = stats_calltimes_window_histograms[f] = BUGLE_CALLOC(BUGLE_HISTOGRAM_BUCKETS, unsigned long);
+        for (b = 0; b < BUGLE_HISTOGRAM_BUCKETS; b++)
+        {
+            unsigned long count = bugle_atomic_load(&h[b]);
+            if (count != flushed[b])
+            {
+                window[b] += count - flushed[b];
+                flushed[b] = count;
+            }
+        }
+    }
+}
+
+/* Adds the time and, if latencies are due, the histogram counts recorded
+ * by a thread since the last flush to the totals. Must be called with the
+ * lock held.
+ */
+static void stats_calltimes_collect(stats_calltimes_thread *t, bugle_bool latencies)
+{
+    double scale;
+    int n, f;
+
+    n = budgie_function_count();
+    scale = stats_calltimes_tick_seconds * stats_calltimes_sample;
+    for (f = 0; f < n; f++)
+    {
+        bugle_uint64_t ticks = bugle_atomic_load(&t->ticks[f]);
+        if (ticks != t->flushed[f])
+        {
+            stats_calltimes_seconds[f] += (double) (ticks - t->flushed[f]) * scale;
+            t->flushed[f] = ticks;
+        }
+    }
+    if (latencies)
+        stats_calltimes_merge(t);
+}
+
+/* Thread-exit destructor: keeps what the thread measured for the next
+ * flush, then frees its state.
+ */
+static void stats_calltimes_thread_release(void *data)
+{
+    stats_calltimes_thread *t = (stats_calltimes_thread *) data;
+
+    bugle_thread_lock_lock(&stats_calltimes_lock);
+    stats_calltimes_collect(t, stats_calltimes_histograms);
+    bugle_list_erase(&stats_calltimes_threads, t->node);
+    bugle_thread_lock_unlock(&stats_calltimes_lock);
+}
+
+/* Updates the latency signals from the window histograms, and empties them */
+static void stats_calltimes_update_latencies(const bugle_timespec *now)
+{
+    int n, f, b, l;
+
+    n = budgie_function_count();
+    for (f = 0; f < n; f++)
+    {
+        unsigned long *window = stats_calltimes_window_histograms[f];
+        unsigned long total = 0, cumulative = 0;
+
+        if (!window)
+            continue;
+        for (b = 0; b < BUGLE_HISTOGRAM_BUCKETS; b++)
+            total += window[b];
+        b = 0;
+        for (l = 0; l < STATS_CALLTIMES_LATENCIES; l++)
+        {
+            stats_signal *si = stats_calltimes_latencies[l][f];
+            unsigned long rank;
+
+            if (!si->active)
+                continue;
+            if (total == 0)
+            {
+                bugle_stats_signal_update_at(si, bugle_nan(), now);
+                continue;
+            }
+            /* The quantiles are increasing, so the search can carry on
+             * from where the last one stopped.
+             */
+            rank = (unsigned long) ceil(stats_calltimes_latency_quantiles[l] * total);
+            if (rank < 1)
+                rank = 1;
+            while (cumulative + window[b] < rank)
+                cumulative += window[b++];
+            bugle_stats_signal_update_at(si, bugle_histogram_bucket_max(b) * stats_calltimes_tick_seconds, now);
+        }
+        memset(window, 0, BUGLE_HISTOGRAM_BUCKETS * sizeof(unsigned long));
+    }
+}
+
+/* Moves the time accumulated by all threads into the signals */
+static bugle_bool stats_calltimes_swap_buffers(function_call *call, const callback_data *data)
+{
+    linked_list_node *i;
+    bugle_timespec now;
+    double total = 0.0;
+    bugle_bool latencies;
+    int n, f;
+
+    n = budgie_function_count();
+    latencies = stats_calltimes_histograms && ++stats_calltimes_window_frames >= stats_calltimes_window;
+    /* The lock is held throughout, since exiting threads add to the totals */
+    bugle_thread_lock_lock(&stats_calltimes_lock);
+    for (i = bugle_list_head(&stats_calltimes_threads); i; i = bugle_list_next(i))
+        stats_calltimes_collect((stats_calltimes_thread *) bugle_list_data(i), latencies);
+
+    bugle_gettime(&now);
+    if (latencies)
+    {
+        stats_calltimes_update_latencies(&now);
+        stats_calltimes_window_frames = 0;
+    }
+    for (f = 0; f < n; f++)
+        if (stats_calltimes_seconds[f] != 0.0)
+        {
+            bugle_stats_signal_add_at(stats_calltimes_signals[f], stats_calltimes_seconds[f], &now);
+            total += stats_calltimes_seconds[f];
+            stats_calltimes_seconds[f] = 0.0;
+        }
+    bugle_stats_signal_add_at(stats_calltimes_total, total, &now);
+    bugle_thread_lock_unlock(&stats_calltimes_lock);
+    return BUGLE_TRUE;
+}
+
+/* Histograms are only kept if some latency signal is used */
+static bugle_bool stats_calltimes_latency_activate(stats_signal *si)
+{
+    stats_calltimes_histograms = BUGLE_TRUE;
+    bugle_stats_signal_update(si, bugle_nan());
     return BUGLE_TRUE;
 }
 
 static bugle_bool stats_calltimes_initialise(filter_set *handle)
 {
     filter *f;
-    int i;
+    int i, l;
 
     f = bugle_filter_new(handle, "stats_calltimes_pre");
     bugle_filter_catches_all(f, BUGLE_FALSE, stats_calltimes_pre);
@@ -72,6 +411,11 @@ static bugle_bool stats_calltimes_initialise(filter_set *handle)
     bugle_filter_catches_all(f, BUGLE_FALSE, stats_calltimes_post);
     bugle_filter_order("invoke", "stats_calltimes_post");
 
+    f = bugle_filter_new(handle, "stats_calltimes");
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, stats_calltimes_swap_buffers);
+    bugle_filter_order("stats_calltimes", "invoke");
+    bugle_filter_order("stats_calltimes", "stats");
+
     /* Try to get this filter-set close to the calls */
     bugle_filter_order("stats_calls", "stats_calltimes_pre");
     bugle_filter_order("stats_basic", "stats_calltimes_pre");
@@ -86,22 +430,61 @@ static bugle_bool stats_calltimes_initialise(filter_set *handle)
         bugle_free(name);
     }
     stats_calltimes_total = bugle_stats_signal_new("calltimes:total", NULL, NULL);
+    for (l = 0; l < STATS_CALLTIMES_LATENCIES; l++)
+    {
+        stats_calltimes_latencies[l] = BUGLE_NMALLOC(budgie_function_count(), stats_signal *);
+        for (i = 0; i < budgie_function_count(); i++)
+        {
+            char *name;
+            name = bugle_asprintf("%s:%s", stats_calltimes_latency_names[l], budgie_function_name(i));
+            stats_calltimes_latencies[l][i] = bugle_stats_signal_new(name, NULL, stats_calltimes_latency_activate);
+            bugle_free(name);
+        }
+    }
+    stats_calltimes_window_histograms = BUGLE_CALLOC(budgie_function_count(), unsigned long *);
+    stats_calltimes_seconds = BUGLE_CALLOC(budgie_function_count(), double);
 
-    time_view = bugle_object_view_new(bugle_get_call_class(),
-                                      NULL,
-                                      NULL,
-                                      sizeof(bugle_timespec));
+    bugle_thread_key_create(&stats_calltimes_key, stats_calltimes_thread_release);
+    bugle_thread_lock_init(&stats_calltimes_lock);
+    bugle_list_init(&stats_calltimes_threads, stats_calltimes_thread_free);
 
+    stats_calltimes_tick_seconds = stats_calltimes_calibrate();
+    if (stats_calltimes_tick_seconds == 0.0 && stats_calltimes_cycles)
+    {
+        /* The counter does not seem to run, so fall back to the clock */
+        stats_calltimes_cycles = BUGLE_FALSE;
+        stats_calltimes_tick_seconds = stats_calltimes_calibrate();
+    }
     return BUGLE_TRUE;
 }
 
 static void stats_calltimes_shutdown(filter_set *handle)
 {
+    int i;
+
+    bugle_thread_key_delete(stats_calltimes_key);
+    bugle_list_clear(&stats_calltimes_threads);
+    for (i = 0; i < budgie_function_count(); i++)
+        bugle_free(stats_calltimes_window_histograms[i]);
+    bugle_free(stats_calltimes_window_histograms);
+    for (i = 0; i < STATS_CALLTIMES_LATENCIES; i++)
+        bugle_free(stats_calltimes_latencies[i]);
+    bugle_thread_lock_destroy(&stats_calltimes_lock);
+    bugle_free(stats_calltimes_seconds);
     bugle_free(stats_calltimes_signals);
 }
 
 void bugle_initialise_filter_library(void)
 {
+    static const filter_set_variable_info stats_calltimes_variables[] =
+    {
+        { "sample", "time only one call in this many, and scale up the results [1]", FILTER_SET_VARIABLE_POSITIVE_INT, &stats_calltimes_sample, NULL },
+        { "random", "space the sampled calls randomly rather than evenly [no]", FILTER_SET_VARIABLE_BOOL, &stats_calltimes_random, NULL },
+        { "cycles", "time calls with the CPU cycle counter, if there is one [yes]", FILTER_SET_VARIABLE_BOOL, &stats_calltimes_cycles, NULL },
+        { "window", "number of frames over which latency percentiles are measured [60]", FILTER_SET_VARIABLE_POSITIVE_INT, &stats_calltimes_window, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
     static const filter_set_info stats_calltimes_info =
     {
         "stats_calltimes",
@@ -109,7 +492,7 @@ void bugle_initialise_filter_library(void)
         stats_calltimes_shutdown,
         NULL,
         NULL,
-        NULL,
+        stats_calltimes_variables,
         "stats module: measure times of calls"
     };
 
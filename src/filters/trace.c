@@ -21,12 +21,115 @@
 #include <bugle/bool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <bugle/gl/glutils.h>
+#include <bugle/glwin/glwin.h>
 #include <bugle/filters.h>
 #include <bugle/memory.h>
+#include <bugle/string.h>
 #include <bugle/log.h>
+#include <bugle/linkedlist.h>
 #include <budgie/reflect.h>
 #include <budgie/addresses.h>
+#include "platform/threads.h"
+#include "platform/types.h"
+#include "common/traceindex.h"
+
+static budgie_dump_array_policy trace_array_policy = { BUDGIE_DUMP_ARRAY_FULL, 16 };
+
+/* Frame index (see common/traceindex.h). To keep locking out of the traced
+ * calls, each thread counts its calls in a trace_index_thread that only it
+ * writes. The counters are never reset: at the end of a frame they are
+ * merged into the totals below by taking the difference from the values
+ * last seen, which is valid even if they wrap. A call made by another
+ * thread while the frame is being ended may land in either frame.
+ *
+ * Everything below is protected by trace_index_lock.
+ */
+typedef struct
+{
+    volatile bugle_uint32_t *counts;
+    bugle_uint32_t *flushed;
+    volatile bugle_uint32_t calls;
+    bugle_uint32_t calls_flushed;
+    linked_list_node *node;
+} trace_index_thread;
+
+static char *trace_index_filename = NULL;
+static FILE *trace_index_file = NULL;
+static FILE *trace_counts_file = NULL;
+static bugle_thread_lock_t trace_index_lock;
+static bugle_thread_key_t trace_index_key;
+static linked_list trace_index_threads;
+static bugle_uint64_t trace_index_frame = 0;
+static long trace_index_start = 0;
+static bugle_uint64_t trace_counts_offset = 0;
+static bugle_uint32_t trace_index_calls = 0;
+/* Calls to each function in the current frame, and the functions that have
+ * a non-zero count, so that they can be emitted and reset cheaply.
+ */
+static bugle_uint32_t *trace_index_counts = NULL;
+static budgie_function *trace_index_touched = NULL;
+static size_t trace_index_touched_count = 0;
+
+/* Adds the calls made by a thread since the last merge to the totals */
+static void trace_index_merge(trace_index_thread *t)
+{
+    budgie_function f;
+    bugle_uint32_t count;
+
+    for (f = 0; f < budgie_function_count(); f++)
+    {
+        count = bugle_atomic_load(&t->counts[f]);
+        if (count != t->flushed[f])
+        {
+            if (trace_index_counts[f] == 0)
+                trace_index_touched[trace_index_touched_count++] = f;
+            trace_index_counts[f] += count - t->flushed[f];
+            t->flushed[f] = count;
+        }
+    }
+    count = bugle_atomic_load(&t->calls);
+    trace_index_calls += count - t->calls_flushed;
+    t->calls_flushed = count;
+}
+
+/* Thread-exit destructor: keeps the calls for the current frame */
+static void trace_index_thread_release(void *data)
+{
+    trace_index_thread *t = (trace_index_thread *) data;
+
+    bugle_thread_lock_lock(&trace_index_lock);
+    trace_index_merge(t);
+    bugle_list_erase(&trace_index_threads, t->node);
+    bugle_thread_lock_unlock(&trace_index_lock);
+    bugle_free((void *) t->counts);
+    bugle_free(t->flushed);
+    bugle_free(t);
+}
+
+static void trace_index_count(budgie_function id)
+{
+    trace_index_thread *t;
+
+    t = (trace_index_thread *) bugle_thread_getspecific(trace_index_key);
+    if (!t)
+    {
+        t = BUGLE_MALLOC(trace_index_thread);
+        t->counts = BUGLE_CALLOC(budgie_function_count(), bugle_uint32_t);
+        t->flushed = BUGLE_CALLOC(budgie_function_count(), bugle_uint32_t);
+        t->calls = 0;
+        t->calls_flushed = 0;
+        bugle_thread_setspecific(trace_index_key, t);
+
+        bugle_thread_lock_lock(&trace_index_lock);
+        t->node = bugle_list_append(&trace_index_threads, t);
+        bugle_thread_lock_unlock(&trace_index_lock);
+    }
+    bugle_atomic_store(&t->counts[id], t->counts[id] + 1);
+    bugle_atomic_store(&t->calls, t->calls + 1);
+}
 
 static bugle_bool trace_callback(function_call *call, const callback_data *data)
 {
@@ -35,11 +138,125 @@ static bugle_bool trace_callback(function_call *call, const callback_data *data)
      */
     bugle_io_writer *writer;
 
-    writer = bugle_io_writer_mem_new(256);
+    if (!bugle_log_enabled("trace", "call", BUGLE_LOG_INFO))
+        return BUGLE_TRUE;
+    writer = bugle_io_writer_mem_scratch();
+    budgie_dump_set_array_policy(&trace_array_policy);
     budgie_dump_any_call(&call->generic, 0, writer);
+    budgie_dump_set_array_policy(NULL);
     bugle_log("trace", "call", BUGLE_LOG_INFO, bugle_io_writer_mem_get(writer));
-    bugle_io_writer_mem_release(writer);
-    bugle_io_writer_close(writer);
+    if (trace_index_file)
+        trace_index_count(call->generic.id);
+    return BUGLE_TRUE;
+}
+
+/* Runs after the swap has been traced, so the swap ends the frame */
+static bugle_bool trace_swap_buffers(function_call *call, const callback_data *data)
+{
+    bugle_traceindex_frame entry;
+    bugle_traceindex_count count;
+    linked_list_node *node;
+    long offset;
+    size_t i;
+
+    offset = bugle_log_file_offset();
+    if (offset < 0)
+        return BUGLE_TRUE;
+
+    bugle_thread_lock_lock(&trace_index_lock);
+    for (node = bugle_list_head(&trace_index_threads); node; node = bugle_list_next(node))
+        trace_index_merge((trace_index_thread *) bugle_list_data(node));
+    entry.frame = trace_index_frame;
+    entry.start = trace_index_start;
+    entry.end = offset;
+    entry.counts_offset = trace_counts_offset;
+    entry.counts_length = trace_index_touched_count;
+    entry.calls = trace_index_calls;
+    for (i = 0; i < trace_index_touched_count; i++)
+    {
+        count.function = trace_index_touched[i];
+        count.count = trace_index_counts[count.function];
+        fwrite(&count, sizeof(count), 1, trace_counts_file);
+        trace_index_counts[count.function] = 0;
+    }
+    /* The counts are flushed first, so that a frame in the index always
+     * has its counts on disk.
+     */
+    fflush(trace_counts_file);
+    fwrite(&entry, sizeof(entry), 1, trace_index_file);
+    fflush(trace_index_file);
+
+    trace_counts_offset += trace_index_touched_count * sizeof(count);
+    trace_index_touched_count = 0;
+    trace_index_calls = 0;
+    trace_index_start = offset;
+    trace_index_frame++;
+    bugle_thread_lock_unlock(&trace_index_lock);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool trace_index_open(void)
+{
+    bugle_traceindex_header header;
+    char *counts_filename;
+
+    /* Compressed logs are written in blocks, and have no byte offsets for
+     * the index to record.
+     */
+    trace_index_start = bugle_log_file_offset();
+    if (trace_index_start < 0)
+    {
+        bugle_log("trace", "index", BUGLE_LOG_WARNING,
+                  "the frame index requires an uncompressed log file; not writing an index");
+        bugle_free(trace_index_filename);
+        trace_index_filename = NULL;
+        return BUGLE_TRUE;
+    }
+
+    counts_filename = bugle_asprintf("%s%s", trace_index_filename, BUGLE_TRACEINDEX_COUNTS_SUFFIX);
+    trace_index_file = fopen(trace_index_filename, "wb");
+    if (trace_index_file)
+        trace_counts_file = fopen(counts_filename, "wb");
+    if (!trace_index_file || !trace_counts_file)
+    {
+        bugle_log_printf("trace", "index", BUGLE_LOG_ERROR,
+                         "cannot open %s for writing: %s",
+                         trace_index_file ? counts_filename : trace_index_filename,
+                         strerror(errno));
+        if (trace_index_file)
+            fclose(trace_index_file);
+        trace_index_file = NULL;
+        bugle_free(counts_filename);
+        return BUGLE_FALSE;
+    }
+    bugle_free(counts_filename);
+
+    memcpy(header.magic, BUGLE_TRACEINDEX_MAGIC, sizeof(header.magic));
+    header.version = BUGLE_TRACEINDEX_VERSION;
+    header.byte_order = BUGLE_TRACEINDEX_BYTE_ORDER;
+    header.function_count = budgie_function_count();
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, trace_index_file);
+
+    bugle_thread_lock_init(&trace_index_lock);
+    bugle_thread_key_create(&trace_index_key, trace_index_thread_release);
+    bugle_list_init(&trace_index_threads, NULL);
+    trace_index_counts = BUGLE_CALLOC(budgie_function_count(), bugle_uint32_t);
+    trace_index_touched = BUGLE_NMALLOC(budgie_function_count(), budgie_function);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool trace_set_arrays(const filter_set_variable_info *var,
+                                   const char *text, const void *value)
+{
+    if (strcmp(text, "full") == 0)
+        trace_array_policy.mode = BUDGIE_DUMP_ARRAY_FULL;
+    else if (strcmp(text, "truncate") == 0)
+        trace_array_policy.mode = BUDGIE_DUMP_ARRAY_TRUNCATE;
+    else if (strcmp(text, "hash") == 0)
+        trace_array_policy.mode = BUDGIE_DUMP_ARRAY_HASH;
+    else
+        return BUGLE_FALSE;
     return BUGLE_TRUE;
 }
 
@@ -51,19 +268,63 @@ static bugle_bool trace_initialise(filter_set *handle)
     bugle_filter_order("invoke", "trace");
     bugle_filter_catches_all(f, BUGLE_FALSE, trace_callback);
     bugle_gl_filter_post_renders("trace");
+
+    if (trace_index_filename)
+    {
+        if (!trace_index_open())
+            return BUGLE_FALSE;
+    }
+    if (trace_index_file)
+    {
+        f = bugle_filter_new(handle, "trace_index");
+        bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, trace_swap_buffers);
+        bugle_filter_order("trace", "trace_index");
+    }
     return BUGLE_TRUE;
 }
 
+static void trace_shutdown(filter_set *handle)
+{
+    if (trace_index_file)
+    {
+        linked_list_node *node;
+
+        fclose(trace_index_file);
+        fclose(trace_counts_file);
+        bugle_thread_key_delete(trace_index_key);
+        for (node = bugle_list_head(&trace_index_threads); node; node = bugle_list_next(node))
+        {
+            trace_index_thread *t = (trace_index_thread *) bugle_list_data(node);
+            bugle_free((void *) t->counts);
+            bugle_free(t->flushed);
+            bugle_free(t);
+        }
+        bugle_list_clear(&trace_index_threads);
+        bugle_thread_lock_destroy(&trace_index_lock);
+        bugle_free(trace_index_counts);
+        bugle_free(trace_index_touched);
+    }
+    bugle_free(trace_index_filename);
+}
+
 void bugle_initialise_filter_library(void)
 {
+    static const filter_set_variable_info trace_variables[] =
+    {
+        { "index", "filename of a frame index for bugle-traceseek [none]", FILTER_SET_VARIABLE_STRING, &trace_index_filename, NULL },
+        { "arrays", "how to log arrays longer than array_limit (full, truncate or hash) [full]", FILTER_SET_VARIABLE_CUSTOM, NULL, trace_set_arrays },
+        { "array_limit", "number of array elements to log in full [16]", FILTER_SET_VARIABLE_UINT, &trace_array_policy.limit, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
     static const filter_set_info trace_info =
     {
         "trace",
         trace_initialise,
+        trace_shutdown,
         NULL,
         NULL,
-        NULL,
-        NULL,
+        trace_variables,
         "captures a text trace of all calls made"
     };
     bugle_filter_set_new(&trace_info);
@@ -0,0 +1,804 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Binary equivalent of the trace filter-set. Calls are captured as raw
+ * argument bytes plus the memory they point to, with no text formatting on
+ * the application thread. Use bugle-tracedump to turn the file into text.
+ * The file format is described in common/tracebin.h.
+ *
+ * The flightrec filter-set, also here, uses the same records.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/bool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#if HAVE_SIGACTION
+# include <signal.h>
+# include <unistd.h>
+# include <fcntl.h>
+#endif
+#include <bugle/gl/glutils.h>
+#include <bugle/gl/glheaders.h>
+#include <bugle/glwin/glwin.h>
+#include <bugle/apireflect.h>
+#include <bugle/input.h>
+#include <bugle/linkedlist.h>
+#include <bugle/filters.h>
+#include <bugle/memory.h>
+#include <bugle/string.h>
+#include <bugle/log.h>
+#include <bugle/io.h>
+#include <bugle/time.h>
+#include <budgie/reflect.h>
+#include <budgie/addresses.h>
+#include "platform/threads.h"
+#include "platform/types.h"
+#include "common/tracebin.h"
+
+static char *tracebin_filename = NULL;
+static FILE *tracebin_file = NULL;
+
+/* Appends a BUGLE_TRACEBIN_RECORD_CALL record for the call to a memory writer */
+static void tracebin_encode_call(const generic_function_call *generic, bugle_io_writer *writer)
+{
+    bugle_timespec now;
+    bugle_uint32_t size, function;
+    bugle_uint64_t thread, timestamp;
+    bugle_uint8_t type, has_retn;
+    size_t start;
+    int i;
+
+    bugle_gettime(&now);
+    function = generic->id;
+    thread = (bugle_uint64_t) bugle_thread_self();
+    timestamp = (bugle_uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    type = BUGLE_TRACEBIN_RECORD_CALL;
+    has_retn = generic->retn != NULL;
+
+    start = bugle_io_writer_mem_size(writer);
+    size = 0; /* filled in below */
+    bugle_io_write(&size, sizeof(size), 1, writer);
+    bugle_io_write(&type, sizeof(type), 1, writer);
+    bugle_io_write(&function, sizeof(function), 1, writer);
+    bugle_io_write(&thread, sizeof(thread), 1, writer);
+    bugle_io_write(&timestamp, sizeof(timestamp), 1, writer);
+    bugle_io_write(&has_retn, sizeof(has_retn), 1, writer);
+    for (i = 0; i < generic->num_args; i++)
+        budgie_serialize_any_type(budgie_call_parameter_type(generic, i),
+                                  generic->args[i],
+                                  budgie_call_parameter_length(generic, i),
+                                  writer);
+    if (has_retn)
+        budgie_serialize_any_type(budgie_call_parameter_type(generic, -1),
+                                  generic->retn,
+                                  budgie_call_parameter_length(generic, -1),
+                                  writer);
+
+    size = bugle_io_writer_mem_size(writer) - start - sizeof(size);
+    memcpy(bugle_io_writer_mem_get(writer) + start, &size, sizeof(size));
+}
+
+static void tracebin_header_init(bugle_tracebin_header *header)
+{
+    memcpy(header->magic, BUGLE_TRACEBIN_MAGIC, sizeof(header->magic));
+    header->version = BUGLE_TRACEBIN_VERSION;
+    header->byte_order = BUGLE_TRACEBIN_BYTE_ORDER;
+    header->pointer_size = sizeof(void *);
+    header->function_count = budgie_function_count();
+    header->type_count = budgie_type_count();
+}
+
+static bugle_bool tracebin_callback(function_call *call, const callback_data *data)
+{
+    bugle_io_writer *writer;
+
+    writer = bugle_io_writer_mem_scratch();
+    tracebin_encode_call(&call->generic, writer);
+    bugle_flockfile(tracebin_file);
+    fwrite(bugle_io_writer_mem_get(writer), 1, bugle_io_writer_mem_size(writer), tracebin_file);
+    bugle_funlockfile(tracebin_file);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool tracebin_initialise(filter_set *handle)
+{
+    filter *f;
+    bugle_tracebin_header header;
+
+    tracebin_file = fopen(tracebin_filename, "wb");
+    if (!tracebin_file)
+    {
+        bugle_log_printf("tracebin", "initialise", BUGLE_LOG_ERROR,
+                         "cannot open %s for writing: %s", tracebin_filename, strerror(errno));
+        return BUGLE_FALSE;
+    }
+    tracebin_header_init(&header);
+    fwrite(&header, sizeof(header), 1, tracebin_file);
+
+    f = bugle_filter_new(handle, "tracebin");
+    bugle_filter_order("invoke", "tracebin");
+    bugle_filter_catches_all(f, BUGLE_FALSE, tracebin_callback);
+    bugle_gl_filter_post_renders("tracebin");
+    return BUGLE_TRUE;
+}
+
+static void tracebin_shutdown(filter_set *handle)
+{
+    if (tracebin_file)
+        fclose(tracebin_file);
+    bugle_free(tracebin_filename);
+}
+
+/* Flight recorder: the same records, kept in a per-thread ring in memory
+ * and only written out when something goes wrong. Each ring holds whole
+ * records; when a new one does not fit, the oldest are discarded. The ring
+ * also remembers where each recent frame started, so that a dump can be
+ * limited to the last few frames.
+ */
+typedef struct
+{
+    unsigned long frame;
+    bugle_uint64_t start;     /* stream offset of the first record */
+} flightrec_frame_start;
+
+typedef struct flightrec_ring_s
+{
+    struct flightrec_ring_s *next; /* fixed once the ring is published */
+    bugle_thread_lock_t lock;
+    bugle_uint64_t thread;
+    char *data;
+    size_t size;
+    bugle_uint64_t begin;     /* stream offset of the oldest record */
+    bugle_uint64_t end;       /* stream offset after the newest record */
+    flightrec_frame_start *starts; /* circular, flightrec_frames entries */
+    long nstarts;
+    long next_start;
+    volatile long pending;    /* function being invoked, or -1 */
+    bugle_bool exited;        /* thread has exited, so the ring can be reused */
+    bugle_uint64_t cursor;    /* used while dumping */
+} flightrec_ring;
+
+/* Destination of a dump. From the signal handler, stdio cannot be used, so
+ * the data is collected in a preallocated buffer and written with write().
+ */
+typedef struct
+{
+    FILE *f;
+#if HAVE_SIGACTION
+    int fd;
+    char *buffer;
+    size_t length;
+#endif
+} flightrec_sink;
+
+static char *flightrec_filename = NULL;
+static long flightrec_buffer = 4096;   /* KiB per thread */
+static long flightrec_frames = 10;
+static bugle_bool flightrec_on_error = BUGLE_FALSE;
+static bugle_bool flightrec_on_segfault = BUGLE_TRUE;
+static double flightrec_frame_time = 0.0; /* milliseconds, 0 to disable */
+static bugle_input_key flightrec_key = { BUGLE_INPUT_NOSYMBOL, 0, BUGLE_TRUE };
+static bugle_bool flightrec_keypress = BUGLE_FALSE;
+
+/* Protects everything below, except that the frame counter, the dump
+ * counter and the list of rings may be read without it, since the signal
+ * handler cannot take it. Taken before any ring lock.
+ */
+static bugle_thread_lock_t flightrec_lock;
+/* New rings are pushed on the front with bugle_atomic_store, so a reader
+ * that loads the head with bugle_atomic_load can walk the list safely.
+ */
+static flightrec_ring * volatile flightrec_rings = NULL;
+static volatile unsigned long flightrec_frame = 0;
+static volatile unsigned long flightrec_dumps = 0;
+static unsigned long flightrec_dump_frame = 0;
+static bugle_bool flightrec_have_swap = BUGLE_FALSE;
+static bugle_timespec flightrec_last_swap;
+static bugle_thread_key_t flightrec_key_ring;
+
+/* Name of the current dump. The signal handler has its own preallocated
+ * copy, since it may interrupt a dump that is using this one.
+ */
+static char *flightrec_path = NULL;
+
+#if HAVE_SIGACTION
+#define FLIGHTREC_SIGNAL_BUFFER 65536
+static struct sigaction flightrec_old_sigsegv_act;
+static char *flightrec_signal_buffer = NULL;
+static char *flightrec_signal_path = NULL;
+#endif
+
+static void flightrec_ring_free(flightrec_ring *ring)
+{
+    bugle_thread_lock_destroy(&ring->lock);
+    bugle_free(ring->starts);
+    bugle_free(ring->data);
+    bugle_free(ring);
+}
+
+/* Called when a thread exits. The ring keeps its history, so that it still
+ * appears in dumps, until a new thread takes it over. Rings are never freed
+ * before shutdown, since the signal handler walks them without locking.
+ */
+static void flightrec_ring_release(void *r)
+{
+    flightrec_ring *ring = (flightrec_ring *) r;
+
+    bugle_thread_lock_lock(&flightrec_lock);
+    bugle_atomic_store(&ring->pending, -1L);
+    ring->exited = BUGLE_TRUE;
+    bugle_thread_lock_unlock(&flightrec_lock);
+}
+
+static flightrec_ring *flightrec_get_ring(void)
+{
+    flightrec_ring *ring;
+
+    ring = (flightrec_ring *) bugle_thread_getspecific(flightrec_key_ring);
+    if (ring)
+        return ring;
+
+    bugle_thread_lock_lock(&flightrec_lock);
+    for (ring = flightrec_rings; ring; ring = ring->next)
+        if (ring->exited)
+            break;
+    if (ring)
+    {
+        bugle_thread_lock_lock(&ring->lock);
+        ring->begin = 0;
+        ring->end = 0;
+        ring->nstarts = 0;
+        ring->next_start = 0;
+        bugle_thread_lock_unlock(&ring->lock);
+    }
+    else
+    {
+        ring = BUGLE_MALLOC(flightrec_ring);
+        bugle_thread_lock_init(&ring->lock);
+        ring->size = (size_t) flightrec_buffer * 1024;
+        ring->data = BUGLE_NMALLOC(ring->size, char);
+        ring->begin = 0;
+        ring->end = 0;
+        ring->starts = BUGLE_NMALLOC(flightrec_frames, flightrec_frame_start);
+        ring->nstarts = 0;
+        ring->next_start = 0;
+        ring->pending = -1;
+        ring->next = flightrec_rings;
+        bugle_atomic_store(&flightrec_rings, ring);
+    }
+    ring->thread = (bugle_uint64_t) bugle_thread_self();
+    ring->exited = BUGLE_FALSE;
+    bugle_thread_lock_unlock(&flightrec_lock);
+
+    bugle_thread_setspecific(flightrec_key_ring, ring);
+    return ring;
+}
+
+static void flightrec_ring_read(const flightrec_ring *ring, bugle_uint64_t offset,
+                                void *out, size_t n)
+{
+    size_t pos, first;
+
+    pos = offset % ring->size;
+    first = ring->size - pos < n ? ring->size - pos : n;
+    memcpy(out, ring->data + pos, first);
+    memcpy((char *) out + first, ring->data, n - first);
+}
+
+#if HAVE_SIGACTION
+static void flightrec_sink_flush(flightrec_sink *sink)
+{
+    size_t done = 0;
+
+    while (done < sink->length)
+    {
+        ssize_t n;
+
+        n = write(sink->fd, sink->buffer + done, sink->length - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    sink->length = 0;
+}
+#endif
+
+/* Only uses async-signal-safe functions when sink->f is NULL */
+static void flightrec_sink_write(flightrec_sink *sink, const void *data, size_t n)
+{
+    if (sink->f)
+        fwrite(data, 1, n, sink->f);
+#if HAVE_SIGACTION
+    else
+    {
+        const char *src = (const char *) data;
+
+        while (n > 0)
+        {
+            size_t m = FLIGHTREC_SIGNAL_BUFFER - sink->length;
+
+            if (m > n) m = n;
+            memcpy(sink->buffer + sink->length, src, m);
+            sink->length += m;
+            src += m;
+            n -= m;
+            if (sink->length == FLIGHTREC_SIGNAL_BUFFER)
+                flightrec_sink_flush(sink);
+        }
+    }
+#endif
+}
+
+static void flightrec_ring_write(const flightrec_ring *ring, bugle_uint64_t offset,
+                                 size_t n, flightrec_sink *sink)
+{
+    size_t pos, first;
+
+    pos = offset % ring->size;
+    first = ring->size - pos < n ? ring->size - pos : n;
+    flightrec_sink_write(sink, ring->data + pos, first);
+    flightrec_sink_write(sink, ring->data, n - first);
+}
+
+static void flightrec_ring_append(flightrec_ring *ring, const char *record, size_t n)
+{
+    unsigned long frame;
+    size_t pos, first;
+
+    if (n > ring->size)
+        return; /* can never fit, so rather keep the history */
+
+    frame = bugle_atomic_load(&flightrec_frame);
+    bugle_thread_lock_lock(&ring->lock);
+    while (ring->end + n - ring->begin > ring->size)
+    {
+        bugle_uint32_t size;
+        flightrec_ring_read(ring, ring->begin, &size, sizeof(size));
+        ring->begin += sizeof(size) + size;
+    }
+    if (ring->nstarts == 0
+        || ring->starts[(ring->next_start + flightrec_frames - 1) % flightrec_frames].frame != frame)
+    {
+        ring->starts[ring->next_start].frame = frame;
+        ring->starts[ring->next_start].start = ring->end;
+        ring->next_start = (ring->next_start + 1) % flightrec_frames;
+        if (ring->nstarts < flightrec_frames)
+            ring->nstarts++;
+    }
+
+    pos = ring->end % ring->size;
+    first = ring->size - pos < n ? ring->size - pos : n;
+    memcpy(ring->data + pos, record, first);
+    memcpy(ring->data, record + first, n - first);
+    ring->end += n;
+    bugle_thread_lock_unlock(&ring->lock);
+}
+
+/* Returns the stream offset of the first record in the last flightrec_frames
+ * frames, or ring->end if there are none.
+ */
+static bugle_uint64_t flightrec_ring_first(const flightrec_ring *ring, unsigned long frame)
+{
+    unsigned long oldest;
+    bugle_uint64_t first = ring->end;
+    long i;
+
+    oldest = frame >= (unsigned long) flightrec_frames ? frame - flightrec_frames + 1 : 0;
+    for (i = 0; i < ring->nstarts; i++)
+        if (ring->starts[i].frame >= oldest && ring->starts[i].start < first)
+            first = ring->starts[i].start;
+    return first > ring->begin ? first : ring->begin;
+}
+
+static bugle_uint64_t flightrec_ring_timestamp(const flightrec_ring *ring, bugle_uint64_t offset)
+{
+    bugle_uint64_t timestamp;
+
+    flightrec_ring_read(ring, offset + sizeof(bugle_uint32_t) + sizeof(bugle_uint8_t)
+                        + sizeof(bugle_uint32_t) + sizeof(bugle_uint64_t),
+                        &timestamp, sizeof(timestamp));
+    return timestamp;
+}
+
+static void flightrec_write_pending(const flightrec_ring *ring, flightrec_sink *sink)
+{
+    bugle_timespec now;
+    bugle_uint32_t size, function;
+    bugle_uint64_t timestamp;
+    bugle_uint8_t type;
+
+    bugle_gettime(&now);
+    timestamp = (bugle_uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    function = bugle_atomic_load(&ring->pending);
+    type = BUGLE_TRACEBIN_RECORD_PENDING;
+    size = sizeof(type) + sizeof(function) + sizeof(ring->thread) + sizeof(timestamp);
+    flightrec_sink_write(sink, &size, sizeof(size));
+    flightrec_sink_write(sink, &type, sizeof(type));
+    flightrec_sink_write(sink, &function, sizeof(function));
+    flightrec_sink_write(sink, &ring->thread, sizeof(ring->thread));
+    flightrec_sink_write(sink, &timestamp, sizeof(timestamp));
+}
+
+/* Writes the name of dump number n into path, without using any functions
+ * that are unsafe in a signal handler.
+ */
+static void flightrec_set_path(char *path, unsigned long n)
+{
+    char digits[24];
+    size_t len, d = 0;
+
+    len = strlen(flightrec_filename);
+    memcpy(path, flightrec_filename, len);
+    path[len++] = '.';
+    do
+    {
+        digits[d++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    while (d > 0)
+        path[len++] = digits[--d];
+    path[len] = '\0';
+}
+
+/* Writes the recent history of every thread to a new file, merging the
+ * threads by timestamp. If locking is false, it is being called from the
+ * signal handler: no locks are taken (the faulting thread might hold one),
+ * and only async-signal-safe functions are used.
+ */
+static void flightrec_dump(const char *reason, bugle_bool locking)
+{
+    bugle_tracebin_header header;
+    flightrec_ring *rings, *ring;
+    unsigned long frame, n;
+    flightrec_sink sink;
+
+    frame = bugle_atomic_load(&flightrec_frame);
+    rings = bugle_atomic_load(&flightrec_rings);
+    n = bugle_atomic_increment(&flightrec_dumps);
+    if (locking)
+    {
+        flightrec_set_path(flightrec_path, n);
+        sink.f = fopen(flightrec_path, "wb");
+        if (!sink.f)
+        {
+            bugle_log_printf("flightrec", "dump", BUGLE_LOG_ERROR,
+                             "cannot open %s for writing: %s", flightrec_path, strerror(errno));
+            return;
+        }
+    }
+    else
+    {
+#if HAVE_SIGACTION
+        flightrec_set_path(flightrec_signal_path, n);
+        sink.f = NULL;
+        sink.fd = open(flightrec_signal_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (sink.fd < 0)
+            return;
+        sink.buffer = flightrec_signal_buffer;
+        sink.length = 0;
+#else
+        return;
+#endif
+    }
+
+    tracebin_header_init(&header);
+    flightrec_sink_write(&sink, &header, sizeof(header));
+
+    for (ring = rings; ring; ring = ring->next)
+    {
+        if (locking)
+            bugle_thread_lock_lock(&ring->lock);
+        ring->cursor = flightrec_ring_first(ring, frame);
+    }
+
+    for (;;)
+    {
+        flightrec_ring *best = NULL;
+        bugle_uint64_t best_time = 0;
+        bugle_uint32_t size;
+
+        for (ring = rings; ring; ring = ring->next)
+        {
+            if (ring->cursor < ring->end)
+            {
+                bugle_uint64_t t = flightrec_ring_timestamp(ring, ring->cursor);
+                if (!best || t < best_time)
+                {
+                    best = ring;
+                    best_time = t;
+                }
+            }
+        }
+        if (!best)
+            break;
+        flightrec_ring_read(best, best->cursor, &size, sizeof(size));
+        flightrec_ring_write(best, best->cursor, sizeof(size) + size, &sink);
+        best->cursor += sizeof(size) + size;
+    }
+
+    for (ring = rings; ring; ring = ring->next)
+    {
+        if (bugle_atomic_load(&ring->pending) >= 0)
+            flightrec_write_pending(ring, &sink);
+        if (locking)
+            bugle_thread_lock_unlock(&ring->lock);
+    }
+
+    if (locking)
+    {
+        fclose(sink.f);
+        bugle_log_printf("flightrec", "dump", BUGLE_LOG_NOTICE,
+                         "%s: wrote recent calls to %s", reason, flightrec_path);
+    }
+#if HAVE_SIGACTION
+    else
+    {
+        flightrec_sink_flush(&sink);
+        close(sink.fd);
+    }
+#endif
+}
+
+/* Dumps, unless a dump was already made within the last flightrec_frames
+ * frames; back-to-back dumps would just repeat the same history.
+ */
+static void flightrec_trigger(const char *reason)
+{
+    unsigned long frame;
+
+    bugle_thread_lock_lock(&flightrec_lock);
+    frame = bugle_atomic_load(&flightrec_frame);
+    if (bugle_atomic_load(&flightrec_dumps) == 0 || frame - flightrec_dump_frame >= (unsigned long) flightrec_frames)
+    {
+        flightrec_dump_frame = frame;
+        flightrec_dump(reason, BUGLE_TRUE);
+    }
+    bugle_thread_lock_unlock(&flightrec_lock);
+}
+
+#if HAVE_SIGACTION
+static void flightrec_sigsegv_handler(int sig)
+{
+    flightrec_dump("segmentation fault", BUGLE_FALSE);
+    /* Hand the fault on to whoever had it before us. The signal is blocked
+     * until this handler returns, at which point the old handler gets it.
+     */
+    sigaction(SIGSEGV, &flightrec_old_sigsegv_act, NULL);
+    bugle_thread_raise(SIGSEGV);
+}
+#endif
+
+static bugle_bool flightrec_pre_callback(function_call *call, const callback_data *data)
+{
+    bugle_atomic_store(&flightrec_get_ring()->pending, (long) call->generic.id);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool flightrec_callback(function_call *call, const callback_data *data)
+{
+    flightrec_ring *ring;
+    bugle_io_writer *writer;
+
+    ring = flightrec_get_ring();
+    writer = bugle_io_writer_mem_scratch();
+    tracebin_encode_call(&call->generic, writer);
+    flightrec_ring_append(ring, bugle_io_writer_mem_get(writer), bugle_io_writer_mem_size(writer));
+    bugle_atomic_store(&ring->pending, -1L);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool flightrec_error_callback(function_call *call, const callback_data *data)
+{
+    GLenum error;
+
+    error = bugle_gl_call_get_error(data->call_object);
+    if (error != GL_NO_ERROR)
+        flightrec_trigger(bugle_api_enum_name(error, BUGLE_API_EXTENSION_BLOCK_GL));
+    return BUGLE_TRUE;
+}
+
+static bugle_bool flightrec_swap_callback(function_call *call, const callback_data *data)
+{
+    bugle_timespec now;
+    bugle_bool slow = BUGLE_FALSE;
+
+    bugle_gettime(&now);
+    bugle_thread_lock_lock(&flightrec_lock);
+    if (flightrec_have_swap && flightrec_frame_time > 0.0)
+    {
+        double elapsed;
+
+        elapsed = 1e3 * (now.tv_sec - flightrec_last_swap.tv_sec)
+            + 1e-6 * (now.tv_nsec - flightrec_last_swap.tv_nsec);
+        slow = elapsed > flightrec_frame_time;
+    }
+    flightrec_last_swap = now;
+    flightrec_have_swap = BUGLE_TRUE;
+    bugle_thread_lock_unlock(&flightrec_lock);
+
+    if (slow)
+        flightrec_trigger("slow frame");
+    if (flightrec_keypress)
+    {
+        flightrec_keypress = BUGLE_FALSE;
+        flightrec_trigger("key press");
+    }
+
+    bugle_thread_lock_lock(&flightrec_lock);
+    bugle_atomic_store(&flightrec_frame, flightrec_frame + 1);
+    bugle_thread_lock_unlock(&flightrec_lock);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool flightrec_initialise(filter_set *handle)
+{
+    filter *f;
+
+    bugle_thread_lock_init(&flightrec_lock);
+    bugle_thread_key_create(&flightrec_key_ring, flightrec_ring_release);
+    flightrec_path = BUGLE_NMALLOC(strlen(flightrec_filename) + 24, char);
+
+    f = bugle_filter_new(handle, "flightrec_pre");
+    bugle_filter_catches_all(f, BUGLE_FALSE, flightrec_pre_callback);
+    bugle_filter_order("flightrec_pre", "invoke");
+
+    f = bugle_filter_new(handle, "flightrec");
+    bugle_filter_catches_all(f, BUGLE_FALSE, flightrec_callback);
+    bugle_filter_order("invoke", "flightrec");
+    bugle_gl_filter_post_renders("flightrec");
+
+    if (flightrec_on_error)
+    {
+        f = bugle_filter_new(handle, "flightrec_error");
+        bugle_filter_catches_all(f, BUGLE_FALSE, flightrec_error_callback);
+        bugle_filter_order("flightrec", "flightrec_error");
+        bugle_filter_order("error", "flightrec_error");
+        bugle_gl_filter_set_queries_error("flightrec");
+    }
+
+    f = bugle_filter_new(handle, "flightrec_swap");
+    bugle_glwin_filter_catches_swap_buffers(f, BUGLE_FALSE, flightrec_swap_callback);
+    bugle_filter_order("flightrec", "flightrec_swap");
+
+    if (flightrec_key.keysym != BUGLE_INPUT_NOSYMBOL)
+        bugle_input_key_callback(&flightrec_key, NULL, bugle_input_key_callback_flag, &flightrec_keypress);
+
+#if HAVE_SIGACTION
+    if (flightrec_on_segfault)
+    {
+        struct sigaction act;
+
+        flightrec_signal_buffer = BUGLE_NMALLOC(FLIGHTREC_SIGNAL_BUFFER, char);
+        flightrec_signal_path = BUGLE_NMALLOC(strlen(flightrec_filename) + 24, char);
+        act.sa_handler = flightrec_sigsegv_handler;
+        act.sa_flags = 0;
+        sigemptyset(&act.sa_mask);
+        while (sigaction(SIGSEGV, &act, &flightrec_old_sigsegv_act) != 0)
+            if (errno != EINTR)
+            {
+                bugle_log_printf("flightrec", "initialise", BUGLE_LOG_WARNING,
+                                 "failed to set SIGSEGV handler: %s", strerror(errno));
+                flightrec_on_segfault = BUGLE_FALSE;
+                break;
+            }
+    }
+#else
+    if (flightrec_on_segfault)
+        bugle_log("flightrec", "initialise", BUGLE_LOG_INFO,
+                  "dumping on a segmentation fault is not supported on this platform");
+#endif
+    return BUGLE_TRUE;
+}
+
+static void flightrec_shutdown(filter_set *handle)
+{
+    flightrec_ring *ring, *next;
+
+#if HAVE_SIGACTION
+    if (flightrec_on_segfault)
+        sigaction(SIGSEGV, &flightrec_old_sigsegv_act, NULL);
+#endif
+#if HAVE_SIGACTION
+    bugle_free(flightrec_signal_buffer);
+    bugle_free(flightrec_signal_path);
+#endif
+    bugle_thread_key_delete(flightrec_key_ring);
+    for (ring = flightrec_rings; ring; ring = next)
+    {
+        next = ring->next;
+        flightrec_ring_free(ring);
+    }
+    flightrec_rings = NULL;
+    bugle_thread_lock_destroy(&flightrec_lock);
+    bugle_free(flightrec_path);
+    bugle_free(flightrec_filename);
+}
+
+/* Error capture needs the error filter-set, so the dependency is only
+ * registered when it is turned on. Variables are set before dependencies
+ * are resolved, so this is early enough.
+ */
+static bugle_bool flightrec_variable_error(const filter_set_variable_info *var,
+                                           const char *text, const void *value)
+{
+    if (*(const bugle_bool *) value)
+        bugle_filter_set_depends("flightrec", "error");
+    return BUGLE_TRUE;
+}
+
+void bugle_initialise_filter_library(void)
+{
+    static const filter_set_variable_info tracebin_variables[] =
+    {
+        { "filename", "filename of the binary trace to write [bugle.trace]", FILTER_SET_VARIABLE_STRING, &tracebin_filename, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
+    static const filter_set_variable_info flightrec_variables[] =
+    {
+        { "filename", "prefix for the dump files, which are numbered from 1 [flightrec.trace]", FILTER_SET_VARIABLE_STRING, &flightrec_filename, NULL },
+        { "buffer", "size of the ring kept for each thread, in KiB [4096]", FILTER_SET_VARIABLE_POSITIVE_INT, &flightrec_buffer, NULL },
+        { "frames", "number of frames of history to dump [10]", FILTER_SET_VARIABLE_POSITIVE_INT, &flightrec_frames, NULL },
+        { "error", "dump when a call generates a GL error (needs the error filter-set) [no]", FILTER_SET_VARIABLE_BOOL, &flightrec_on_error, flightrec_variable_error },
+        { "segfault", "dump on a segmentation fault [yes]", FILTER_SET_VARIABLE_BOOL, &flightrec_on_segfault, NULL },
+        { "frame_time", "dump when a frame takes longer than this many milliseconds (0 to disable) [0]", FILTER_SET_VARIABLE_FLOAT, &flightrec_frame_time, NULL },
+        { "key_dump", "key to dump on demand [none]", FILTER_SET_VARIABLE_KEY, &flightrec_key, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
+    static const filter_set_info tracebin_info =
+    {
+        "tracebin",
+        tracebin_initialise,
+        tracebin_shutdown,
+        NULL,
+        NULL,
+        tracebin_variables,
+        "captures a binary trace of all calls made, for decoding with bugle-tracedump"
+    };
+    static const filter_set_info flightrec_info =
+    {
+        "flightrec",
+        flightrec_initialise,
+        flightrec_shutdown,
+        NULL,
+        NULL,
+        flightrec_variables,
+        "keeps the last few frames of calls in memory, and dumps them on an error or crash"
+    };
+
+    bugle_filter_set_new(&tracebin_info);
+    tracebin_filename = bugle_strdup("bugle.trace");
+
+    /* No direct rendering, but some of the length functions query state */
+    bugle_gl_filter_set_renders("tracebin");
+    /* Some of the queries depend on extensions */
+    bugle_filter_set_depends("tracebin", "glbeginend");
+    bugle_filter_set_depends("tracebin", "glextensions");
+
+    bugle_filter_set_new(&flightrec_info);
+    flightrec_filename = bugle_strdup("flightrec.trace");
+    bugle_gl_filter_set_renders("flightrec");
+    bugle_filter_set_depends("flightrec", "glbeginend");
+    bugle_filter_set_depends("flightrec", "glextensions");
+}
@@ -69,16 +69,19 @@ static bugle_bool error_callback(function_call *call, const callback_data *data)
          */
         if (*call->glGetError.retn != GL_NO_ERROR)
         {
-            const char *name;
-            name = bugle_api_enum_name(*call->glGetError.retn, BUGLE_API_EXTENSION_BLOCK_GL);
-            if (name)
-                bugle_log_printf("error", "callback", BUGLE_LOG_WARNING,
-                                 "glGetError() returned %s when GL_NO_ERROR was expected",
-                                 name);
-            else
-                bugle_log_printf("error", "callback", BUGLE_LOG_WARNING,
-                                 "glGetError() returned %#08x when GL_NO_ERROR was expected",
-                                 (unsigned int) *call->glGetError.retn);
+            if (bugle_log_enabled("error", "callback", BUGLE_LOG_WARNING))
+            {
+                const char *name;
+                name = bugle_api_enum_name(*call->glGetError.retn, BUGLE_API_EXTENSION_BLOCK_GL);
+                if (name)
+                    bugle_log_printf("error", "callback", BUGLE_LOG_WARNING,
+                                     "glGetError() returned %s when GL_NO_ERROR was expected",
+                                     name);
+                else
+                    bugle_log_printf("error", "callback", BUGLE_LOG_WARNING,
+                                     "glGetError() returned %#08x when GL_NO_ERROR was expected",
+                                     (unsigned int) *call->glGetError.retn);
+            }
         }
         else if (bugle_gl_in_begin_end())
         {
@@ -145,7 +148,8 @@ static bugle_bool error_initialise(filter_set *handle)
 static bugle_bool showerror_callback(function_call *call, const callback_data *data)
 {
     GLenum error;
-    if ((error = bugle_gl_call_get_error_internal(data->call_object)) != GL_NO_ERROR)
+    if ((error = bugle_gl_call_get_error_internal(data->call_object)) != GL_NO_ERROR
+        && bugle_log_enabled("showerror", "gl", BUGLE_LOG_NOTICE))
     {
         const char *name;
         name = bugle_api_enum_name(error, BUGLE_API_EXTENSION_BLOCK_GL);
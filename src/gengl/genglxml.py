@@ -323,6 +323,9 @@ def do_header(options, apis):
     print("#define BUGLE_API_EXTENSION_COUNT {0}".format(index))
     print(dedent("""
         extern const bugle_api_extension_data _bugle_api_extension_table[BUGLE_API_EXTENSION_COUNT];
+        extern const int _bugle_api_extension_hash_displace[];
+        extern const int _bugle_api_extension_hash_index[];
+        extern const int _bugle_api_extension_hash_count;
         extern const bugle_api_function_data _bugle_api_function_table[];
         extern const bugle_api_enum_data * const _bugle_api_enum_table[];
         extern const int _bugle_api_enum_count[];
@@ -356,6 +359,71 @@ def extension_descendants(extensions, extension):
                     q.append(f)
     return ans
 
+def perfect_hash(key, seed):
+    '''
+    Must match bugle_perfect_hash in common/perfecthash.h
+    '''
+    h = (2166136261 ^ seed) & 0xffffffff
+    for c in bytearray(key.encode('utf-8')):
+        h ^= c
+        h = (h * 16777619) & 0xffffffff
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xffffffff
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xffffffff
+    h ^= h >> 16
+    return h
+
+def make_perfect_hash(names):
+    '''
+    Builds a minimal perfect hash table for the given distinct names, in the
+    format described in common/perfecthash.h. Returns the displacement array
+    and an array mapping each slot to the index of the name in C{names}.
+    '''
+    n = len(names)
+    buckets = [[] for i in range(n)]
+    for i, name in enumerate(names):
+        buckets[perfect_hash(name, 0) % n].append(i)
+    order = sorted(range(n), key = lambda b: -len(buckets[b]))
+    displace = [0] * n
+    slots = [None] * n
+
+    # Place the collisions first, searching for a seed that sends every
+    # name in the bucket to a distinct free slot
+    for b in order:
+        bucket = buckets[b]
+        if len(bucket) <= 1:
+            break
+        d = 1
+        while True:
+            targets = [perfect_hash(names[i], d) % n for i in bucket]
+            if len(set(targets)) == len(targets) and all(slots[t] is None for t in targets):
+                break
+            d += 1
+        for i, t in zip(bucket, targets):
+            slots[t] = i
+        displace[b] = d
+
+    # Singletons go directly into the remaining free slots
+    free = [s for s in range(n) if slots[s] is None]
+    for b in order:
+        if len(buckets[b]) == 1:
+            slot = free.pop(0)
+            slots[slot] = buckets[b][0]
+            displace[b] = -slot - 1
+    return displace, slots
+
+def do_c_perfect_hash(prefix, names):
+    displace, slots = make_perfect_hash(names)
+    for array, values in [('displace', displace), ('index', slots)]:
+        print('const int {0}_hash_{1}[{2}] =\n{{'.format(prefix, array, max(len(values), 1)))
+        for i in range(0, len(values), 16):
+            print('    ' + ', '.join(str(v) for v in values[i : i + 16]) + ',')
+        if not values:
+            print('    0')
+        print('};')
+    print('const int {0}_hash_count = {1};'.format(prefix, len(names)))
+
 def do_c_extension_table(apis):
     for api in apis:
         for extension in api.extensions.values():
@@ -384,6 +452,9 @@ def do_c_extension_table(apis):
             print('    {{ {0} }},'.format(', '.join(fields)))
     print('};')
 
+    names = [extension.name for api in apis for extension in api.extensions.values()]
+    do_c_perfect_hash('_bugle_api_extension', names)
+
 def do_c_function_table(apis, header):
     functions = load_function_ids(header)
     print(dedent('''
@@ -0,0 +1,971 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Keeps CPU copies of buffer object contents, so that checks and the
+ * debugger can look at index and vertex data without stalling on
+ * glGetBufferSubData.
+ *
+ * Each shadow is split into fixed-size chunks. Chunks are reference
+ * counted, so that a glCopyBufferSubData of whole chunks just shares them,
+ * and a shared chunk is copied when one of its owners is written. A NULL
+ * chunk has never been written and reads as zeros. The memory budget
+ * applies to the distinct chunks in a share group; a buffer that would
+ * exceed it is simply no longer shadowed.
+ *
+ * Anything that writes a buffer in a way we cannot follow (shader writes,
+ * transform feedback, pixel packing, persistent mappings and so on) causes
+ * the shadow to be dropped, since a stale shadow is worse than none.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <string.h>
+#include <stddef.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include <bugle/filters.h>
+#include <bugle/objects.h>
+#include <bugle/hashtable.h>
+#include <bugle/glwin/trackcontext.h>
+#include <bugle/gl/glheaders.h>
+#include <bugle/gl/glutils.h>
+#include <bugle/gl/glbeginend.h>
+#include <bugle/gl/glextensions.h>
+#include <bugle/gl/globjects.h>
+#include <bugle/gl/glbuffershadow.h>
+#include <budgie/types.h>
+#include <budgie/call.h>
+#include <budgie/addresses.h>
+#include "platform/threads.h"
+
+#define BUFFERSHADOW_CHUNK_SIZE 65536
+
+typedef struct
+{
+    size_t refcount;
+    size_t length;
+    /* followed by length bytes of data */
+} buffershadow_chunk;
+
+#define BUFFERSHADOW_CHUNK_DATA(c) ((unsigned char *) ((c) + 1))
+
+typedef struct
+{
+    size_t size;
+    size_t n_chunks;
+    buffershadow_chunk **chunks;    /* NULL chunks hold zeros */
+    const void *map_pointer;        /* non-NULL while mapped for writing */
+    size_t map_offset;
+    size_t map_length;
+} buffershadow_buffer;
+
+typedef struct
+{
+    bugle_thread_lock_t mutex;
+    hashptr_table buffers;          /* buffershadow_buffer, indexed by buffer id */
+    size_t used;                    /* bytes held in chunks */
+} buffershadow_data;
+
+static bugle_bool buffershadow_element = BUGLE_TRUE;
+static bugle_bool buffershadow_vertex = BUGLE_FALSE;
+static long buffershadow_budget = 64;
+static bugle_bool buffershadow_loaded = BUGLE_FALSE;
+static object_view buffershadow_view;
+
+static size_t buffershadow_chunk_length(const buffershadow_buffer *buffer, size_t index)
+{
+    size_t start;
+
+    start = index * BUFFERSHADOW_CHUNK_SIZE;
+    return buffer->size - start < BUFFERSHADOW_CHUNK_SIZE
+        ? buffer->size - start : BUFFERSHADOW_CHUNK_SIZE;
+}
+
+static void buffershadow_chunk_release(buffershadow_data *shadow, buffershadow_chunk *chunk)
+{
+    if (chunk && --chunk->refcount == 0)
+    {
+        shadow->used -= chunk->length;
+        bugle_free(chunk);
+    }
+}
+
+/* Makes chunk index of buffer private to it, allocating it if necessary.
+ * If discard is true the old contents are not preserved. Returns NULL if
+ * this would exceed the budget.
+ */
+static buffershadow_chunk *buffershadow_chunk_writable(buffershadow_data *shadow,
+                                                       buffershadow_buffer *buffer,
+                                                       size_t index, bugle_bool discard)
+{
+    buffershadow_chunk *old, *chunk;
+    size_t length;
+
+    old = buffer->chunks[index];
+    if (old && old->refcount == 1)
+        return old;
+
+    length = buffershadow_chunk_length(buffer, index);
+    if (shadow->used + length > ((size_t) buffershadow_budget << 20))
+        return NULL;
+    chunk = (buffershadow_chunk *) bugle_malloc(sizeof(buffershadow_chunk) + length);
+    chunk->refcount = 1;
+    chunk->length = length;
+    if (!discard)
+    {
+        if (old)
+            memcpy(BUFFERSHADOW_CHUNK_DATA(chunk), BUFFERSHADOW_CHUNK_DATA(old), length);
+        else
+            memset(BUFFERSHADOW_CHUNK_DATA(chunk), 0, length);
+    }
+    shadow->used += length;
+    buffershadow_chunk_release(shadow, old);
+    buffer->chunks[index] = chunk;
+    return chunk;
+}
+
+static void buffershadow_buffer_free(buffershadow_data *shadow, buffershadow_buffer *buffer)
+{
+    size_t i;
+
+    for (i = 0; i < buffer->n_chunks; i++)
+        buffershadow_chunk_release(shadow, buffer->chunks[i]);
+    bugle_free(buffer->chunks);
+    bugle_free(buffer);
+}
+
+/* Stops shadowing a buffer. An id of 0 drops every shadow. */
+static void buffershadow_drop(buffershadow_data *shadow, GLuint id)
+{
+    buffershadow_buffer *buffer;
+    const hashptr_table_entry *i;
+
+    if (id)
+    {
+        buffer = (buffershadow_buffer *) bugle_hashptr_get_int(&shadow->buffers, id);
+        if (buffer)
+        {
+            buffershadow_buffer_free(shadow, buffer);
+            bugle_hashptr_erase_int(&shadow->buffers, id);
+        }
+    }
+    else
+    {
+        for (i = bugle_hashptr_begin(&shadow->buffers); i; i = bugle_hashptr_next(&shadow->buffers, i))
+            if (i->value)
+                buffershadow_buffer_free(shadow, (buffershadow_buffer *) i->value);
+        bugle_hashptr_clear(&shadow->buffers);
+    }
+}
+
+/* Replaces any existing shadow of id with a new one of the given size,
+ * initially reading as zeros. Returns NULL if the buffer is too large to
+ * fit in the budget.
+ */
+static buffershadow_buffer *buffershadow_create(buffershadow_data *shadow, GLuint id, size_t size)
+{
+    buffershadow_buffer *buffer;
+
+    buffershadow_drop(shadow, id);
+    if (size > ((size_t) buffershadow_budget << 20))
+        return NULL;
+    buffer = BUGLE_MALLOC(buffershadow_buffer);
+    buffer->size = size;
+    buffer->n_chunks = (size + BUFFERSHADOW_CHUNK_SIZE - 1) / BUFFERSHADOW_CHUNK_SIZE;
+    buffer->chunks = BUGLE_CALLOC(buffer->n_chunks, buffershadow_chunk *);
+    buffer->map_pointer = NULL;
+    buffer->map_offset = 0;
+    buffer->map_length = 0;
+    bugle_hashptr_set_int(&shadow->buffers, id, buffer);
+    return buffer;
+}
+
+static buffershadow_buffer *buffershadow_get(buffershadow_data *shadow, GLuint id)
+{
+    if (!id)
+        return NULL;
+    return (buffershadow_buffer *) bugle_hashptr_get_int(&shadow->buffers, id);
+}
+
+/* Copies data into the shadow. Returns BUGLE_FALSE if the budget was
+ * exceeded, in which case the shadow is partially updated and must be
+ * dropped.
+ */
+static bugle_bool buffershadow_write(buffershadow_data *shadow, buffershadow_buffer *buffer,
+                                     size_t offset, size_t size, const void *data)
+{
+    const unsigned char *src;
+
+    src = (const unsigned char *) data;
+    while (size > 0)
+    {
+        size_t index, pos, len;
+        buffershadow_chunk *chunk;
+
+        index = offset / BUFFERSHADOW_CHUNK_SIZE;
+        pos = offset % BUFFERSHADOW_CHUNK_SIZE;
+        len = buffershadow_chunk_length(buffer, index) - pos;
+        if (len > size)
+            len = size;
+        chunk = buffershadow_chunk_writable(shadow, buffer, index,
+                                            pos == 0 && len == buffershadow_chunk_length(buffer, index));
+        if (!chunk)
+            return BUGLE_FALSE;
+        memcpy(BUFFERSHADOW_CHUNK_DATA(chunk) + pos, src, len);
+        src += len;
+        offset += len;
+        size -= len;
+    }
+    return BUGLE_TRUE;
+}
+
+static void buffershadow_read(const buffershadow_buffer *buffer,
+                              size_t offset, size_t size, void *data)
+{
+    unsigned char *dst;
+
+    dst = (unsigned char *) data;
+    while (size > 0)
+    {
+        size_t index, pos, len;
+        const buffershadow_chunk *chunk;
+
+        index = offset / BUFFERSHADOW_CHUNK_SIZE;
+        pos = offset % BUFFERSHADOW_CHUNK_SIZE;
+        len = buffershadow_chunk_length(buffer, index) - pos;
+        if (len > size)
+            len = size;
+        chunk = buffer->chunks[index];
+        if (chunk)
+            memcpy(dst, BUFFERSHADOW_CHUNK_DATA(chunk) + pos, len);
+        else
+            memset(dst, 0, len);
+        dst += len;
+        offset += len;
+        size -= len;
+    }
+}
+
+/* Copies a range between shadows. Whole chunks are shared rather than
+ * copied. The ranges may be in the same buffer, but not overlap. Returns
+ * BUGLE_FALSE if the budget was exceeded.
+ */
+static bugle_bool buffershadow_copy(buffershadow_data *shadow,
+                                    buffershadow_buffer *dst, size_t dst_offset,
+                                    const buffershadow_buffer *src, size_t src_offset,
+                                    size_t size)
+{
+    while (size > 0)
+    {
+        size_t dst_index, src_index, dst_pos, src_pos, len;
+
+        dst_index = dst_offset / BUFFERSHADOW_CHUNK_SIZE;
+        src_index = src_offset / BUFFERSHADOW_CHUNK_SIZE;
+        dst_pos = dst_offset % BUFFERSHADOW_CHUNK_SIZE;
+        src_pos = src_offset % BUFFERSHADOW_CHUNK_SIZE;
+        len = buffershadow_chunk_length(dst, dst_index);
+        if (dst_pos == 0 && src_pos == 0 && len <= size
+            && len == buffershadow_chunk_length(src, src_index))
+        {
+            buffershadow_chunk *chunk;
+
+            chunk = src->chunks[src_index];
+            if (chunk)
+                chunk->refcount++;
+            buffershadow_chunk_release(shadow, dst->chunks[dst_index]);
+            dst->chunks[dst_index] = chunk;
+        }
+        else
+        {
+            buffershadow_chunk *out;
+            const buffershadow_chunk *in;
+
+            len -= dst_pos;
+            if (len > buffershadow_chunk_length(src, src_index) - src_pos)
+                len = buffershadow_chunk_length(src, src_index) - src_pos;
+            if (len > size)
+                len = size;
+            out = buffershadow_chunk_writable(shadow, dst, dst_index,
+                                              dst_pos == 0 && len == buffershadow_chunk_length(dst, dst_index));
+            if (!out)
+                return BUGLE_FALSE;
+            in = src->chunks[src_index];
+            if (in)
+                memcpy(BUFFERSHADOW_CHUNK_DATA(out) + dst_pos, BUFFERSHADOW_CHUNK_DATA(in) + src_pos, len);
+            else
+                memset(BUFFERSHADOW_CHUNK_DATA(out) + dst_pos, 0, len);
+        }
+        dst_offset += len;
+        src_offset += len;
+        size -= len;
+    }
+    return BUGLE_TRUE;
+}
+
+static buffershadow_data *buffershadow_lock(void)
+{
+    buffershadow_data *shadow;
+
+    if (!buffershadow_loaded)
+        return NULL;
+    shadow = (buffershadow_data *) bugle_object_get_current_data(bugle_get_namespace_class(), buffershadow_view);
+    if (shadow)
+        bugle_thread_lock_lock(&shadow->mutex);
+    return shadow;
+}
+
+static void buffershadow_unlock(buffershadow_data *shadow)
+{
+    bugle_thread_lock_unlock(&shadow->mutex);
+}
+
+/* Finds the buffer bound to target. Returns BUGLE_FALSE if the target is
+ * not one we know how to query, in which case any buffer might be affected.
+ */
+static bugle_bool buffershadow_bound(GLenum target, GLuint *id)
+{
+    GLenum binding;
+    GLint value = 0;
+
+    binding = bugle_gl_buffer_binding(target);
+    if (binding == GL_NONE)
+        return BUGLE_FALSE;
+    CALL(glGetIntegerv)(binding, &value);
+    *id = value;
+    return BUGLE_TRUE;
+}
+
+/* Whether new data stores for a buffer with this target should be shadowed */
+static bugle_bool buffershadow_target_enabled(GLenum target)
+{
+    switch (target)
+    {
+    case GL_ELEMENT_ARRAY_BUFFER: return buffershadow_element;
+    case GL_ARRAY_BUFFER: return buffershadow_vertex;
+    default: return BUGLE_FALSE;
+    }
+}
+
+/* Handles a new data store for buffer id, which is shadowed if target is
+ * one of the selected targets.
+ */
+static void buffershadow_data_store(GLuint id, GLenum target, size_t size, const void *data,
+                                    const callback_data *cb)
+{
+    buffershadow_data *shadow;
+    buffershadow_buffer *buffer;
+
+    if (!id)
+        return;
+    shadow = buffershadow_lock();
+    if (!shadow)
+        return;
+    if (bugle_gl_call_get_error(cb->call_object) != GL_NO_ERROR
+        || !buffershadow_target_enabled(target))
+        buffershadow_drop(shadow, id);
+    else
+    {
+        buffer = buffershadow_create(shadow, id, size);
+        if (buffer && data && !buffershadow_write(shadow, buffer, 0, size, data))
+            buffershadow_drop(shadow, id);
+    }
+    buffershadow_unlock(shadow);
+}
+
+static void buffershadow_sub_data(GLuint id, size_t offset, size_t size, const void *data,
+                                  const callback_data *cb)
+{
+    buffershadow_data *shadow;
+    buffershadow_buffer *buffer;
+
+    shadow = buffershadow_lock();
+    if (!shadow)
+        return;
+    buffer = buffershadow_get(shadow, id);
+    if (buffer)
+    {
+        if (bugle_gl_call_get_error(cb->call_object) != GL_NO_ERROR
+            || offset > buffer->size || size > buffer->size - offset
+            || (size > 0 && !data)
+            || !buffershadow_write(shadow, buffer, offset, size, data))
+            buffershadow_drop(shadow, id);
+    }
+    buffershadow_unlock(shadow);
+}
+
+/* Drops the shadow of a buffer that was written in some way that we
+ * cannot follow. An id of 0 drops all shadows.
+ */
+static void buffershadow_invalidate(GLuint id)
+{
+    buffershadow_data *shadow;
+
+    shadow = buffershadow_lock();
+    if (!shadow)
+        return;
+    buffershadow_drop(shadow, id);
+    buffershadow_unlock(shadow);
+}
+
+static void buffershadow_invalidate_target(GLenum target)
+{
+    GLuint id = 0;
+
+    if (buffershadow_bound(target, &id))
+    {
+        if (id)
+            buffershadow_invalidate(id);
+    }
+    else
+        buffershadow_invalidate(0);
+}
+
+static bugle_bool buffershadow_glBufferData(function_call *call, const callback_data *data)
+{
+    GLenum target;
+    GLuint id;
+
+    if (bugle_gl_in_begin_end())
+        return BUGLE_TRUE;
+    target = *call->glBufferData.arg0;
+    if (buffershadow_bound(target, &id))
+        buffershadow_data_store(id, target, *call->glBufferData.arg1,
+                                *call->glBufferData.arg2, data);
+    else
+        buffershadow_invalidate(0);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glBufferSubData(function_call *call, const callback_data *data)
+{
+    GLuint id;
+
+    if (bugle_gl_in_begin_end())
+        return BUGLE_TRUE;
+    if (buffershadow_bound(*call->glBufferSubData.arg0, &id))
+    {
+        if (id)
+            buffershadow_sub_data(id, *call->glBufferSubData.arg1, *call->glBufferSubData.arg2,
+                                  *call->glBufferSubData.arg3, data);
+    }
+    else
+        buffershadow_invalidate(0);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glDeleteBuffers(function_call *call, const callback_data *data)
+{
+    buffershadow_data *shadow;
+    GLsizei n, i;
+    const GLuint *buffers;
+
+    n = *call->glDeleteBuffers.arg0;
+    buffers = *call->glDeleteBuffers.arg1;
+    if (n <= 0 || !buffers)
+        return BUGLE_TRUE;
+    shadow = buffershadow_lock();
+    if (!shadow)
+        return BUGLE_TRUE;
+    for (i = 0; i < n; i++)
+        if (buffers[i])
+            buffershadow_drop(shadow, buffers[i]);
+    buffershadow_unlock(shadow);
+    return BUGLE_TRUE;
+}
+
+/* Called for functions whose first argument is the target of a write
+ * that we do not mirror.
+ */
+static bugle_bool buffershadow_write_target(function_call *call, const callback_data *data)
+{
+    if (!bugle_gl_in_begin_end())
+        buffershadow_invalidate_target(*(const GLenum *) call->generic.args[0]);
+    return BUGLE_TRUE;
+}
+
+/* Called for functions whose first argument is a buffer that is written
+ * in a way that we do not mirror.
+ */
+static bugle_bool buffershadow_write_id(function_call *call, const callback_data *data)
+{
+    GLuint id;
+
+    id = *(const GLuint *) call->generic.args[0];
+    if (id)
+        buffershadow_invalidate(id);
+    return BUGLE_TRUE;
+}
+
+/* Writes by the GPU to an unknown set of buffers */
+static bugle_bool buffershadow_write_unknown(function_call *call, const callback_data *data)
+{
+    buffershadow_invalidate(0);
+    return BUGLE_TRUE;
+}
+
+#ifdef GL_VERSION_1_5
+/* Mapping is tracked by remembering where a writable mapping lives, and
+ * copying the whole mapped range into the shadow just before it is unmapped.
+ * That is only possible if the mapping can be read and holds the full
+ * contents of the range at unmap time. Write-only mappings may hold garbage
+ * in the bytes that were not written, and explicitly flushed or invalidated
+ * ranges do not reflect the data store, so for those the shadow is dropped.
+ */
+static void buffershadow_map(GLuint id, const void *pointer,
+                             size_t offset, size_t length, bugle_bool write, bugle_bool copyable)
+{
+    buffershadow_data *shadow;
+    buffershadow_buffer *buffer;
+
+    shadow = buffershadow_lock();
+    if (!shadow)
+        return;
+    buffer = buffershadow_get(shadow, id);
+    if (buffer && pointer && write)
+    {
+        if (!copyable || offset > buffer->size || length > buffer->size - offset)
+            buffershadow_drop(shadow, id);
+        else
+        {
+            buffer->map_pointer = pointer;
+            buffer->map_offset = offset;
+            buffer->map_length = length;
+        }
+    }
+    buffershadow_unlock(shadow);
+}
+
+/* Called before the unmap, while the mapping is still valid */
+static void buffershadow_unmap(GLuint id)
+{
+    buffershadow_data *shadow;
+    buffershadow_buffer *buffer;
+
+    shadow = buffershadow_lock();
+    if (!shadow)
+        return;
+    buffer = buffershadow_get(shadow, id);
+    if (buffer && buffer->map_pointer)
+    {
+        const void *pointer;
+
+        pointer = buffer->map_pointer;
+        buffer->map_pointer = NULL;
+        if (!buffershadow_write(shadow, buffer, buffer->map_offset, buffer->map_length, pointer))
+            buffershadow_drop(shadow, id);
+    }
+    buffershadow_unlock(shadow);
+}
+
+static bugle_bool buffershadow_glMapBuffer(function_call *call, const callback_data *data)
+{
+    GLuint id;
+    GLenum access;
+    size_t size = 0;
+
+    if (bugle_gl_in_begin_end())
+        return BUGLE_TRUE;
+    if (buffershadow_bound(*call->glMapBuffer.arg0, &id) && id)
+    {
+        access = *call->glMapBuffer.arg1;
+        if (bugle_gl_buffer_shadow_size(id, &size))
+            buffershadow_map(id, *call->glMapBuffer.retn, 0, size,
+                             access != GL_READ_ONLY, access == GL_READ_WRITE);
+    }
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glUnmapBuffer_pre(function_call *call, const callback_data *data)
+{
+    GLuint id;
+
+    if (bugle_gl_in_begin_end())
+        return BUGLE_TRUE;
+    if (buffershadow_bound(*call->glUnmapBuffer.arg0, &id) && id)
+        buffershadow_unmap(id);
+    return BUGLE_TRUE;
+}
+
+/* If the data store was corrupted while mapped, the contents are undefined */
+static bugle_bool buffershadow_glUnmapBuffer(function_call *call, const callback_data *data)
+{
+    GLuint id;
+
+    if (!*call->glUnmapBuffer.retn && !bugle_gl_in_begin_end()
+        && buffershadow_bound(*call->glUnmapBuffer.arg0, &id) && id)
+        buffershadow_invalidate(id);
+    return BUGLE_TRUE;
+}
+#endif /* GL_VERSION_1_5 */
+
+#ifdef GL_VERSION_2_1
+/* Reading pixels into a buffer object writes it */
+static bugle_bool buffershadow_pixel_pack(function_call *call, const callback_data *data)
+{
+    if (!bugle_gl_in_begin_end()
+        && BUGLE_GL_HAS_EXTENSION_GROUP(GL_VERSION_2_1))
+        buffershadow_invalidate_target(GL_PIXEL_PACK_BUFFER);
+    return BUGLE_TRUE;
+}
+#endif
+
+#ifdef GL_VERSION_3_0
+/* Whether a mapping made with glMapBufferRange holds the contents of the
+ * range when it is unmapped.
+ */
+static bugle_bool buffershadow_map_range_copyable(GLbitfield access)
+{
+    GLbitfield untracked;
+
+    untracked = GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_FLUSH_EXPLICIT_BIT;
+#ifdef GL_VERSION_4_4
+    untracked |= GL_MAP_PERSISTENT_BIT;
+#endif
+    return (access & GL_MAP_READ_BIT) && !(access & untracked);
+}
+
+static bugle_bool buffershadow_glMapBufferRange(function_call *call, const callback_data *data)
+{
+    GLuint id;
+    GLbitfield access;
+
+    if (bugle_gl_in_begin_end())
+        return BUGLE_TRUE;
+    if (buffershadow_bound(*call->glMapBufferRange.arg0, &id) && id)
+    {
+        access = *call->glMapBufferRange.arg3;
+        buffershadow_map(id, *call->glMapBufferRange.retn,
+                         *call->glMapBufferRange.arg1, *call->glMapBufferRange.arg2,
+                         (access & GL_MAP_WRITE_BIT) != 0, buffershadow_map_range_copyable(access));
+    }
+    return BUGLE_TRUE;
+}
+#endif
+
+#ifdef GL_VERSION_3_1
+static void buffershadow_copy_sub_data(GLuint read, GLuint write,
+                                       size_t read_offset, size_t write_offset, size_t size,
+                                       const callback_data *cb)
+{
+    buffershadow_data *shadow;
+    buffershadow_buffer *src, *dst;
+
+    shadow = buffershadow_lock();
+    if (!shadow)
+        return;
+    dst = buffershadow_get(shadow, write);
+    if (dst)
+    {
+        src = buffershadow_get(shadow, read);
+        if (!src
+            || bugle_gl_call_get_error(cb->call_object) != GL_NO_ERROR
+            || read_offset > src->size || size > src->size - read_offset
+            || write_offset > dst->size || size > dst->size - write_offset
+            || !buffershadow_copy(shadow, dst, write_offset, src, read_offset, size))
+            buffershadow_drop(shadow, write);
+    }
+    buffershadow_unlock(shadow);
+}
+
+static bugle_bool buffershadow_glCopyBufferSubData(function_call *call, const callback_data *data)
+{
+    GLuint read = 0, write = 0;
+
+    if (bugle_gl_in_begin_end())
+        return BUGLE_TRUE;
+    if (!buffershadow_bound(*call->glCopyBufferSubData.arg1, &write))
+        buffershadow_invalidate(0);
+    else if (write && buffershadow_bound(*call->glCopyBufferSubData.arg0, &read))
+        buffershadow_copy_sub_data(read, write,
+                                   *call->glCopyBufferSubData.arg2, *call->glCopyBufferSubData.arg3,
+                                   *call->glCopyBufferSubData.arg4, data);
+    else if (write)
+        buffershadow_invalidate(write);
+    return BUGLE_TRUE;
+}
+#endif
+
+#ifdef GL_VERSION_4_4
+static bugle_bool buffershadow_glBufferStorage(function_call *call, const callback_data *data)
+{
+    GLenum target;
+    GLuint id;
+
+    if (bugle_gl_in_begin_end())
+        return BUGLE_TRUE;
+    target = *call->glBufferStorage.arg0;
+    if (!buffershadow_bound(target, &id))
+        buffershadow_invalidate(0);
+    else if (*call->glBufferStorage.arg3 & GL_MAP_PERSISTENT_BIT)
+    {
+        if (id)
+            buffershadow_invalidate(id);
+    }
+    else
+        buffershadow_data_store(id, target, *call->glBufferStorage.arg1,
+                                *call->glBufferStorage.arg2, data);
+    return BUGLE_TRUE;
+}
+#endif
+
+#ifdef GL_VERSION_4_5
+/* Buffers created with glCreateBuffers have no target, so we go by the one
+ * that globjects saw them first bound to.
+ */
+static bugle_bool buffershadow_glNamedBufferData(function_call *call, const callback_data *data)
+{
+    GLuint id;
+
+    id = *call->glNamedBufferData.arg0;
+    buffershadow_data_store(id, bugle_globjects_get_target(BUGLE_GLOBJECTS_BUFFER, id),
+                            *call->glNamedBufferData.arg1, *call->glNamedBufferData.arg2, data);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glNamedBufferStorage(function_call *call, const callback_data *data)
+{
+    GLuint id;
+
+    id = *call->glNamedBufferStorage.arg0;
+    if (*call->glNamedBufferStorage.arg3 & GL_MAP_PERSISTENT_BIT)
+        buffershadow_invalidate(id);
+    else
+        buffershadow_data_store(id, bugle_globjects_get_target(BUGLE_GLOBJECTS_BUFFER, id),
+                                *call->glNamedBufferStorage.arg1, *call->glNamedBufferStorage.arg2, data);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glNamedBufferSubData(function_call *call, const callback_data *data)
+{
+    buffershadow_sub_data(*call->glNamedBufferSubData.arg0, *call->glNamedBufferSubData.arg1,
+                          *call->glNamedBufferSubData.arg2, *call->glNamedBufferSubData.arg3, data);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glMapNamedBuffer(function_call *call, const callback_data *data)
+{
+    GLuint id;
+    GLenum access;
+    size_t size = 0;
+
+    id = *call->glMapNamedBuffer.arg0;
+    access = *call->glMapNamedBuffer.arg1;
+    if (bugle_gl_buffer_shadow_size(id, &size))
+        buffershadow_map(id, *call->glMapNamedBuffer.retn, 0, size,
+                         access != GL_READ_ONLY, access == GL_READ_WRITE);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glMapNamedBufferRange(function_call *call, const callback_data *data)
+{
+    GLbitfield access;
+
+    access = *call->glMapNamedBufferRange.arg3;
+    buffershadow_map(*call->glMapNamedBufferRange.arg0, *call->glMapNamedBufferRange.retn,
+                     *call->glMapNamedBufferRange.arg1, *call->glMapNamedBufferRange.arg2,
+                     (access & GL_MAP_WRITE_BIT) != 0, buffershadow_map_range_copyable(access));
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glUnmapNamedBuffer_pre(function_call *call, const callback_data *data)
+{
+    buffershadow_unmap(*call->glUnmapNamedBuffer.arg0);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glUnmapNamedBuffer(function_call *call, const callback_data *data)
+{
+    if (!*call->glUnmapNamedBuffer.retn)
+        buffershadow_invalidate(*call->glUnmapNamedBuffer.arg0);
+    return BUGLE_TRUE;
+}
+
+static bugle_bool buffershadow_glCopyNamedBufferSubData(function_call *call, const callback_data *data)
+{
+    buffershadow_copy_sub_data(*call->glCopyNamedBufferSubData.arg0, *call->glCopyNamedBufferSubData.arg1,
+                               *call->glCopyNamedBufferSubData.arg2, *call->glCopyNamedBufferSubData.arg3,
+                               *call->glCopyNamedBufferSubData.arg4, data);
+    return BUGLE_TRUE;
+}
+#endif
+
+bugle_bool bugle_gl_buffer_shadow_size(GLuint buffer, size_t *size)
+{
+    buffershadow_data *shadow;
+    const buffershadow_buffer *b;
+    bugle_bool ret = BUGLE_FALSE;
+
+    shadow = buffershadow_lock();
+    if (!shadow)
+        return BUGLE_FALSE;
+    b = buffershadow_get(shadow, buffer);
+    if (b && !b->map_pointer)
+    {
+        *size = b->size;
+        ret = BUGLE_TRUE;
+    }
+    buffershadow_unlock(shadow);
+    return ret;
+}
+
+bugle_bool bugle_gl_buffer_shadow_read(GLuint buffer, size_t offset, size_t size, void *data)
+{
+    buffershadow_data *shadow;
+    const buffershadow_buffer *b;
+    bugle_bool ret = BUGLE_FALSE;
+
+    shadow = buffershadow_lock();
+    if (!shadow)
+        return BUGLE_FALSE;
+    b = buffershadow_get(shadow, buffer);
+    if (b && !b->map_pointer && offset <= b->size && size <= b->size - offset)
+    {
+        buffershadow_read(b, offset, size, data);
+        ret = BUGLE_TRUE;
+    }
+    buffershadow_unlock(shadow);
+    return ret;
+}
+
+static void buffershadow_data_init(const void *key, void *data)
+{
+    buffershadow_data *shadow;
+
+    shadow = (buffershadow_data *) data;
+    bugle_thread_lock_init(&shadow->mutex);
+    bugle_hashptr_init(&shadow->buffers, NULL);
+    shadow->used = 0;
+}
+
+static void buffershadow_data_clear(void *data)
+{
+    buffershadow_data *shadow;
+
+    shadow = (buffershadow_data *) data;
+    buffershadow_drop(shadow, 0);
+    bugle_thread_lock_destroy(&shadow->mutex);
+}
+
+static bugle_bool buffershadow_filter_set_initialise(filter_set *handle)
+{
+    filter *f;
+
+    /* Everything is caught while inactive, since a shadow that missed a
+     * write would be wrong forever after.
+     */
+    f = bugle_filter_new(handle, "buffershadow");
+    bugle_filter_catches(f, "glBufferData", BUGLE_TRUE, buffershadow_glBufferData);
+    bugle_filter_catches(f, "glBufferSubData", BUGLE_TRUE, buffershadow_glBufferSubData);
+    bugle_filter_catches(f, "glDeleteBuffers", BUGLE_TRUE, buffershadow_glDeleteBuffers);
+#ifdef GL_VERSION_1_5
+    bugle_filter_catches(f, "glMapBuffer", BUGLE_TRUE, buffershadow_glMapBuffer);
+    bugle_filter_catches(f, "glUnmapBuffer", BUGLE_TRUE, buffershadow_glUnmapBuffer);
+#endif
+#ifdef GL_VERSION_2_1
+    bugle_filter_catches(f, "glReadPixels", BUGLE_TRUE, buffershadow_pixel_pack);
+    bugle_filter_catches(f, "glGetTexImage", BUGLE_TRUE, buffershadow_pixel_pack);
+    bugle_filter_catches(f, "glGetCompressedTexImage", BUGLE_TRUE, buffershadow_pixel_pack);
+#endif
+#ifdef GL_VERSION_3_0
+    bugle_filter_catches(f, "glMapBufferRange", BUGLE_TRUE, buffershadow_glMapBufferRange);
+    bugle_filter_catches(f, "glEndTransformFeedback", BUGLE_TRUE, buffershadow_write_unknown);
+#endif
+#ifdef GL_VERSION_3_1
+    bugle_filter_catches(f, "glCopyBufferSubData", BUGLE_TRUE, buffershadow_glCopyBufferSubData);
+#endif
+#ifdef GL_VERSION_4_2
+    bugle_filter_catches(f, "glMemoryBarrier", BUGLE_TRUE, buffershadow_write_unknown);
+#endif
+#ifdef GL_VERSION_4_3
+    bugle_filter_catches(f, "glClearBufferData", BUGLE_TRUE, buffershadow_write_target);
+    bugle_filter_catches(f, "glClearBufferSubData", BUGLE_TRUE, buffershadow_write_target);
+    bugle_filter_catches(f, "glInvalidateBufferData", BUGLE_TRUE, buffershadow_write_id);
+    bugle_filter_catches(f, "glInvalidateBufferSubData", BUGLE_TRUE, buffershadow_write_id);
+#endif
+#ifdef GL_VERSION_4_4
+    bugle_filter_catches(f, "glBufferStorage", BUGLE_TRUE, buffershadow_glBufferStorage);
+#endif
+#ifdef GL_VERSION_4_5
+    bugle_filter_catches(f, "glNamedBufferData", BUGLE_TRUE, buffershadow_glNamedBufferData);
+    bugle_filter_catches(f, "glNamedBufferStorage", BUGLE_TRUE, buffershadow_glNamedBufferStorage);
+    bugle_filter_catches(f, "glNamedBufferSubData", BUGLE_TRUE, buffershadow_glNamedBufferSubData);
+    bugle_filter_catches(f, "glMapNamedBuffer", BUGLE_TRUE, buffershadow_glMapNamedBuffer);
+    bugle_filter_catches(f, "glMapNamedBufferRange", BUGLE_TRUE, buffershadow_glMapNamedBufferRange);
+    bugle_filter_catches(f, "glUnmapNamedBuffer", BUGLE_TRUE, buffershadow_glUnmapNamedBuffer);
+    bugle_filter_catches(f, "glCopyNamedBufferSubData", BUGLE_TRUE, buffershadow_glCopyNamedBufferSubData);
+    bugle_filter_catches(f, "glClearNamedBufferData", BUGLE_TRUE, buffershadow_write_id);
+    bugle_filter_catches(f, "glClearNamedBufferSubData", BUGLE_TRUE, buffershadow_write_id);
+    bugle_filter_catches(f, "glMemoryBarrierByRegion", BUGLE_TRUE, buffershadow_write_unknown);
+    bugle_filter_catches(f, "glReadnPixels", BUGLE_TRUE, buffershadow_pixel_pack);
+    bugle_filter_catches(f, "glGetnTexImage", BUGLE_TRUE, buffershadow_pixel_pack);
+    bugle_filter_catches(f, "glGetnCompressedTexImage", BUGLE_TRUE, buffershadow_pixel_pack);
+    bugle_filter_catches(f, "glGetTextureImage", BUGLE_TRUE, buffershadow_pixel_pack);
+    bugle_filter_catches(f, "glGetTextureSubImage", BUGLE_TRUE, buffershadow_pixel_pack);
+    bugle_filter_catches(f, "glGetCompressedTextureImage", BUGLE_TRUE, buffershadow_pixel_pack);
+    bugle_filter_catches(f, "glGetCompressedTextureSubImage", BUGLE_TRUE, buffershadow_pixel_pack);
+#endif
+    bugle_filter_order("invoke", "buffershadow");
+    bugle_gl_filter_post_renders("buffershadow");
+    bugle_gl_filter_set_queries_error("buffershadow");
+
+    /* Mapped ranges must be copied while they are still mapped */
+    f = bugle_filter_new(handle, "buffershadow_pre");
+#ifdef GL_VERSION_1_5
+    bugle_filter_catches(f, "glUnmapBuffer", BUGLE_TRUE, buffershadow_glUnmapBuffer_pre);
+#endif
+#ifdef GL_VERSION_4_5
+    bugle_filter_catches(f, "glUnmapNamedBuffer", BUGLE_TRUE, buffershadow_glUnmapNamedBuffer_pre);
+#endif
+    bugle_filter_order("buffershadow_pre", "invoke");
+
+    buffershadow_view = bugle_object_view_new(bugle_get_namespace_class(),
+                                              buffershadow_data_init,
+                                              buffershadow_data_clear,
+                                              sizeof(buffershadow_data));
+    buffershadow_loaded = BUGLE_TRUE;
+    return BUGLE_TRUE;
+}
+
+void buffershadow_initialise(void)
+{
+    static const filter_set_variable_info buffershadow_variables[] =
+    {
+        { "element", "shadow buffers created on the element array target [yes]", FILTER_SET_VARIABLE_BOOL, &buffershadow_element, NULL },
+        { "vertex", "shadow buffers created on the array target [no]", FILTER_SET_VARIABLE_BOOL, &buffershadow_vertex, NULL },
+        { "budget", "memory to use for shadows in each share group, in MiB [64]", FILTER_SET_VARIABLE_POSITIVE_INT, &buffershadow_budget, NULL },
+        { NULL, NULL, 0, NULL, NULL }
+    };
+
+    static const filter_set_info buffershadow_info =
+    {
+        "buffershadow",
+        buffershadow_filter_set_initialise,
+        NULL,
+        NULL,
+        NULL,
+        buffershadow_variables,
+        "keeps CPU copies of buffer contents to avoid reading them back"
+    };
+
+    bugle_filter_set_new(&buffershadow_info);
+    bugle_filter_set_depends("buffershadow", "trackcontext");
+    bugle_filter_set_depends("buffershadow", "globjects");
+    /* Needed to tell whether writes succeeded */
+    bugle_filter_set_depends("buffershadow", "error");
+    bugle_gl_filter_set_renders("buffershadow");
+}
@@ -27,6 +27,7 @@
 #include <bugle/glwin/trackcontext.h>
 #include <bugle/gl/glutils.h>
 #include <bugle/gl/glextensions.h>
+#include <bugle/gl/glbeginend.h>
 #include <bugle/hashtable.h>
 #include <bugle/filters.h>
 #include <bugle/objects.h>
@@ -148,24 +149,53 @@ static bugle_bool glextensions_filter_set_initialise(filter_set *handle)
                                               context_init,
                                               context_clear,
                                               sizeof(context_extensions));
+    /* Parsing the extension strings is expensive, and many contexts are
+     * never queried (e.g. when no checking filter-sets are active).
+     * context_init queries the current context, which is correct because
+     * the data is only ever retrieved for the current context.
+     */
+    bugle_object_view_set_lazy(bugle_get_context_class(), glextensions_view);
     return BUGLE_TRUE;
 }
 
+/* Returns the extensions of the current context, or NULL if there is no
+ * current context. Constructing the view queries GL, which is not allowed
+ * inside glBegin/glEnd, so in that case NULL is also returned and callers
+ * give the conservative answer until the view can be constructed.
+ */
+static const context_extensions *glextensions_get(void)
+{
+    object *obj;
+
+    obj = bugle_object_get_current(bugle_get_context_class());
+    if (!obj)
+        return NULL;
+    if (!bugle_object_view_constructed(obj, glextensions_view) && bugle_gl_in_begin_end())
+        return NULL;
+    return (const context_extensions *) bugle_object_get_data(obj, glextensions_view);
+}
+
 /* The output can be inverted by passing ~ext instead of ext (which basically
  * means "true if this extension is not present"). This is used in the
- * state tables.
+ * state tables. If the extensions cannot be determined, the answer is
+ * BUGLE_FALSE either way, so that callers skip extension-specific code.
  */
 bugle_bool bugle_gl_has_extension(bugle_api_extension ext)
 {
     const context_extensions *ce;
+    bugle_bool invert = BUGLE_FALSE;
 
     /* bugle_api_extension_id returns -1 for unknown extensions - play it safe */
     if (ext == NULL_EXTENSION) return BUGLE_FALSE;
-    if (ext < 0) return !bugle_gl_has_extension(~ext);
+    if (ext < 0)
+    {
+        ext = ~ext;
+        invert = BUGLE_TRUE;
+    }
     assert(ext < bugle_api_extension_count());
-    ce = (const context_extensions *) bugle_object_get_current_data(bugle_get_context_class(), glextensions_view);
+    ce = glextensions_get();
     if (!ce) return BUGLE_FALSE;
-    else return ce->flags[ext];
+    else return ce->flags[ext] != invert;
 }
 
 bugle_bool bugle_gl_has_extension2(int ext, const char *name)
@@ -174,7 +204,7 @@ bugle_bool bugle_gl_has_extension2(int ext, const char *name)
 
     assert(ext >= -1 && ext < bugle_api_extension_count());
     /* bugle_api_extension_id returns -1 for unknown extensions - play it safe */
-    ce = (const context_extensions *) bugle_object_get_current_data(bugle_get_context_class(), glextensions_view);
+    ce = glextensions_get();
     if (!ce) return BUGLE_FALSE;
     if (ext >= 0)
         return ce->flags[ext];
@@ -183,23 +213,30 @@ bugle_bool bugle_gl_has_extension2(int ext, const char *name)
 }
 
 /* The output can be inverted by passing ~ext instead of ext (which basically
- * means "true if none of these extensions are present").
+ * means "true if none of these extensions are present"). As for
+ * bugle_gl_has_extension, the answer is BUGLE_FALSE either way if the
+ * extensions cannot be determined.
  */
 bugle_bool bugle_gl_has_extension_group(bugle_api_extension ext)
 {
     const context_extensions *ce;
     size_t i;
     const bugle_api_extension *exts;
+    bugle_bool invert = BUGLE_FALSE;
 
-    if (ext < 0) return !bugle_gl_has_extension_group(~ext);
+    if (ext < 0)
+    {
+        ext = ~ext;
+        invert = BUGLE_TRUE;
+    }
     assert(ext < bugle_api_extension_count());
-    ce = (const context_extensions *) bugle_object_get_current_data(bugle_get_context_class(), glextensions_view);
+    ce = glextensions_get();
     if (!ce) return BUGLE_FALSE;
     exts = bugle_api_extension_group_members(ext);
 
     for (i = 0; exts[i] != NULL_EXTENSION; i++)
-        if (ce->flags[exts[i]]) return BUGLE_TRUE;
-    return BUGLE_FALSE;
+        if (ce->flags[exts[i]]) return !invert;
+    return invert;
 }
 
 bugle_bool bugle_gl_has_extension_group2(bugle_api_extension ext, const char *name)
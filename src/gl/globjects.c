@@ -125,7 +125,7 @@ static void globjects_delete_multiple(bugle_globjects_type type,
     {
         for (i = 0; i < count; i++)
             if (is == NULL || !is(objects[i]))
-                bugle_hashptr_set_int(table, objects[i], NULL);
+                bugle_hashptr_erase_int(table, objects[i]);
         bugle_gl_end_internal_render("globjects_delete_multiple", BUGLE_TRUE);
     }
     unlock();
@@ -196,7 +196,7 @@ static void globjects_delete_single(bugle_globjects_type type,
     lock();
     table = get_table(type);
     if (table)
-        bugle_hashptr_set_int(table, object, NULL);
+        bugle_hashptr_erase_int(table, object);
     unlock();
 }
 #endif /* GL_ES_VERSION_2_0 || GL_VERSION_2_0 */
@@ -493,7 +493,7 @@ static bugle_bool globjects_glDeleteSync(function_call *call, const callback_dat
     lock();
     table = get_table(BUGLE_GLOBJECTS_SYNC);
     if (table)
-        bugle_hashptr_set(table, sync, NULL);
+        bugle_hashptr_erase(table, sync);
     unlock();
     return BUGLE_TRUE;
 }
@@ -587,6 +587,7 @@ static bugle_bool globjects_filter_set_initialise(filter_set *handle)
                                       checks_init,
                                       (void (*)(void *)) bugle_list_clear,
                                       sizeof(linked_list));
+    bugle_object_view_set_initialised(bugle_get_call_class(), call_view);
     return BUGLE_TRUE;
 }
 
@@ -272,3 +272,43 @@ GLenum bugle_gl_call_get_error(object *call_object)
     else
         return GL_NO_ERROR;
 }
+
+GLenum bugle_gl_buffer_binding(GLenum target)
+{
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER: return GL_ARRAY_BUFFER_BINDING;
+    case GL_ELEMENT_ARRAY_BUFFER: return GL_ELEMENT_ARRAY_BUFFER_BINDING;
+#ifdef GL_VERSION_2_1
+    case GL_PIXEL_PACK_BUFFER: return GL_PIXEL_PACK_BUFFER_BINDING;
+    case GL_PIXEL_UNPACK_BUFFER: return GL_PIXEL_UNPACK_BUFFER_BINDING;
+#endif
+#ifdef GL_VERSION_3_0
+    case GL_TRANSFORM_FEEDBACK_BUFFER: return GL_TRANSFORM_FEEDBACK_BUFFER_BINDING;
+#endif
+#ifdef GL_VERSION_3_1
+    case GL_COPY_READ_BUFFER: return GL_COPY_READ_BUFFER;
+    case GL_COPY_WRITE_BUFFER: return GL_COPY_WRITE_BUFFER;
+    case GL_UNIFORM_BUFFER: return GL_UNIFORM_BUFFER_BINDING;
+    /* The binding is queried with the target itself */
+    case GL_TEXTURE_BUFFER: return GL_TEXTURE_BUFFER;
+#endif
+#ifdef GL_VERSION_4_0
+    case GL_DRAW_INDIRECT_BUFFER: return GL_DRAW_INDIRECT_BUFFER_BINDING;
+#endif
+#ifdef GL_VERSION_4_2
+    case GL_ATOMIC_COUNTER_BUFFER: return GL_ATOMIC_COUNTER_BUFFER_BINDING;
+#endif
+#ifdef GL_VERSION_4_3
+    case GL_DISPATCH_INDIRECT_BUFFER: return GL_DISPATCH_INDIRECT_BUFFER_BINDING;
+    case GL_SHADER_STORAGE_BUFFER: return GL_SHADER_STORAGE_BUFFER_BINDING;
+#endif
+#ifdef GL_VERSION_4_4
+    case GL_QUERY_BUFFER: return GL_QUERY_BUFFER_BINDING;
+#endif
+#ifdef GL_VERSION_4_6
+    case GL_PARAMETER_BUFFER: return GL_PARAMETER_BUFFER_BINDING;
+#endif
+    default: return GL_NONE;
+    }
+}
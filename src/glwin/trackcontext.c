@@ -353,7 +353,7 @@ static bugle_bool trackcontext_destroycontext(function_call *call, const callbac
     /* FIXME: leaks from namespace associations */
     ctx = bugle_glwin_get_context_destroy(call);
     if (ctx)
-        bugle_hashptr_set(&context_objects, ctx, NULL);
+        bugle_hashptr_erase(&context_objects, ctx);
     return BUGLE_TRUE;
 }
 
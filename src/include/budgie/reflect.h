@@ -74,6 +74,48 @@ BUGLE_EXPORT_PRE void budgie_dump_any_type_extended(budgie_type type,
                                                     const void *pointer,
                                                     bugle_io_writer *writer) BUGLE_EXPORT_POST;
 
+/* How budgie_dump_array treats arrays with more than limit elements.
+ * Smaller arrays are always dumped in full.
+ */
+typedef enum
+{
+    BUDGIE_DUMP_ARRAY_FULL,       /* every element */
+    BUDGIE_DUMP_ARRAY_TRUNCATE,   /* the first limit elements, then an ellipsis */
+    BUDGIE_DUMP_ARRAY_HASH        /* the element count and a hash of the contents */
+} budgie_dump_array_mode;
+
+typedef struct
+{
+    budgie_dump_array_mode mode;
+    long limit;
+} budgie_dump_array_policy;
+
+/* Dumps count elements of type starting at value, as "{ a, b, ... }",
+ * subject to the policy of the calling thread. The length is passed on to
+ * each element, as for budgie_dump_any_type.
+ */
+BUGLE_EXPORT_PRE void budgie_dump_array(budgie_type type, const void *value, int count, int length, bugle_io_writer *writer) BUGLE_EXPORT_POST;
+/* Sets the array policy used by dumps on the calling thread, or restores
+ * the default (every array in full) if policy is NULL. The policy is not
+ * copied. Filter-sets that want a policy should set it around their own
+ * dumps, since other filter-sets share the thread.
+ */
+BUGLE_EXPORT_PRE void budgie_dump_set_array_policy(const budgie_dump_array_policy *policy) BUGLE_EXPORT_POST;
+
+/* Writes a binary form of a value to writer, including the arrays and
+ * strings reachable through its pointers, without formatting anything. The
+ * length has the same meaning as for budgie_dump_any_type. The encoding is
+ * only meaningful to the same build on the same platform.
+ */
+BUGLE_EXPORT_PRE void budgie_serialize_any_type(budgie_type type, const void *value, int length, bugle_io_writer *writer) BUGLE_EXPORT_POST;
+/* Dumps a value written by budgie_serialize_any_type, producing the same
+ * text that budgie_dump_any_type produced for the original value, including
+ * the original pointer values. *data is advanced past the value. Returns
+ * BUGLE_FALSE if the data is truncated or corrupt, in which case *data is
+ * unchanged and partial output may have been written.
+ */
+BUGLE_EXPORT_PRE bugle_bool budgie_dump_serialized(const char **data, const char *end, bugle_io_writer *writer) BUGLE_EXPORT_POST;
+
 /* Generated function that converts [an array of] one numeric type to another */
 BUGLE_EXPORT_PRE void budgie_type_convert(void *out, budgie_type out_type, const void *in, budgie_type in_type, size_t count) BUGLE_EXPORT_POST;
 
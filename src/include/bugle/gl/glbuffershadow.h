@@ -0,0 +1,53 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BUGLE_GL_GLBUFFERSHADOW_H
+#define BUGLE_GL_GLBUFFERSHADOW_H
+
+#include <stddef.h>
+#include <bugle/gl/glheaders.h>
+#include <bugle/bool.h>
+#include <bugle/export.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The buffershadow filter-set keeps CPU copies of the contents of selected
+ * buffer objects, so that they can be examined without reading them back
+ * from the driver. These functions return BUGLE_FALSE if the filter-set is
+ * not loaded, if the buffer is not shadowed, or if the shadow cannot be
+ * trusted (for example, while the buffer is mapped for writing). The caller
+ * must then fall back to querying GL.
+ */
+
+/* Retrieves the size of the data store of a shadowed buffer */
+BUGLE_EXPORT_PRE bugle_bool bugle_gl_buffer_shadow_size(GLuint buffer, size_t *size) BUGLE_EXPORT_POST;
+
+/* Copies size bytes starting at offset from the shadow of buffer into data.
+ * Fails if the range is not entirely inside the buffer.
+ */
+BUGLE_EXPORT_PRE bugle_bool bugle_gl_buffer_shadow_read(GLuint buffer, size_t offset, size_t size, void *data) BUGLE_EXPORT_POST;
+
+/* Used by the initialisation code */
+void buffershadow_initialise(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !BUGLE_GL_GLBUFFERSHADOW_H */
@@ -64,6 +64,11 @@ BUGLE_EXPORT_PRE void bugle_gl_filter_post_renders(const char *name) BUGLE_EXPOR
 BUGLE_EXPORT_PRE void bugle_gl_filter_set_queries_error(const char *name) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE GLenum bugle_gl_call_get_error(object *call_object) BUGLE_EXPORT_POST;
 
+/* Returns the glGetIntegerv query for the buffer bound to a buffer target,
+ * or GL_NONE if the target is not known.
+ */
+BUGLE_EXPORT_PRE GLenum bugle_gl_buffer_binding(GLenum target) BUGLE_EXPORT_POST;
+
 #ifdef __cplusplus
 }
 #endif
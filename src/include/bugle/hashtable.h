@@ -35,9 +35,9 @@ typedef struct
 typedef struct
 {
     hash_table_entry *entries;
-    size_t size;
+    size_t size;        /* always zero or a power of two */
     size_t count;
-    int size_index;
+    int size_index;     /* unused, kept so that the layout is unchanged */
     void (*destructor)(void *);
 } hash_table;
 
@@ -50,6 +50,10 @@ BUGLE_EXPORT_PRE void bugle_hash_set(hash_table *table, const char *key, void *v
 BUGLE_EXPORT_PRE bugle_bool bugle_hash_count(const hash_table *table, const char *key) BUGLE_EXPORT_POST;
 /* Returns NULL if key absent OR if value is NULL */
 BUGLE_EXPORT_PRE void *bugle_hash_get(const hash_table *table, const char *key) BUGLE_EXPORT_POST;
+/* Removes the key if present, calling the destructor on the value. Entries
+ * may be moved, so this must not be used while walking the table.
+ */
+BUGLE_EXPORT_PRE void bugle_hash_erase(hash_table *table, const char *key) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void bugle_hash_clear(hash_table *table) BUGLE_EXPORT_POST;
 
 /* Walk the hash table. A walker loop looks like this:
@@ -71,9 +75,9 @@ typedef struct
 typedef struct
 {
     hashptr_table_entry *entries;
-    size_t size;
+    size_t size;        /* always zero or a power of two */
     size_t count;
-    int size_index;
+    int size_index;     /* unused, kept so that the layout is unchanged */
     void (*destructor)(void *);
 } hashptr_table;
 
@@ -81,6 +85,7 @@ BUGLE_EXPORT_PRE void bugle_hashptr_init(hashptr_table *table, void (*destructor
 BUGLE_EXPORT_PRE void bugle_hashptr_set(hashptr_table *table, const void *key, void *value) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE bugle_bool bugle_hashptr_count(const hashptr_table *table, const void *key) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void *bugle_hashptr_get(const hashptr_table *table, const void *key) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE void bugle_hashptr_erase(hashptr_table *table, const void *key) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void bugle_hashptr_clear(hashptr_table *table) BUGLE_EXPORT_POST;
 
 BUGLE_EXPORT_PRE const hashptr_table_entry *bugle_hashptr_begin(hashptr_table *table) BUGLE_EXPORT_POST;
@@ -96,6 +101,11 @@ static inline void *bugle_hashptr_get_int(hashptr_table *table, size_t key)
     return bugle_hashptr_get(table, (const void *) key);
 }
 
+static inline void bugle_hashptr_erase_int(hashptr_table *table, size_t key)
+{
+    bugle_hashptr_erase(table, (const void *) key);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -48,6 +48,20 @@ BUGLE_EXPORT_PRE size_t bugle_io_read(void *ptr, size_t size, size_t nmemb, bugl
  */
 BUGLE_EXPORT_PRE int bugle_io_reader_close(bugle_io_reader *reader) BUGLE_EXPORT_POST;
 
+/*** Specific types of readers */
+
+/* Create a reader that wraps a FILE.
+ * Kills the program on OOM, so always returns non-NULL.
+ */
+BUGLE_EXPORT_PRE bugle_io_reader *bugle_io_reader_file_new(FILE *f) BUGLE_EXPORT_POST;
+
+/* Creates a reader that decodes the output of bugle_io_writer_block_new
+ * from inner, and takes ownership of inner. Reading stops cleanly at the
+ * end of the last complete block. Returns NULL if inner does not start with
+ * a valid header, in which case the caller still owns it.
+ */
+BUGLE_EXPORT_PRE bugle_io_reader *bugle_io_reader_block_new(bugle_io_reader *inner) BUGLE_EXPORT_POST;
+
 typedef struct bugle_io_writer bugle_io_writer;
 
 /*** Writer output functions ***/
@@ -82,11 +96,28 @@ BUGLE_EXPORT_PRE void bugle_io_writer_mem_clear(bugle_io_writer *writer) BUGLE_E
 /* Frees the string memory. Do not use after this except to close */
 BUGLE_EXPORT_PRE void bugle_io_writer_mem_release(bugle_io_writer *writer) BUGLE_EXPORT_POST;
 
+/* Returns a memory writer owned by the calling thread, emptied but with
+ * its buffer retained from the previous call, so that repeatedly formatting
+ * short strings does not allocate. The contents are only valid until the
+ * next call from the same thread, and the writer must not be closed.
+ */
+BUGLE_EXPORT_PRE bugle_io_writer *bugle_io_writer_mem_scratch(void) BUGLE_EXPORT_POST;
+
 /* Create a writer that wraps a FILE.
  * Kills the program on OOM, so always returns non-NULL.
  */
 BUGLE_EXPORT_PRE bugle_io_writer *bugle_io_writer_file_new(FILE *f) BUGLE_EXPORT_POST;
 
+/* Creates a writer that compresses everything written to it and passes it
+ * on to inner, which it takes ownership of. The data is split into
+ * independent blocks of block_size bytes (0 for the default) that are
+ * compressed on a background thread, so if the process dies the output can
+ * still be decoded up to the last complete block. It is safe to use from
+ * several threads at once. Returns NULL if the thread cannot be started,
+ * in which case the caller still owns inner.
+ */
+BUGLE_EXPORT_PRE bugle_io_writer *bugle_io_writer_block_new(bugle_io_writer *inner, size_t block_size) BUGLE_EXPORT_POST;
+
 /* Creates a writer to accept a connection on host:port. The interpretation of
  * host and port are platform-specific, but must accept at least an IPv4
  * address in host and a number in port. Host may also be NULL to bind to the
@@ -42,6 +42,13 @@ enum
     BUGLE_LOG_DEBUG
 };
 
+/* Returns true if a message with these attributes would be written to at
+ * least one target, i.e., the severity is enabled for some target and the
+ * filter-set and event are not muted. Use it to skip building expensive
+ * messages that would only be thrown away.
+ */
+BUGLE_EXPORT_PRE bugle_bool bugle_log_enabled(const char *filterset, const char *event, int severity) BUGLE_EXPORT_POST;
+
 /* Write a message to the log. Do not include a trailing newline; this will
  * be provided automatically.
  */
@@ -59,6 +66,14 @@ BUGLE_EXPORT_PRE void bugle_log_printf(const char *filterset, const char *event,
 BUGLE_EXPORT_PRE void bugle_log_callback(const char *filterset, const char *event, int severity,
                                          void (*callback)(void *arg, FILE *f), void *arg) BUGLE_EXPORT_POST;
 
+/* Returns the offset in the log file after every message that any thread
+ * has logged so far, or -1 if there is no log file or it is compressed
+ * (which has no meaningful byte offsets). With asynchronous logging this
+ * waits for all threads' buffered messages to be written, so it should not
+ * be called for every message.
+ */
+BUGLE_EXPORT_PRE long bugle_log_file_offset(void) BUGLE_EXPORT_POST;
+
 /* Used internally by the initialisation code */
 void log_initialise(void);
 
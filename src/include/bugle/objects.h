@@ -33,21 +33,46 @@ typedef struct object object;
 
 BUGLE_EXPORT_PRE object_class *bugle_object_class_new(object_class *parent) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void bugle_object_class_free(object_class *klass) BUGLE_EXPORT_POST;
+/* Objects of a pooled class are recycled through a per-thread free list
+ * instead of being returned to the heap. This is only suitable for
+ * short-lived objects that are freed by the thread that created them. It
+ * must be called before any objects of the class are created.
+ */
+BUGLE_EXPORT_PRE void bugle_object_class_set_pooled(object_class *klass) BUGLE_EXPORT_POST;
 /* Returns an offset into the structure, which should be passed back to
  * object_get_current to get the data associated with this registration.
  * The key passed to the structure is determined by the individual classes,
  * and may give more information about the abstract object.
+ * The data is zero-filled before the constructor is called.
  */
 BUGLE_EXPORT_PRE object_view bugle_object_view_new(object_class *klass,
                                                    void (*constructor)(const void *key, void *data),
                                                    void (*destructor)(void *data),
                                                    size_t size) BUGLE_EXPORT_POST;
+/* Defers running the constructor for a view until the data for the view
+ * is first retrieved from an object, instead of when the object is created.
+ * The destructor is only run for objects where the view was constructed.
+ * The key passed to bugle_object_new must remain valid for the lifetime of
+ * the object, and the data must not be retrieved concurrently from several
+ * threads. It must be called before any objects of the class are created.
+ */
+BUGLE_EXPORT_PRE void bugle_object_view_set_lazy(object_class *klass, object_view view) BUGLE_EXPORT_POST;
+/* Declares that the constructor for a view initialises all of its data,
+ * so that it need not be zero-filled first. This saves time for views of
+ * classes whose objects are created often, such as the call class. It
+ * must be called before any objects of the class are created.
+ */
+BUGLE_EXPORT_PRE void bugle_object_view_set_initialised(object_class *klass, object_view view) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE object *    bugle_object_new(object_class *klass, const void *key, bugle_bool make_current) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void        bugle_object_free(object *obj) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE object *    bugle_object_get_current(const object_class *klass) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void *      bugle_object_get_current_data(const object_class *klass, object_view view) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void        bugle_object_set_current(object_class *klass, object *obj) BUGLE_EXPORT_POST;
 BUGLE_EXPORT_PRE void *      bugle_object_get_data(object *obj, object_view view) BUGLE_EXPORT_POST;
+/* Returns BUGLE_FALSE if the view is lazy and has not yet been constructed
+ * for obj, so that callers can avoid constructing it at a bad time.
+ */
+BUGLE_EXPORT_PRE bugle_bool  bugle_object_view_constructed(const object *obj, object_view view) BUGLE_EXPORT_POST;
 
 #ifdef __cplusplus
 }
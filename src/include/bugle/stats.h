@@ -113,6 +113,13 @@ BUGLE_EXPORT_PRE void bugle_stats_signal_update(stats_signal *si, double v) BUGL
 /* Convenience for accumulating signals */
 BUGLE_EXPORT_PRE void bugle_stats_signal_add(stats_signal *si, double dv) BUGLE_EXPORT_POST;
 
+/* As above, but with the time of the change supplied by the caller. This
+ * saves a clock read per signal when a generator updates many signals at
+ * once, e.g. at the end of a frame.
+ */
+BUGLE_EXPORT_PRE void bugle_stats_signal_update_at(stats_signal *si, double v, const bugle_timespec *now) BUGLE_EXPORT_POST;
+BUGLE_EXPORT_PRE void bugle_stats_signal_add_at(stats_signal *si, double dv, const bugle_timespec *now) BUGLE_EXPORT_POST;
+
 BUGLE_EXPORT_PRE void bugle_filter_set_stats_generator(const char *name) BUGLE_EXPORT_POST;
 
 /*** Public API for loggers ***/
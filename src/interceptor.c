@@ -25,6 +25,7 @@
 #include <bugle/glwin/glwin.h>
 #include <bugle/glwin/trackcontext.h>
 #include <bugle/gl/globjects.h>
+#include <bugle/gl/glbuffershadow.h>
 #include <bugle/gl/gldisplaylist.h>
 #include <bugle/gl/glbeginend.h>
 #include <bugle/gl/glextensions.h>
@@ -191,6 +192,7 @@ static void initialise_core_filters(void)
     glbeginend_initialise();
     glextensions_initialise();
     globjects_initialise();
+    buffershadow_initialise();
     log_initialise();
     statistics_initialise();
 }
@@ -23,6 +23,8 @@
 #include <bugle/memory.h>
 #include <bugle/string.h>
 #include <bugle/bool.h>
+#include <bugle/io.h>
+#include <bugle/hashtable.h>
 #include "platform/threads.h"
 #include "platform/types.h"
 #include <stdio.h>
@@ -30,8 +32,14 @@
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#if HAVE_SIGACTION
+# include <signal.h>
+# include <unistd.h>
+# include <errno.h>
+#endif
 
 #define LOG_DEFAULT_FORMAT "[%l] %f.%e: %m"
+#define LOG_ASYNC_MIN_BUFFER 4096
 
 /* Note: it is important for these to all have sensible initial values
  * (even though the format is later replaced by bugle_strdup), because errors in
@@ -41,6 +49,14 @@ static char *log_filename = NULL;
 static char *log_format = LOG_DEFAULT_FORMAT;
 static bugle_bool log_flush = BUGLE_FALSE;
 static FILE *log_file = NULL;
+/* With compression, the file target is written through this instead of
+ * log_file, which is then NULL.
+ */
+static bugle_io_writer *log_file_writer = NULL;
+static bugle_bool log_compress = BUGLE_FALSE;
+static bugle_bool log_async = BUGLE_FALSE;
+static long log_async_buffer = 256;
+static bugle_bool log_async_drop = BUGLE_FALSE;
 
 enum
 {
@@ -66,6 +82,51 @@ static const char *log_level_names[] =
     "DEBUG"
 };
 
+/* The format is compiled into a list of ops when the filter-set is
+ * initialised, so that it is not re-parsed for every message and target.
+ */
+typedef enum
+{
+    LOG_OP_END,
+    LOG_OP_LITERAL,
+    LOG_OP_LEVEL,
+    LOG_OP_FILTERSET,
+    LOG_OP_EVENT,
+    LOG_OP_MESSAGE,
+    LOG_OP_PID,
+    LOG_OP_THREAD
+} log_op_type;
+
+typedef struct
+{
+    log_op_type type;
+    const char *text;         /* for LOG_OP_LITERAL; not NUL-terminated */
+    size_t length;
+} log_op;
+
+/* Compiled form of LOG_DEFAULT_FORMAT */
+static const log_op log_default_ops[] =
+{
+    { LOG_OP_LITERAL, "[", 1 },
+    { LOG_OP_LEVEL, NULL, 0 },
+    { LOG_OP_LITERAL, "] ", 2 },
+    { LOG_OP_FILTERSET, NULL, 0 },
+    { LOG_OP_LITERAL, ".", 1 },
+    { LOG_OP_EVENT, NULL, 0 },
+    { LOG_OP_LITERAL, ": ", 2 },
+    { LOG_OP_MESSAGE, NULL, 0 },
+    { LOG_OP_END, NULL, 0 }
+};
+
+static const log_op *log_ops = log_default_ops;
+static log_op *log_compiled_ops = NULL;
+
+/* Bit i is set if severity i is accepted by at least one target. It is
+ * kept up to date by the level variable callbacks and by initialisation,
+ * and starts out matching the default levels with no log file.
+ */
+static unsigned int log_enabled_mask = (1U << (BUGLE_LOG_NOTICE + 1)) - 1;
+
 static inline void log_start(FILE *f)
 {
     bugle_flockfile(f);
@@ -88,50 +149,897 @@ static FILE *log_get_file(int target)
     }
 }
 
-/* Processes tokens from *format until it hits something it cannot
- * handle itself (i.e., %m). The return value indicates what was hit:
- * 0: all done
- * 1: %m (format is advanced past the %m)
+static bugle_bool log_target_open(int target)
+{
+    return log_get_file(target) != NULL
+        || (target == LOG_TARGET_FILE && log_file_writer != NULL);
+}
+
+static void log_target_write(int target, const char *text, size_t length)
+{
+    if (target == LOG_TARGET_FILE && log_file_writer != NULL)
+        bugle_io_write(text, 1, length, log_file_writer);
+    else
+        fwrite(text, 1, length, log_get_file(target));
+}
+
+/* Compiles format into a list of ops. The literal ops point into format,
+ * which must outlive the result.
  */
-static int log_next(FILE *f, const char **format, const char *filterset, const char *event, int severity)
+static log_op *log_compile(const char *format)
 {
-    while (**format)
+    log_op *ops;
+    const char *p;
+    size_t count, n = 0;
+
+    /* Every op consumes at least one character, plus one for LOG_OP_END */
+    count = strlen(format) + 1;
+    ops = BUGLE_NMALLOC(count, log_op);
+
+    p = format;
+    while (*p)
     {
-        if (**format == '%')
+        ops[n].text = NULL;
+        ops[n].length = 0;
+        if (*p == '%')
         {
-            switch ((*format)[1])
+            switch (p[1])
             {
-            case 'l': fputs(log_level_names[severity], f); break;
-            case 'f': fputs(filterset, f); break;
-            case 'e': fputs(event, f); break;
-            case 'm': *format += 2; return 1;
-            case 'p': fprintf(f, "%" BUGLE_PRIu64, (bugle_uint64_t) bugle_getpid()); break;
-            case 't': fprintf(f, "%" BUGLE_PRIu64, (bugle_uint64_t) bugle_thread_self()); break;
-            case '%': fputc('%', f); break;
+            case 'l': ops[n].type = LOG_OP_LEVEL; break;
+            case 'f': ops[n].type = LOG_OP_FILTERSET; break;
+            case 'e': ops[n].type = LOG_OP_EVENT; break;
+            case 'm': ops[n].type = LOG_OP_MESSAGE; break;
+            case 'p': ops[n].type = LOG_OP_PID; break;
+            case 't': ops[n].type = LOG_OP_THREAD; break;
+            case '%':
+                ops[n].type = LOG_OP_LITERAL;
+                ops[n].text = p;
+                ops[n].length = 1;
+                break;
             default: /* Unrecognised escape, treat it as literal */
-                fputc('%', f);
-                (*format)--;
+                ops[n].type = LOG_OP_LITERAL;
+                ops[n].text = p;
+                ops[n].length = 1;
+                p--;
             }
-            *format += 2;
+            p += 2;
         }
         else
         {
-            fputc(**format, f);
-            (*format)++;
+            ops[n].type = LOG_OP_LITERAL;
+            ops[n].text = p;
+            ops[n].length = strcspn(p, "%");
+            p += ops[n].length;
+        }
+        n++;
+    }
+    assert(n < count);
+    ops[n].type = LOG_OP_END;
+    ops[n].text = NULL;
+    ops[n].length = 0;
+    return ops;
+}
+
+/* Computes log_enabled_mask as if *changed were about to be set to value */
+static void log_update_enabled(const long *changed, long value)
+{
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+    {
+        long level = (&log_levels[i] == changed) ? value : log_levels[i];
+        if (!log_target_open(i) || level <= 0)
+            continue;
+        if (level > BUGLE_LOG_DEBUG + 1)
+            level = BUGLE_LOG_DEBUG + 1;
+        mask |= (1U << level) - 1;
+    }
+    log_enabled_mask = mask;
+}
+
+/* Messages from the filter-sets and events named in log_mute are discarded
+ * whatever their severity. log_muted maps a filter-set name either to
+ * &log_mute_all, if all its messages are muted, or to a hash table whose
+ * keys are the muted events. It is only changed while the log filter-set is
+ * being initialised or shut down, so it is read without locking.
+ */
+static char *log_mute = NULL;
+static hash_table log_muted;
+static bugle_bool log_muted_any = BUGLE_FALSE;
+static char log_mute_all;
+
+static void log_mute_free(void *entry)
+{
+    if (entry != &log_mute_all)
+    {
+        bugle_hash_clear((hash_table *) entry);
+        bugle_free(entry);
+    }
+}
+
+/* Adds one name, which is either "filterset" or "filterset.event" */
+static void log_mute_add(const char *name, size_t length)
+{
+    char *filterset, *event;
+    hash_table *events;
+
+    filterset = bugle_strndup(name, length);
+    event = strchr(filterset, '.');
+    if (!event)
+        bugle_hash_set(&log_muted, filterset, &log_mute_all);
+    else
+    {
+        *event++ = '\0';
+        events = (hash_table *) bugle_hash_get(&log_muted, filterset);
+        if (events == NULL)
+        {
+            events = BUGLE_MALLOC(hash_table);
+            bugle_hash_init(events, NULL);
+            bugle_hash_set(&log_muted, filterset, events);
+        }
+        if (events != (hash_table *) &log_mute_all)
+            bugle_hash_set(events, event, NULL);
+    }
+    bugle_free(filterset);
+}
+
+/* Parses log_mute, a list of names separated by spaces or commas */
+static void log_mute_parse(void)
+{
+    const char *p = log_mute;
+    size_t length;
+
+    bugle_hash_init(&log_muted, log_mute_free);
+    while (p && *p)
+    {
+        p += strspn(p, " ,");
+        length = strcspn(p, " ,");
+        if (length > 0)
+            log_mute_add(p, length);
+        p += length;
+    }
+    log_muted_any = log_muted.count > 0;
+}
+
+static bugle_bool log_is_muted(const char *filterset, const char *event)
+{
+    void *entry;
+
+    if (!log_muted_any)
+        return BUGLE_FALSE;
+    entry = bugle_hash_get(&log_muted, filterset);
+    if (entry == NULL)
+        return BUGLE_FALSE;
+    return entry == &log_mute_all || bugle_hash_count((hash_table *) entry, event);
+}
+
+/* Writes ops from *op until it hits something it cannot handle itself
+ * (i.e., the message). The return value indicates what was hit:
+ * 0: all done
+ * 1: the message (op is advanced past it)
+ */
+static int log_next(FILE *f, const log_op **op, const char *filterset, const char *event, int severity)
+{
+    for (; (*op)->type != LOG_OP_END; (*op)++)
+    {
+        switch ((*op)->type)
+        {
+        case LOG_OP_LITERAL: fwrite((*op)->text, 1, (*op)->length, f); break;
+        case LOG_OP_LEVEL: fputs(log_level_names[severity], f); break;
+        case LOG_OP_FILTERSET: fputs(filterset, f); break;
+        case LOG_OP_EVENT: fputs(event, f); break;
+        case LOG_OP_MESSAGE: (*op)++; return 1;
+        case LOG_OP_PID: fprintf(f, "%" BUGLE_PRIu64, (bugle_uint64_t) bugle_getpid()); break;
+        case LOG_OP_THREAD: fprintf(f, "%" BUGLE_PRIu64, (bugle_uint64_t) bugle_thread_self()); break;
+        default: assert(0);
         }
     }
     fputc('\n', f);
     return 0;
 }
 
+/* Asynchronous logging.
+ *
+ * When the async option is set, each thread formats its log lines into a
+ * private ring buffer and a single writer thread copies them to the log
+ * targets in batches. Each ring has exactly one producer (the owning thread)
+ * and one consumer (the writer), so head and tail are advanced with plain
+ * acquire/release stores. Lines from one thread stay in order, but lines
+ * from different threads may be reordered relative to each other.
+ *
+ * Before the filter-set is initialised, and for bugle_log_callback (which
+ * needs a FILE *), the synchronous path is used. In the latter case the
+ * thread first waits for its own ring to drain so that its lines stay in
+ * order.
+ *
+ * Rings are only added to the front of log_buffers, with a release store,
+ * and are never unlinked while the writer is running: the ring of an exited
+ * thread is handed to the next new thread once it has drained. This lets
+ * the crash handler walk the list without taking the lock.
+ *
+ * The writer sleeps on log_wake_sem when all rings are empty. It sets
+ * log_writer_idle before its final check, and producers check it after
+ * publishing a record; the fences ensure that at least one side notices
+ * the other. Producers that find their ring full either drop the line or
+ * wait on log_space_sem, which the writer posts after every pass.
+ */
+typedef struct
+{
+    size_t length;           /* bytes of text that follow, including newline */
+    unsigned int targets;    /* bitmask of LOG_TARGET_* */
+} log_record;
+
+typedef struct log_buffer
+{
+    struct log_buffer *next;        /* set before the ring is published */
+    char *data;
+    unsigned long mask;             /* capacity - 1, capacity a power of 2 */
+    volatile unsigned long head;    /* advanced by the owning thread */
+    volatile unsigned long tail;    /* advanced by the writer thread */
+    volatile unsigned long dropped; /* lines discarded while full */
+    unsigned long reported;         /* value of dropped last reported */
+    int finished;                   /* owning thread has exited; protected by log_buffers_lock */
+
+    /* Formatting space, only used by the owning thread */
+    char *line;
+    size_t line_size;
+    char *message;
+    size_t message_size;
+} log_buffer;
+
+static volatile int log_async_active = 0;
+static volatile int log_writer_stop = 0;
+static volatile int log_writer_idle = 0;
+static unsigned long log_async_capacity;
+static bugle_thread_handle log_writer;
+static bugle_thread_key_t log_buffer_key;
+static bugle_thread_lock_t log_buffers_lock;
+static log_buffer * volatile log_buffers = NULL;
+/* Protects log_writer_idle transitions and log_space_waiters */
+static bugle_thread_lock_t log_async_lock;
+static unsigned int log_space_waiters = 0;
+static bugle_thread_sem_t log_wake_sem;
+static bugle_thread_sem_t log_space_sem;
+/* Used by the writer to format its own messages */
+static log_buffer log_writer_scratch;
+
+#if HAVE_SIGACTION
+static const int log_crash_signals[] =
+{
+    SIGSEGV,
+#ifdef SIGBUS
+    SIGBUS,
+#endif
+    SIGFPE,
+    SIGILL,
+    SIGABRT
+};
+#define LOG_CRASH_SIGNALS ((int) (sizeof(log_crash_signals) / sizeof(log_crash_signals[0])))
+static struct sigaction log_crash_old[LOG_CRASH_SIGNALS];
+static bugle_bool log_crash_installed = BUGLE_FALSE;
+/* File descriptors for the targets, for writing from the crash handler.
+ * The compressed log file has none, since it cannot be written raw.
+ */
+static int log_crash_fds[LOG_TARGET_COUNT];
+#endif
+
+static unsigned int log_get_targets(int severity)
+{
+    unsigned int targets = 0;
+    int i;
+
+    if (!(log_enabled_mask & (1U << severity)))
+        return 0;
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+        if (log_target_open(i) && severity < log_levels[i])
+            targets |= 1U << i;
+    return targets;
+}
+
+static void log_line_append(log_buffer *b, size_t *length, const char *s, size_t n)
+{
+    if (*length + n > b->line_size)
+    {
+        size_t size = b->line_size ? b->line_size : 256;
+        while (*length + n > size)
+            size *= 2;
+        b->line = BUGLE_NREALLOC(b->line, size, char);
+        b->line_size = size;
+    }
+    memcpy(b->line + *length, s, n);
+    *length += n;
+}
+
+/* String equivalent of log_next, formatting a whole line into b->line */
+static size_t log_format_line(log_buffer *b, const char *filterset, const char *event,
+                              int severity, const char *message)
+{
+    const log_op *op;
+    const char *str;
+    char number[32];
+    size_t length = 0;
+
+    for (op = log_ops; op->type != LOG_OP_END; op++)
+    {
+        switch (op->type)
+        {
+        case LOG_OP_LITERAL:
+            log_line_append(b, &length, op->text, op->length);
+            continue;
+        case LOG_OP_LEVEL: str = log_level_names[severity]; break;
+        case LOG_OP_FILTERSET: str = filterset; break;
+        case LOG_OP_EVENT: str = event; break;
+        case LOG_OP_MESSAGE: str = message; break;
+        case LOG_OP_PID:
+            bugle_snprintf(number, sizeof(number), "%" BUGLE_PRIu64, (bugle_uint64_t) bugle_getpid());
+            str = number;
+            break;
+        case LOG_OP_THREAD:
+            bugle_snprintf(number, sizeof(number), "%" BUGLE_PRIu64, (bugle_uint64_t) bugle_thread_self());
+            str = number;
+            break;
+        default:
+            assert(0);
+            continue;
+        }
+        log_line_append(b, &length, str, strlen(str));
+    }
+    log_line_append(b, &length, "\n", 1);
+    return length;
+}
+
+static void log_buffer_copy_in(log_buffer *b, unsigned long pos, const void *src, size_t n)
+{
+    size_t offset = pos & b->mask;
+    size_t first = b->mask + 1 - offset;
+
+    if (first > n) first = n;
+    memcpy(b->data + offset, src, first);
+    memcpy(b->data, (const char *) src + first, n - first);
+}
+
+static void log_buffer_copy_out(const log_buffer *b, unsigned long pos, void *dst, size_t n)
+{
+    size_t offset = pos & b->mask;
+    size_t first = b->mask + 1 - offset;
+
+    if (first > n) first = n;
+    memcpy(dst, b->data + offset, first);
+    memcpy((char *) dst + first, b->data, n - first);
+}
+
+#if HAVE_SIGACTION
+/* Async-signal-safe equivalent of log_target_write */
+static void log_target_write_raw(int target, const char *text, size_t length)
+{
+    int fd = log_crash_fds[target];
+
+    while (fd >= 0 && length > 0)
+    {
+        ssize_t n;
+
+        n = write(fd, text, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        text += n;
+        length -= n;
+    }
+}
+#endif
+
+/* Writes out everything in the ring. The caller must ensure that no other
+ * thread is draining the same ring, except in emergencies. If raw is true,
+ * only async-signal-safe functions are used, and dropped lines are not
+ * reported.
+ */
+static bugle_bool log_buffer_drain(log_buffer *b, bugle_bool raw)
+{
+    unsigned long head, tail, dropped;
+    log_record record;
+    int i;
+
+    head = bugle_atomic_load(&b->head);
+    tail = b->tail;
+    if (head == tail)
+        return BUGLE_FALSE;
+    while (tail != head)
+    {
+        size_t offset, first;
+
+        log_buffer_copy_out(b, tail, &record, sizeof(record));
+        tail += sizeof(record);
+        offset = tail & b->mask;
+        first = b->mask + 1 - offset;
+        if (first > record.length) first = record.length;
+        for (i = 0; i < LOG_TARGET_COUNT; i++)
+            if (record.targets & (1U << i))
+            {
+#if HAVE_SIGACTION
+                if (raw)
+                {
+                    log_target_write_raw(i, b->data + offset, first);
+                    log_target_write_raw(i, b->data, record.length - first);
+                    continue;
+                }
+#endif
+                log_target_write(i, b->data + offset, first);
+                log_target_write(i, b->data, record.length - first);
+            }
+        tail += record.length;
+    }
+    bugle_atomic_store(&b->tail, tail);
+
+    dropped = bugle_atomic_load(&b->dropped);
+    if (dropped != b->reported && !raw)
+    {
+        char message[64];
+        unsigned int targets;
+        size_t length;
+
+        targets = log_get_targets(BUGLE_LOG_WARNING);
+        bugle_snprintf(message, sizeof(message), "%lu log messages dropped (buffer full)",
+                       dropped - b->reported);
+        length = log_format_line(&log_writer_scratch, "log", "async", BUGLE_LOG_WARNING, message);
+        for (i = 0; i < LOG_TARGET_COUNT; i++)
+            if (targets & (1U << i))
+                log_target_write(i, log_writer_scratch.line, length);
+        b->reported = dropped;
+    }
+    return BUGLE_TRUE;
+}
+
+#if !HAVE_SIGACTION
+static void log_flush_targets(void)
+{
+    int i;
+
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+        if (log_get_file(i))
+            fflush(log_get_file(i));
+}
+#endif
+
+/* One pass of the writer over all rings. Returns true if anything was written. */
+static bugle_bool log_writer_pass(void)
+{
+    log_buffer *b;
+    bugle_bool any = BUGLE_FALSE;
+    int i;
+
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+        if (log_get_file(i))
+            bugle_flockfile(log_get_file(i));
+    for (b = bugle_atomic_load(&log_buffers); b != NULL; b = b->next)
+        if (log_buffer_drain(b, BUGLE_FALSE))
+            any = BUGLE_TRUE;
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+        if (log_get_file(i))
+        {
+            if (any && log_flush) fflush(log_get_file(i));
+            bugle_funlockfile(log_get_file(i));
+        }
+    return any;
+}
+
+static bugle_bool log_async_pending(void)
+{
+    log_buffer *b;
+    bugle_bool pending = BUGLE_FALSE;
+
+    for (b = bugle_atomic_load(&log_buffers); b != NULL && !pending; b = b->next)
+        pending = bugle_atomic_load(&b->head) != b->tail;
+    return pending;
+}
+
+static void log_async_release_waiters(void)
+{
+    bugle_thread_lock_lock(&log_async_lock);
+    while (log_space_waiters > 0)
+    {
+        log_space_waiters--;
+        bugle_thread_sem_post(&log_space_sem);
+    }
+    bugle_thread_lock_unlock(&log_async_lock);
+}
+
+/* Must be called with log_async_lock held */
+static void log_async_wake_locked(void)
+{
+    if (log_writer_idle)
+    {
+        bugle_atomic_store(&log_writer_idle, 0);
+        bugle_thread_sem_post(&log_wake_sem);
+    }
+}
+
+/* Blocks until the writer has completed another pass */
+static void log_async_wait_space(void)
+{
+    bugle_thread_lock_lock(&log_async_lock);
+    log_space_waiters++;
+    log_async_wake_locked();
+    bugle_thread_lock_unlock(&log_async_lock);
+    bugle_thread_sem_wait(&log_space_sem);
+}
+
+static unsigned int log_writer_main(void *arg)
+{
+    for (;;)
+    {
+        int stop = bugle_atomic_load(&log_writer_stop);
+        bugle_bool any = log_writer_pass();
+
+        log_async_release_waiters();
+        if (any)
+            continue;
+        if (stop)
+            break;
+
+        bugle_thread_lock_lock(&log_async_lock);
+        bugle_atomic_store(&log_writer_idle, 1);
+        bugle_thread_lock_unlock(&log_async_lock);
+        bugle_thread_fence();
+        if (log_async_pending() || bugle_atomic_load(&log_writer_stop))
+        {
+            bugle_thread_lock_lock(&log_async_lock);
+            bugle_atomic_store(&log_writer_idle, 0);
+            bugle_thread_lock_unlock(&log_async_lock);
+        }
+        else
+            bugle_thread_sem_wait(&log_wake_sem);
+    }
+    return 0;
+}
+
+static void log_buffer_release(void *data)
+{
+    log_buffer *b = (log_buffer *) data;
+
+    bugle_free(b->line);
+    bugle_free(b->message);
+    b->line = b->message = NULL;
+    b->line_size = b->message_size = 0;
+    bugle_thread_lock_lock(&log_buffers_lock);
+    b->finished = 1;
+    bugle_thread_lock_unlock(&log_buffers_lock);
+}
+
+static log_buffer *log_buffer_get(void)
+{
+    log_buffer *b;
+
+    b = (log_buffer *) bugle_thread_getspecific(log_buffer_key);
+    if (b == NULL)
+    {
+        /* Take over the ring of an exited thread once it has drained */
+        bugle_thread_lock_lock(&log_buffers_lock);
+        for (b = log_buffers; b != NULL; b = b->next)
+            if (b->finished && b->head == bugle_atomic_load(&b->tail))
+            {
+                b->finished = 0;
+                break;
+            }
+        bugle_thread_lock_unlock(&log_buffers_lock);
+
+        if (b == NULL)
+        {
+            b = BUGLE_ZALLOC(log_buffer);
+            b->data = (char *) bugle_malloc(log_async_capacity);
+            b->mask = log_async_capacity - 1;
+            bugle_thread_lock_lock(&log_buffers_lock);
+            b->next = log_buffers;
+            bugle_atomic_store(&log_buffers, b);
+            bugle_thread_lock_unlock(&log_buffers_lock);
+        }
+        bugle_thread_setspecific(log_buffer_key, b);
+    }
+    return b;
+}
+
+/* Waits until the writer has consumed everything in b */
+static void log_buffer_sync(log_buffer *b)
+{
+    while (bugle_atomic_load(&log_async_active)
+           && b->head != bugle_atomic_load(&b->tail))
+        log_async_wait_space();
+}
+
+/* Waits until the writer has consumed everything that any thread had
+ * buffered on entry. Rings are never unlinked, so the list can be walked
+ * without log_buffers_lock. Each ring is only waited on up to the head seen
+ * here, so threads that keep logging cannot hold this up indefinitely.
+ */
+static void log_buffers_sync_all(void)
+{
+    log_buffer *b;
+    unsigned long head;
+
+    for (b = bugle_atomic_load(&log_buffers); b != NULL; b = b->next)
+    {
+        head = bugle_atomic_load(&b->head);
+        while (bugle_atomic_load(&log_async_active)
+               && (long) (head - bugle_atomic_load(&b->tail)) > 0)
+            log_async_wait_space();
+    }
+}
+
+/* Appends a line to the ring. Returns false if the line should rather be
+ * written directly, either because it can never fit or because the writer
+ * has been shut down.
+ */
+static bugle_bool log_buffer_put(log_buffer *b, const char *text, size_t length,
+                                 unsigned int targets)
+{
+    log_record record;
+    unsigned long head, needed;
+
+    needed = sizeof(record) + length;
+    if (needed > b->mask + 1)
+        return BUGLE_FALSE;
+    head = b->head;
+    while (needed > b->mask + 1 - (head - bugle_atomic_load(&b->tail)))
+    {
+        if (!bugle_atomic_load(&log_async_active))
+            return BUGLE_FALSE;
+        if (log_async_drop)
+        {
+            bugle_atomic_store(&b->dropped, b->dropped + 1);
+            return BUGLE_TRUE;
+        }
+        log_async_wait_space();
+    }
+
+    record.length = length;
+    record.targets = targets;
+    log_buffer_copy_in(b, head, &record, sizeof(record));
+    log_buffer_copy_in(b, head + sizeof(record), text, length);
+    bugle_atomic_store(&b->head, head + needed);
+
+    bugle_thread_fence();
+    if (bugle_atomic_load(&log_writer_idle))
+    {
+        bugle_thread_lock_lock(&log_async_lock);
+        log_async_wake_locked();
+        bugle_thread_lock_unlock(&log_async_lock);
+    }
+    return BUGLE_TRUE;
+}
+
+static void log_async_message(log_buffer *b, unsigned int targets,
+                              const char *filterset, const char *event, int severity,
+                              const char *message)
+{
+    size_t length;
+    int i;
+
+    length = log_format_line(b, filterset, event, severity, message);
+    if (log_buffer_put(b, b->line, length, targets))
+        return;
+
+    log_buffer_sync(b);
+    for (i = 0; i < LOG_TARGET_COUNT; i++)
+        if (targets & (1U << i))
+        {
+            FILE *f = log_get_file(i);
+            if (f) log_start(f);
+            log_target_write(i, b->line, length);
+            if (f) log_end(f);
+        }
+}
+
+/* Best-effort drain of every ring by a thread that is about to die. It takes
+ * no locks, so it may interleave output with the writer thread, but it
+ * avoids losing the lines leading up to a crash. Where sigaction is
+ * available it is also used from the crash handler, so it bypasses stdio
+ * and writes to the file descriptors directly.
+ */
+static void log_async_panic(void)
+{
+    log_buffer *b;
+
+    if (!bugle_atomic_load(&log_async_active))
+        return;
+    bugle_atomic_store(&log_async_active, 0);
+#if HAVE_SIGACTION
+    for (b = bugle_atomic_load(&log_buffers); b != NULL; b = b->next)
+        log_buffer_drain(b, BUGLE_TRUE);
+#else
+    for (b = bugle_atomic_load(&log_buffers); b != NULL; b = b->next)
+        log_buffer_drain(b, BUGLE_FALSE);
+    log_flush_targets();
+#endif
+}
+
+#if HAVE_SIGACTION
+/* Flushes the rings, then passes the signal on to whatever handler was
+ * installed before ours.
+ */
+static void log_crash_handler(int sig, siginfo_t *info, void *context)
+{
+    const struct sigaction *old = NULL;
+    int i;
+
+    log_async_panic();
+    for (i = 0; i < LOG_CRASH_SIGNALS; i++)
+        if (log_crash_signals[i] == sig)
+            old = &log_crash_old[i];
+    if (old == NULL)
+        return;
+    if (old->sa_flags & SA_SIGINFO)
+        (*old->sa_sigaction)(sig, info, context);
+    else if (old->sa_handler == SIG_DFL)
+    {
+        /* Reinstate the default action. The signal is blocked until we
+         * return, at which point it is delivered again.
+         */
+        sigaction(sig, old, NULL);
+        raise(sig);
+    }
+    else if (old->sa_handler != SIG_IGN)
+        (*old->sa_handler)(sig);
+}
+#endif
+
+static bugle_bool log_async_start(void)
+{
+#if HAVE_SIGACTION
+    int i;
+#endif
+
+    log_async_capacity = LOG_ASYNC_MIN_BUFFER;
+    while (log_async_capacity < (unsigned long) log_async_buffer * 1024)
+        log_async_capacity *= 2;
+
+    if (bugle_thread_key_create(&log_buffer_key, log_buffer_release) != 0)
+        return BUGLE_FALSE;
+    bugle_thread_lock_init(&log_buffers_lock);
+    bugle_thread_lock_init(&log_async_lock);
+    bugle_thread_sem_init(&log_wake_sem, 0);
+    bugle_thread_sem_init(&log_space_sem, 0);
+    if (bugle_thread_create(&log_writer, log_writer_main, NULL) != 0)
+        return BUGLE_FALSE;
+
+#if HAVE_SIGACTION
+    log_crash_fds[LOG_TARGET_STDOUT] = fileno(stdout);
+    log_crash_fds[LOG_TARGET_STDERR] = fileno(stderr);
+    log_crash_fds[LOG_TARGET_FILE] = log_file ? fileno(log_file) : -1;
+    for (i = 0; i < LOG_CRASH_SIGNALS; i++)
+    {
+        struct sigaction act;
+
+        act.sa_sigaction = log_crash_handler;
+        act.sa_flags = SA_SIGINFO;
+        sigemptyset(&act.sa_mask);
+        while (sigaction(log_crash_signals[i], &act, &log_crash_old[i]) != 0)
+            if (errno != EINTR)
+            {
+                perror("failed to set crash handler");
+                break;
+            }
+    }
+    log_crash_installed = BUGLE_TRUE;
+#endif
+    bugle_atomic_store(&log_async_active, 1);
+    return BUGLE_TRUE;
+}
+
+static void log_async_stop(void)
+{
+#if HAVE_SIGACTION
+    int i;
+
+    /* Put back the handlers saved by log_async_start, unless someone else
+     * has since replaced ours, in which case theirs is left in place.
+     */
+    for (i = 0; log_crash_installed && i < LOG_CRASH_SIGNALS; i++)
+    {
+        struct sigaction cur;
+
+        if (sigaction(log_crash_signals[i], NULL, &cur) == 0
+            && (cur.sa_flags & SA_SIGINFO)
+            && cur.sa_sigaction == log_crash_handler)
+            sigaction(log_crash_signals[i], &log_crash_old[i], NULL);
+    }
+    log_crash_installed = BUGLE_FALSE;
+#endif
+
+    if (!bugle_atomic_load(&log_async_active))
+        return;
+    bugle_atomic_store(&log_async_active, 0);
+    bugle_atomic_store(&log_writer_stop, 1);
+    bugle_thread_lock_lock(&log_async_lock);
+    bugle_atomic_store(&log_writer_idle, 1);
+    log_async_wake_locked();
+    bugle_thread_lock_unlock(&log_async_lock);
+    bugle_thread_join(log_writer, NULL);
+
+    /* Pick up anything that raced with the shutdown, and release any
+     * producers still waiting for space; they will see that the writer is
+     * gone and write directly. Rings belonging to live threads are not
+     * freed, since those threads still hold pointers to them.
+     */
+    log_writer_pass();
+    log_async_release_waiters();
+    bugle_free(log_writer_scratch.line);
+    log_writer_scratch.line = NULL;
+    log_writer_scratch.line_size = 0;
+}
+
+/* Synchronous output to the compressed log file */
+static void log_writer_line(const char *filterset, const char *event, int severity,
+                            const char *message)
+{
+    log_buffer scratch;
+    size_t length;
+
+    if (severity >= log_levels[LOG_TARGET_FILE])
+        return;
+    memset(&scratch, 0, sizeof(scratch));
+    length = log_format_line(&scratch, filterset, event, severity, message);
+    bugle_io_write(scratch.line, 1, length, log_file_writer);
+    bugle_free(scratch.line);
+}
+
+/* The callback needs a FILE. Where possible it is pointed at memory,
+ * otherwise at a temporary file that is read back.
+ */
+static void log_writer_callback(const char *filterset, const char *event, int severity,
+                                void (*callback)(void *arg, FILE *f), void *arg)
+{
+    FILE *tmp;
+    char *message = NULL;
+#if HAVE_OPEN_MEMSTREAM
+    size_t size;
+#else
+    long size;
+#endif
+
+    if (severity >= log_levels[LOG_TARGET_FILE])
+        return;
+#if HAVE_OPEN_MEMSTREAM
+    tmp = open_memstream(&message, &size);
+#else
+    tmp = tmpfile();
+#endif
+    if (tmp == NULL)
+    {
+        log_writer_line(filterset, event, severity, "<message could not be formatted>");
+        return;
+    }
+    (*callback)(arg, tmp);
+#if HAVE_OPEN_MEMSTREAM
+    if (fclose(tmp) == 0)
+        log_writer_line(filterset, event, severity, message);
+    free(message); /* allocated by the C library, not bugle_malloc */
+#else
+    size = ftell(tmp);
+    rewind(tmp);
+    message = BUGLE_NMALLOC(size + 1, char);
+    size = fread(message, 1, size, tmp);
+    message[size] = '\0';
+    fclose(tmp);
+    log_writer_line(filterset, event, severity, message);
+    bugle_free(message);
+#endif
+}
+
 void bugle_log_callback(const char *filterset, const char *event, int severity,
                                void (*callback)(void *arg, FILE *f), void *arg)
 {
     int i;
 
+    if (!(log_enabled_mask & (1U << severity))
+        || log_is_muted(filterset, event))
+        return;
+    if (bugle_atomic_load(&log_async_active))
+        log_buffer_sync(log_buffer_get());
+
     for (i = 0; i < LOG_TARGET_COUNT; i++)
     {
-        const char *format;
+        const log_op *op;
         int special;
         FILE *f = log_get_file(i);
         int level = log_levels[i];
@@ -139,8 +1047,8 @@ void bugle_log_callback(const char *filterset, const char *event, int severity,
         if (!f || severity >= level) continue;
 
         log_start(f);
-        format = log_format;
-        while ((special = log_next(f, &format, filterset, event, severity)) != 0)
+        op = log_ops;
+        while ((special = log_next(f, &op, filterset, event, severity)) != 0)
             switch (special)
             {
             case 1:
@@ -149,6 +1057,8 @@ void bugle_log_callback(const char *filterset, const char *event, int severity,
             }
         log_end(f);
     }
+    if (log_file_writer)
+        log_writer_callback(filterset, event, severity, callback, arg);
 }
 
 void bugle_log_printf(const char *filterset, const char *event, int severity,
@@ -156,10 +1066,40 @@ void bugle_log_printf(const char *filterset, const char *event, int severity,
 {
     int i;
 
+    if (!(log_enabled_mask & (1U << severity))
+        || log_is_muted(filterset, event))
+        return;
+    if (bugle_atomic_load(&log_async_active))
+    {
+        va_list ap;
+        unsigned int targets;
+        log_buffer *b;
+        int length;
+
+        targets = log_get_targets(severity);
+        if (!targets) return;
+        b = log_buffer_get();
+        for (;;)
+        {
+            va_start(ap, msg_format);
+            length = bugle_vsnprintf(b->message, b->message_size, msg_format, ap);
+            va_end(ap);
+            if (length >= 0 && (size_t) length < b->message_size)
+                break;
+            if (length >= 0)
+                b->message_size = length + 1;
+            else
+                b->message_size = b->message_size ? b->message_size * 2 : 256;
+            b->message = BUGLE_NREALLOC(b->message, b->message_size, char);
+        }
+        log_async_message(b, targets, filterset, event, severity, b->message);
+        return;
+    }
+
     for (i = 0; i < LOG_TARGET_COUNT; i++)
     {
         va_list ap;
-        const char *format;
+        const log_op *op;
         int special;
         FILE *f = log_get_file(i);
         int level = log_levels[i];
@@ -167,8 +1107,8 @@ void bugle_log_printf(const char *filterset, const char *event, int severity,
         if (!f || severity >= level) continue;
 
         log_start(f);
-        format = log_format;
-        while ((special = log_next(f, &format, filterset, event, severity)) != 0)
+        op = log_ops;
+        while ((special = log_next(f, &op, filterset, event, severity)) != 0)
             switch (special)
             {
             case 1:
@@ -179,6 +1119,17 @@ void bugle_log_printf(const char *filterset, const char *event, int severity,
             }
         log_end(f);
     }
+    if (log_file_writer)
+    {
+        va_list ap;
+        char *message;
+
+        va_start(ap, msg_format);
+        message = bugle_vasprintf(msg_format, ap);
+        va_end(ap);
+        log_writer_line(filterset, event, severity, message);
+        bugle_free(message);
+    }
 }
 
 void bugle_log(const char *filterset, const char *event, int severity,
@@ -186,9 +1137,20 @@ void bugle_log(const char *filterset, const char *event, int severity,
 {
     int i;
 
+    if (!(log_enabled_mask & (1U << severity))
+        || log_is_muted(filterset, event))
+        return;
+    if (bugle_atomic_load(&log_async_active))
+    {
+        unsigned int targets = log_get_targets(severity);
+        if (targets)
+            log_async_message(log_buffer_get(), targets, filterset, event, severity, message);
+        return;
+    }
+
     for (i = 0; i < LOG_TARGET_COUNT; i++)
     {
-        const char *format;
+        const log_op *op;
         int special;
         FILE *f = log_get_file(i);
         int level = log_levels[i];
@@ -196,8 +1158,8 @@ void bugle_log(const char *filterset, const char *event, int severity,
         if (!f || severity >= level) continue;
 
         log_start(f);
-        format = log_format;
-        while ((special = log_next(f, &format, filterset, event, severity)) != 0)
+        op = log_ops;
+        while ((special = log_next(f, &op, filterset, event, severity)) != 0)
             switch (special)
             {
             case 1:
@@ -206,10 +1168,33 @@ void bugle_log(const char *filterset, const char *event, int severity,
             }
         log_end(f);
     }
+    if (log_file_writer)
+        log_writer_line(filterset, event, severity, message);
+}
+
+bugle_bool bugle_log_enabled(const char *filterset, const char *event, int severity)
+{
+    return (log_enabled_mask & (1U << severity)) != 0
+        && !log_is_muted(filterset, event);
+}
+
+long bugle_log_file_offset(void)
+{
+    long offset;
+
+    if (!log_file)
+        return -1;
+    if (bugle_atomic_load(&log_async_active))
+        log_buffers_sync_all();
+    bugle_flockfile(log_file);
+    offset = ftell(log_file);
+    bugle_funlockfile(log_file);
+    return offset;
 }
 
 static void log_alloc_die(void)
 {
+    log_async_panic();
     bugle_log("core", "alloc", BUGLE_LOG_ERROR, "memory allocation failed");
     abort();
 }
@@ -218,28 +1203,66 @@ static bugle_bool log_filter_set_initialise(filter_set *handle)
 {
     if (log_filename)
     {
-        log_file = fopen(log_filename, "w");
+        log_file = fopen(log_filename, log_compress ? "wb" : "w");
         if (!log_file)
         {
             fprintf(stderr, "failed to open log file %s\n", log_filename);
             return BUGLE_FALSE;
         }
+        if (log_compress)
+        {
+            bugle_io_writer *inner = bugle_io_writer_file_new(log_file);
+
+            log_file_writer = bugle_io_writer_block_new(inner, 0);
+            if (!log_file_writer)
+            {
+                fputs("failed to start log compression thread; writing uncompressed\n", stderr);
+                log_file_writer = inner;
+            }
+            log_file = NULL;
+        }
     }
+    log_compiled_ops = log_compile(log_format);
+    log_ops = log_compiled_ops;
+    log_update_enabled(NULL, 0);
+    log_mute_parse();
     bugle_set_alloc_die(log_alloc_die);
+    if (log_async && !log_async_start())
+        fputs("failed to start log writer thread; logging synchronously\n", stderr);
     return BUGLE_TRUE;
 }
 
 static void log_filter_set_shutdown(filter_set *handle)
 {
+    if (log_async)
+        log_async_stop();
     bugle_set_alloc_die(NULL);
+    log_ops = log_default_ops;
+    bugle_free(log_compiled_ops);
+    log_compiled_ops = NULL;
+    log_muted_any = BUGLE_FALSE;
+    bugle_hash_clear(&log_muted);
+    bugle_free(log_mute);
+    log_mute = NULL;
     if (log_filename)
     {
         if (log_file) fclose(log_file);
+        if (log_file_writer) bugle_io_writer_close(log_file_writer);
+        log_file = NULL;
+        log_file_writer = NULL;
+        log_update_enabled(NULL, 0);
         bugle_free(log_filename);
     }
     bugle_free(log_format);
 }
 
+static bugle_bool log_set_level(const filter_set_variable_info *var,
+                                const char *text, const void *value)
+{
+    log_update_enabled((const long *) var->value, *(const long *) value);
+    return BUGLE_TRUE;
+}
+
 void log_initialise(void)
 {
     static const filter_set_variable_info log_variables[] =
@@ -247,9 +1270,14 @@ void log_initialise(void)
         { "filename", "filename of the log to write [none]", FILTER_SET_VARIABLE_STRING, &log_filename, NULL },
         { "flush", "flush log after every call [no]", FILTER_SET_VARIABLE_BOOL, &log_flush, NULL },
         { "format", "template for log lines [[%l] %f.%e: %m]", FILTER_SET_VARIABLE_STRING, &log_format, NULL },
-        { "file_level", "how much information to log to file [4] (0 is none, 5 is all)", FILTER_SET_VARIABLE_UINT, &log_levels[LOG_TARGET_FILE], NULL },
-        { "stderr_level", "how much information to log to stderr [3]", FILTER_SET_VARIABLE_UINT, &log_levels[LOG_TARGET_STDERR], NULL },
-        { "stdout_level", "how much information to log to stderr [0]", FILTER_SET_VARIABLE_UINT, &log_levels[LOG_TARGET_STDOUT], NULL },
+        { "file_level", "how much information to log to file [4] (0 is none, 5 is all)", FILTER_SET_VARIABLE_UINT, &log_levels[LOG_TARGET_FILE], log_set_level },
+        { "stderr_level", "how much information to log to stderr [3]", FILTER_SET_VARIABLE_UINT, &log_levels[LOG_TARGET_STDERR], log_set_level },
+        { "stdout_level", "how much information to log to stderr [0]", FILTER_SET_VARIABLE_UINT, &log_levels[LOG_TARGET_STDOUT], log_set_level },
+        { "async", "write the log from a background thread [no]", FILTER_SET_VARIABLE_BOOL, &log_async, NULL },
+        { "async_buffer", "per-thread buffer for asynchronous logging, in KiB [256]", FILTER_SET_VARIABLE_POSITIVE_INT, &log_async_buffer, NULL },
+        { "async_drop", "discard messages instead of waiting when the buffer is full [no]", FILTER_SET_VARIABLE_BOOL, &log_async_drop, NULL },
+        { "compress", "compress the log file (decompress with bugle-unblock) [no]", FILTER_SET_VARIABLE_BOOL, &log_compress, NULL },
+        { "mute", "filter-sets or filterset.event names whose messages are discarded, separated by spaces or commas [none]", FILTER_SET_VARIABLE_STRING, &log_mute, NULL },
         { NULL, NULL, 0, NULL, NULL }
     };
 
@@ -32,6 +32,27 @@
 #include <assert.h>
 #include "platform/threads.h"
 
+/* Maximum number of free objects kept in each per-thread pool */
+#define OBJECT_POOL_MAX 8
+
+/* Number of classes whose current object is cached in thread-local storage.
+ * Classes created beyond this limit always take the slow path.
+ */
+#define OBJECT_CACHE_SIZE 16
+
+/* Used to align view data within a single-block object */
+typedef union
+{
+    long l;
+    double d;
+    long double ld;
+    void *p;
+    void (*f)(void);
+} object_align;
+
+#define OBJECT_ALIGN (sizeof(object_align))
+#define OBJECT_ROUND(x) (((x) + OBJECT_ALIGN - 1) / OBJECT_ALIGN * OBJECT_ALIGN)
+
 struct object_class
 {
     size_t count;       /* number of registrants */
@@ -40,13 +61,33 @@ struct object_class
 
     struct object_class *parent;
     object_view parent_view; /* view where we store current of this class in parent */
+
+    /* Layout of view data in a single block, computed by object_class_freeze
+     * when the first object is created (which is after filters_finalise, so
+     * all views are known). No views may be added after that point.
+     */
+    volatile unsigned long frozen;
+    size_t *offsets;    /* per-view offset from the start of the object, or 0 if no data */
+    struct object_lazy_view *lazy; /* per-view lazy construction info, or NULL if no lazy views */
+    size_t header_size; /* size of the object header, rounded for alignment */
+    size_t data_size;   /* total size of the view data */
+    size_t zero_size;   /* size of the leading part of the view data that is zeroed */
+
+    bugle_bool pooled;
+    bugle_thread_key_t pool; /* per-thread object_pool */
+
+    unsigned int cache_index;      /* slot in object_current_cache */
+    unsigned int cache_dependents; /* mask of slots of descendant classes */
 };
 
+/* An object is a single allocation: this header, followed by the data for
+ * each view at the offsets given by the class.
+ */
 struct object
 {
     object_class *klass;
-    size_t count;
-    void *views[1]; /* actually [count] at runtime */
+    const void *key;          /* key passed to lazy view constructors */
+    struct object *pool_next; /* next free object in the pool */
 };
 
 typedef struct
@@ -54,31 +95,247 @@ typedef struct
     void (*constructor)(const void *key, void *data);
     void (*destructor)(void *data);
     size_t size;
+    bugle_bool lazy;
+    bugle_bool initialised; /* constructor initialises all the data, so it is not zeroed */
 } object_class_info;
 
+/* A lazy view has a flag byte in the object data that is set once the view
+ * has been constructed.
+ */
+typedef struct object_lazy_view
+{
+    size_t flag;  /* offset of the flag from the start of the object, or 0 if not lazy */
+    const object_class_info *info;
+} object_lazy_view;
+
+typedef struct
+{
+    object *head;
+    size_t size;
+} object_pool;
+
+typedef struct
+{
+    object *obj;
+    unsigned long epoch; /* value of object_current_epoch when filled */
+} object_current_entry;
+
+static bugle_thread_lock_t object_layout_lock;
+
+/* Cache of the current object of each class, so that the common case of
+ * bugle_object_get_current is a single thread-local load rather than a
+ * chain of bugle_thread_getspecific calls through the parent classes.
+ *
+ * An entry is valid if its epoch matches object_current_epoch. Setting the
+ * current object of a root class only affects the calling thread, so it
+ * just clears that thread's entries for the descendant classes. Setting the
+ * current object of a child class writes into the parent object, which may
+ * be visible to other threads, so it bumps the global epoch instead. This is
+ * rare (e.g., glNewList) compared to lookups.
+ */
+static unsigned int object_cache_classes = 0;
+static volatile unsigned long object_current_epoch = 1;
+#if BUGLE_HAVE_THREAD_LOCAL
+static BUGLE_THREAD_LOCAL object_current_entry object_current_cache[OBJECT_CACHE_SIZE];
+#endif
+
+BUGLE_CONSTRUCTOR(object_layout_init);
+static void object_layout_init(void)
+{
+    bugle_thread_lock_init(&object_layout_lock);
+}
+
 object_class * bugle_object_class_new(object_class *parent)
 {
     object_class *klass;
+    object_class *ancestor;
 
     klass = BUGLE_MALLOC(object_class);
     bugle_list_init(&klass->info, bugle_free);
     klass->parent = parent;
     klass->count = 0;
+    klass->frozen = 0;
+    klass->offsets = NULL;
+    klass->lazy = NULL;
+    klass->header_size = 0;
+    klass->data_size = 0;
+    klass->zero_size = 0;
+    klass->pooled = BUGLE_FALSE;
+    klass->cache_dependents = 0;
     if (parent)
         klass->parent_view = bugle_object_view_new(parent, NULL, NULL, sizeof(object *));
     else
         bugle_thread_key_create(&klass->current, NULL);
+
+    BUGLE_RUN_CONSTRUCTOR(object_layout_init);
+    bugle_thread_lock_lock(&object_layout_lock);
+    klass->cache_index = object_cache_classes;
+    if (object_cache_classes < OBJECT_CACHE_SIZE)
+    {
+        object_cache_classes++;
+        for (ancestor = parent; ancestor; ancestor = ancestor->parent)
+            ancestor->cache_dependents |= 1U << klass->cache_index;
+    }
+    bugle_thread_lock_unlock(&object_layout_lock);
     return klass;
 }
 
+static void object_pool_free(void *data)
+{
+    object_pool *pool;
+    object *obj;
+
+    pool = (object_pool *) data;
+    while (pool->head)
+    {
+        obj = pool->head;
+        pool->head = obj->pool_next;
+        bugle_free(obj);
+    }
+    bugle_free(pool);
+}
+
+void bugle_object_class_set_pooled(object_class *klass)
+{
+    assert(!klass->frozen);
+    if (!klass->pooled)
+    {
+        klass->pooled = BUGLE_TRUE;
+        bugle_thread_key_create(&klass->pool, object_pool_free);
+    }
+}
+
 void bugle_object_class_free(object_class *klass)
 {
     bugle_list_clear(&klass->info);
     if (!klass->parent)
         bugle_thread_key_delete(klass->current);
+    if (klass->pooled)
+        bugle_thread_key_delete(klass->pool);
+    bugle_free(klass->offsets);
+    bugle_free(klass->lazy);
     bugle_free(klass);
 }
 
+/* Computes the single-block layout for the class. View data are packed
+ * after the header, each view aligned to OBJECT_ALIGN. Since the header is
+ * never empty, an offset of 0 marks a view without data. The views that
+ * are zeroed come first, followed by the construction flags for lazy
+ * views, so that everything that must be zeroed is one contiguous range.
+ * Views marked with bugle_object_view_set_initialised come last and are
+ * left to their constructors.
+ */
+static void object_class_freeze(object_class *klass)
+{
+    linked_list_node *i;
+    const object_class_info *info;
+    size_t j, offset;
+
+    BUGLE_RUN_CONSTRUCTOR(object_layout_init);
+    bugle_thread_lock_lock(&object_layout_lock);
+    if (!klass->frozen)
+    {
+        klass->header_size = OBJECT_ROUND(sizeof(object));
+        klass->offsets = BUGLE_NMALLOC(klass->count ? klass->count : 1, size_t);
+        offset = klass->header_size;
+        for (i = bugle_list_head(&klass->info), j = 0; i; i = bugle_list_next(i), j++)
+        {
+            info = (const object_class_info *) bugle_list_data(i);
+            if (!info->initialised)
+            {
+                klass->offsets[j] = info->size ? offset : 0;
+                offset += OBJECT_ROUND(info->size);
+            }
+        }
+        for (i = bugle_list_head(&klass->info), j = 0; i; i = bugle_list_next(i), j++)
+        {
+            info = (const object_class_info *) bugle_list_data(i);
+            if (info->lazy)
+            {
+                if (!klass->lazy)
+                    klass->lazy = BUGLE_CALLOC(klass->count, object_lazy_view);
+                klass->lazy[j].flag = offset++;
+                klass->lazy[j].info = info;
+            }
+        }
+        offset = OBJECT_ROUND(offset);
+        klass->zero_size = offset - klass->header_size;
+        for (i = bugle_list_head(&klass->info), j = 0; i; i = bugle_list_next(i), j++)
+        {
+            info = (const object_class_info *) bugle_list_data(i);
+            if (info->initialised)
+            {
+                klass->offsets[j] = info->size ? offset : 0;
+                offset += OBJECT_ROUND(info->size);
+            }
+        }
+        klass->data_size = offset - klass->header_size;
+        bugle_atomic_store(&klass->frozen, 1UL);
+    }
+    bugle_thread_lock_unlock(&object_layout_lock);
+}
+
+/* Obtains a block for an object, from the per-thread pool if the class is
+ * pooled. Everything except the views marked with
+ * bugle_object_view_set_initialised is zeroed.
+ */
+static object *object_alloc(object_class *klass)
+{
+    object_pool *pool;
+    object *obj = NULL;
+
+    if (!bugle_atomic_load(&klass->frozen))
+        object_class_freeze(klass);
+
+    if (klass->pooled)
+    {
+        pool = (object_pool *) bugle_thread_getspecific(klass->pool);
+        if (pool && pool->head)
+        {
+            obj = pool->head;
+            pool->head = obj->pool_next;
+            pool->size--;
+        }
+    }
+    if (!obj)
+    {
+        obj = (object *) bugle_malloc(klass->header_size + klass->data_size);
+        obj->klass = klass;
+    }
+    obj->pool_next = NULL;
+    memset((char *) obj + klass->header_size, 0, klass->zero_size);
+    return obj;
+}
+
+static void object_release(object *obj)
+{
+    object_class *klass;
+    object_pool *pool;
+
+    klass = obj->klass;
+    if (!klass->pooled)
+    {
+        bugle_free(obj);
+        return;
+    }
+    pool = (object_pool *) bugle_thread_getspecific(klass->pool);
+    if (!pool)
+    {
+        pool = BUGLE_MALLOC(object_pool);
+        pool->head = NULL;
+        pool->size = 0;
+        bugle_thread_setspecific(klass->pool, pool);
+    }
+    if (pool->size < OBJECT_POOL_MAX)
+    {
+        obj->pool_next = pool->head;
+        pool->head = obj;
+        pool->size++;
+    }
+    else
+        bugle_free(obj);
+}
+
 object_view bugle_object_view_new(object_class *klass,
                                   void (*constructor)(const void *key, void *data),
                                   void (*destructor)(void *data),
@@ -86,14 +343,66 @@ object_view bugle_object_view_new(object_class *klass,
 {
     object_class_info *info;
 
+    assert(!klass->frozen);
     info = BUGLE_MALLOC(object_class_info);
     info->constructor = constructor;
     info->destructor = destructor;
     info->size = size;
+    info->lazy = BUGLE_FALSE;
+    info->initialised = BUGLE_FALSE;
     bugle_list_append(&klass->info, info);
     return klass->count++;
 }
 
+static object_class_info *object_view_info(object_class *klass, object_view view)
+{
+    linked_list_node *i;
+
+    assert(!klass->frozen);
+    assert(view < klass->count);
+    i = bugle_list_head(&klass->info);
+    while (view > 0)
+    {
+        i = bugle_list_next(i);
+        view--;
+    }
+    return (object_class_info *) bugle_list_data(i);
+}
+
+void bugle_object_view_set_lazy(object_class *klass, object_view view)
+{
+    object_view_info(klass, view)->lazy = BUGLE_TRUE;
+}
+
+void bugle_object_view_set_initialised(object_class *klass, object_view view)
+{
+    object_class_info *info;
+
+    info = object_view_info(klass, view);
+    assert(info->constructor != NULL);
+    info->initialised = BUGLE_TRUE;
+}
+
+/* Returns the storage for a view, without triggering lazy construction */
+static void *object_view_data(object *obj, object_view view)
+{
+    size_t offset;
+
+    offset = obj->klass->offsets[view];
+    return offset ? (void *) ((char *) obj + offset) : NULL;
+}
+
+static void object_view_construct(object *obj, object_view view)
+{
+    const object_lazy_view *lazy;
+
+    lazy = &obj->klass->lazy[view];
+    /* Mark it first, so that the constructor may itself use the view */
+    ((char *) obj)[lazy->flag] = 1;
+    if (lazy->info->constructor)
+        (*lazy->info->constructor)(obj->key, object_view_data(obj, view));
+}
+
 object *bugle_object_new(object_class *klass, const void *key, bugle_bool make_current)
 {
     object *obj;
@@ -101,29 +410,15 @@ object *bugle_object_new(object_class *klass, const void *key, bugle_bool make_c
     const object_class_info *info;
     size_t j;
 
-    obj = bugle_malloc(sizeof(object) + klass->count * sizeof(void *) - sizeof(void *));
-    obj->klass = klass;
-    obj->count = klass->count;
-
-    for (i = bugle_list_head(&klass->info), j = 0; i; i = bugle_list_next(i), j++)
-    {
-        info = (const object_class_info *) bugle_list_data(i);
-        if (info->size)
-        {
-            obj->views[j] = bugle_malloc(info->size);
-            memset(obj->views[j], 0, info->size);
-        }
-        else
-            obj->views[j] = NULL;
-    }
-
+    obj = object_alloc(klass);
+    obj->key = key;
     if (make_current) bugle_object_set_current(klass, obj);
 
     for (i = bugle_list_head(&klass->info), j = 0; i; i = bugle_list_next(i), j++)
     {
         info = (const object_class_info *) bugle_list_data(i);
-        if (info->constructor)
-            (*info->constructor)(key, obj->views[j]);
+        if (info->constructor && !info->lazy)
+            (*info->constructor)(key, object_view_data(obj, j));
     }
     return obj;
 }
@@ -140,14 +435,14 @@ void bugle_object_free(object *obj)
     for (i = bugle_list_head(&obj->klass->info), j = 0; i; i = bugle_list_next(i), j++)
     {
         info = (const object_class_info *) bugle_list_data(i);
-        if (info->destructor)
-            (*info->destructor)(obj->views[j]);
-        bugle_free(obj->views[j]);
+        if (info->destructor
+            && (!info->lazy || ((char *) obj)[obj->klass->lazy[j].flag]))
+            (*info->destructor)(object_view_data(obj, j));
     }
-    bugle_free(obj);
+    object_release(obj);
 }
 
-object *bugle_object_get_current(const object_class *klass)
+static object *object_get_current_slow(const object_class *klass)
 {
     void *ans;
 
@@ -161,6 +456,30 @@ object *bugle_object_get_current(const object_class *klass)
         return (object *) bugle_thread_getspecific(klass->current);
 }
 
+object *bugle_object_get_current(const object_class *klass)
+{
+#if BUGLE_HAVE_THREAD_LOCAL
+    object_current_entry *entry;
+    unsigned long epoch;
+
+    if (klass->cache_index < OBJECT_CACHE_SIZE)
+    {
+        entry = &object_current_cache[klass->cache_index];
+        epoch = bugle_atomic_load(&object_current_epoch);
+        if (entry->epoch != epoch)
+        {
+            /* The epoch is read first, so a concurrent change leaves the
+             * entry stale and it is refilled on the next lookup.
+             */
+            entry->obj = object_get_current_slow(klass);
+            entry->epoch = epoch;
+        }
+        return entry->obj;
+    }
+#endif
+    return object_get_current_slow(klass);
+}
+
 void *bugle_object_get_current_data(const object_class *klass, object_view view)
 {
     return bugle_object_get_data(bugle_object_get_current(klass), view);
@@ -174,13 +493,45 @@ void bugle_object_set_current(object_class *klass, object *obj)
     {
         tmp = bugle_object_get_current_data(klass->parent, klass->parent_view);
         if (tmp) *(object **) tmp = obj;
+        bugle_thread_lock_lock(&object_layout_lock);
+        bugle_atomic_store(&object_current_epoch, object_current_epoch + 1);
+        bugle_thread_lock_unlock(&object_layout_lock);
     }
     else
+    {
+#if BUGLE_HAVE_THREAD_LOCAL
+        unsigned int mask, j;
+
+        for (mask = klass->cache_dependents, j = 0; mask; mask >>= 1, j++)
+            if (mask & 1)
+                object_current_cache[j].epoch = 0;
+        if (klass->cache_index < OBJECT_CACHE_SIZE)
+        {
+            object_current_cache[klass->cache_index].obj = obj;
+            object_current_cache[klass->cache_index].epoch = bugle_atomic_load(&object_current_epoch);
+        }
+#endif
         bugle_thread_setspecific(klass->current, (void *) obj);
+    }
 }
 
 void *bugle_object_get_data(object *obj, object_view view)
 {
+    const object_class *klass;
+    size_t offset;
+
     if (!obj) return NULL;
-    else return obj->views[view];
+    klass = obj->klass;
+    if (klass->lazy && klass->lazy[view].flag && !((char *) obj)[klass->lazy[view].flag])
+        object_view_construct(obj, view);
+    offset = klass->offsets[view];
+    return offset ? (void *) ((char *) obj + offset) : NULL;
+}
+
+bugle_bool bugle_object_view_constructed(const object *obj, object_view view)
+{
+    const object_class *klass;
+
+    klass = obj->klass;
+    return !klass->lazy || !klass->lazy[view].flag || ((const char *) obj)[klass->lazy[view].flag];
 }
@@ -16,8 +16,14 @@
  */
 
 #include <bugle/time.h>
+#include "platform/ticks.h"
 
 int bugle_gettime(bugle_timespec *ts)
 {
     return 0;
 }
+
+bugle_uint64_t bugle_ticks_clock(void)
+{
+    return 0;
+}
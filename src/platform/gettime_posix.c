@@ -24,6 +24,7 @@
 #include <sys/time.h>
 #include <time.h>
 #include <bugle/time.h>
+#include "platform/ticks.h"
 
 #if _POSIX_TIMERS > 0 && defined(_POSIX_MONOTONIC_CLOCK)
 
@@ -55,3 +56,12 @@ int bugle_gettime(bugle_timespec *ts)
 }
 
 #endif
+
+bugle_uint64_t bugle_ticks_clock(void)
+{
+    bugle_timespec ts;
+
+    if (bugle_gettime(&ts) != 0)
+        return 0;
+    return (bugle_uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -21,6 +21,7 @@
 #include <windows.h>
 #include <stddef.h>
 #include <bugle/time.h>
+#include "platform/ticks.h"
 
 int bugle_gettime(bugle_timespec *tv)
 {
@@ -46,3 +47,11 @@ int bugle_gettime(bugle_timespec *tv)
     tv->tv_nsec = count.QuadPart * 1000000000 / freq.QuadPart;
     return 0;
 }
+
+bugle_uint64_t bugle_ticks_clock(void)
+{
+    LARGE_INTEGER count;
+
+    QueryPerformanceCounter(&count);
+    return (bugle_uint64_t) count.QuadPart;
+}
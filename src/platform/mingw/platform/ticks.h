@@ -0,0 +1 @@
+#include "../../msvcrt/platform/ticks.h"
@@ -104,6 +104,24 @@ typedef DWORD bugle_thread_key_t;
     } while (0)
 #define bugle_thread_key_delete(key) (TlsFree(key))
 
+/* Atomic loads and stores of pointer-sized values (pointers or unsigned
+ * long). The object must be declared volatile: MSVC gives volatile reads
+ * acquire semantics and volatile writes release semantics (/volatile:ms),
+ * and MinGW uses the GCC builtins. bugle_atomic_increment adds one to an
+ * unsigned long and returns the new value.
+ */
+#if defined(__ATOMIC_ACQUIRE)
+# define bugle_atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+# define bugle_atomic_store(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+# define bugle_atomic_increment(ptr) __atomic_add_fetch((ptr), 1UL, __ATOMIC_SEQ_CST)
+# define bugle_thread_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+# define bugle_atomic_load(ptr) (*(ptr))
+# define bugle_atomic_store(ptr, value) ((void) (*(ptr) = (value)))
+# define bugle_atomic_increment(ptr) ((unsigned long) InterlockedIncrement((volatile LONG *) (ptr)))
+# define bugle_thread_fence() MemoryBarrier()
+#endif
+
 typedef DWORD bugle_thread_id;
 #define bugle_thread_self() (GetCurrentThreadId())
 #define bugle_thread_equal(t1, t2) ((bugle_bool) ((t1) == (t2)))
@@ -0,0 +1,44 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* bugle_ticks() reads a cheap counter for timing short intervals, such as
+ * a single call. It runs at an unspecified constant rate, which must be
+ * calibrated against bugle_gettime by the caller. Where there is no such
+ * counter, it falls back to the performance counter used by bugle_gettime.
+ */
+
+#ifndef BUGLE_PLATFORM_TICKS_H
+#define BUGLE_PLATFORM_TICKS_H
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/export.h>
+#include "platform/types.h"
+
+BUGLE_EXPORT_PRE bugle_uint64_t bugle_ticks_clock(void) BUGLE_EXPORT_POST;
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+# define bugle_ticks() ((bugle_uint64_t) __builtin_ia32_rdtsc())
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+# include <intrin.h>
+# define bugle_ticks() ((bugle_uint64_t) __rdtsc())
+#else
+# define bugle_ticks() bugle_ticks_clock()
+#endif
+
+#endif /* !BUGLE_PLATFORM_TICKS_H */
@@ -56,6 +56,11 @@ typedef int bugle_thread_key_t;
 #define bugle_thread_setspecific(key, value) (-1)
 #define bugle_thread_key_delete(key) (-1)
 
+#define bugle_atomic_load(ptr) (*(ptr))
+#define bugle_atomic_store(ptr, value) ((void) (*(ptr) = (value)))
+#define bugle_atomic_increment(ptr) (++*(ptr))
+#define bugle_thread_fence() ((void) 0)
+
 typedef int bugle_thread_t;
 #define bugle_thread_self() (0)
 #define bugle_thread_raise(sig) (-1)
@@ -0,0 +1,28 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BUGLE_PLATFORM_TICKS_H
+#define BUGLE_PLATFORM_TICKS_H
+
+#include <bugle/export.h>
+#include "platform/types.h"
+
+BUGLE_EXPORT_PRE bugle_uint64_t bugle_ticks_clock(void) BUGLE_EXPORT_POST;
+
+#define bugle_ticks() bugle_ticks_clock()
+
+#endif /* !BUGLE_PLATFORM_TICKS_H */
@@ -67,6 +67,29 @@ typedef pthread_key_t bugle_thread_key_t;
 #define bugle_thread_setspecific(key, value) pthread_setspecific(key, value)
 #define bugle_thread_key_delete(key) pthread_key_delete(key)
 
+/* Atomic loads and stores of pointer-sized values (pointers or unsigned
+ * long), for publishing data to threads that do not take a lock. The
+ * object should be declared volatile. Loads have acquire semantics and
+ * stores have release semantics; neither is a read-modify-write.
+ * bugle_atomic_increment adds one to an unsigned long and returns the new
+ * value; it is a full barrier, and is safe to use in a signal handler.
+ * bugle_thread_fence is a full memory barrier.
+ */
+#if defined(__ATOMIC_ACQUIRE)
+# define bugle_atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+# define bugle_atomic_store(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+# define bugle_atomic_increment(ptr) __atomic_add_fetch((ptr), 1UL, __ATOMIC_SEQ_CST)
+# define bugle_thread_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+# define bugle_atomic_load(ptr) \
+    __extension__ ({ __typeof__(*(ptr)) bugle_atomic_tmp_ = *(ptr); \
+                     __sync_synchronize(); \
+                     bugle_atomic_tmp_; })
+# define bugle_atomic_store(ptr, value) (__sync_synchronize(), (void) (*(ptr) = (value)))
+# define bugle_atomic_increment(ptr) __sync_add_and_fetch((ptr), 1UL)
+# define bugle_thread_fence() __sync_synchronize()
+#endif
+
 typedef pthread_t bugle_thread_id;
 #define bugle_thread_self() pthread_self()
 #define bugle_thread_equal(t1, t2) ((bugle_bool) ((t1) == (t2)))
@@ -22,6 +22,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <bugle/export.h>
 #include <bugle/bool.h>
 
@@ -31,6 +32,15 @@ extern "C" {
  */
 BUGLE_EXPORT_PRE bugle_bool bugle_process_is_shell(void) BUGLE_EXPORT_POST;
 
+/* Determines whether the size bytes starting at data can be read, without
+ * touching them. Protection is only checked per page, so this is cheap
+ * even for large ranges, and it is safe to call from several threads at
+ * once. Returns 1 if the range is readable, 0 if it is not, and -1 if the
+ * platform has no way to tell (in which case the caller has to find out
+ * some other way).
+ */
+BUGLE_EXPORT_PRE int bugle_process_check_readable(const void *data, size_t size) BUGLE_EXPORT_POST;
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,12 +18,17 @@
 #if HAVE_CONFIG_H
 # include <config.h>
 #endif
+#include "platform_config.h"
 
 #include "platform/process.h"
 #include <unistd.h>
 #include <string.h>
 #include <stddef.h>
 #include <errno.h>
+#if HAVE_PROCESS_VM_READV
+# include <sys/types.h>
+# include <sys/uio.h>
+#endif
 #include <bugle/export.h>
 #include <bugle/bool.h>
 #include <bugle/memory.h>
@@ -63,3 +68,80 @@ bugle_bool bugle_process_is_shell(void)
     }
     return ans;
 }
+
+#if HAVE_PROCESS_VM_READV
+/* Number of pages probed by each system call */
+#define PROBE_BATCH 512
+
+/* process_vm_readv on our own pid fails with EFAULT rather than raising
+ * SIGSEGV if the remote address is not readable. Reading one byte from each
+ * page is enough, since protection is per page. It is a plain system call,
+ * so unlike catching SIGSEGV there is no process-wide state to protect.
+ */
+int bugle_process_check_readable(const void *data, size_t size)
+{
+    static int disabled = 0;   /* set if the kernel refuses the call */
+    static size_t page_size = 0;
+    struct iovec local, remote[PROBE_BATCH];
+    char scratch[PROBE_BATCH];
+    size_t addr, last, last_page, n;
+    bugle_bool done = BUGLE_FALSE;
+    pid_t pid;
+    ssize_t result;
+
+    if (size == 0)
+        return 1;
+    if (disabled)
+        return -1;
+    if (page_size == 0)
+    {
+        /* Benign race: every thread computes the same value */
+        long ps = sysconf(_SC_PAGESIZE);
+        page_size = ps > 0 ? (size_t) ps : 4096;
+    }
+
+    addr = (const char *) data - (const char *) NULL;
+    last = addr + (size - 1);
+    if (last < addr)
+        return 0;           /* wraps around the address space */
+    last_page = last - last % page_size;
+
+    pid = getpid();
+    local.iov_base = scratch;
+    while (!done)
+    {
+        /* The first probe is at data, the rest at the start of each page */
+        for (n = 0; n < PROBE_BATCH && !done; n++)
+        {
+            remote[n].iov_base = (void *) addr;
+            remote[n].iov_len = 1;
+            if (addr >= last_page)
+                done = BUGLE_TRUE;
+            else
+                addr += page_size - addr % page_size;
+        }
+        local.iov_len = n;
+
+        do
+        {
+            result = process_vm_readv(pid, &local, 1, remote, n, 0);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0)
+        {
+            if (errno == EFAULT)
+                return 0;
+            if (errno != ENOMEM)
+                disabled = 1;   /* ENOSYS, or EPERM under some security policies */
+            return -1;
+        }
+        if ((size_t) result < n)
+            return 0;
+    }
+    return 1;
+}
+#else /* !HAVE_PROCESS_VM_READV */
+int bugle_process_check_readable(const void *data, size_t size)
+{
+    return -1;
+}
+#endif
@@ -29,3 +29,8 @@ bugle_bool bugle_process_is_shell(void)
 {
     return BUGLE_FALSE;
 }
+
+int bugle_process_check_readable(const void *data, size_t size)
+{
+    return -1;
+}
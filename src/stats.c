@@ -56,7 +56,7 @@ static hash_table stats_statistics_first;
 
 /*** Low-level utilities ***/
 
-static double time_elapsed(bugle_timespec *old, bugle_timespec *now)
+static double time_elapsed(const bugle_timespec *old, const bugle_timespec *now)
 {
     return (now->tv_sec - old->tv_sec) + 1e-9 * (now->tv_nsec - old->tv_nsec);
 }
@@ -136,25 +136,38 @@ double bugle_stats_expression_evaluate(const stats_expression *expr,
     return 0.0;  /* Unreachable, but keeps compilers quiet */
 }
 
+void bugle_stats_signal_update_at(stats_signal *si, double v, const bugle_timespec *now)
+{
+    /* Integrate over time; a NaN indicates that this is the first time */
+    if (bugle_isfinite(si->value))
+        si->integral += time_elapsed(&si->last_updated, now) * si->value;
+    si->value = v;
+    si->last_updated = *now;
+}
+
 void bugle_stats_signal_update(stats_signal *si, double v)
 {
     bugle_timespec now;
 
     bugle_gettime(&now);
-    /* Integrate over time; a NaN indicates that this is the first time */
-    if (bugle_isfinite(si->value))
-        si->integral += time_elapsed(&si->last_updated, &now) * si->value;
-    si->value = v;
-    si->last_updated = now;
+    bugle_stats_signal_update_at(si, v, &now);
 }
 
-/* Convenience for accumulating signals */
-void bugle_stats_signal_add(stats_signal *si, double dv)
+void bugle_stats_signal_add_at(stats_signal *si, double dv, const bugle_timespec *now)
 {
     if (!bugle_isfinite(si->value))
-        bugle_stats_signal_update(si, dv);
+        bugle_stats_signal_update_at(si, dv, now);
     else
-        bugle_stats_signal_update(si, si->value + dv);
+        bugle_stats_signal_update_at(si, si->value + dv, now);
+}
+
+/* Convenience for accumulating signals */
+void bugle_stats_signal_add(stats_signal *si, double dv)
+{
+    bugle_timespec now;
+
+    bugle_gettime(&now);
+    bugle_stats_signal_add_at(si, dv, &now);
 }
 
 static bugle_bool stats_signal_activate(stats_signal *si)
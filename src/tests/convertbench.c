@@ -0,0 +1,153 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Measures how fast budgie_type_convert converts arrays, compared to the
+ * old generic loop that converted each element through a long double.
+ * This test is not automated.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <budgie/types.h>
+#include <budgie/reflect.h>
+#include <bugle/memory.h>
+#include <bugle/time.h>
+#include "platform/types.h"
+#include "budgielib/internal.h"
+
+typedef struct
+{
+    const char *in;
+    convert_kind in_kind;
+    const char *out;
+    convert_kind out_kind;
+} convert_pair;
+
+static const convert_pair pairs[] =
+{
+    { "GLubyte", CONVERT_UINT8, "GLuint", CONVERT_UINT32 },
+    { "GLushort", CONVERT_UINT16, "GLuint", CONVERT_UINT32 },
+    { "GLint", CONVERT_INT32, "GLfloat", CONVERT_FLOAT },
+    { "GLfloat", CONVERT_FLOAT, "GLdouble", CONVERT_DOUBLE },
+    { "GLdouble", CONVERT_DOUBLE, "GLfloat", CONVERT_FLOAT },
+    { "GLhalfARB", CONVERT_HALF, "GLfloat", CONVERT_FLOAT }
+};
+
+static const size_t sizes[] = { 16, 1024, 65536 };
+
+/* The old implementation, for comparison. The generated version switched
+ * on the budgie type rather than the representation, but the shape of the
+ * loop is the same. Half-floats were treated as plain integers.
+ */
+static void convert_generic(void *out, convert_kind out_kind, const void *in, convert_kind in_kind, size_t count)
+{
+    long double value;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        switch (in_kind)
+        {
+        case CONVERT_UINT8: value = (long double) ((const bugle_uint8_t *) in)[i]; break;
+        case CONVERT_HALF:
+        case CONVERT_UINT16: value = (long double) ((const bugle_uint16_t *) in)[i]; break;
+        case CONVERT_INT32: value = (long double) ((const bugle_int32_t *) in)[i]; break;
+        case CONVERT_FLOAT: value = (long double) ((const float *) in)[i]; break;
+        case CONVERT_DOUBLE: value = (long double) ((const double *) in)[i]; break;
+        default: abort();
+        }
+        switch (out_kind)
+        {
+        case CONVERT_UINT32: ((bugle_uint32_t *) out)[i] = (bugle_uint32_t) value; break;
+        case CONVERT_FLOAT: ((float *) out)[i] = (float) value; break;
+        case CONVERT_DOUBLE: ((double *) out)[i] = (double) value; break;
+        default: abort();
+        }
+    }
+}
+
+static double elapsed(const bugle_timespec *start, const bugle_timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + 1e-9 * (end->tv_nsec - start->tv_nsec);
+}
+
+/* Returns throughput in millions of elements per second */
+static double run(void *out, budgie_type out_type, const void *in, budgie_type in_type,
+                  const convert_pair *pair, size_t count, bugle_bool generic)
+{
+    bugle_timespec start, end;
+    double total = 0.0;
+    int reps = 0;
+
+    bugle_gettime(&start);
+    do
+    {
+        if (generic)
+            convert_generic(out, pair->out_kind, in, pair->in_kind, count);
+        else
+            budgie_type_convert(out, out_type, in, in_type, count);
+        total += count;
+        reps++;
+        bugle_gettime(&end);
+    } while (reps < 10 || elapsed(&start, &end) < 0.2);
+    return total / elapsed(&start, &end) / 1e6;
+}
+
+int main(void)
+{
+    size_t max_size, i, j;
+    unsigned char *in, *out;
+
+    max_size = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    /* Large enough for max_size elements of any of the types */
+    in = BUGLE_NMALLOC(max_size * 8, unsigned char);
+    out = BUGLE_NMALLOC(max_size * 8, unsigned char);
+
+    printf("%-20s %8s %12s %12s\n", "conversion", "count", "generic", "specialised");
+    for (i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++)
+    {
+        budgie_type in_type, out_type;
+        char name[64];
+
+        in_type = budgie_type_id_nomangle(pairs[i].in);
+        out_type = budgie_type_id_nomangle(pairs[i].out);
+        if (in_type == NULL_TYPE || out_type == NULL_TYPE)
+            continue;
+        /* Bytes are representable in all the input types */
+        for (j = 0; j < max_size; j++)
+            out[j] = (unsigned char) (j * 37);
+        budgie_type_convert(in, in_type, out, budgie_type_id_nomangle("GLubyte"), max_size);
+
+        sprintf(name, "%s->%s", pairs[i].in, pairs[i].out);
+        for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+        {
+            double slow, fast;
+
+            slow = run(out, out_type, in, in_type, &pairs[i], sizes[j], BUGLE_TRUE);
+            fast = run(out, out_type, in, in_type, &pairs[i], sizes[j], BUGLE_FALSE);
+            printf("%-20s %8lu %8.1f M/s %8.1f M/s\n",
+                   name, (unsigned long) sizes[j], slow, fast);
+        }
+    }
+
+    bugle_free(in);
+    bugle_free(out);
+    return 0;
+}
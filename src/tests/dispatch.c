@@ -0,0 +1,89 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2026  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Measures the cost of an intercepted call under contention. Each thread
+ * repeatedly calls glXGetCurrentContext, which is legal without a current
+ * context and does almost no work in the driver, so the time is dominated
+ * by the path through filters_run. Run it with bugle preloaded and the
+ * chain of interest, e.g.
+ *
+ * BUGLE_CHAIN=<chain> LD_PRELOAD=libbugle.so bugletest --suite dispatch
+ *
+ * and without bugle for the cost of the call itself. The mean time per call
+ * is printed for each number of threads.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <GL/glx.h>
+#include <stdio.h>
+#include <bugle/bool.h>
+#include <bugle/time.h>
+#include "platform/threads.h"
+#include "test.h"
+
+#define DISPATCH_STEPS 1000000
+#define DISPATCH_MAX_THREADS 8
+
+/* Returns the number of calls that unexpectedly found a context */
+static unsigned int dispatch_thread_main(void *arg)
+{
+    unsigned int bad = 0;
+    int i;
+
+    (void) arg;
+    for (i = 0; i < DISPATCH_STEPS; i++)
+        if (glXGetCurrentContext() != NULL)
+            bad++;
+    return bad;
+}
+
+static void dispatch_contention(void)
+{
+    static const int counts[] = {1, 2, 4, DISPATCH_MAX_THREADS};
+    unsigned int i;
+    int j;
+
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        bugle_thread_handle threads[DISPATCH_MAX_THREADS];
+        bugle_timespec start, end;
+        double elapsed;
+
+        bugle_gettime(&start);
+        for (j = 0; j < counts[i]; j++)
+            TEST_ASSERT(bugle_thread_create(&threads[j], dispatch_thread_main, NULL) == 0);
+        for (j = 0; j < counts[i]; j++)
+        {
+            unsigned int bad = 1;
+            TEST_ASSERT(bugle_thread_join(threads[j], &bad) == 0);
+            TEST_ASSERT(bad == 0);
+        }
+        bugle_gettime(&end);
+        elapsed = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        fprintf(stderr, "\n    %d threads: %.1f ns/call", counts[i],
+                elapsed * 1e9 / ((double) DISPATCH_STEPS * counts[i]));
+    }
+    fprintf(stderr, "\n%-52s", "");
+}
+
+void dispatch_suite_register(void)
+{
+    test_suite *ts = test_suite_new("dispatch", TEST_FLAG_MANUAL, NULL, NULL);
+    test_suite_add_test(ts, "contention", dispatch_contention);
+}
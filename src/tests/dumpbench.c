@@ -0,0 +1,170 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Measures how fast shader sources are escaped by budgie_dump_string,
+ * compared to writing them a character at a time, and checks that both
+ * produce the same output. This test is not automated.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <bugle/io.h>
+#include <bugle/memory.h>
+#include <bugle/time.h>
+#include "budgielib/internal.h"
+
+/* A typical fragment shader, repeated to make up the sizes below */
+static const char shader_chunk[] =
+    "#version 120\n"
+    "\n"
+    "uniform sampler2D diffuse_map;\n"
+    "uniform sampler2D normal_map;\n"
+    "uniform vec3 light_dir;      // in tangent space\n"
+    "uniform float specular_power;\n"
+    "\n"
+    "varying vec2 texcoord;\n"
+    "varying vec3 view_dir;\n"
+    "\n"
+    "/* Blinn-Phong with a normal map */\n"
+    "void main()\n"
+    "{\n"
+    "\tvec3 n = normalize(texture2D(normal_map, texcoord).xyz * 2.0 - 1.0);\n"
+    "\tvec3 h = normalize(light_dir + normalize(view_dir));\n"
+    "\tfloat diffuse = max(dot(n, light_dir), 0.0);\n"
+    "\tfloat specular = pow(max(dot(n, h), 0.0), specular_power);\n"
+    "\tvec4 albedo = texture2D(diffuse_map, texcoord);\n"
+    "\tgl_FragColor = vec4(albedo.rgb * diffuse + vec3(specular), albedo.a);\n"
+    "}\n";
+
+static const size_t sizes[] = { 1024, 16384, 262144 };
+
+/* The old implementation, for comparison */
+static void dump_string_bytewise(const char *value, bugle_io_writer *writer)
+{
+    bugle_io_putc('"', writer);
+    while (value[0])
+    {
+        switch (value[0])
+        {
+        case '"': bugle_io_puts("\\\"", writer); break;
+        case '\\': bugle_io_puts("\\\\", writer); break;
+        case '\n': bugle_io_puts("\\n", writer); break;
+        case '\r': bugle_io_puts("\\r", writer); break;
+        default:
+            if ((value[0] >= 0 && value[0] < 0x20) || value[0] == 0x7f)
+                bugle_io_printf(writer, "\\%03o", (int) value[0]);
+            else
+                bugle_io_putc(value[0], writer);
+        }
+        value++;
+    }
+    bugle_io_putc('"', writer);
+}
+
+static double elapsed(const bugle_timespec *start, const bugle_timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + 1e-9 * (end->tv_nsec - start->tv_nsec);
+}
+
+/* Returns BUGLE_TRUE if both implementations give the same output */
+static bugle_bool same(const char *source)
+{
+    bugle_io_writer *old_writer, *new_writer;
+    bugle_bool ret;
+
+    old_writer = bugle_io_writer_mem_new(1024);
+    new_writer = bugle_io_writer_mem_new(1024);
+    dump_string_bytewise(source, old_writer);
+    budgie_dump_string(source, new_writer);
+    ret = bugle_io_writer_mem_size(old_writer) == bugle_io_writer_mem_size(new_writer)
+        && memcmp(bugle_io_writer_mem_get(old_writer),
+                  bugle_io_writer_mem_get(new_writer),
+                  bugle_io_writer_mem_size(old_writer)) == 0;
+    bugle_io_writer_mem_release(old_writer);
+    bugle_io_writer_close(old_writer);
+    bugle_io_writer_mem_release(new_writer);
+    bugle_io_writer_close(new_writer);
+    return ret;
+}
+
+/* Returns throughput in MB/s of source bytes */
+static double run(const char *source, size_t size, bugle_bool bytewise, bugle_io_writer *writer)
+{
+    bugle_timespec start, end;
+    size_t total = 0;
+    int reps = 0;
+
+    bugle_gettime(&start);
+    do
+    {
+        bugle_io_writer_mem_clear(writer);
+        if (bytewise)
+            dump_string_bytewise(source, writer);
+        else
+            budgie_dump_string(source, writer);
+        total += size;
+        reps++;
+        bugle_gettime(&end);
+    } while (reps < 10 || elapsed(&start, &end) < 0.5);
+    return total / elapsed(&start, &end) / 1e6;
+}
+
+int main(void)
+{
+    bugle_io_writer *writer;
+    char all[256];
+    size_t i, j;
+
+    /* Every character, so that each escape is compared at least once */
+    for (i = 0; i < 255; i++)
+        all[i] = (char) (i + 1);
+    all[255] = '\0';
+    if (!same(all))
+    {
+        fprintf(stderr, "Output differs from the bytewise implementation\n");
+        return 1;
+    }
+
+    writer = bugle_io_writer_mem_new(1024);
+    printf("%10s %12s %12s\n", "size", "bytewise", "bulk");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        char *source;
+        double slow, fast;
+
+        source = BUGLE_NMALLOC(sizes[i] + 1, char);
+        for (j = 0; j < sizes[i]; j++)
+            source[j] = shader_chunk[j % (sizeof(shader_chunk) - 1)];
+        source[sizes[i]] = '\0';
+        if (!same(source))
+        {
+            fprintf(stderr, "Output differs from the bytewise implementation\n");
+            return 1;
+        }
+
+        slow = run(source, sizes[i], BUGLE_TRUE, writer);
+        fast = run(source, sizes[i], BUGLE_FALSE, writer);
+        printf("%10lu %9.1f MB/s %7.1f MB/s\n", (unsigned long) sizes[i], slow, fast);
+        bugle_free(source);
+    }
+    bugle_io_writer_mem_release(writer);
+    bugle_io_writer_close(writer);
+    return 0;
+}
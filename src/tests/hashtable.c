@@ -0,0 +1,520 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2013  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Validate the hash tables */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/hashtable.h>
+#include <bugle/memory.h>
+#include <bugle/string.h>
+#include <bugle/time.h>
+#include <string.h>
+#include <stdio.h>
+#include "test.h"
+
+/* Number of distinct keys used in the randomised tests */
+#define HASH_KEYS 1000
+
+static int hash_destroyed;
+
+static void hash_destructor(void *value)
+{
+    hash_destroyed++;
+}
+
+/* Simple linear congruential generator, so that results are repeatable */
+static unsigned long hash_random_state;
+
+static unsigned long hash_random(void)
+{
+    hash_random_state = hash_random_state * 1103515245UL + 12345UL;
+    return (hash_random_state >> 16) & 0x7fff;
+}
+
+/* Applies a random sequence of sets and erases, checking the table
+ * against a plain array after each step.
+ */
+static void hash_random_ops(void)
+{
+    hash_table table;
+    int present[HASH_KEYS];
+    char key[32];
+    const hash_table_entry *e;
+    int i, k, count, walked;
+
+    bugle_hash_init(&table, hash_destructor);
+    memset(present, 0, sizeof(present));
+    hash_random_state = 1;
+    hash_destroyed = 0;
+    count = 0;
+    for (i = 0; i < 20000; i++)
+    {
+        k = hash_random() % HASH_KEYS;
+        bugle_snprintf(key, sizeof(key), "key%d", k);
+        if (hash_random() % 3 == 0)
+        {
+            bugle_hash_erase(&table, key);
+            if (present[k]) count--;
+            present[k] = 0;
+        }
+        else
+        {
+            bugle_hash_set(&table, key, &present[k]);
+            if (!present[k]) count++;
+            present[k] = 1;
+        }
+        TEST_ASSERT(table.count == (size_t) count);
+    }
+
+    for (k = 0; k < HASH_KEYS; k++)
+    {
+        bugle_snprintf(key, sizeof(key), "key%d", k);
+        TEST_ASSERT(bugle_hash_count(&table, key) == (present[k] ? BUGLE_TRUE : BUGLE_FALSE));
+        TEST_ASSERT(bugle_hash_get(&table, key) == (present[k] ? &present[k] : NULL));
+    }
+
+    walked = 0;
+    for (e = bugle_hash_begin(&table); e; e = bugle_hash_next(&table, e))
+    {
+        TEST_ASSERT(e->value != NULL && *(int *) e->value == 1);
+        walked++;
+    }
+    TEST_ASSERT(walked == count);
+
+    hash_destroyed = 0;
+    bugle_hash_clear(&table);
+    TEST_ASSERT(hash_destroyed == count);
+    TEST_ASSERT(bugle_hash_get(&table, "key0") == NULL);
+}
+
+static void hashptr_random_ops(void)
+{
+    hashptr_table table;
+    int present[HASH_KEYS];
+    const hashptr_table_entry *e;
+    int i, k, count, walked;
+
+    bugle_hashptr_init(&table, NULL);
+    memset(present, 0, sizeof(present));
+    hash_random_state = 2;
+    count = 0;
+    for (i = 0; i < 20000; i++)
+    {
+        /* Multiples of a power of two, which defeat a weak hash */
+        k = hash_random() % HASH_KEYS;
+        if (hash_random() % 3 == 0)
+        {
+            bugle_hashptr_erase_int(&table, (size_t) (k + 1) * 4096);
+            if (present[k]) count--;
+            present[k] = 0;
+        }
+        else
+        {
+            bugle_hashptr_set_int(&table, (size_t) (k + 1) * 4096, &present[k]);
+            if (!present[k]) count++;
+            present[k] = 1;
+        }
+        TEST_ASSERT(table.count == (size_t) count);
+    }
+
+    for (k = 0; k < HASH_KEYS; k++)
+    {
+        TEST_ASSERT(bugle_hashptr_count(&table, (const void *) ((size_t) (k + 1) * 4096))
+                    == (present[k] ? BUGLE_TRUE : BUGLE_FALSE));
+        TEST_ASSERT(bugle_hashptr_get_int(&table, (size_t) (k + 1) * 4096)
+                    == (present[k] ? &present[k] : NULL));
+    }
+
+    walked = 0;
+    for (e = bugle_hashptr_begin(&table); e; e = bugle_hashptr_next(&table, e))
+        walked++;
+    TEST_ASSERT(walked == count);
+    bugle_hashptr_clear(&table);
+}
+
+/* Overwriting a value calls the destructor on the old value */
+static void hash_overwrite(void)
+{
+    hash_table table;
+    int a, b;
+
+    bugle_hash_init(&table, hash_destructor);
+    hash_destroyed = 0;
+    bugle_hash_set(&table, "a", &a);
+    bugle_hash_set(&table, "a", &b);
+    TEST_ASSERT(hash_destroyed == 1);
+    TEST_ASSERT(table.count == 1);
+    TEST_ASSERT(bugle_hash_get(&table, "a") == &b);
+    bugle_hash_erase(&table, "a");
+    TEST_ASSERT(hash_destroyed == 2);
+    bugle_hash_erase(&table, "a");
+    TEST_ASSERT(hash_destroyed == 2);
+    TEST_ASSERT(table.count == 0);
+    bugle_hash_clear(&table);
+}
+
+/* Benchmark of the tables against the previous implementation, which used
+ * a weak string hash, prime table sizes with % on every probe, full strcmp
+ * on every probe and no deletion (erased keys were overwritten with NULL
+ * instead). Each round inserts fresh keys, looks them up several times in a
+ * scrambled order and deletes them again, as an application that keeps
+ * creating and destroying objects would.
+ */
+#define BENCH_ROUNDS 20
+#define BENCH_KEYS 20000
+#define BENCH_LOOKUPS 10
+
+typedef struct
+{
+    const void *key;
+    void *value;
+} legacy_entry;
+
+typedef struct
+{
+    legacy_entry *entries;
+    size_t size;
+    size_t count;
+    int size_index;
+    bugle_bool strings;
+} legacy_table;
+
+static size_t legacy_primes[sizeof(size_t) * 8];
+
+static bugle_bool legacy_is_prime(size_t x)
+{
+    size_t i;
+
+    for (i = 2; i * i <= x; i++)
+        if (x % i == 0) return BUGLE_FALSE;
+    return BUGLE_TRUE;
+}
+
+static void legacy_initialise(void)
+{
+    int i;
+
+    legacy_primes[0] = 0;
+    legacy_primes[1] = 5;
+    for (i = 1; i + 1 < (int) (sizeof(legacy_primes) / sizeof(legacy_primes[0]))
+         && legacy_primes[i] < ((size_t) -1) / 4; i++)
+    {
+        legacy_primes[i + 1] = legacy_primes[i] * 2 + 1;
+        while (!legacy_is_prime(legacy_primes[i + 1])) legacy_primes[i + 1] += 2;
+    }
+}
+
+static size_t legacy_hash(const legacy_table *table, const void *key)
+{
+    size_t h = 0;
+    const char *ch;
+
+    if (!table->strings)
+        return (const char *) key - (const char *) NULL;
+    for (ch = (const char *) key; *ch; ch++)
+        h = (h + *ch) * 29;
+    return h;
+}
+
+static bugle_bool legacy_equal(const legacy_table *table, const void *a, const void *b)
+{
+    if (!table->strings)
+        return a == b;
+    return strcmp((const char *) a, (const char *) b) == 0;
+}
+
+static void legacy_set(legacy_table *table, const void *key, void *value)
+{
+    size_t h, i;
+
+    if (table->count >= table->size / 2)
+    {
+        legacy_table big;
+
+        big.size_index = table->size_index + 1;
+        big.size = legacy_primes[big.size_index];
+        big.entries = BUGLE_CALLOC(big.size, legacy_entry);
+        big.count = table->count;
+        big.strings = table->strings;
+        for (i = 0; i < table->size; i++)
+            if (table->entries[i].key)
+            {
+                h = legacy_hash(&big, table->entries[i].key) % big.size;
+                while (big.entries[h].key)
+                    if (++h == big.size) h = 0;
+                big.entries[h] = table->entries[i];
+            }
+        bugle_free(table->entries);
+        *table = big;
+    }
+    h = legacy_hash(table, key) % table->size;
+    while (table->entries[h].key && !legacy_equal(table, table->entries[h].key, key))
+        if (++h == table->size) h = 0;
+    if (!table->entries[h].key)
+    {
+        table->entries[h].key = table->strings ? bugle_strdup((const char *) key) : key;
+        table->count++;
+    }
+    table->entries[h].value = value;
+}
+
+static void *legacy_get(const legacy_table *table, const void *key)
+{
+    size_t h;
+
+    if (!table->entries) return NULL;
+    h = legacy_hash(table, key) % table->size;
+    while (table->entries[h].key && !legacy_equal(table, table->entries[h].key, key))
+        if (++h == table->size) h = 0;
+    return table->entries[h].value;
+}
+
+static void legacy_clear(legacy_table *table)
+{
+    size_t i;
+
+    if (table->strings)
+        for (i = 0; i < table->size; i++)
+            bugle_free((void *) table->entries[i].key);
+    bugle_free(table->entries);
+}
+
+/* Implementations of the benchmark operations for each table */
+typedef struct
+{
+    const char *name;
+    void *(*init)(bugle_bool strings);
+    void (*set)(void *table, const void *key, void *value);
+    void *(*get)(void *table, const void *key);
+    void (*erase)(void *table, const void *key);
+    size_t (*size)(void *table);
+    void (*clear)(void *table);
+} bench_ops;
+
+static void *bench_legacy_init(bugle_bool strings)
+{
+    legacy_table *table;
+
+    table = BUGLE_ZALLOC(legacy_table);
+    table->strings = strings;
+    return table;
+}
+
+static void bench_legacy_set(void *table, const void *key, void *value)
+{
+    legacy_set((legacy_table *) table, key, value);
+}
+
+static void *bench_legacy_get(void *table, const void *key)
+{
+    return legacy_get((legacy_table *) table, key);
+}
+
+static void bench_legacy_erase(void *table, const void *key)
+{
+    legacy_set((legacy_table *) table, key, NULL);
+}
+
+static size_t bench_legacy_size(void *table)
+{
+    return ((legacy_table *) table)->size;
+}
+
+static void bench_legacy_clear(void *table)
+{
+    legacy_clear((legacy_table *) table);
+    bugle_free(table);
+}
+
+static void *bench_hash_init(bugle_bool strings)
+{
+    hash_table *table;
+
+    table = BUGLE_MALLOC(hash_table);
+    bugle_hash_init(table, NULL);
+    return table;
+}
+
+static void bench_hash_set(void *table, const void *key, void *value)
+{
+    bugle_hash_set((hash_table *) table, (const char *) key, value);
+}
+
+static void *bench_hash_get(void *table, const void *key)
+{
+    return bugle_hash_get((hash_table *) table, (const char *) key);
+}
+
+static void bench_hash_erase(void *table, const void *key)
+{
+    bugle_hash_erase((hash_table *) table, (const char *) key);
+}
+
+static size_t bench_hash_size(void *table)
+{
+    return ((hash_table *) table)->size;
+}
+
+static void bench_hash_clear(void *table)
+{
+    bugle_hash_clear((hash_table *) table);
+    bugle_free(table);
+}
+
+static void *bench_hashptr_init(bugle_bool strings)
+{
+    hashptr_table *table;
+
+    table = BUGLE_MALLOC(hashptr_table);
+    bugle_hashptr_init(table, NULL);
+    return table;
+}
+
+static void bench_hashptr_set(void *table, const void *key, void *value)
+{
+    bugle_hashptr_set((hashptr_table *) table, key, value);
+}
+
+static void *bench_hashptr_get(void *table, const void *key)
+{
+    return bugle_hashptr_get((hashptr_table *) table, key);
+}
+
+static void bench_hashptr_erase(void *table, const void *key)
+{
+    bugle_hashptr_erase((hashptr_table *) table, key);
+}
+
+static size_t bench_hashptr_size(void *table)
+{
+    return ((hashptr_table *) table)->size;
+}
+
+static void bench_hashptr_clear(void *table)
+{
+    bugle_hashptr_clear((hashptr_table *) table);
+    bugle_free(table);
+}
+
+static const bench_ops bench_legacy =
+{
+    "legacy", bench_legacy_init, bench_legacy_set, bench_legacy_get,
+    bench_legacy_erase, bench_legacy_size, bench_legacy_clear
+};
+
+static const bench_ops bench_hash =
+{
+    "hash", bench_hash_init, bench_hash_set, bench_hash_get,
+    bench_hash_erase, bench_hash_size, bench_hash_clear
+};
+
+static const bench_ops bench_hashptr =
+{
+    "hashptr", bench_hashptr_init, bench_hashptr_set, bench_hashptr_get,
+    bench_hashptr_erase, bench_hashptr_size, bench_hashptr_clear
+};
+
+static void bench_run(const bench_ops *ops, bugle_bool strings,
+                      const void * const *keys, const size_t *order)
+{
+    void *table;
+    bugle_timespec start, end;
+    size_t r, i, j, hits = 0;
+    double elapsed;
+    const void * const *round_keys;
+
+    table = ops->init(strings);
+    bugle_gettime(&start);
+    for (r = 0; r < BENCH_ROUNDS; r++)
+    {
+        round_keys = keys + r * BENCH_KEYS;
+        for (i = 0; i < BENCH_KEYS; i++)
+            ops->set(table, round_keys[i], (void *) round_keys[i]);
+        for (j = 0; j < BENCH_LOOKUPS; j++)
+            for (i = 0; i < BENCH_KEYS; i++)
+                hits += ops->get(table, round_keys[order[i]]) == round_keys[order[i]];
+        for (i = 0; i < BENCH_KEYS; i++)
+            ops->erase(table, round_keys[i]);
+    }
+    bugle_gettime(&end);
+    TEST_ASSERT(hits == (size_t) BENCH_ROUNDS * BENCH_KEYS * BENCH_LOOKUPS);
+
+    elapsed = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+    fprintf(stderr, "\n    %-7s %-7s keys: %6.1f ns/op, %8lu slots at end",
+            ops->name, strings ? "string" : "pointer",
+            elapsed * 1e9 / ((double) BENCH_ROUNDS * BENCH_KEYS * (BENCH_LOOKUPS + 2)),
+            (unsigned long) ops->size(table));
+    ops->clear(table);
+}
+
+static void hash_benchmark(void)
+{
+    const void **keys;
+    char **names;
+    size_t *order;
+    size_t i, j, tmp, total;
+
+    legacy_initialise();
+    total = (size_t) BENCH_ROUNDS * BENCH_KEYS;
+    keys = BUGLE_NMALLOC(total, const void *);
+    names = BUGLE_NMALLOC(total, char *);
+    order = BUGLE_NMALLOC(BENCH_KEYS, size_t);
+
+    /* Pointer keys are spaced like heap allocations. String keys look like
+     * extension and uniform names, with long common prefixes.
+     */
+    for (i = 0; i < total; i++)
+    {
+        keys[i] = (const void *) (0x100000 + i * 48);
+        names[i] = bugle_asprintf("GL_EXT_benchmark_extension_%lu", (unsigned long) i);
+    }
+    hash_random_state = 3;
+    for (i = 0; i < BENCH_KEYS; i++)
+        order[i] = i;
+    for (i = BENCH_KEYS - 1; i > 0; i--)
+    {
+        j = (hash_random() << 15 | hash_random()) % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    bench_run(&bench_legacy, BUGLE_FALSE, keys, order);
+    bench_run(&bench_hashptr, BUGLE_FALSE, keys, order);
+    bench_run(&bench_legacy, BUGLE_TRUE, (const void * const *) names, order);
+    bench_run(&bench_hash, BUGLE_TRUE, (const void * const *) names, order);
+    fprintf(stderr, "\n%-52s", "");
+
+    for (i = 0; i < total; i++)
+        bugle_free(names[i]);
+    bugle_free(names);
+    bugle_free(keys);
+    bugle_free(order);
+}
+
+void hashtable_suite_register(void)
+{
+    test_suite *ts = test_suite_new("hashtable", 0, NULL, NULL);
+    test_suite_add_test(ts, "random", hash_random_ops);
+    test_suite_add_test(ts, "random_ptr", hashptr_random_ops);
+    test_suite_add_test(ts, "overwrite", hash_overwrite);
+
+    ts = test_suite_new("hashtable_benchmark", TEST_FLAG_MANUAL, NULL, NULL);
+    test_suite_add_test(ts, "benchmark", hash_benchmark);
+}
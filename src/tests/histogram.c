@@ -0,0 +1,99 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Check the edges of the logarithmic histogram buckets */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "common/histogram.h"
+#include "platform/types.h"
+#include "test.h"
+
+#define HISTOGRAM_ONE ((bugle_uint64_t) 1)
+
+static void histogram_small(void)
+{
+    int i;
+
+    /* Values below BUGLE_HISTOGRAM_SUB each have a bucket */
+    for (i = 0; i < BUGLE_HISTOGRAM_SUB; i++)
+    {
+        TEST_ASSERT(bugle_histogram_bucket(i) == i);
+        TEST_ASSERT(bugle_histogram_bucket_max(i) == i);
+    }
+}
+
+static void histogram_powers(void)
+{
+    int k;
+
+    for (k = BUGLE_HISTOGRAM_SUB_BITS; k < 64; k++)
+    {
+        bugle_uint64_t p = HISTOGRAM_ONE << k;
+        int b = bugle_histogram_bucket(p);
+
+        /* Each power of two starts a new group of buckets */
+        TEST_ASSERT(b == BUGLE_HISTOGRAM_SUB * (k - BUGLE_HISTOGRAM_SUB_BITS + 1));
+        TEST_ASSERT(bugle_histogram_bucket(p - 1) == b - 1);
+        TEST_ASSERT(bugle_histogram_bucket_max(b - 1) == (double) (p - 1));
+        TEST_ASSERT(bugle_histogram_bucket_max(b) >= (double) p);
+        TEST_ASSERT(bugle_histogram_bucket(p + (p >> BUGLE_HISTOGRAM_SUB_BITS) - 1) == b);
+    }
+}
+
+static void histogram_contains(void)
+{
+    bugle_uint64_t x = 1;
+    int i;
+
+    /* Every value lies in its bucket, and not in the one below */
+    for (i = 0; i < 10000; i++)
+    {
+        int b = bugle_histogram_bucket(x);
+
+        TEST_ASSERT(b >= 0 && b < BUGLE_HISTOGRAM_BUCKETS);
+        TEST_ASSERT(bugle_histogram_bucket_max(b) >= (double) x);
+        if (b > 0)
+            TEST_ASSERT(bugle_histogram_bucket_max(b - 1) < (double) x);
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        x >>= i % 64;
+    }
+}
+
+static void histogram_top(void)
+{
+    bugle_uint64_t top = ~(bugle_uint64_t) 0;
+
+    /* The largest values saturate in the last bucket */
+    TEST_ASSERT(bugle_histogram_bucket(top) == BUGLE_HISTOGRAM_BUCKETS - 1);
+    TEST_ASSERT(bugle_histogram_bucket(HISTOGRAM_ONE << 63) == BUGLE_HISTOGRAM_BUCKETS - BUGLE_HISTOGRAM_SUB);
+    TEST_ASSERT(bugle_histogram_bucket(top - (top >> (BUGLE_HISTOGRAM_SUB_BITS + 1)))
+                == BUGLE_HISTOGRAM_BUCKETS - 1);
+    TEST_ASSERT(bugle_histogram_bucket(top - (top >> (BUGLE_HISTOGRAM_SUB_BITS + 1)) - 1)
+                == BUGLE_HISTOGRAM_BUCKETS - 2);
+    TEST_ASSERT(bugle_histogram_bucket_max(BUGLE_HISTOGRAM_BUCKETS - 1) >= (double) top);
+}
+
+void histogram_suite_register(void)
+{
+    test_suite *ts = test_suite_new("histogram", 0, NULL, NULL);
+    test_suite_add_test(ts, "small", histogram_small);
+    test_suite_add_test(ts, "powers", histogram_powers);
+    test_suite_add_test(ts, "contains", histogram_contains);
+    test_suite_add_test(ts, "top", histogram_top);
+}
@@ -0,0 +1,286 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Validate the block compression writer and reader */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/io.h>
+#include <bugle/memory.h>
+#include <bugle/bool.h>
+#include <bugle/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common/io-impl.h"
+#include "platform/threads.h"
+#include "test.h"
+
+#define IO_TEST_FILE "bugle-io-test.tmp"
+#define IO_TEST_BLOCK 4096
+#define IO_TEST_SIZE 100000
+
+/* Trace-like text, with some noise so that not everything compresses */
+static char *io_make_data(size_t size)
+{
+    char *data;
+    size_t i;
+    unsigned int seed = 1;
+
+    data = BUGLE_NMALLOC(size, char);
+    for (i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245U + 12345U;
+        if ((seed >> 16) % 8 == 0)
+            data[i] = (char) (seed >> 24);
+        else
+            data[i] = "glVertex3f(1.0, 2.0, 3.0);\n"[i % 27];
+    }
+    return data;
+}
+
+/* Writes size bytes of data through a block writer, in uneven pieces */
+static void io_write_file(const char *data, size_t size)
+{
+    bugle_io_writer *writer;
+    size_t pos = 0, piece = 1;
+
+    writer = bugle_io_writer_block_new(bugle_io_writer_file_new(fopen(IO_TEST_FILE, "wb")), IO_TEST_BLOCK);
+    TEST_ASSERT(writer != NULL);
+    while (pos < size)
+    {
+        if (piece > size - pos) piece = size - pos;
+        bugle_io_write(data + pos, 1, piece, writer);
+        pos += piece;
+        piece = piece * 3 % 10007;
+    }
+    TEST_ASSERT(bugle_io_writer_close(writer) == 0);
+}
+
+/* Reads back the decoded contents of the file. Returns the number of bytes */
+static size_t io_read_file(char *data, size_t size)
+{
+    bugle_io_reader *reader;
+    size_t got;
+
+    reader = bugle_io_reader_block_new(bugle_io_reader_file_new(fopen(IO_TEST_FILE, "rb")));
+    TEST_ASSERT(reader != NULL);
+    if (reader == NULL)
+        return 0;
+    got = bugle_io_read(data, 1, size, reader);
+    bugle_io_reader_close(reader);
+    return got;
+}
+
+static void io_block_roundtrip(void)
+{
+    char *data, *back;
+
+    data = io_make_data(IO_TEST_SIZE);
+    back = BUGLE_NMALLOC(IO_TEST_SIZE + 1, char);
+    io_write_file(data, IO_TEST_SIZE);
+    TEST_ASSERT(io_read_file(back, IO_TEST_SIZE + 1) == IO_TEST_SIZE);
+    TEST_ASSERT(memcmp(data, back, IO_TEST_SIZE) == 0);
+    remove(IO_TEST_FILE);
+    bugle_free(data);
+    bugle_free(back);
+}
+
+/* A cut-off file must decode to whole blocks of the original */
+static void io_block_truncated(void)
+{
+    char *data, *back, *file;
+    size_t file_size, cut, got;
+    FILE *f;
+
+    data = io_make_data(IO_TEST_SIZE);
+    back = BUGLE_NMALLOC(IO_TEST_SIZE, char);
+    io_write_file(data, IO_TEST_SIZE);
+
+    f = fopen(IO_TEST_FILE, "rb");
+    fseek(f, 0, SEEK_END);
+    file_size = ftell(f);
+    rewind(f);
+    file = BUGLE_NMALLOC(file_size, char);
+    TEST_ASSERT(fread(file, 1, file_size, f) == file_size);
+    fclose(f);
+
+    for (cut = 16; cut < file_size; cut += file_size / 37)
+    {
+        f = fopen(IO_TEST_FILE, "wb");
+        fwrite(file, 1, cut, f);
+        fclose(f);
+        got = io_read_file(back, IO_TEST_SIZE);
+        TEST_ASSERT(got % IO_TEST_BLOCK == 0);
+        TEST_ASSERT(memcmp(data, back, got) == 0);
+    }
+
+    remove(IO_TEST_FILE);
+    bugle_free(file);
+    bugle_free(data);
+    bugle_free(back);
+}
+
+/* A writer that passes data on to a file, but can be held up to simulate
+ * slow output.
+ */
+typedef struct
+{
+    bugle_io_writer *inner;
+    bugle_thread_lock_t lock;
+    bugle_bool held;
+    bugle_thread_sem_t release;
+} io_gate;
+
+static size_t io_gate_write(const void *ptr, size_t size, size_t nmemb, void *arg)
+{
+    io_gate *g = (io_gate *) arg;
+    bugle_bool held;
+
+    bugle_thread_lock_lock(&g->lock);
+    held = g->held;
+    bugle_thread_lock_unlock(&g->lock);
+    if (held)
+        bugle_thread_sem_wait(&g->release);
+    return bugle_io_write(ptr, size, nmemb, g->inner);
+}
+
+static int io_gate_close(void *arg)
+{
+    io_gate *g = (io_gate *) arg;
+
+    return bugle_io_writer_close(g->inner);
+}
+
+typedef struct
+{
+    bugle_io_writer *writer;
+    const char *data;
+    size_t size;
+    bugle_thread_lock_t lock;
+    bugle_bool done;
+} io_submit_struct;
+
+static unsigned int io_submit_child(void *arg)
+{
+    io_submit_struct *s = (io_submit_struct *) arg;
+
+    bugle_io_write(s->data, 1, s->size, s->writer);
+    bugle_thread_lock_lock(&s->lock);
+    s->done = BUGLE_TRUE;
+    bugle_thread_lock_unlock(&s->lock);
+    return 0;
+}
+
+/* Several full blocks must be accepted while the output is stalled, rather
+ * than each one waiting for the previous one to be written out.
+ */
+static void io_block_async(void)
+{
+    io_gate gate;
+    io_submit_struct s;
+    bugle_io_writer *gated, *writer;
+    bugle_thread_handle child;
+    bugle_timespec start, now;
+    bugle_bool done = BUGLE_FALSE;
+    char *data, *back;
+    const size_t size = 3 * IO_TEST_BLOCK;
+
+    gate.inner = bugle_io_writer_file_new(fopen(IO_TEST_FILE, "wb"));
+    bugle_thread_lock_init(&gate.lock);
+    gate.held = BUGLE_FALSE;
+    bugle_thread_sem_init(&gate.release, 0);
+    gated = BUGLE_MALLOC(bugle_io_writer);
+    gated->fn_vprintf = NULL;
+    gated->fn_putc = NULL;
+    gated->fn_write = io_gate_write;
+    gated->fn_close = io_gate_close;
+    gated->arg = &gate;
+
+    writer = bugle_io_writer_block_new(gated, IO_TEST_BLOCK);
+    TEST_ASSERT(writer != NULL);
+    if (writer == NULL)
+        return;
+    bugle_thread_lock_lock(&gate.lock);
+    gate.held = BUGLE_TRUE;
+    bugle_thread_lock_unlock(&gate.lock);
+
+    data = io_make_data(size);
+    s.writer = writer;
+    s.data = data;
+    s.size = size;
+    bugle_thread_lock_init(&s.lock);
+    s.done = BUGLE_FALSE;
+    TEST_ASSERT(bugle_thread_create(&child, io_submit_child, &s) == 0);
+
+    bugle_gettime(&start);
+    do
+    {
+        bugle_thread_lock_lock(&s.lock);
+        done = s.done;
+        bugle_thread_lock_unlock(&s.lock);
+        bugle_gettime(&now);
+    } while (!done && now.tv_sec - start.tv_sec < 10);
+    TEST_ASSERT(done);
+
+    bugle_thread_lock_lock(&gate.lock);
+    gate.held = BUGLE_FALSE;
+    bugle_thread_lock_unlock(&gate.lock);
+    bugle_thread_sem_post(&gate.release);
+    TEST_ASSERT(bugle_thread_join(child, NULL) == 0);
+    TEST_ASSERT(bugle_io_writer_close(writer) == 0);
+
+    back = BUGLE_NMALLOC(size + 1, char);
+    TEST_ASSERT(io_read_file(back, size + 1) == size);
+    TEST_ASSERT(memcmp(data, back, size) == 0);
+    remove(IO_TEST_FILE);
+    bugle_thread_sem_destroy(&gate.release);
+    bugle_thread_lock_destroy(&gate.lock);
+    bugle_thread_lock_destroy(&s.lock);
+    bugle_free(data);
+    bugle_free(back);
+}
+
+static void io_mem_scratch(void)
+{
+    bugle_io_writer *writer;
+    const char *buffer;
+    int i;
+
+    writer = bugle_io_writer_mem_scratch();
+    for (i = 0; i < 1000; i++)
+        bugle_io_printf(writer, "%d ", i);
+    buffer = bugle_io_writer_mem_get(writer);
+
+    /* The same writer comes back empty, with the grown buffer kept */
+    TEST_ASSERT(bugle_io_writer_mem_scratch() == writer);
+    TEST_ASSERT(bugle_io_writer_mem_size(writer) == 0);
+    TEST_ASSERT(bugle_io_writer_mem_get(writer) == buffer);
+    TEST_ASSERT(buffer[0] == '\0');
+    bugle_io_puts("abc", writer);
+    TEST_ASSERT(strcmp(bugle_io_writer_mem_get(writer), "abc") == 0);
+}
+
+void io_suite_register(void)
+{
+    test_suite *ts = test_suite_new("io", 0, NULL, NULL);
+    test_suite_add_test(ts, "block_roundtrip", io_block_roundtrip);
+    test_suite_add_test(ts, "block_truncated", io_block_truncated);
+    test_suite_add_test(ts, "block_async", io_block_async);
+    test_suite_add_test(ts, "mem_scratch", io_mem_scratch);
+}
@@ -0,0 +1,91 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2026  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Measures bugle_object_get_current for the three lookups made on each
+ * intercepted call: the current context, the current namespace (a child
+ * class of the context) and the current call. The same objects.c that goes
+ * into libbugle is linked in, so both paths are the real code. Only the
+ * first OBJECT_CACHE_SIZE classes get a thread-local cache entry; later
+ * classes use the thread-specific keys, as all classes did before the
+ * cache, so a second set of classes created after filler classes measures
+ * the old path. This test is not automated.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <bugle/bool.h>
+#include <bugle/objects.h>
+#include <bugle/time.h>
+
+#define STEPS 10000000
+/* Must be at least OBJECT_CACHE_SIZE in objects.c */
+#define FILLER_CLASSES 16
+
+typedef struct
+{
+    object_class *context, *namespace, *call;
+} bench_classes;
+
+static void make_classes(bench_classes *c)
+{
+    c->context = bugle_object_class_new(NULL);
+    c->namespace = bugle_object_class_new(c->context);
+    c->call = bugle_object_class_new(NULL);
+    bugle_object_class_set_pooled(c->call);
+    bugle_object_new(c->context, NULL, BUGLE_TRUE);
+    bugle_object_new(c->namespace, NULL, BUGLE_TRUE);
+    bugle_object_new(c->call, NULL, BUGLE_TRUE);
+}
+
+/* Returns the mean time per call (three lookups) in nanoseconds */
+static double run(const bench_classes *c)
+{
+    bugle_timespec start, end;
+    volatile unsigned long sink = 0;
+    long i;
+
+    bugle_gettime(&start);
+    for (i = 0; i < STEPS; i++)
+    {
+        sink += (unsigned long) bugle_object_get_current(c->context);
+        sink += (unsigned long) bugle_object_get_current(c->namespace);
+        sink += (unsigned long) bugle_object_get_current(c->call);
+    }
+    bugle_gettime(&end);
+    return ((end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec)) * 1e9 / STEPS;
+}
+
+int main(void)
+{
+    bench_classes cached, uncached;
+    int i;
+
+    make_classes(&cached);
+    for (i = 0; i < FILLER_CLASSES; i++)
+        bugle_object_class_new(NULL);
+    make_classes(&uncached);
+
+#if BUGLE_HAVE_THREAD_LOCAL
+    printf("thread-local cache: %.2f ns/call\n", run(&cached));
+#else
+    printf("thread-local cache: not available\n");
+#endif
+    printf("thread-specific keys: %.2f ns/call\n", run(&uncached));
+    return 0;
+}
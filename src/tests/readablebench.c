@@ -0,0 +1,187 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Measures how fast client arrays can be validated by the checks
+ * filter-set, using bugle_process_check_readable, compared to the old
+ * method of touching every byte while catching SIGSEGV under a global lock.
+ * Each thread checks its own array. This test is not automated.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include <bugle/time.h>
+#include "platform/threads.h"
+#include "platform/process.h"
+
+#define MAX_THREADS 4
+
+static const size_t sizes[] = { 4096, 1024 * 1024, 64 * 1024 * 1024 };
+static const int thread_counts[] = { 1, MAX_THREADS };
+
+#if HAVE_SIGLONGJMP
+static sigjmp_buf touch_buf;
+static bugle_thread_lock_t touch_mutex;
+
+static void touch_sigsegv_handler(int sig)
+{
+    siglongjmp(touch_buf, 1);
+}
+
+/* The old implementation, for comparison */
+static bugle_bool touch_range(const void *data, size_t size)
+{
+    bugle_bool result = BUGLE_TRUE;
+    struct sigaction act, old_act;
+
+    bugle_thread_lock_lock(&touch_mutex);
+    if (sigsetjmp(touch_buf, 1) == 0)
+    {
+        const volatile char *cdata;
+        size_t i;
+
+        act.sa_handler = touch_sigsegv_handler;
+        act.sa_flags = 0;
+        sigemptyset(&act.sa_mask);
+        sigaction(SIGSEGV, &act, &old_act);
+        cdata = (const char *) data;
+        for (i = 0; i < size; i++)
+            (void) cdata[i];
+    }
+    else
+        result = BUGLE_FALSE;
+    sigaction(SIGSEGV, &old_act, NULL);
+    bugle_thread_lock_unlock(&touch_mutex);
+    return result;
+}
+#endif
+
+typedef struct
+{
+    const char *data;
+    size_t size;
+    bugle_bool old;
+    double seconds;
+    unsigned long checks;
+} bench_thread;
+
+static double elapsed(const bugle_timespec *start, const bugle_timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + 1e-9 * (end->tv_nsec - start->tv_nsec);
+}
+
+static unsigned int bench_thread_run(void *arg)
+{
+    bench_thread *t;
+    bugle_timespec start, end;
+    bugle_bool ok = BUGLE_TRUE;
+
+    t = (bench_thread *) arg;
+    t->checks = 0;
+    bugle_gettime(&start);
+    do
+    {
+#if HAVE_SIGLONGJMP
+        if (t->old)
+            ok = touch_range(t->data, t->size);
+        else
+#endif
+            ok = bugle_process_check_readable(t->data, t->size) != 0;
+        t->checks++;
+        bugle_gettime(&end);
+    } while (ok && (t->checks < 5 || elapsed(&start, &end) < 0.2));
+    t->seconds = elapsed(&start, &end);
+    return ok ? 0 : 1;
+}
+
+/* Returns the number of checks completed per second, over all threads */
+static double run(char **arrays, size_t size, int threads, bugle_bool old)
+{
+    bench_thread t[MAX_THREADS];
+    bugle_thread_handle handles[MAX_THREADS];
+    double rate = 0.0;
+    int i;
+
+    for (i = 0; i < threads; i++)
+    {
+        t[i].data = arrays[i];
+        t[i].size = size;
+        t[i].old = old;
+        if (bugle_thread_create(&handles[i], bench_thread_run, &t[i]) != 0)
+        {
+            fprintf(stderr, "failed to create thread\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < threads; i++)
+    {
+        unsigned int ret;
+
+        bugle_thread_join(handles[i], &ret);
+        if (ret != 0)
+        {
+            fprintf(stderr, "valid array was reported as unreadable\n");
+            exit(1);
+        }
+        rate += t[i].checks / t[i].seconds;
+    }
+    return rate;
+}
+
+int main(void)
+{
+    char *arrays[MAX_THREADS];
+    size_t max_size, i, j;
+    int k;
+
+    if (bugle_process_check_readable(sizes, sizeof(sizes)) < 0)
+        printf("Warning: bugle_process_check_readable is not supported on this platform\n");
+#if HAVE_SIGLONGJMP
+    bugle_thread_lock_init(&touch_mutex);
+#endif
+    max_size = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    for (k = 0; k < MAX_THREADS; k++)
+    {
+        arrays[k] = BUGLE_NMALLOC(max_size, char);
+        memset(arrays[k], 1, max_size);
+    }
+
+    printf("%10s %8s %14s %14s\n", "size", "threads", "old", "new");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        for (j = 0; j < sizeof(thread_counts) / sizeof(thread_counts[0]); j++)
+        {
+            double slow = 0.0, fast;
+
+#if HAVE_SIGLONGJMP
+            slow = run(arrays, sizes[i], thread_counts[j], BUGLE_TRUE);
+#endif
+            fast = run(arrays, sizes[i], thread_counts[j], BUGLE_FALSE);
+            printf("%10lu %8d %10.0f /s %10.0f /s\n",
+                   (unsigned long) sizes[i], thread_counts[j], slow, fast);
+        }
+
+    for (k = 0; k < MAX_THREADS; k++)
+        bugle_free(arrays[k]);
+    return 0;
+}
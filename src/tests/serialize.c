@@ -0,0 +1,201 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Check that serialised values dump the same way as the originals */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <bugle/io.h>
+#include <bugle/memory.h>
+#include <budgie/types.h>
+#include <budgie/reflect.h>
+#include <string.h>
+#include "test.h"
+
+/* Dumps value both directly and via serialisation, and compares the text.
+ * Also checks that every truncation of the serialised form is rejected.
+ */
+static void serialize_check(const char *type_name, const void *value, int length)
+{
+    budgie_type type;
+    bugle_io_writer *direct, *decoded, *serial;
+    char *direct_str, *decoded_str, *serial_str;
+    const char *data;
+    size_t size, i;
+
+    type = budgie_type_id_nomangle(type_name);
+    if (type == NULL_TYPE)
+    {
+        test_skipped("type %s not found", type_name);
+        return;
+    }
+
+    direct = bugle_io_writer_mem_new(64);
+    decoded = bugle_io_writer_mem_new(64);
+    serial = bugle_io_writer_mem_new(64);
+    budgie_dump_any_type(type, value, length, direct);
+    budgie_serialize_any_type(type, value, length, serial);
+    serial_str = bugle_io_writer_mem_get(serial);
+    size = bugle_io_writer_mem_size(serial);
+
+    data = serial_str;
+    TEST_ASSERT(budgie_dump_serialized(&data, serial_str + size, decoded));
+    TEST_ASSERT(data == serial_str + size);
+    direct_str = bugle_io_writer_mem_get(direct);
+    decoded_str = bugle_io_writer_mem_get(decoded);
+    TEST_ASSERT(strcmp(direct_str, decoded_str) == 0);
+
+    for (i = 0; i < size; i++)
+    {
+        bugle_io_writer *scratch;
+
+        scratch = bugle_io_writer_mem_new(64);
+        data = serial_str;
+        TEST_ASSERT(!budgie_dump_serialized(&data, serial_str + i, scratch));
+        bugle_io_writer_mem_release(scratch);
+        bugle_io_writer_close(scratch);
+    }
+
+    bugle_io_writer_mem_release(direct);
+    bugle_io_writer_mem_release(decoded);
+    bugle_io_writer_mem_release(serial);
+    bugle_io_writer_close(direct);
+    bugle_io_writer_close(decoded);
+    bugle_io_writer_close(serial);
+}
+
+static void serialize_scalar(void)
+{
+    float f = 1.5f;
+    serialize_check("GLfloat", &f, -1);
+}
+
+static void serialize_pointer(void)
+{
+    float values[4] = { 1.0f, -2.5f, 0.0f, 100.0f };
+    const float *ptr = values;
+    const float *null_ptr = NULL;
+
+    serialize_check("const GLfloat *", &ptr, 4);
+    serialize_check("const GLfloat *", &ptr, -1);
+    serialize_check("const GLfloat *", &null_ptr, 4);
+}
+
+static void serialize_string(void)
+{
+    const char *str = "hello \"world\"\n";
+    const char *null_str = NULL;
+
+    serialize_check("const GLchar *", &str, -1);
+    serialize_check("const GLchar *", &null_str, -1);
+}
+
+/* The generated dumpers format numbers without printf, so check that the
+ * output is the same as it would have been.
+ */
+static void dump_check(const char *type_name, const void *value, const char *expected)
+{
+    budgie_type type;
+    bugle_io_writer *writer;
+
+    type = budgie_type_id_nomangle(type_name);
+    if (type == NULL_TYPE)
+    {
+        test_skipped("type %s not found", type_name);
+        return;
+    }
+    writer = bugle_io_writer_mem_new(64);
+    budgie_dump_any_type(type, value, -1, writer);
+    TEST_ASSERT(strcmp(bugle_io_writer_mem_get(writer), expected) == 0);
+    bugle_io_writer_mem_release(writer);
+    bugle_io_writer_close(writer);
+}
+
+static void serialize_dump_numbers(void)
+{
+    int i[3] = { 0, -2147483647 - 1, 123456 };
+    unsigned int u = 4294967295U;
+    float f[6] = { 0.0f, -0.0f, 1.0f, -999999.0f, 1000000.0f, 0.25f };
+
+    dump_check("GLint", &i[0], "0");
+    dump_check("GLint", &i[1], "-2147483648");
+    dump_check("GLint", &i[2], "123456");
+    dump_check("GLuint", &u, "4294967295");
+    dump_check("GLfloat", &f[0], "0");
+    dump_check("GLfloat", &f[1], "-0");
+    dump_check("GLfloat", &f[2], "1");
+    dump_check("GLfloat", &f[3], "-999999");
+    dump_check("GLfloat", &f[4], "1e+06");
+    dump_check("GLfloat", &f[5], "0.25");
+}
+
+static void serialize_dump_string(void)
+{
+    const char *str = "a long enough run of plain text to span a vector, then \"quotes\"\tand\\\001\177\n";
+
+    dump_check("const GLchar *", &str,
+               "\"a long enough run of plain text to span a vector, then \\\"quotes\\\"\\011and\\\\\\001\\177\\n\"");
+}
+
+/* Dumps a pointer to four floats under each array policy */
+static void serialize_dump_array_policy(void)
+{
+    static const char *expected[] =
+    {
+        " -> { 1, -2.5, 0, 100 }",
+        " -> { 1, -2.5, ... <4 elements> }",
+        " -> { <4 elements, hash "
+    };
+    float values[4] = { 1.0f, -2.5f, 0.0f, 100.0f };
+    const float *ptr = values;
+    budgie_dump_array_policy policy;
+    budgie_type type;
+    int i;
+
+    type = budgie_type_id_nomangle("const GLfloat *");
+    if (type == NULL_TYPE)
+    {
+        test_skipped("type const GLfloat * not found");
+        return;
+    }
+    policy.limit = 2;
+    for (i = 0; i < 3; i++)
+    {
+        bugle_io_writer *writer;
+
+        policy.mode = (budgie_dump_array_mode) (BUDGIE_DUMP_ARRAY_FULL + i);
+        writer = bugle_io_writer_mem_new(64);
+        budgie_dump_set_array_policy(&policy);
+        budgie_dump_any_type(type, &ptr, 4, writer);
+        budgie_dump_set_array_policy(NULL);
+        TEST_ASSERT(strstr(bugle_io_writer_mem_get(writer), expected[i]) != NULL);
+        bugle_io_writer_mem_release(writer);
+        bugle_io_writer_close(writer);
+    }
+}
+
+void serialize_suite_register(void)
+{
+    test_suite *ts = test_suite_new("serialize", 0, NULL, NULL);
+    test_suite_add_test(ts, "scalar", serialize_scalar);
+    test_suite_add_test(ts, "pointer", serialize_pointer);
+    test_suite_add_test(ts, "string", serialize_string);
+    test_suite_add_test(ts, "dump_numbers", serialize_dump_numbers);
+    test_suite_add_test(ts, "dump_string", serialize_dump_string);
+    test_suite_add_test(ts, "dump_array_policy", serialize_dump_array_policy);
+}
@@ -64,6 +64,7 @@ static int glut_initialised = 0;
 #if BUGLE_GLWIN_GLX
 extern void arbcreatecontext_suite_register(void);
 extern void contextattribs_suite_register(void);
+extern void dispatch_suite_register(void);
 #endif
 extern void dlopen_suite_register(void);
 extern void draw_suite_register(void);
@@ -81,7 +82,11 @@ extern void texcomplete_suite_register(void);
 extern void triangles_suite_register(void);
 #endif
 
+extern void hashtable_suite_register(void);
+extern void histogram_suite_register(void);
+extern void io_suite_register(void);
 extern void math_suite_register(void);
+extern void serialize_suite_register(void);
 extern void string_suite_register(void);
 extern void threads_suite_register(void);
 
@@ -91,6 +96,7 @@ static void (* const register_fns[])(void) =
 #if BUGLE_GLWIN_GLX
     arbcreatecontext_suite_register,
     contextattribs_suite_register,
+    dispatch_suite_register,
 #endif
     dlopen_suite_register,
     draw_suite_register,
@@ -109,6 +115,10 @@ static void (* const register_fns[])(void) =
 #endif /* TEST_GL */
     string_suite_register,
     math_suite_register,
+    hashtable_suite_register,
+    histogram_suite_register,
+    io_suite_register,
+    serialize_suite_register,
     threads_suite_register
 };
 
@@ -0,0 +1,205 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Converts a binary trace written by the tracebin filter-set to the text
+ * form produced by the trace filter-set.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bugle/bool.h>
+#include <bugle/io.h>
+#include <bugle/memory.h>
+#include <budgie/types.h>
+#include <budgie/reflect.h>
+#include "platform/types.h"
+#include "common/tracebin.h"
+
+static void usage(void)
+{
+    fputs("Usage: bugle-tracedump [-t] <trace file>\n"
+          "  -t   prefix each call with the thread and timestamp\n",
+          stderr);
+    exit(2);
+}
+
+static bugle_bool read_header(FILE *f, const char *filename)
+{
+    bugle_tracebin_header header;
+
+    if (fread(&header, sizeof(header), 1, f) != 1
+        || memcmp(header.magic, BUGLE_TRACEBIN_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fprintf(stderr, "%s: not a bugle binary trace\n", filename);
+        return BUGLE_FALSE;
+    }
+    if (header.byte_order != BUGLE_TRACEBIN_BYTE_ORDER
+        || header.version != BUGLE_TRACEBIN_VERSION
+        || header.pointer_size != sizeof(void *))
+    {
+        fprintf(stderr, "%s: trace was written on an incompatible platform or version\n", filename);
+        return BUGLE_FALSE;
+    }
+    if (header.function_count != (bugle_uint32_t) budgie_function_count()
+        || header.type_count != (bugle_uint32_t) budgie_type_count())
+    {
+        fprintf(stderr, "%s: trace was written by a different build of bugle\n", filename);
+        return BUGLE_FALSE;
+    }
+    return BUGLE_TRUE;
+}
+
+/* Dumps one call record, in the same form as budgie_dump_any_call */
+static bugle_bool dump_call(const char *data, const char *end,
+                            bugle_bool timestamps, bugle_io_writer *writer)
+{
+    bugle_uint32_t function;
+    bugle_uint64_t thread, timestamp;
+    bugle_uint8_t has_retn;
+    int i, num_args;
+
+    if ((size_t) (end - data) < sizeof(function) + sizeof(thread) + sizeof(timestamp) + sizeof(has_retn))
+        return BUGLE_FALSE;
+    memcpy(&function, data, sizeof(function)); data += sizeof(function);
+    memcpy(&thread, data, sizeof(thread)); data += sizeof(thread);
+    memcpy(&timestamp, data, sizeof(timestamp)); data += sizeof(timestamp);
+    memcpy(&has_retn, data, sizeof(has_retn)); data += sizeof(has_retn);
+    if (function >= (bugle_uint32_t) budgie_function_count())
+        return BUGLE_FALSE;
+
+    if (timestamps)
+        bugle_io_printf(writer, "[%" BUGLE_PRIu64 " %" BUGLE_PRIu64 ".%09" BUGLE_PRIu64 "] ",
+                        thread, timestamp / 1000000000, timestamp % 1000000000);
+    bugle_io_printf(writer, "%s(", budgie_function_name(function));
+    num_args = budgie_group_parameter_count(budgie_function_group(function));
+    for (i = 0; i < num_args; i++)
+    {
+        if (i) bugle_io_puts(", ", writer);
+        if (!budgie_dump_serialized(&data, end, writer))
+            return BUGLE_FALSE;
+    }
+    bugle_io_putc(')', writer);
+    if (has_retn)
+    {
+        bugle_io_puts(" = ", writer);
+        if (!budgie_dump_serialized(&data, end, writer))
+            return BUGLE_FALSE;
+    }
+    bugle_io_putc('\n', writer);
+    return data == end;
+}
+
+/* Dumps a call that was still in progress when the trace was written */
+static bugle_bool dump_pending(const char *data, const char *end,
+                               bugle_bool timestamps, bugle_io_writer *writer)
+{
+    bugle_uint32_t function;
+    bugle_uint64_t thread, timestamp;
+
+    if ((size_t) (end - data) != sizeof(function) + sizeof(thread) + sizeof(timestamp))
+        return BUGLE_FALSE;
+    memcpy(&function, data, sizeof(function)); data += sizeof(function);
+    memcpy(&thread, data, sizeof(thread)); data += sizeof(thread);
+    memcpy(&timestamp, data, sizeof(timestamp));
+    if (function >= (bugle_uint32_t) budgie_function_count())
+        return BUGLE_FALSE;
+
+    if (timestamps)
+        bugle_io_printf(writer, "[%" BUGLE_PRIu64 " %" BUGLE_PRIu64 ".%09" BUGLE_PRIu64 "] ",
+                        thread, timestamp / 1000000000, timestamp % 1000000000);
+    bugle_io_printf(writer, "%s(...) <did not return>\n", budgie_function_name(function));
+    return BUGLE_TRUE;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = NULL;
+    bugle_bool timestamps = BUGLE_FALSE;
+    bugle_io_writer *writer;
+    FILE *f;
+    char *record = NULL;
+    size_t record_size = 0;
+    unsigned long index = 0;
+    int status = 0;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0)
+            timestamps = BUGLE_TRUE;
+        else if (argv[i][0] == '-' || filename != NULL)
+            usage();
+        else
+            filename = argv[i];
+    }
+    if (filename == NULL)
+        usage();
+
+    f = fopen(filename, "rb");
+    if (!f)
+    {
+        perror(filename);
+        return 1;
+    }
+    if (!read_header(f, filename))
+    {
+        fclose(f);
+        return 1;
+    }
+
+    writer = bugle_io_writer_file_new(stdout);
+    for (;;)
+    {
+        bugle_uint32_t size;
+        bugle_uint8_t type;
+
+        if (fread(&size, sizeof(size), 1, f) != 1)
+            break;
+        if (size > record_size)
+        {
+            record_size = size;
+            record = BUGLE_NREALLOC(record, record_size, char);
+        }
+        if (size < sizeof(type) || fread(record, 1, size, f) != size)
+        {
+            fprintf(stderr, "%s: record %lu is truncated\n", filename, index);
+            status = 1;
+            break;
+        }
+        memcpy(&type, record, sizeof(type));
+        if ((type == BUGLE_TRACEBIN_RECORD_CALL
+             && !dump_call(record + sizeof(type), record + size, timestamps, writer))
+            || (type == BUGLE_TRACEBIN_RECORD_PENDING
+                && !dump_pending(record + sizeof(type), record + size, timestamps, writer)))
+        {
+            bugle_io_putc('\n', writer);
+            fprintf(stderr, "%s: record %lu is corrupt\n", filename, index);
+            status = 1;
+            break;
+        }
+        index++;
+    }
+
+    bugle_io_writer_close(writer);
+    bugle_free(record);
+    fclose(f);
+    return status;
+}
@@ -0,0 +1,284 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Extracts a range of frames from a trace log, using the frame index written
+ * by the trace filter-set. Both files are mapped rather than read, so only
+ * the pages for the requested frames are touched.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <bugle/bool.h>
+#include <bugle/memory.h>
+#include <bugle/string.h>
+#include <budgie/types.h>
+#include <budgie/reflect.h>
+#include "platform/types.h"
+#include "common/traceindex.h"
+
+typedef struct
+{
+    const char *data;
+    size_t size;
+} mapped_file;
+
+typedef struct
+{
+    budgie_function function;
+    bugle_uint64_t count;
+} function_total;
+
+static void usage(void)
+{
+    fputs("Usage: bugle-traceseek [-c] <log> <index> <first frame> [<last frame>]\n"
+          "  -c   print per-function call counts instead of the log lines\n",
+          stderr);
+    exit(2);
+}
+
+static bugle_bool map_file(const char *filename, mapped_file *m)
+{
+    struct stat st;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror(filename);
+        if (fd >= 0) close(fd);
+        return BUGLE_FALSE;
+    }
+    m->size = st.st_size;
+    m->data = NULL;
+    if (m->size > 0)
+    {
+        m->data = (const char *) mmap(NULL, m->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (m->data == (const char *) MAP_FAILED)
+        {
+            perror(filename);
+            close(fd);
+            return BUGLE_FALSE;
+        }
+    }
+    close(fd);
+    return BUGLE_TRUE;
+}
+
+static void unmap_file(mapped_file *m)
+{
+    if (m->size > 0)
+        munmap((void *) m->data, m->size);
+}
+
+static bugle_bool parse_frame(const char *text, bugle_uint64_t *frame)
+{
+    char *end;
+    unsigned long value;
+
+    value = strtoul(text, &end, 10);
+    if (*text == '\0' || *end != '\0')
+        return BUGLE_FALSE;
+    *frame = value;
+    return BUGLE_TRUE;
+}
+
+/* Returns the first entry whose frame number is at least frame */
+static size_t lower_bound(const bugle_traceindex_frame *entries, size_t n,
+                          bugle_uint64_t frame)
+{
+    size_t lo = 0, hi = n;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].frame < frame)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int compare_totals(const void *a, const void *b)
+{
+    const function_total *x = (const function_total *) a;
+    const function_total *y = (const function_total *) b;
+
+    if (x->count != y->count)
+        return x->count > y->count ? -1 : 1;
+    return x->function - y->function;
+}
+
+static int dump_counts(const char *index_filename,
+                       const bugle_traceindex_frame *first,
+                       const bugle_traceindex_frame *last)
+{
+    mapped_file counts;
+    char *counts_filename;
+    function_total *totals;
+    bugle_uint64_t calls = 0;
+    const bugle_traceindex_frame *e;
+    int n, i;
+
+    counts_filename = bugle_asprintf("%s%s", index_filename, BUGLE_TRACEINDEX_COUNTS_SUFFIX);
+    if (!map_file(counts_filename, &counts))
+    {
+        bugle_free(counts_filename);
+        return 1;
+    }
+
+    n = budgie_function_count();
+    totals = BUGLE_NMALLOC(n, function_total);
+    for (i = 0; i < n; i++)
+    {
+        totals[i].function = i;
+        totals[i].count = 0;
+    }
+    for (e = first; e <= last; e++)
+    {
+        bugle_traceindex_count count;
+        bugle_uint32_t j;
+
+        calls += e->calls;
+        if (e->counts_offset + (bugle_uint64_t) e->counts_length * sizeof(count) > counts.size)
+        {
+            fprintf(stderr, "%s: counts for frame %" BUGLE_PRIu64 " are missing\n",
+                    counts_filename, e->frame);
+            break;
+        }
+        for (j = 0; j < e->counts_length; j++)
+        {
+            memcpy(&count, counts.data + e->counts_offset + j * sizeof(count), sizeof(count));
+            if (count.function < (bugle_uint32_t) n)
+                totals[count.function].count += count.count;
+        }
+    }
+
+    qsort(totals, n, sizeof(function_total), compare_totals);
+    printf("%" BUGLE_PRIu64 " calls in frames %" BUGLE_PRIu64 "-%" BUGLE_PRIu64 "\n",
+           calls, first->frame, last->frame);
+    for (i = 0; i < n && totals[i].count > 0; i++)
+        printf("%12" BUGLE_PRIu64 " %s\n", totals[i].count, budgie_function_name(totals[i].function));
+
+    bugle_free(totals);
+    unmap_file(&counts);
+    bugle_free(counts_filename);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bugle_bool counts = BUGLE_FALSE;
+    const char *args[4];
+    int nargs = 0;
+    mapped_file index, log;
+    bugle_traceindex_header header;
+    const bugle_traceindex_frame *entries;
+    size_t n, a, b;
+    bugle_uint64_t first, last;
+    int status = 0;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0)
+            counts = BUGLE_TRUE;
+        else if (argv[i][0] == '-' || nargs == 4)
+            usage();
+        else
+            args[nargs++] = argv[i];
+    }
+    if (nargs < 3)
+        usage();
+    if (!parse_frame(args[2], &first))
+        usage();
+    last = first;
+    if (nargs == 4 && !parse_frame(args[3], &last))
+        usage();
+    if (last < first)
+        usage();
+
+    if (!map_file(args[1], &index))
+        return 1;
+    if (index.size < sizeof(header))
+    {
+        fprintf(stderr, "%s: not a bugle frame index\n", args[1]);
+        unmap_file(&index);
+        return 1;
+    }
+    memcpy(&header, index.data, sizeof(header));
+    if (memcmp(header.magic, BUGLE_TRACEINDEX_MAGIC, sizeof(header.magic)) != 0
+        || header.version != BUGLE_TRACEINDEX_VERSION
+        || header.byte_order != BUGLE_TRACEINDEX_BYTE_ORDER)
+    {
+        fprintf(stderr, "%s: not a bugle frame index, or from an incompatible platform or version\n", args[1]);
+        unmap_file(&index);
+        return 1;
+    }
+
+    /* A partial final entry is from a capture that was cut short */
+    entries = (const bugle_traceindex_frame *) (index.data + sizeof(header));
+    n = (index.size - sizeof(header)) / sizeof(bugle_traceindex_frame);
+    a = lower_bound(entries, n, first);
+    b = lower_bound(entries, n, last + 1);
+    if (a >= b)
+    {
+        fprintf(stderr, "%s: no frames in the range %" BUGLE_PRIu64 "-%" BUGLE_PRIu64 "\n",
+                args[1], first, last);
+        unmap_file(&index);
+        return 1;
+    }
+
+    if (counts)
+    {
+        if (header.function_count != (bugle_uint32_t) budgie_function_count())
+        {
+            fprintf(stderr, "%s: index was written by a different build of bugle\n", args[1]);
+            status = 1;
+        }
+        else
+            status = dump_counts(args[1], &entries[a], &entries[b - 1]);
+    }
+    else if (!map_file(args[0], &log))
+        status = 1;
+    else
+    {
+        bugle_uint64_t start = entries[a].start;
+        bugle_uint64_t end = entries[b - 1].end;
+
+        if (end > log.size || start > end)
+        {
+            fprintf(stderr, "%s: log is shorter than the index expects\n", args[0]);
+            status = 1;
+        }
+        else
+            fwrite(log.data + start, 1, end - start, stdout);
+        unmap_file(&log);
+    }
+
+    unmap_file(&index);
+    return status;
+}
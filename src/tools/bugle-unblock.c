@@ -0,0 +1,59 @@
+/*  BuGLe: an OpenGL debugging tool
+ *  Copyright (C) 2014  Bruce Merry
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Decompresses a file written through bugle_io_writer_block_new, such as a
+ * log or exe trace written with the compress option.
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <bugle/io.h>
+
+int main(int argc, char **argv)
+{
+    bugle_io_reader *file, *reader;
+    FILE *f;
+    char buffer[65536];
+    size_t n;
+
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-'))
+    {
+        fputs("Usage: bugle-unblock [<file>]\n", stderr);
+        return 2;
+    }
+    f = argc == 2 ? fopen(argv[1], "rb") : stdin;
+    if (!f)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    file = bugle_io_reader_file_new(f);
+    reader = bugle_io_reader_block_new(file);
+    if (!reader)
+    {
+        fprintf(stderr, "%s: not a bugle compressed file\n", argc == 2 ? argv[1] : "<stdin>");
+        bugle_io_reader_close(file);
+        return 1;
+    }
+    while ((n = bugle_io_read(buffer, 1, sizeof(buffer), reader)) > 0)
+        fwrite(buffer, 1, n, stdout);
+    bugle_io_reader_close(reader);
+    return 0;
+}